@@ -0,0 +1,199 @@
+//--------------------------------------------------------------------
+// AutoColor.cpp
+// A C++ module that computes per-frame auto-levels and gray-world
+// white balance curves from a sample of a frame's pixels.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "AutoColor.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+namespace
+{
+
+// Limits on the white balance gains.
+const double MIN_GAIN = 0.5;
+const double MAX_GAIN = 2.0;
+
+// Fraction of the sample clipped to black and to white by
+// auto-levels.
+const double CLIP_FRACTION = 0.005;
+
+// Narrowest range of levels auto-levels stretches to the full
+// range, so at most an 8x stretch.
+const double MIN_RANGE = 32;
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Constructor.  The curves start out as the identity.
+//---------------------------------------------------------------
+AutoColor::AutoColor()
+{
+    m_gains[0] = m_gains[1] = m_gains[2] = 1.0;
+    BuildCurves();
+}
+
+//---------------------------------------------------------------
+// Starts a new stream of frames.  Returns false if the parameters
+// are out of range.
+//---------------------------------------------------------------
+bool AutoColor::Init(bool autoLevels, bool whiteBalance, double smoothing)
+{
+    m_autoLevels = false;
+    m_whiteBalance = false;
+    m_primed = false;
+    m_gains[0] = m_gains[1] = m_gains[2] = 1.0;
+    m_black = 0;
+    m_white = 255;
+    BuildCurves();
+
+    if ((!autoLevels && !whiteBalance) || !(smoothing >= 0 && smoothing <= 0.99))
+        return false;
+
+    m_autoLevels = autoLevels;
+    m_whiteBalance = whiteBalance;
+    m_smoothing = smoothing;
+    return true;
+}
+
+//---------------------------------------------------------------
+// Updates the curves from a sample of a frame's pixels and
+// returns them.
+//---------------------------------------------------------------
+const ColorCurves &AutoColor::Update(const std::vector<uint32_t> &samples)
+{
+    if (!IsEnabled() || samples.empty())
+        return m_curves;
+
+    // Gray world:  scale each channel's mean to the mean of all
+    // three.
+    double gains[3] = {1.0, 1.0, 1.0};
+    if (m_whiteBalance)
+    {
+        uint64_t sums[3] = {0, 0, 0};
+        for (uint32_t color : samples)
+        {
+            sums[0] += color & 0xff;
+            sums[1] += (color >> 8) & 0xff;
+            sums[2] += (color >> 16) & 0xff;
+        }
+        double gray = static_cast<double>(sums[0] + sums[1] + sums[2]) / 3;
+        for (int c = 0; c < 3; c++)
+        {
+            if (sums[c] > 0)
+                gains[c] = __min(__max(gray / sums[c], MIN_GAIN), MAX_GAIN);
+        }
+    }
+
+    // Levels:  find the percentiles of the balanced luma.
+    double black = 0;
+    double white = 255;
+    if (m_autoLevels)
+    {
+        // Luma weights (1, 2, 1) of 4, in 8.8 fixed point with the
+        // gains folded in.
+        int weights[3];
+        weights[0] = static_cast<int>(gains[0] * 64 + 0.5);
+        weights[1] = static_cast<int>(gains[1] * 128 + 0.5);
+        weights[2] = static_cast<int>(gains[2] * 64 + 0.5);
+
+        unsigned histogram[256] = {0};
+        for (uint32_t color : samples)
+        {
+            int luma = ((color & 0xff) * weights[0] + ((color >> 8) & 0xff) * weights[1] +
+                ((color >> 16) & 0xff) * weights[2] + 128) >> 8;
+            histogram[__min(luma, 255)]++;
+        }
+
+        size_t clip = static_cast<size_t>(samples.size() * CLIP_FRACTION);
+        size_t count = 0;
+        int low = 0;
+        while (low < 255 && count + histogram[low] <= clip)
+            count += histogram[low++];
+        count = 0;
+        int high = 255;
+        while (high > 0 && count + histogram[high] <= clip)
+            count += histogram[high--];
+
+        black = low;
+        white = high + 1;
+        if (white - black < MIN_RANGE)
+        {
+            // Widen the range about its middle, staying in bounds.
+            double mid = __min(__max((black + white) / 2, MIN_RANGE / 2), 255 - MIN_RANGE / 2);
+            black = mid - MIN_RANGE / 2;
+            white = mid + MIN_RANGE / 2;
+        }
+    }
+
+    if (!m_primed)
+    {
+        m_primed = true;
+        for (int c = 0; c < 3; c++)
+            m_gains[c] = gains[c];
+        m_black = black;
+        m_white = white;
+    }
+    else
+    {
+        double fresh = 1.0 - m_smoothing;
+        for (int c = 0; c < 3; c++)
+            m_gains[c] = m_gains[c] * m_smoothing + gains[c] * fresh;
+        m_black = m_black * m_smoothing + black * fresh;
+        m_white = m_white * m_smoothing + white * fresh;
+    }
+
+    BuildCurves();
+    return m_curves;
+}
+
+//---------------------------------------------------------------
+// Builds the curves from the current gains and levels.
+//---------------------------------------------------------------
+void AutoColor::BuildCurves()
+{
+    double scale = 255.0 / __max(m_white - m_black, 1.0);
+    for (int c = 0; c < 3; c++)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            double level = (i * m_gains[c] - m_black) * scale;
+            m_curves.m_curves[c][i] = static_cast<uint8_t>(__min(__max(level + 0.5, 0.0), 255.0));
+        }
+    }
+}
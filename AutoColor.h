@@ -0,0 +1,110 @@
+//--------------------------------------------------------------------
+// AutoColor.h
+// A C++ module that computes per-frame auto-levels and gray-world
+// white balance curves from a sample of a frame's pixels.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Init() with the corrections wanted, then
+//   for each frame pass a sample of its pixels (for example from
+//   CameraFrameGrabber::SampleRawColors()) to Update(), and hand the
+//   returned curves to CameraFrameGrabber::ConvertRawFrame().  When
+//   a flat-field correction has to come first, correct the samples
+//   with FlatField::CorrectPixel() and hand the curves to
+//   FlatField::Apply() instead.
+//
+// * White balance uses the gray-world assumption:  each channel is
+//   scaled so the sample's channel means match, with the gains held
+//   between 1/2 and 2 so a scene that really is mostly one color
+//   isn't pushed too far.
+//
+// * Auto-levels stretches the white-balanced luma between the 0.5
+//   and 99.5 percentiles of the sample to the full 0..255 range.
+//   The stretch is limited so a flat scene isn't blown up into
+//   noise.
+//
+// * Both corrections scale each channel on its own, so together
+//   they reduce to one 256-entry curve per channel, which the
+//   conversion kernels apply at the cost of a table lookup.
+//
+// * The gains and levels are smoothed over frames with an
+//   exponential moving average, so the picture doesn't flicker
+//   as things move through the scene.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "CaptureFormat.h"
+
+//---------------------------------------------------------------
+// A C++ class that tracks the color curves for a stream of frames.
+//---------------------------------------------------------------
+class AutoColor
+{
+public:
+    AutoColor();
+
+    // Starts a new stream of frames.  'smoothing' (0 to 0.99) is
+    // how much of the previous frame's gains and levels carry over
+    // to each new frame.  Returns false if the smoothing is out of
+    // range or neither correction is wanted.
+    bool Init(bool autoLevels, bool whiteBalance, double smoothing);
+
+    // Returns true if Init() has been called successfully.
+    bool IsEnabled() const { return m_autoLevels || m_whiteBalance; }
+
+    // Updates the curves from a sample of a frame's 32-bit BGR
+    // pixels and returns them.  An empty sample leaves the curves
+    // as they were.
+    const ColorCurves &Update(const std::vector<uint32_t> &samples);
+
+    // Returns the current curves.
+    const ColorCurves &GetCurves() const { return m_curves; }
+
+private:
+    void BuildCurves();
+
+    bool m_autoLevels = false;      // Stretch luma to the full range.
+    bool m_whiteBalance = false;    // Balance the channel means.
+    double m_smoothing = 0;         // Weight of the previous parameters.
+    bool m_primed = false;          // True once the first sample has been seen.
+    double m_gains[3];              // White balance gain of blue, green, and red.
+    double m_black = 0;             // Level mapped to 0, after white balance.
+    double m_white = 255;           // Level mapped to 255, after white balance.
+    ColorCurves m_curves;           // Curves built from the above.
+};
@@ -0,0 +1,211 @@
+//--------------------------------------------------------------------
+// BmpFile.cpp
+// A C++ module for writing images to Microsoft .BMP files.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "BmpFile.h"
+
+#include <io.h>
+#include <stdio.h>
+#include <string.h>
+#include <windows.h>
+
+//---------------------------------------------------------------
+// Writes a 24-bit BGR or 32-bit BGRA image from memory to a
+// Microsoft .BMP file on disk.  If 'flush' is true, waits until
+// the file has been committed to the disk before returning.
+// Returns true if successful.
+//---------------------------------------------------------------
+bool BmpWrite(const char *szPath, unsigned width, unsigned height,
+    unsigned stride, unsigned bitsPerPixel, const void *pBits, bool flush)
+{
+    // Check for bogus arguments.
+    if (szPath == nullptr || szPath[0] == '\0' || width < 1 || height < 1 ||
+        stride < width * 3 || (bitsPerPixel != 24 && bitsPerPixel != 32) ||
+        pBits == nullptr)
+    {
+        return false;
+    }
+
+    // Open the output file.
+    FILE *fp = nullptr;
+    if (fopen_s(&fp, szPath, "wb") || fp == nullptr)
+    {
+        // Failed opening output file!
+        return false;
+    }
+
+    unsigned outStride = width * bitsPerPixel / 8;
+    while (outStride % 4)
+        outStride++;
+
+    // Build BITMAPINFOHEADER to write to file.
+    BITMAPINFOHEADER stInfoHdr = {0};
+    stInfoHdr.biSize = sizeof(stInfoHdr);
+    stInfoHdr.biBitCount = bitsPerPixel;
+    stInfoHdr.biWidth = width;
+    stInfoHdr.biHeight = height;
+    stInfoHdr.biPlanes = 1;
+    stInfoHdr.biSizeImage = outStride * height;
+
+    // Build BITMAPFILEHEADER structure.
+    BITMAPFILEHEADER stFileHdr;
+    memset(&stFileHdr, 0, sizeof(stFileHdr));
+    stFileHdr.bfType = (WORD)'B' + 256 * (WORD)'M';
+    stFileHdr.bfSize = sizeof(BITMAPFILEHEADER) + stInfoHdr.biSize + stInfoHdr.biSizeImage;
+    stFileHdr.bfOffBits = sizeof(BITMAPFILEHEADER) + stInfoHdr.biSize;
+
+    // Write the BITMAPFILEHEADER to the output file.
+    if (fwrite(&stFileHdr, sizeof(stFileHdr), 1, fp) != 1)
+    {
+        // Write to output file failed!
+        fclose(fp);
+        _unlink(szPath);
+        return false;
+    }
+
+    // Write the BITMAPINFOHEADER to the output file.
+    if (fwrite(&stInfoHdr, stInfoHdr.biSize, 1, fp) != 1)
+    {
+        // Write to output file failed!
+        fclose(fp);
+        _unlink(szPath);
+        return false;
+    }
+
+    // Write the bitmap bits one scanline at a time.
+    const unsigned char *scanline = static_cast<const unsigned char *>(pBits) + stride * (height - 1);
+    for (unsigned y = 0; y < height; y++)
+    {
+        if (fwrite(scanline, outStride, 1, fp) != 1)
+        {
+            // Write to output file failed!
+            fclose(fp);
+            _unlink(szPath);
+            return false;
+        }
+
+        scanline -= stride;
+    }
+
+    // Push the file out of the C runtime's and the OS's caches.
+    if (flush && (fflush(fp) != 0 || _commit(_fileno(fp)) != 0))
+    {
+        fclose(fp);
+        _unlink(szPath);
+        return false;
+    }
+
+    fclose(fp);
+    return true;
+}
+
+//---------------------------------------------------------------
+// Reads an uncompressed 24-bit or 32-bit Microsoft .BMP file into
+// a top-down 32-bit BGRA image (stride width * 4) with opaque
+// alpha.  Returns true if successful.
+//---------------------------------------------------------------
+bool BmpRead(const char *szPath, unsigned &width, unsigned &height,
+    std::vector<unsigned char> &bgra)
+{
+    width = height = 0;
+    bgra.clear();
+    if (szPath == nullptr || szPath[0] == '\0')
+        return false;
+
+    FILE *fp = nullptr;
+    if (fopen_s(&fp, szPath, "rb") || fp == nullptr)
+        return false;
+
+    // Read and check the headers.
+    BITMAPFILEHEADER stFileHdr;
+    BITMAPINFOHEADER stInfoHdr;
+    if (fread(&stFileHdr, sizeof(stFileHdr), 1, fp) != 1 ||
+        fread(&stInfoHdr, sizeof(stInfoHdr), 1, fp) != 1 ||
+        stFileHdr.bfType != (WORD)'B' + 256 * (WORD)'M' ||
+        stInfoHdr.biSize < sizeof(stInfoHdr) || stInfoHdr.biCompression != BI_RGB ||
+        (stInfoHdr.biBitCount != 24 && stInfoHdr.biBitCount != 32) ||
+        stInfoHdr.biWidth < 1 || stInfoHdr.biHeight == 0 ||
+        stInfoHdr.biWidth > 32768 || stInfoHdr.biHeight > 32768 || stInfoHdr.biHeight < -32768)
+    {
+        fclose(fp);
+        return false;
+    }
+
+    // A negative height means the rows are stored top-down.
+    bool topDown = stInfoHdr.biHeight < 0;
+    unsigned w = stInfoHdr.biWidth;
+    unsigned h = topDown ? -stInfoHdr.biHeight : stInfoHdr.biHeight;
+    unsigned bytesPerPixel = stInfoHdr.biBitCount / 8;
+    unsigned inStride = w * bytesPerPixel;
+    while (inStride % 4)
+        inStride++;
+
+    if (fseek(fp, stFileHdr.bfOffBits, SEEK_SET) != 0)
+    {
+        fclose(fp);
+        return false;
+    }
+
+    // Read the bitmap bits one scanline at a time.
+    std::vector<unsigned char> scanline(inStride);
+    bgra.resize(static_cast<size_t>(w) * 4 * h);
+    for (unsigned y = 0; y < h; y++)
+    {
+        if (fread(scanline.data(), inStride, 1, fp) != 1)
+        {
+            // File is truncated!
+            fclose(fp);
+            bgra.clear();
+            return false;
+        }
+
+        unsigned char *out = &bgra[static_cast<size_t>(w) * 4 * (topDown ? y : h - 1 - y)];
+        const unsigned char *in = scanline.data();
+        for (unsigned x = 0; x < w; x++, in += bytesPerPixel, out += 4)
+        {
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = in[2];
+            out[3] = 0xff;
+        }
+    }
+
+    fclose(fp);
+    width = w;
+    height = h;
+    return true;
+}
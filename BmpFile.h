@@ -0,0 +1,59 @@
+//--------------------------------------------------------------------
+// BmpFile.h
+// A C++ module for reading and writing images as Microsoft .BMP
+// files.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+
+//---------------------------------------------------------------
+// Writes a 24-bit BGR or 32-bit BGRA image from memory to a
+// Microsoft .BMP file on disk.  If 'flush' is true, waits until
+// the file has been committed to the disk before returning.
+// Returns true if successful.
+//---------------------------------------------------------------
+bool BmpWrite(const char *szPath, unsigned width, unsigned height,
+    unsigned stride, unsigned bitsPerPixel, const void *pBits, bool flush = false);
+
+//---------------------------------------------------------------
+// Reads an uncompressed 24-bit or 32-bit Microsoft .BMP file into
+// a top-down 32-bit BGRA image (stride width * 4) with opaque
+// alpha.  Returns true if successful.
+//---------------------------------------------------------------
+bool BmpRead(const char *szPath, unsigned &width, unsigned &height,
+    std::vector<unsigned char> &bgra);
@@ -38,9 +38,12 @@
 //--------------------------------------------------------------------
 
 #include "CameraFrameGrabber.h"
+#include "DeviceRegistry.h"
 
 #include <stdio.h>
 #include <tchar.h>
+#include <windows.h>
+#include <cfgmgr32.h>
 #include <mfapi.h>
 #include <mfidl.h>
 #include <mfreadwrite.h>
@@ -49,6 +52,8 @@
 #include <atlcom.h>
 #include <conio.h>
 #include <stdexcept>
+#include <map>
+#include <mutex>
 
 // Link to Microsoft's Media Foundation libraries.
 #pragma comment(lib, "mfplat.lib")
@@ -56,6 +61,14 @@
 #pragma comment(lib, "mfreadwrite.lib")
 #pragma comment(lib, "mfuuid.lib")
 
+// Link to the configuration manager for device change notifications.
+#pragma comment(lib, "cfgmgr32.lib")
+
+// Device interface class of camera devices (KSCATEGORY_VIDEO_CAMERA
+// from ksmedia.h).
+static const GUID g_cameraInterfaceClass =
+    { 0xe5323777, 0xf976, 0x4f5b, { 0x9b, 0x55, 0xb9, 0x46, 0x99, 0xc4, 0x6e, 0x44 } };
+
 namespace
 {
 
@@ -156,203 +169,624 @@ uint32_t ConvertYuvToRgbColor(int y, int u, int v)
 }
 
 //---------------------------------------------------------------
-// Converts pixels from NV12 format to BGR32 format.
+// Returns 'v' clipped to the range 0-to-255 inclusive.
+//---------------------------------------------------------------
+int inline clip8(int v) { return __max(0, __min(255, v)); }
+
+//---------------------------------------------------------------
+// Where the conversion kernels put each pixel.  The converted
+// pixel for source pixel (x, y) goes to output pixel
+// m_origin + x * m_colStep + y * m_rowStep.
 //---------------------------------------------------------------
-void ConvertNv12ToBgr32(
-    const void *inData,     // in:  Points to the Y plane, which is followed immediately by the UV plane.
-    unsigned inWidth,       // in:  Width of image in pixels.
-    unsigned inHeight,      // in:  Height of image in pixels.
-    unsigned inStride,      // in:  Width of each scanline in bytes (usually same as inWidth but not always).
-    void *outData           // out:  Buffer where converted image will be placed.
-                            //       Must be at least inStride * inHeight * 4 bytes in size.
+struct OutputMapping
+{
+    ptrdiff_t m_origin = 0;     // Output pixel of source pixel (0, 0).
+    ptrdiff_t m_colStep = 1;    // Output pixels between horizontally adjacent source pixels.
+    ptrdiff_t m_rowStep = 0;    // Output pixels between vertically adjacent source pixels.
+};
+
+//---------------------------------------------------------------
+// Works out where each pixel of a frame goes in the oriented
+// output frame.
+//---------------------------------------------------------------
+OutputMapping GetOutputMapping(
+    const FrameOrientation &orientation,    // in:  How to orient the frame.
+    unsigned width,                         // in:  Source width in pixels.
+    unsigned height                         // in:  Source height in pixels.
     )
 {
-    unsigned char *outDataBGR = reinterpret_cast<unsigned char *>(outData);
+    // The mapping is affine, so mapping the corner pixel and its
+    // two neighbours gives the origin and both steps.
+    ptrdiff_t w = width;
+    ptrdiff_t h = height;
+    ptrdiff_t outWidth = orientation.IsTransposed() ? h : w;
+    ptrdiff_t outHeight = orientation.IsTransposed() ? w : h;
+    auto map = [&](ptrdiff_t x, ptrdiff_t y)
+    {
+        ptrdiff_t ox = x, oy = y;
+        switch (orientation.m_rotation)
+        {
+        case 90:    ox = h - 1 - y; oy = x;         break;
+        case 180:   ox = w - 1 - x; oy = h - 1 - y; break;
+        case 270:   ox = y;         oy = w - 1 - x; break;
+        }
+        if (orientation.m_flipHorizontal)
+            ox = outWidth - 1 - ox;
+        if (orientation.m_flipVertical)
+            oy = outHeight - 1 - oy;
+        return oy * outWidth + ox;
+    };
+
+    OutputMapping mapping;
+    mapping.m_origin = map(0, 0);
+    mapping.m_colStep = map(1, 0) - mapping.m_origin;
+    mapping.m_rowStep = map(0, 1) - mapping.m_origin;
+    return mapping;
+}
 
-    // inY points to the first pixel of the 'Y' plane.
-    // inUV points to the first pixel of the 'UV' plane.
-    const unsigned char *inDataY = reinterpret_cast<const unsigned char *>(inData);
-    const unsigned char *inDataUV = inDataY + (inStride * inHeight);
+//---------------------------------------------------------------
+// Stores converted pixels unchanged.  The kernels are templates
+// on how pixels are stored, so per-frame color corrections cost
+// nothing when they're off and no extra pass when they're on.
+//---------------------------------------------------------------
+struct StorePixel
+{
+    static const bool IsIdentity = true;
+    uint32_t operator()(uint32_t bgr) const { return bgr; }
+};
 
-    // For each scanline..
-    for (unsigned y = 0; y < inHeight; ++y)
+//---------------------------------------------------------------
+// Stores converted pixels through per-channel color curves.  The
+// alpha byte passes through, as it does for StorePixel.
+//---------------------------------------------------------------
+struct StoreCurvedPixel
+{
+    static const bool IsIdentity = false;
+    const ColorCurves *m_curves;
+    uint32_t operator()(uint32_t bgr) const
     {
-        uint32_t *outScan = reinterpret_cast<uint32_t *>(outDataBGR + inWidth * 4 * y);
-        const unsigned char *inScanY = inDataY + inStride * y;
-        const unsigned char *inScanUV = inDataUV + inStride * y / 2;
+        return (bgr & 0xff000000) |
+            m_curves->m_curves[0][bgr & 0xff] |
+            (m_curves->m_curves[1][(bgr >> 8) & 0xff] << 8) |
+            (m_curves->m_curves[2][(bgr >> 16) & 0xff] << 16);
+    }
+};
 
-        // For each pixel on this scanline...
-        for (unsigned x = 0; x < inWidth; ++x)
-        {
-            int y = *inScanY++;
-            int u = inScanUV[0];
-            int v = inScanUV[1];
-            if (x & 1)
-                inScanUV += 2;
+//---------------------------------------------------------------
+// Converts a span of pixels from BGR24 format to BGR32 format.
+//---------------------------------------------------------------
+template <class Store>
+void ConvertRgb24Span(
+    const unsigned char *in,    // in:  First source pixel.
+    unsigned count,             // in:  Number of pixels.
+    uint32_t *out,              // out: Where the first pixel goes.
+    ptrdiff_t step,             // in:  Output pixels between consecutive pixels.
+    const Store &store          // in:  Stores each converted pixel.
+    )
+{
+    for (unsigned x = 0; x < count; ++x, in += 3, out += step)
+        *out = store(in[0] | (in[1] << 8) | (in[2] << 16));
+}
 
-            *outScan++ = ConvertYuvToRgbColor(y, u, v);
+//---------------------------------------------------------------
+// Copies a span of BGR32 pixels.
+//---------------------------------------------------------------
+template <class Store>
+void ConvertRgb32Span(
+    const unsigned char *in,    // in:  First source pixel.
+    unsigned count,             // in:  Number of pixels.
+    uint32_t *out,              // out: Where the first pixel goes.
+    ptrdiff_t step,             // in:  Output pixels between consecutive pixels.
+    const Store &store          // in:  Stores each converted pixel.
+    )
+{
+    if (Store::IsIdentity && step == 1)
+    {
+        memcpy(out, in, count * 4);
+        return;
+    }
+
+    const uint32_t *pin = reinterpret_cast<const uint32_t *>(in);
+    for (unsigned x = 0; x < count; ++x, out += step)
+        *out = store(*pin++);
+}
+
+//---------------------------------------------------------------
+// Converts a span of pixels from YUY2 format to BGR32 format.
+// This was adapted from some public domain code.
+//---------------------------------------------------------------
+template <class Store>
+void ConvertYuy2Span(
+    const unsigned char *in,    // in:  First source pixel; must start a Y-U-Y-V group.
+    unsigned count,             // in:  Number of pixels.
+    uint32_t *out,              // out: Where the first pixel goes.
+    ptrdiff_t step,             // in:  Output pixels between consecutive pixels.
+    const Store &store          // in:  Stores each converted pixel.
+    )
+{
+    for (unsigned x = 0; x < count; x += 2, in += 4)
+    {
+        int d = in[1] - 128;
+        int e = in[3] - 128;
+        int bd = 516 * d + 128;
+        int gde = -100 * d - 208 * e + 128;
+        int re = 409 * e + 128;
+
+        // The second pixel of the group may be past the span's end
+        // if the frame width is odd.
+        for (unsigned i = 0; i < 2 && x + i < count; i++, out += step)
+        {
+            int c = 298 * (in[i * 2] - 16);
+            *out = store(clip8((c + bd) >> 8) | (clip8((c + gde) >> 8) << 8) | (clip8((c + re) >> 8) << 16));
         }
     }
 }
 
 //---------------------------------------------------------------
-// Returns 'v' clipped to the range 0-to-255 inclusive.
+// Converts a span of pixels from NV12 format to BGR32 format.
 //---------------------------------------------------------------
-int inline clip8(int v) { return __max(0, __min(255, v)); }
+template <class Store>
+void ConvertNv12Span(
+    const unsigned char *inY,   // in:  First source pixel in the Y plane.
+    const unsigned char *inUV,  // in:  Its U-V pair in the UV plane; the span must start on an even pixel.
+    unsigned count,             // in:  Number of pixels.
+    uint32_t *out,              // out: Where the first pixel goes.
+    ptrdiff_t step,             // in:  Output pixels between consecutive pixels.
+    const Store &store          // in:  Stores each converted pixel.
+    )
+{
+    for (unsigned x = 0; x < count; ++x, out += step)
+    {
+        *out = store(ConvertYuvToRgbColor(*inY++, inUV[0], inUV[1]));
+        if (x & 1)
+            inUV += 2;
+    }
+}
 
 //---------------------------------------------------------------
-// Converts pixels from YUY2 format to BGR32 format.
-// This was adapted from some public domain code.
+// Converts a span of one row of a frame to BGR32 format.
 //---------------------------------------------------------------
-void ConvertYuy2ToBgr32(
-    const void *inData,     // in:  Points to the Y plane, which is followed immediately by the UV plane.
-    unsigned inWidth,       // in:  Width of image in pixels.
-    unsigned inHeight,      // in:  Height of image in pixels.
-    unsigned inStride,      // in:  Width of each scanline in bytes (usually same as (inWidth x 2) but not always).
-    void *outData           // out:  Buffer where converted image will be placed.
-                            //       Must be at least inStride * inHeight * 4 bytes in size.
+template <class Store>
+void ConvertSpan(
+    const CaptureFormat &fmt,   // in:  Format of the frame.
+    const unsigned char *inData,// in:  Frame data in the device's native format.
+    unsigned y,                 // in:  Source row.
+    unsigned x0,                // in:  First source column; must be even.
+    unsigned count,             // in:  Number of pixels.
+    uint32_t *out,              // out: Where the first pixel goes.
+    ptrdiff_t step,             // in:  Output pixels between consecutive pixels.
+    const Store &store          // in:  Stores each converted pixel.
     )
 {
-    unsigned char *outDataBGR = reinterpret_cast<unsigned char *>(outData);
-    const unsigned char *inDataYUY = reinterpret_cast<const unsigned char *>(inData);
+    const unsigned char *inScan = inData + static_cast<size_t>(fmt.m_stride) * y;
+    switch (fmt.m_pixelType)
+    {
+    case CPT_RGB24:
+        ConvertRgb24Span(inScan + x0 * 3, count, out, step, store);
+        break;
+    case CPT_RGB32:
+        ConvertRgb32Span(inScan + x0 * 4, count, out, step, store);
+        break;
+    case CPT_YUY2:
+        ConvertYuy2Span(inScan + x0 * 2, count, out, step, store);
+        break;
+    case CPT_NV12:
+    {
+        // The UV plane follows the Y plane, one row per two Y rows.
+        const unsigned char *inUV = inData + static_cast<size_t>(fmt.m_stride) * (fmt.m_height + y / 2);
+        ConvertNv12Span(inScan + x0, inUV + x0, count, out, step, store);
+        break;
+    }
+    default:
+        break;
+    }
+}
 
-    // For each scanline..
-    for (unsigned y = 0; y < inHeight; ++y)
+//---------------------------------------------------------------
+// Converts a span of one row of a frame to BGR32 format, filling
+// the pixels covered by the privacy mask instead of converting
+// them.
+//---------------------------------------------------------------
+template <class Store>
+void ConvertMaskedSpan(
+    const CaptureFormat &fmt,   // in:  Format of the frame.
+    const PrivacyMask &mask,    // in:  Pixels to hide.
+    const unsigned char *inData,// in:  Frame data in the device's native format.
+    unsigned y,                 // in:  Source row.
+    unsigned x0,                // in:  First source column; must be even.
+    unsigned count,             // in:  Number of pixels.
+    uint32_t *out,              // out: Where the first pixel goes.
+    ptrdiff_t step,             // in:  Output pixels between consecutive pixels.
+    const Store &store          // in:  Stores each converted pixel.
+    )
+{
+    size_t numSpans = 0;
+    const PrivacyMask::Span *spans = mask.GetSpans(y, numSpans);
+    unsigned x = x0;
+    unsigned end = x0 + count;
+    for (size_t i = 0; i < numSpans && x < end; i++)
     {
-        unsigned char *outScan = outDataBGR + inWidth * 4 * y;
-        const unsigned char *inScan = inDataYUY + inStride * y;
+        unsigned maskStart = __max(spans[i].m_start, x);
+        unsigned maskEnd = __min(spans[i].m_end, end);
+        if (maskStart >= maskEnd)
+            continue;
 
-        // For each pixel on this scanline...
-        for (unsigned x = 0; x < inWidth / 2; ++x)
+        // Convert the pixels before the masked span.  Spans start
+        // and end on even columns, so every converted run does too.
+        if (maskStart > x)
+            ConvertSpan(fmt, inData, y, x, maskStart - x, out + (x - x0) * step, step, store);
+
+        unsigned blockSize = mask.GetPixelateSize();
+        uint32_t *pout = out + (maskStart - x0) * step;
+        if (blockSize < 2)
         {
-            int y0 = *inScan++;
-            int u0 = *inScan++;
-            int y1 = *inScan++;
-            int v0 = *inScan++;
-
-            int c = y0 - 16;
-            int d = u0 - 128;
-            int e = v0 - 128;
-
-            *outScan++ = clip8(( 298 * c + 516 * d + 128) >> 8);
-            *outScan++ = clip8(( 298 * c - 100 * d - 208 * e + 128) >> 8);
-            *outScan++ = clip8(( 298 * c + 409 * e + 128) >> 8);
-            *outScan++ = '\0';
-
-            c = y1 - 16;
-
-            *outScan++ = clip8(( 298 * c + 516 * d + 128) >> 8);
-            *outScan++ = clip8(( 298 * c - 100 * d - 208 * e + 128) >> 8);
-            *outScan++ = clip8(( 298 * c + 409 * e + 128) >> 8);
-            *outScan++ = '\0';
+            uint32_t color = mask.GetColor();
+            for (unsigned mx = maskStart; mx < maskEnd; mx++, pout += step)
+                *pout = color;
+        }
+        else
+        {
+            // Repeat the converted center pixel of each block.
+            unsigned sy = __min((y / blockSize) * blockSize + blockSize / 2, fmt.m_height - 1);
+            for (unsigned mx = maskStart; mx < maskEnd; )
+            {
+                unsigned blockEnd = __min((mx / blockSize + 1) * blockSize, maskEnd);
+                unsigned sx = __min((mx / blockSize) * blockSize + blockSize / 2, fmt.m_width - 1) & ~1u;
+                uint32_t color = 0;
+                ConvertSpan(fmt, inData, sy, sx, 1, &color, 1, store);
+                for (; mx < blockEnd; mx++, pout += step)
+                    *pout = color;
+            }
         }
+        x = maskEnd;
     }
+
+    if (x < end)
+        ConvertSpan(fmt, inData, y, x, end - x, out + (x - x0) * step, step, store);
 }
 
-} // End anon namespace
+// Size of the square tiles that rotations by 90 and 270 degrees
+// are converted in.  A tile's output rows (64 rows of 256 bytes)
+// fit easily in the L1 cache.
+const unsigned ROTATE_TILE_SIZE = 64;
+
+// Number of rows and columns in the grid of pixels sampled by
+// SampleRawColors(); 4096 samples are plenty for percentiles.
+const unsigned SAMPLE_GRID_SIZE = 64;
 
 //---------------------------------------------------------------
-CameraFrameGrabber::CameraFrameGrabber()
+// Converts one frame to BGR32 format at the given mapping.
+//---------------------------------------------------------------
+template <class Store>
+void ConvertMappedFrame(
+    const CaptureFormat &fmt,   // in:  Format of the frame to be converted.
+    bool transposed,            // in:  True if source rows become output columns.
+    const OutputMapping &mapping, // in:  Where each pixel goes.
+    const PrivacyMask &mask,    // in:  Pixels to hide instead of converting.
+    const unsigned char *inData,// in:  Frame data in the device's native format.
+    uint32_t *out,              // out: Where source pixel (0, 0) goes.
+    const Store &store          // in:  Stores each converted pixel.
+    )
 {
-    if (MFStartup(MF_VERSION) != S_OK)
+    if (!transposed)
     {
-        throw std::runtime_error("Media Foundation startup failed!  Aborting.");
+        // Source rows stay output rows, possibly mirrored, so
+        // convert a whole row at a time.
+        for (unsigned y = 0; y < fmt.m_height; ++y)
+        {
+            ConvertMaskedSpan(fmt, mask, inData, y, 0, fmt.m_width, out + y * mapping.m_rowStep,
+                mapping.m_colStep, store);
+        }
+        return;
+    }
+
+    // Source rows become output columns.  Converting a row at a
+    // time would touch a new cache line for every pixel written,
+    // so convert a tile at a time instead:  the tile's rows are
+    // read once and its output rows stay in cache until filled.
+    for (unsigned ty = 0; ty < fmt.m_height; ty += ROTATE_TILE_SIZE)
+    {
+        unsigned tileHeight = __min(ROTATE_TILE_SIZE, fmt.m_height - ty);
+        for (unsigned tx = 0; tx < fmt.m_width; tx += ROTATE_TILE_SIZE)
+        {
+            unsigned tileWidth = __min(ROTATE_TILE_SIZE, fmt.m_width - tx);
+            for (unsigned y = ty; y < ty + tileHeight; ++y)
+            {
+                ConvertMaskedSpan(fmt, mask, inData, y, tx, tileWidth,
+                    out + y * mapping.m_rowStep + tx * mapping.m_colStep, mapping.m_colStep, store);
+            }
+        }
     }
 }
 
 //---------------------------------------------------------------
-CameraFrameGrabber::~CameraFrameGrabber()
+// Converts one frame of the given capture format to BGR32
+// format, rotating and/or mirroring it, hiding its privacy mask,
+// and applying its color curves on the way.  Returns false if the
+// pixel format is unsupported.
+//---------------------------------------------------------------
+bool ConvertFrameToBgr32(
+    const CaptureFormat &fmt,   // in:  Format of the frame to be converted.
+    const FrameOrientation &orientation, // in:  How to orient the converted frame.
+    const PrivacyMask &mask,    // in:  Pixels to hide instead of converting.
+    const ColorCurves *curves,  // in:  Per-channel curves to apply, or null for none.
+    const unsigned char *inData,// in:  Frame data in the device's native format.
+    void *data,                 // out: Buffer where converted image will be placed.
+                                //      Must be at least fmt.m_width * fmt.m_height * 4 bytes in size.
+    std::string &errText        // out: Description of the error, if any.
+    )
 {
-    Close();
-    MFShutdown();
+    if (fmt.m_pixelType != CPT_RGB24 && fmt.m_pixelType != CPT_RGB32 &&
+        fmt.m_pixelType != CPT_YUY2 && fmt.m_pixelType != CPT_NV12)
+    {
+        // Unsupported pixel format!
+        errText = "Unsupported pixel format.";
+        return false;
+    }
+
+    OutputMapping mapping = GetOutputMapping(orientation, fmt.m_width, fmt.m_height);
+    uint32_t *out = reinterpret_cast<uint32_t *>(data) + mapping.m_origin;
+    if (curves != nullptr)
+    {
+        StoreCurvedPixel store;
+        store.m_curves = curves;
+        ConvertMappedFrame(fmt, orientation.IsTransposed(), mapping, mask, inData, out, store);
+    }
+    else
+    {
+        ConvertMappedFrame(fmt, orientation.IsTransposed(), mapping, mask, inData, out, StorePixel());
+    }
+    return true;
 }
 
 //---------------------------------------------------------------
-// Retrieves a list of the names of the available camera capture
-// devices.  Returns an empty list if there are no capture
-// devices installed on the system.
+// Reads the next sample from the source reader and returns its
+// data as a contiguous buffer, along with its timestamps.  Sets
+// 'dropped' instead if the device was unable to deliver a frame.
+// Returns true if successful.
 //---------------------------------------------------------------
-std::vector<std::wstring> CameraFrameGrabber::GetDeviceNames()
+bool ReadFrameBuffer(
+    IMFSourceReader *reader,            // in:  Source reader to read the sample from.
+    CComPtr<IMFMediaBuffer> &mbuffer,   // out: Contiguous buffer holding the frame data.
+    FrameTimestamp &timestamp,          // out: When the frame was captured and dequeued.
+    bool &dropped,                      // out: True if the device dropped the frame.
+    std::string &errText                // out: Description of the error, if any.
+    )
 {
-    std::vector<std::wstring> out;
+    dropped = false;
 
-    // Create an empty Media Foundation attributes object.
-    CComPtr<IMFAttributes> pAttributes = nullptr;
-    if (MFCreateAttributes(&pAttributes, 1) != S_OK)
-        return out;
+    DWORD streamIndex = 0;
+    DWORD flags = 0;
+    LONGLONG streamTime = 0;
+    CComPtr<IMFSample> pSample = nullptr;
+    if (reader->ReadSample(MF_SOURCE_READER_FIRST_VIDEO_STREAM, 0,
+                           &streamIndex, &flags, &streamTime,
+                           &pSample) != S_OK)
+    {
+        errText = "ReadSample failed.";
+        return false;
+    }
 
-    // Set the attribute's GUID to the clas of devices that
-    // support video capture.
-    if (pAttributes->SetGUID(MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE,
-                             MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE_VIDCAP_GUID) != S_OK)
-        return out;
+    // Read the clocks back to back, so the system time reported by
+    // the device can be mapped onto the monotonic clock.
+    const LONGLONG systemNow = MFGetSystemTime();
+    timestamp.m_dequeueTime = std::chrono::steady_clock::now();
+    timestamp.m_wallTime = std::chrono::system_clock::now();
+    timestamp.m_sampleTime = streamTime;
+    timestamp.m_captureTime = timestamp.m_dequeueTime;
+    timestamp.m_haveCaptureTime = false;
 
-    // Enumerate the devices that support video capture.
-    CComHeapPtr<IMFActivate*> ppActivates;
-    UINT32 numActiveDevs = 0;
-    if (MFEnumDeviceSources(pAttributes, &ppActivates, &numActiveDevs) != S_OK)
-        return out;
+    if ((streamIndex == 0) && (flags & MF_SOURCE_READERF_STREAMTICK))
+    {
+        // The camera dropped a frame or was unable to capture.
+        dropped = true;
+        return true;
+    }
 
-    // Get the name of each device.
-    for (UINT32 i = 0; i < numActiveDevs; ++i)
+    if (pSample == nullptr)
     {
-        CComHeapPtr<WCHAR> pDevName;
-        if (ppActivates[i]->GetAllocatedString(MF_DEVSOURCE_ATTRIBUTE_FRIENDLY_NAME, &pDevName, nullptr) != S_OK)
-            return out;
+        errText = "No sample data.";
+        return false;
+    }
 
-        out.push_back(std::wstring(pDevName));
+    // Extract the frame data from the sample object.
+    // We have to convert it to contiguous format.
+    if (pSample->ConvertToContiguousBuffer(&mbuffer) != S_OK)
+    {
+        errText = "ConvertToContiguousBuffer failed.";
+        return false;
     }
 
-    // Release the devices.
-    for (UINT32 i = 0; i < numActiveDevs; ++i)
-        reinterpret_cast<CComPtr<IMFActivate>&>(ppActivates[i]).Release();
+    // Devices that report the system (QPC) time at which they
+    // captured the frame let us measure the latency up to dequeue.
+    UINT64 captureSystemTime = 0;
+    if (SUCCEEDED(pSample->GetUINT64(MFSampleExtension_DeviceReferenceSystemTime, &captureSystemTime)) &&
+        captureSystemTime <= static_cast<UINT64>(systemNow))
+    {
+        using Hns = std::chrono::duration<long long, std::ratio<1, 10000000>>;
+        timestamp.m_captureTime -= std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            Hns(systemNow - static_cast<LONGLONG>(captureSystemTime)));
+        timestamp.m_haveCaptureTime = true;
+    }
 
-    return out;
+    return true;
 }
 
 //---------------------------------------------------------------
-// Retrieves a list of the supported capture formats for
-// the specified capture device.  Returns an empty list if
-// error.
+// Returns the pixel type of the given video format GUID, or
+// CPT_INVALID if the format is not supported.
 //---------------------------------------------------------------
-std::vector<CaptureFormat> CameraFrameGrabber::GetDeviceFormats(unsigned deviceIndex)
+CapturePixelType GetPixelTypeFromGuid(const GUID &vidFormatGuid)
 {
-    std::vector<CaptureFormat> out;
+    if (vidFormatGuid == MFVideoFormat_RGB32)   return CPT_RGB32;
+    if (vidFormatGuid == MFVideoFormat_RGB24)   return CPT_RGB24;
+    if (vidFormatGuid == MFVideoFormat_YUY2)    return CPT_YUY2;
+    if (vidFormatGuid == MFVideoFormat_NV12)    return CPT_NV12;
+    return CPT_INVALID;
+}
+
+//---------------------------------------------------------------
+// Creates a source reader for the given media source.  The
+// reader is told to leave the media source running when the
+// reader is released, so that the media source can be cached
+// and reused.  Returns true if successful.
+//---------------------------------------------------------------
+bool CreateSourceReader(IMFMediaSource *pMediaSource, CComPtr<IMFSourceReader> &reader)
+{
+    CComPtr<IMFAttributes> pAttributes = nullptr;
+    if (MFCreateAttributes(&pAttributes, 1) != S_OK)
+        return false;
+
+    if (pAttributes->SetUINT32(MF_SOURCE_READER_DISCONNECT_MEDIASOURCE_ON_SHUTDOWN, TRUE) != S_OK)
+        return false;
+
+    return MFCreateSourceReaderFromMediaSource(pMediaSource, pAttributes, &reader) == S_OK;
+}
+
+//---------------------------------------------------------------
+// Supplies Media Foundation video capture devices to the
+// DeviceRegistry.  The activated device objects are
+// IMFMediaSource pointers.
+//---------------------------------------------------------------
+class MfDeviceSource : public DeviceSource
+{
+public:
+    MfDeviceSource();
+    ~MfDeviceSource() override;
+
+    bool EnumerateDevices(std::vector<DeviceInfo> &devices) override;
+    std::shared_ptr<void> ActivateDevice(const DeviceInfo &device) override;
+    bool GetDeviceFormats(const std::shared_ptr<void> &device,
+        std::vector<CaptureFormat> &formats) override;
+    void WatchForChanges(std::function<void()> onChange) override;
+
+private:
+    static DWORD CALLBACK OnDeviceChange(HCMNOTIFICATION hNotify, PVOID context,
+        CM_NOTIFY_ACTION action, PCM_NOTIFY_EVENT_DATA eventData, DWORD eventDataSize);
+
+    bool m_started = false;                     // True if MFStartup() succeeded.
+    std::mutex m_lock;                          // Protects m_activates.
+    std::map<std::wstring, CComPtr<IMFActivate>> m_activates;  // Activation objects, by symbolic link.
+    HCMNOTIFICATION m_hNotify = nullptr;        // Device change notification handle.
+    std::function<void()> m_onChange;           // Called when a device is added or removed.
+};
+
+//---------------------------------------------------------------
+MfDeviceSource::MfDeviceSource()
+{
+    // Keep Media Foundation running for as long as the cached
+    // device objects may be in use.
+    m_started = (MFStartup(MF_VERSION) == S_OK);
+}
+
+//---------------------------------------------------------------
+MfDeviceSource::~MfDeviceSource()
+{
+    if (m_hNotify != nullptr)
+        CM_Unregister_Notification(m_hNotify);
+
+    m_activates.clear();
+
+    if (m_started)
+        MFShutdown();
+}
+
+//---------------------------------------------------------------
+// Enumerates the video capture devices, remembering each one's
+// activation object for ActivateDevice().
+//---------------------------------------------------------------
+bool MfDeviceSource::EnumerateDevices(std::vector<DeviceInfo> &devices)
+{
+    devices.clear();
 
     // Create an empty Media Foundation attributes object.
     CComPtr<IMFAttributes> pAttributes = nullptr;
     if (MFCreateAttributes(&pAttributes, 1) != S_OK)
-        return out;
+        return false;
 
     // Set the attribute's GUID to the class of devices that
     // support video capture.
     if (pAttributes->SetGUID(MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE,
-                              MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE_VIDCAP_GUID) != S_OK)
-        return out;
+                             MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE_VIDCAP_GUID) != S_OK)
+        return false;
 
     // Enumerate the devices that support video capture.
     CComHeapPtr<IMFActivate*> ppActivates;
     UINT32 numActiveDevs = 0;
     if (MFEnumDeviceSources(pAttributes, &ppActivates, &numActiveDevs) != S_OK)
-        return out;
+        return false;
 
-    if (deviceIndex >= numActiveDevs)
-        return out;
+    // Get the name and symbolic link of each device.  The array
+    // owns a reference to each device, which we hand over to the
+    // CComPtr in the map.
+    std::map<std::wstring, CComPtr<IMFActivate>> activates;
+    bool ok = true;
+    for (UINT32 i = 0; i < numActiveDevs; ++i)
+    {
+        CComPtr<IMFActivate> pActivate;
+        pActivate.Attach(ppActivates[i]);
+
+        CComHeapPtr<WCHAR> pDevName;
+        CComHeapPtr<WCHAR> pSymLink;
+        if (!ok ||
+            pActivate->GetAllocatedString(MF_DEVSOURCE_ATTRIBUTE_FRIENDLY_NAME, &pDevName, nullptr) != S_OK ||
+            pActivate->GetAllocatedString(MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE_VIDCAP_SYMBOLIC_LINK, &pSymLink, nullptr) != S_OK)
+        {
+            ok = false;
+            continue;
+        }
 
-    // Get a pointer to the device the caller requested.
-    const CComPtr<IMFActivate> pActivate = ppActivates[deviceIndex];
+        DeviceInfo info;
+        info.m_friendlyName = std::wstring(pDevName);
+        info.m_symbolicLink = std::wstring(pSymLink);
+        devices.push_back(info);
+        activates[info.m_symbolicLink] = pActivate;
+    }
 
-    // Release all of the devices.
-    for (UINT32 i = 0; i < numActiveDevs; ++i)
-        reinterpret_cast<CComPtr<IMFActivate>&>(ppActivates[i]).Release();
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_activates.swap(activates);
+    return ok;
+}
 
-    // Activate the device the caller requested.
-    CComPtr<IMFMediaSource> pMediaSource = nullptr;
+//---------------------------------------------------------------
+// Activates the specified device, returning its IMFMediaSource.
+//---------------------------------------------------------------
+std::shared_ptr<void> MfDeviceSource::ActivateDevice(const DeviceInfo &device)
+{
+    CComPtr<IMFActivate> pActivate;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto it = m_activates.find(device.m_symbolicLink);
+        if (it == m_activates.end())
+            return nullptr;
+        pActivate = it->second;
+    }
+
+    IMFMediaSource *pMediaSource = nullptr;
     if (pActivate->ActivateObject(__uuidof(IMFMediaSource), (VOID**) &pMediaSource) != S_OK)
-        return out;
+        return nullptr;
 
-    if (MFCreateSourceReaderFromMediaSource(pMediaSource, NULL, &reinterpret_cast<IMFSourceReader *>(m_pReader)) != S_OK)
-        return out;
+    // Shut the media source down when the last user lets go of it.
+    return std::shared_ptr<void>(pMediaSource, [](void *p)
+    {
+        IMFMediaSource *pSource = static_cast<IMFMediaSource *>(p);
+        pSource->Shutdown();
+        pSource->Release();
+    });
+}
+
+//---------------------------------------------------------------
+// Retrieves the capture formats supported by an activated
+// device.  Returns true if successful.
+//---------------------------------------------------------------
+bool MfDeviceSource::GetDeviceFormats(const std::shared_ptr<void> &device,
+    std::vector<CaptureFormat> &formats)
+{
+    formats.clear();
+
+    CComPtr<IMFSourceReader> reader;
+    if (!CreateSourceReader(static_cast<IMFMediaSource *>(device.get()), reader))
+        return false;
 
     // Step through the device's media types to get the size/format
     // of each one.
@@ -360,8 +794,8 @@ std::vector<CaptureFormat> CameraFrameGrabber::GetDeviceFormats(unsigned deviceI
     DWORD formatIndex = 0;
     while (1)
     {
-        IMFMediaType *mediaType = nullptr;
-        if (reinterpret_cast<IMFSourceReader *>(m_pReader)->GetNativeMediaType(MF_SOURCE_READER_FIRST_VIDEO_STREAM, formatIndex, &mediaType) != S_OK)
+        CComPtr<IMFMediaType> mediaType = nullptr;
+        if (reader->GetNativeMediaType(MF_SOURCE_READER_FIRST_VIDEO_STREAM, formatIndex, &mediaType) != S_OK)
             break;
 
         GUID vidFormatGuid;
@@ -371,10 +805,7 @@ std::vector<CaptureFormat> CameraFrameGrabber::GetDeviceFormats(unsigned deviceI
         CaptureFormat fmt;
 
         // Set the pixel type indicator.
-        if (vidFormatGuid == MFVideoFormat_RGB32)   fmt.m_pixelType = CPT_RGB32;
-        if (vidFormatGuid == MFVideoFormat_RGB24)   fmt.m_pixelType = CPT_RGB24;
-        if (vidFormatGuid == MFVideoFormat_YUY2)    fmt.m_pixelType = CPT_YUY2;
-        if (vidFormatGuid == MFVideoFormat_NV12)    fmt.m_pixelType = CPT_NV12;
+        fmt.m_pixelType = GetPixelTypeFromGuid(vidFormatGuid);
         if (fmt.m_pixelType == CPT_INVALID)
         {
             // Skip unsupported video image formats.
@@ -389,68 +820,141 @@ std::vector<CaptureFormat> CameraFrameGrabber::GetDeviceFormats(unsigned deviceI
         fmt.m_stride = stride;
         fmt.m_frameSize = frameSize;
         fmt.m_vidFormatGuid = vidFormatGuid;
-        out.push_back(fmt);
-
-        if (mediaType)
-            mediaType->Release();
+        formats.push_back(fmt);
 
         ++formatIndex;
     }
 
-    // Release all of the devices.
-    for (UINT32 i = 0; i < numActiveDevs; ++i)
-        reinterpret_cast<CComPtr<IMFActivate>&>(ppActivates[i]).Release();
+    return true;
+}
 
-    return out;
+//---------------------------------------------------------------
+// Registers for notifications of camera devices being added or
+// removed.
+//---------------------------------------------------------------
+void MfDeviceSource::WatchForChanges(std::function<void()> onChange)
+{
+    if (m_hNotify != nullptr)
+        return;
+
+    m_onChange = onChange;
+
+    CM_NOTIFY_FILTER filter = {0};
+    filter.cbSize = sizeof(filter);
+    filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+    filter.u.DeviceInterface.ClassGuid = g_cameraInterfaceClass;
+    if (CM_Register_Notification(&filter, this, &MfDeviceSource::OnDeviceChange, &m_hNotify) != CR_SUCCESS)
+        m_hNotify = nullptr;
 }
 
 //---------------------------------------------------------------
-// Opens a capture session to the specified device.
-// Returns true if successful.
+// Called by the system on a worker thread when a camera device
+// is added or removed.
 //---------------------------------------------------------------
-bool CameraFrameGrabber::Open(unsigned deviceIndex, unsigned formatIndex)
+DWORD CALLBACK MfDeviceSource::OnDeviceChange(HCMNOTIFICATION /*hNotify*/, PVOID context,
+    CM_NOTIFY_ACTION action, PCM_NOTIFY_EVENT_DATA /*eventData*/, DWORD /*eventDataSize*/)
 {
-    // Create an empty Media Foundation attributes object.
-    CComPtr<IMFAttributes> pAttributes = nullptr;
-    if (MFCreateAttributes(&pAttributes, 1) != S_OK)
-        return false;
+    MfDeviceSource *pThis = static_cast<MfDeviceSource *>(context);
+    if ((action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL ||
+         action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL) && pThis->m_onChange)
+    {
+        pThis->m_onChange();
+    }
 
-    // Set the attribute's GUID to the clas of devices that
-    // support video capture.
-    if (pAttributes->SetGUID(MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE,
-                              MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE_VIDCAP_GUID) != S_OK)
-        return false;
+    return ERROR_SUCCESS;
+}
 
-    // Enumerate the devices that support video capture.
-    CComHeapPtr<IMFActivate*> ppActivates;
-    UINT32 numActiveDevs = 0;
-    if (MFEnumDeviceSources(pAttributes, &ppActivates, &numActiveDevs) != S_OK)
-        return false;
+} // End anon namespace
 
-    if (deviceIndex >= numActiveDevs)
-        return false;
+//---------------------------------------------------------------
+CameraFrameGrabber::CameraFrameGrabber()
+{
+    if (MFStartup(MF_VERSION) != S_OK)
+    {
+        throw std::runtime_error("Media Foundation startup failed!  Aborting.");
+    }
+}
 
-    // Get a pointer to the device the caller requested.
-    const CComPtr<IMFActivate> pActivate = ppActivates[deviceIndex];
+//---------------------------------------------------------------
+CameraFrameGrabber::~CameraFrameGrabber()
+{
+    Close();
+    MFShutdown();
+}
 
-    // Release all of the devices.
-    for (UINT32 i = 0; i < numActiveDevs; ++i)
-        reinterpret_cast<CComPtr<IMFActivate>&>(ppActivates[i]).Release();
+//---------------------------------------------------------------
+// Returns the process-wide registry of Media Foundation capture
+// devices used by all CameraFrameGrabber objects.
+//---------------------------------------------------------------
+DeviceRegistry &CameraFrameGrabber::GetDeviceRegistry()
+{
+    static DeviceRegistry registry(std::unique_ptr<DeviceSource>(new MfDeviceSource));
+    return registry;
+}
 
-    // Activate the device the caller requested.
-    CComPtr<IMFMediaSource> pMediaSource = nullptr;
-    if (pActivate->ActivateObject(__uuidof(IMFMediaSource), (VOID**) &pMediaSource) != S_OK)
-        return false;
+//---------------------------------------------------------------
+// Retrieves a list of the names of the available camera capture
+// devices.  Returns an empty list if there are no capture
+// devices installed on the system.
+//---------------------------------------------------------------
+std::vector<std::wstring> CameraFrameGrabber::GetDeviceNames()
+{
+    std::vector<std::wstring> out;
+    for (const auto &device : GetDeviceRegistry().GetDevices())
+        out.push_back(device.m_friendlyName);
+    return out;
+}
+
+//---------------------------------------------------------------
+// Retrieves a list of the supported capture formats for
+// the specified capture device.  Returns an empty list if
+// error.
+//---------------------------------------------------------------
+std::vector<CaptureFormat> CameraFrameGrabber::GetDeviceFormats(unsigned deviceIndex)
+{
+    std::vector<CaptureFormat> out;
+
+    DeviceRegistry &registry = GetDeviceRegistry();
+    DeviceInfo device;
+    if (!registry.GetDevice(deviceIndex, device))
+        return out;
 
-    if (MFCreateSourceReaderFromMediaSource(pMediaSource, NULL, &reinterpret_cast<IMFSourceReader *>(m_pReader)) != S_OK)
+    registry.GetDeviceFormats(device, out);
+    return out;
+}
+
+//---------------------------------------------------------------
+// Opens a capture session to the specified device.
+// Returns true if successful.
+//---------------------------------------------------------------
+bool CameraFrameGrabber::Open(unsigned deviceIndex, unsigned formatIndex)
+{
+    Close();
+
+    DeviceRegistry &registry = GetDeviceRegistry();
+    DeviceInfo device;
+    if (!registry.GetDevice(deviceIndex, device))
         return false;
 
+    // Get the activated device from the registry.  If the cached
+    // media source has gone bad (e.g. the device was unplugged and
+    // plugged back in), activate it again.
+    CComPtr<IMFSourceReader> reader;
+    std::shared_ptr<void> source = registry.GetActivatedDevice(device);
+    if (!source || !CreateSourceReader(static_cast<IMFMediaSource *>(source.get()), reader))
+    {
+        registry.ForgetDevice(device);
+        source = registry.GetActivatedDevice(device);
+        if (!source || !CreateSourceReader(static_cast<IMFMediaSource *>(source.get()), reader))
+            return false;
+    }
+
     // Get the media type for the format requested by the caller.
     DWORD fIndex = formatIndex;
     unsigned width = 0, height = 0, stride = 0, frameSize = 0;
 
-    IMFMediaType *mediaType = nullptr;
-    if (reinterpret_cast<IMFSourceReader *>(m_pReader)->GetNativeMediaType(MF_SOURCE_READER_FIRST_VIDEO_STREAM, fIndex, &mediaType) != S_OK)
+    CComPtr<IMFMediaType> mediaType = nullptr;
+    if (reader->GetNativeMediaType(MF_SOURCE_READER_FIRST_VIDEO_STREAM, fIndex, &mediaType) != S_OK)
         return false;
 
     // Set the video processing flag, which will enable YUV to RGB conversion.
@@ -462,10 +966,7 @@ bool CameraFrameGrabber::Open(unsigned deviceIndex, unsigned formatIndex)
         return false;
 
     CaptureFormat fmt;
-    if (vidFormatGuid == MFVideoFormat_RGB32)   fmt.m_pixelType = CPT_RGB32;
-    if (vidFormatGuid == MFVideoFormat_RGB24)   fmt.m_pixelType = CPT_RGB24;
-    if (vidFormatGuid == MFVideoFormat_YUY2)    fmt.m_pixelType = CPT_YUY2;
-    if (vidFormatGuid == MFVideoFormat_NV12)    fmt.m_pixelType = CPT_NV12;
+    fmt.m_pixelType = GetPixelTypeFromGuid(vidFormatGuid);
     if (fmt.m_pixelType == CPT_INVALID)
     {
         // Unsupported pixel format!
@@ -478,22 +979,80 @@ bool CameraFrameGrabber::Open(unsigned deviceIndex, unsigned formatIndex)
     fmt.m_stride = stride;
     fmt.m_frameSize = frameSize;
     fmt.m_vidFormatGuid = vidFormatGuid;
-    m_captureFormat = fmt;
 
-    if (reinterpret_cast<IMFSourceReader *>(m_pReader)->SetCurrentMediaType(
-            MF_SOURCE_READER_FIRST_VIDEO_STREAM, nullptr, mediaType) != S_OK)
+    if (reader->SetCurrentMediaType(MF_SOURCE_READER_FIRST_VIDEO_STREAM, nullptr, mediaType) != S_OK)
         return false;
 
-    if (mediaType)
-        mediaType->Release();
+    m_captureFormat = fmt;
+    m_deviceIndex = deviceIndex;
+    m_source = source;
+    m_pReader = reader.Detach();
+    m_pMediaType = mediaType.Detach();
 
+    // Work out which pixels of each row the kernels must mask.
+    m_privacyMask.Compile(m_orientation, m_captureFormat.m_width, m_captureFormat.m_height);
     return true;
 }
 
 //---------------------------------------------------------------
 void CameraFrameGrabber::Close()
 {
+    if (m_pReader != nullptr)
+        reinterpret_cast<IMFSourceReader *>(m_pReader)->Release();
+    m_pReader = nullptr;
+
+    if (m_pMediaType != nullptr)
+        reinterpret_cast<IMFMediaType *>(m_pMediaType)->Release();
+    m_pMediaType = nullptr;
+    m_suspended = false;
+
+    // The registry keeps its own reference to the media source,
+    // so it stays running for the next Open().
+    m_source.reset();
+}
+
+//---------------------------------------------------------------
+// Stops the device from streaming until Resume() is called,
+// while keeping the activated device and the negotiated media
+// type.  Returns true if successful.
+//---------------------------------------------------------------
+bool CameraFrameGrabber::Suspend()
+{
+    if (m_pReader == nullptr || m_source == nullptr)
+        return false;
+
+    // Releasing the reader leaves the media source alive (see
+    // CreateSourceReader()), and stopping the source turns the
+    // device's stream off.
+    reinterpret_cast<IMFSourceReader *>(m_pReader)->Release();
     m_pReader = nullptr;
+    static_cast<IMFMediaSource *>(m_source.get())->Stop();
+
+    m_suspended = true;
+    return true;
+}
+
+//---------------------------------------------------------------
+// Restarts streaming after Suspend(), reusing the activated
+// device and the negotiated media type instead of going through
+// all of Open() again.  Returns true if successful.
+//---------------------------------------------------------------
+bool CameraFrameGrabber::Resume()
+{
+    if (!m_suspended)
+        return m_pReader != nullptr;
+
+    CComPtr<IMFSourceReader> reader;
+    if (!CreateSourceReader(static_cast<IMFMediaSource *>(m_source.get()), reader))
+        return false;
+
+    if (reader->SetCurrentMediaType(MF_SOURCE_READER_FIRST_VIDEO_STREAM, nullptr,
+            reinterpret_cast<IMFMediaType *>(m_pMediaType)) != S_OK)
+        return false;
+
+    m_pReader = reader.Detach();
+    m_suspended = false;
+    return true;
 }
 
 //---------------------------------------------------------------
@@ -502,11 +1061,13 @@ void CameraFrameGrabber::Close()
 // 32-bit BGRA format and placed into the buffer given by
 // the caller.  Returns true if successful.  Note the very
 // first frame may be all black, as some devices take some
-// time to fully initialize. 
+// time to fully initialize.  If the device dropped the frame,
+// returns false and WasFrameDropped() returns true.
 //---------------------------------------------------------------
 bool CameraFrameGrabber::GrabFrame(void *data, size_t dataSize, std::string &errText)
 {
     errText.clear();
+    m_frameDropped = false;
 
     if (data == nullptr || dataSize < 1)
     {
@@ -516,47 +1077,96 @@ bool CameraFrameGrabber::GrabFrame(void *data, size_t dataSize, std::string &err
 
     if (m_pReader == nullptr)
     {
-        errText = "Uninitialized.";
+        errText = m_suspended ? "Suspended." : "Uninitialized.";
         return false;
     }
 
     // Read the frame buffer from the capture device.
-    DWORD streamIndex = 0;
-    DWORD flags = 0;
-    LONGLONG streamTime = 0;
-    CComPtr<IMFSample> pSample = nullptr;
-    if (reinterpret_cast<IMFSourceReader *>(m_pReader)->ReadSample(MF_SOURCE_READER_FIRST_VIDEO_STREAM, 0,
-                                            &streamIndex, &flags, &streamTime,
-                                            &pSample) != S_OK)
+    CComPtr<IMFMediaBuffer> mbuffer;
+    bool dropped = false;
+    FrameTimestamp timestamp;
+    if (!ReadFrameBuffer(reinterpret_cast<IMFSourceReader *>(m_pReader), mbuffer, timestamp, dropped, errText))
+        return false;
+
+    m_frameDropped = dropped;
+    if (dropped)
     {
-        errText = "ReadSample failed.";
+        // The camera dropped a frame or was unable to capture.
+        // Let the caller decide whether to retry rather than
+        // handing back a substitute black frame.
+        errText = "Device dropped the frame.";
         return false;
     }
 
-    if ((streamIndex == 0) && (flags & MF_SOURCE_READERF_STREAMTICK))
+    // Lock the contiguous buffer.
+    unsigned char *mbufferData = nullptr;
+    DWORD mbufferDataMax = 0, mbufferLen = 0;
+    if (mbuffer->Lock(&mbufferData, &mbufferDataMax, &mbufferLen) != S_OK)
     {
-        // The camera dropped a frame or was unable to capture, so
-        // fill the caller's frame buffer with black pixels.
-        memset(data, 0, dataSize);
-        return true;
+        errText = "Failed locking IMFMediaBuffer.";
+        return false;
     }
 
-    if (pSample == nullptr)
+    // Convert the raw frame data to a usable format.
+    // The converted frame data is placed into the caller's 'data' buffer.
+    bool result = ConvertFrameToBgr32(m_captureFormat, m_orientation, m_privacyMask, nullptr,
+        mbufferData, data, errText);
+    if (result)
+        m_timestamp = timestamp;
+
+    mbuffer->Unlock();
+
+    return result;
+}
+
+//---------------------------------------------------------------
+// Returns the size in bytes of one frame in the device's native
+// pixel format, as retrieved by GrabRawFrame().
+//---------------------------------------------------------------
+size_t CameraFrameGrabber::GetRawFrameSize() const
+{
+    if (m_captureFormat.m_frameSize != 0)
+        return m_captureFormat.m_frameSize;
+
+    // NV12 has a half-height UV plane after the Y plane.
+    size_t size = static_cast<size_t>(m_captureFormat.m_stride) * m_captureFormat.m_height;
+    if (m_captureFormat.m_pixelType == CPT_NV12)
+        size += size / 2;
+    return size;
+}
+
+//---------------------------------------------------------------
+// Captures an image frame from the currently open device
+// without converting it.  The frame is placed into 'raw' in the
+// device's native pixel format.  Returns false if the device
+// dropped the frame or an error occurred.
+//---------------------------------------------------------------
+bool CameraFrameGrabber::GrabRawFrame(std::vector<unsigned char> &raw, std::string &errText)
+{
+    errText.clear();
+    m_frameDropped = false;
+
+    if (m_pReader == nullptr)
     {
-        errText = "No sample data.";
+        errText = m_suspended ? "Suspended." : "Uninitialized.";
         return false;
     }
 
-    // Extract the frame data from the sample object.
-    // First we have to convert it to contiguous format.
+    // Read the frame buffer from the capture device.
     CComPtr<IMFMediaBuffer> mbuffer;
-    if (pSample->ConvertToContiguousBuffer(&mbuffer) != S_OK)
+    bool dropped = false;
+    FrameTimestamp timestamp;
+    if (!ReadFrameBuffer(reinterpret_cast<IMFSourceReader *>(m_pReader), mbuffer, timestamp, dropped, errText))
+        return false;
+
+    m_frameDropped = dropped;
+    if (dropped)
     {
-        errText = "ConvertToContiguousBuffer failed.";
+        errText = "Device dropped the frame.";
         return false;
     }
 
-    // Next we have to lock the contiguous buffer.
+    // Lock the contiguous buffer.
     unsigned char *mbufferData = nullptr;
     DWORD mbufferDataMax = 0, mbufferLen = 0;
     if (mbuffer->Lock(&mbufferData, &mbufferDataMax, &mbufferLen) != S_OK)
@@ -565,55 +1175,119 @@ bool CameraFrameGrabber::GrabFrame(void *data, size_t dataSize, std::string &err
         return false;
     }
 
-    // Convert the raw frame data to a usable format.
-    // The converted frame data is placed into the caller's 'data' buffer.
+    // Copy the frame as-is into the caller's buffer.
     bool result = true;
-    if (m_captureFormat.m_pixelType == CPT_RGB24)
+    size_t rawSize = GetRawFrameSize();
+    if (mbufferLen < rawSize)
     {
-        // Convert 24-bit to 32-bit.
-        for (unsigned y = 0; y < m_captureFormat.m_height; ++y)
-        {
-            const unsigned char *pin = reinterpret_cast<const unsigned char *>(mbufferData) + y * m_captureFormat.m_stride;
-            unsigned char *pout = reinterpret_cast<unsigned char *>(data) + m_captureFormat.m_width * 4;
-            for (unsigned x = 0; x < m_captureFormat.m_width; ++x)
-            {
-                *pout++ = *pin++;
-                *pout++ = *pin++;
-                *pout++ = *pin++;
-                *pout++ = '\0';
-            }
-        }
+        errText = "Sample data is smaller than the frame size.";
+        result = false;
     }
-    else if (m_captureFormat.m_pixelType == CPT_RGB32)
+    else
     {
-        // Copy 32-bit frame as-is.
-        memcpy(data, mbufferData, m_captureFormat.m_stride * m_captureFormat.m_height);
+        raw.resize(rawSize);
+        memcpy(raw.data(), mbufferData, rawSize);
+        m_timestamp = timestamp;
     }
-    else if (m_captureFormat.m_pixelType == CPT_YUY2)
+
+    mbuffer->Unlock();
+
+    return result;
+}
+
+//---------------------------------------------------------------
+// Converts a frame retrieved by GrabRawFrame() to 32-bit BGRA
+// format, placing the result into the buffer given by the
+// caller.  Returns true if successful.
+//---------------------------------------------------------------
+bool CameraFrameGrabber::ConvertRawFrame(const void *raw, size_t rawSize,
+    void *data, size_t dataSize, std::string &errText, const ColorCurves *curves) const
+{
+    errText.clear();
+
+    if (raw == nullptr || rawSize < GetRawFrameSize() ||
+        data == nullptr || dataSize < static_cast<size_t>(GetStride()) * GetHeight())
     {
-        // Convert YUY2 frame to 32-bit.
-        ConvertYuy2ToBgr32(mbufferData, m_captureFormat.m_width,
-                                        m_captureFormat.m_height,
-                                        m_captureFormat.m_stride,
-                                        data);
+        errText = "Bad parameter.";
+        return false;
     }
-    else if (m_captureFormat.m_pixelType == CPT_NV12)
+
+    return ConvertFrameToBgr32(m_captureFormat, m_orientation, m_privacyMask, curves,
+        static_cast<const unsigned char *>(raw), data, errText);
+}
+
+//---------------------------------------------------------------
+// Converts a sparse grid of pixels from a raw frame, skipping
+// those hidden by the privacy mask.
+//---------------------------------------------------------------
+bool CameraFrameGrabber::SampleRawColors(const void *raw, size_t rawSize,
+    std::vector<uint32_t> &colors, std::vector<uint32_t> *pixels) const
+{
+    colors.clear();
+    if (pixels != nullptr)
+        pixels->clear();
+    const CaptureFormat &fmt = m_captureFormat;
+    if (raw == nullptr || rawSize < GetRawFrameSize() || fmt.m_width < 2 || fmt.m_height == 0)
+        return false;
+    if (fmt.m_pixelType != CPT_RGB24 && fmt.m_pixelType != CPT_RGB32 &&
+        fmt.m_pixelType != CPT_YUY2 && fmt.m_pixelType != CPT_NV12)
     {
-        // Convert NV12 frame to 32-bit.
-        ConvertNv12ToBgr32(mbufferData, m_captureFormat.m_width,
-                                        m_captureFormat.m_height,
-                                        m_captureFormat.m_stride,
-                                        data);
+        return false;
     }
-    else
+
+    const unsigned gridSize = __min(SAMPLE_GRID_SIZE, fmt.m_height);
+    const unsigned gridWidth = __min(SAMPLE_GRID_SIZE, fmt.m_width / 2);
+    const unsigned char *inData = static_cast<const unsigned char *>(raw);
+    const OutputMapping mapping = GetOutputMapping(m_orientation, fmt.m_width, fmt.m_height);
+    colors.reserve(gridSize * gridWidth);
+    for (unsigned gy = 0; gy < gridSize; ++gy)
     {
-        // Unsupported pixel format!
-        errText = "Unsupported pixel format.";
-        result = false;
+        unsigned y = (2 * gy + 1) * fmt.m_height / (2 * gridSize);
+        size_t numSpans = 0;
+        const PrivacyMask::Span *spans = m_privacyMask.GetSpans(y, numSpans);
+        size_t span = 0;
+        for (unsigned gx = 0; gx < gridWidth; ++gx)
+        {
+            // Spans are sorted, so walk them along with the samples.
+            unsigned x = ((2 * gx + 1) * fmt.m_width / (2 * gridWidth)) & ~1u;
+            while (span < numSpans && spans[span].m_end <= x)
+                ++span;
+            if (span < numSpans && spans[span].m_start <= x)
+                continue;
+
+            uint32_t color;
+            ConvertSpan(fmt, inData, y, x, 1, &color, 1, StorePixel());
+            colors.push_back(color);
+            if (pixels != nullptr)
+                pixels->push_back(static_cast<uint32_t>(mapping.m_origin + x * mapping.m_colStep + y * mapping.m_rowStep));
+        }
     }
+    return true;
+}
 
-    mbuffer->Unlock();
+//---------------------------------------------------------------
+// Sets how converted frames are rotated and mirrored.  Returns
+// false if the rotation isn't a multiple of 90 degrees.
+//---------------------------------------------------------------
+bool CameraFrameGrabber::SetOrientation(const FrameOrientation &orientation)
+{
+    if (orientation.m_rotation % 90 != 0)
+        return false;
 
-    return result;
+    m_orientation = orientation;
+    m_orientation.m_rotation %= 360;
+    m_privacyMask.Compile(m_orientation, m_captureFormat.m_width, m_captureFormat.m_height);
+    return true;
 }
 
+//---------------------------------------------------------------
+// Sets the regions of converted frames to hide, and how to hide
+// them.
+//---------------------------------------------------------------
+void CameraFrameGrabber::SetPrivacyMask(const std::vector<PrivacyRegion> &regions,
+    uint32_t color, unsigned pixelateSize)
+{
+    m_privacyMask.SetRegions(regions);
+    m_privacyMask.SetFill(color, pixelateSize);
+    m_privacyMask.Compile(m_orientation, m_captureFormat.m_width, m_captureFormat.m_height);
+}
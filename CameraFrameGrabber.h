@@ -43,61 +43,74 @@
 //   call the GrabFrame() member as many times as desired to
 //   capture frames, then call the Close() member when done.
 //
+// * Devices are looked up through a process-wide DeviceRegistry,
+//   so enumerating devices, activating a device, and reading its
+//   format list each happen only once per device, however many
+//   times GetDeviceNames(), GetDeviceFormats(), and Open() are
+//   called.
+//
 // * This module supports capture devices that produce images
 //   in following pixel encoding formats:  BGR-24, BGR-32,
 //   YUY-2, and NV-12.
 //
 // * The output format produced by this module is always BGRA-32
 //   regardless of the device's capture format.
+//
+// * SetOrientation() rotates and/or mirrors the converted frames.
+//   The conversion kernels write each pixel straight to its
+//   rotated position, so orientation costs no extra pass over the
+//   frame and no extra buffer.  Rotations by 90 and 270 degrees are
+//   converted in small square tiles, so the column-wise writes stay
+//   in cache.  GetWidth() and GetHeight() report the oriented size.
+//
+// * SetPrivacyMask() hides regions of the converted frames.  The
+//   regions are compiled into masked spans of each row when the
+//   device is opened, and the kernels fill those spans instead of
+//   converting them, so masked pixels never reach the caller.
+//
+// * GrabRawFrame() and ConvertRawFrame() split GrabFrame() into
+//   its two halves, for callers that want to work on frames in the
+//   device's native pixel format before converting them.
+//
+// * ConvertRawFrame() can also run every pixel through per-channel
+//   color curves, such as auto-levels and white balance computed
+//   from SampleRawColors(), inside the conversion kernels.  The
+//   kernels are templates on how each pixel is stored, so frames
+//   without curves run the same code as before and frames with them
+//   cost three table lookups per pixel rather than another pass.
+//
+// * Each grabbed frame is timestamped three ways:  the device's
+//   own sample time, the host's monotonic clock when the frame was
+//   dequeued, and the wall clock.  Devices that report the system
+//   time of capture also get their capture time mapped onto the
+//   host's monotonic clock, so frames from different devices can
+//   be lined up.
 //--------------------------------------------------------------------
 
 #pragma once
 
+#include "CaptureFormat.h"
+#include "PrivacyMask.h"
+
 #include <stdio.h>
+#include <chrono>
+#include <memory>
 #include <vector>
 #include <string>
-#include <guiddef.h>
 
-//---------------------------------------------------------------
-// Possible values for the pixel type member of CaptureFormat.
-//---------------------------------------------------------------
-enum CapturePixelType
-{
-    CPT_INVALID = 0,
-    CPT_RGB24   = 1,
-    CPT_RGB32   = 2,
-    CPT_YUY2    = 3,
-    CPT_NV12    = 4
-};
+class DeviceRegistry;
 
 //---------------------------------------------------------------
-// Structure that describes a video image format.
+// When a frame was captured and dequeued.
 //---------------------------------------------------------------
-struct CaptureFormat
+struct FrameTimestamp
 {
-    CaptureFormat() = default;
-
-    // Index of this capture format.
-    // This is used to select this format in a device with multiple formats.
-    unsigned m_index = 0;
-
-    // Size of the captured image in pixels.
-    unsigned m_width = 0;
-    unsigned m_height = 0;
-
-    // Width of each scanline in bytes.
-    // Note that only counts one color plane in multi-plane images!
-    unsigned m_stride = 0;
-
-    // Size of each sample frame buffer in bytes.
-    // May be zero, in which case we have to calculate the size.
-    unsigned m_frameSize = 0;
-
-    // Indicates the kind of pixel encoding.
-    CapturePixelType m_pixelType = CPT_INVALID;
-
-    // The GUID of this video format.
-    GUID m_vidFormatGuid = {0};
+    long long m_sampleTime = 0;                         // Device's sample time, in 100 ns units.
+    std::chrono::steady_clock::time_point m_captureTime; // When the device captured the frame (host monotonic clock).
+    std::chrono::steady_clock::time_point m_dequeueTime; // When the frame was dequeued (host monotonic clock).
+    std::chrono::system_clock::time_point m_wallTime;    // When the frame was dequeued (wall clock).
+    bool m_haveCaptureTime = false;                     // False if the device didn't report its capture time,
+                                                        // in which case m_captureTime is m_dequeueTime.
 };
 
 //---------------------------------------------------------------
@@ -110,6 +123,10 @@ public:
     CameraFrameGrabber();
     ~CameraFrameGrabber();
 
+    // Returns the process-wide registry that caches the capture
+    // device list, activated devices, and format lists.
+    static DeviceRegistry &GetDeviceRegistry();
+
     // Retrieves a list of the names of the available camera
     // capture devices.  Returns an empty list if there are no
     // capture devices installed on the system.
@@ -128,24 +145,99 @@ public:
     // Closes the capture session.
     void Close();
 
+    // Stops the device from streaming, to save power and USB
+    // bandwidth during long waits between frames.  The activated
+    // device and negotiated media type are kept, so Resume() is
+    // much faster than Close() followed by Open().  Returns true
+    // if successful.
+    bool Suspend();
+
+    // Restarts streaming after Suspend().  The device may need
+    // some warm-up frames again before its exposure settles.
+    // Returns true if successful.
+    bool Resume();
+
+    // Returns true if the capture session is suspended.
+    bool IsSuspended() const { return m_suspended; }
+
+    // Sets how converted frames are rotated and mirrored.  Returns
+    // false if the rotation isn't a multiple of 90 degrees.
+    bool SetOrientation(const FrameOrientation &orientation);
+    const FrameOrientation &GetOrientation() const { return m_orientation; }
+
+    // Sets the regions of converted frames to hide, in oriented
+    // frame coordinates, and fills them with the given color
+    // (0x00RRGGBB) or, if pixelateSize is more than 1, pixelates
+    // them in blocks of that size.
+    void SetPrivacyMask(const std::vector<PrivacyRegion> &regions, uint32_t color, unsigned pixelateSize);
+
     // Return information about the format of the images
     // retrieved by GrabFrame().
-    unsigned GetWidth() const { return m_captureFormat.m_width; }
-    unsigned GetHeight() const { return m_captureFormat.m_height; }
+    unsigned GetWidth() const
+        { return m_orientation.IsTransposed() ? m_captureFormat.m_height : m_captureFormat.m_width; }
+    unsigned GetHeight() const
+        { return m_orientation.IsTransposed() ? m_captureFormat.m_width : m_captureFormat.m_height; }
     unsigned GetStride() const { return GetWidth() * 4; }
     unsigned GetBitsPerPixel() const { return 32; }
 
+    // Return information about the device's native format, as
+    // retrieved by GrabRawFrame().
+    CapturePixelType GetPixelType() const { return m_captureFormat.m_pixelType; }
+    const CaptureFormat &GetCaptureFormat() const { return m_captureFormat; }
+    size_t GetRawFrameSize() const;
+
     // Captures an image frame from the currently open device.
     // The pixels are converted from the internal format to
     // 32-bit BGRA format and placed into the buffer given by
     // the caller.  Returns true if successful.  Note the very
     // first frame may be all black, as some devices take some
-    // time to fully initialize. 
+    // time to fully initialize.  If the device dropped the frame,
+    // returns false and WasFrameDropped() returns true.
     bool GrabFrame(void *data, size_t dataSize, std::string &errText);
 
+    // Captures an image frame from the currently open device
+    // without converting it.  The frame is placed into 'raw' in
+    // the device's native pixel format.  Returns false if the
+    // device dropped the frame or an error occurred.
+    bool GrabRawFrame(std::vector<unsigned char> &raw, std::string &errText);
+
+    // Converts a frame retrieved by GrabRawFrame() to 32-bit BGRA
+    // format, placing the result into the buffer given by the
+    // caller.  If 'curves' is given, each pixel is run through
+    // them as it is converted.  Returns true if successful.  May be
+    // called from another thread while frames are being grabbed.
+    bool ConvertRawFrame(const void *raw, size_t rawSize,
+        void *data, size_t dataSize, std::string &errText,
+        const ColorCurves *curves = nullptr) const;
+
+    // Converts a sparse grid of pixels from a frame retrieved by
+    // GrabRawFrame() to 32-bit BGR, for gathering statistics
+    // without converting the whole frame.  Pixels hidden by the
+    // privacy mask are left out.  If 'pixels' is given, it receives
+    // where each sample lands in the converted frame, in pixels
+    // from its start.  Returns false on bad parameters.
+    bool SampleRawColors(const void *raw, size_t rawSize, std::vector<uint32_t> &colors,
+        std::vector<uint32_t> *pixels = nullptr) const;
+
+    // Returns true if the last GrabFrame() or GrabRawFrame() call
+    // failed because the device dropped the frame, in which case
+    // it is worth trying again.
+    bool WasFrameDropped() const { return m_frameDropped; }
+
+    // Returns the timestamps of the frame retrieved by the last
+    // successful GrabFrame() or GrabRawFrame() call.
+    const FrameTimestamp &GetFrameTimestamp() const { return m_timestamp; }
+
 private:
     void *m_pReader = nullptr;      // opaque pointer to internally used IMFSourceReader object.
+    std::shared_ptr<void> m_source; // Activated device (IMFMediaSource) shared with the device registry.
+    void *m_pMediaType = nullptr;   // opaque pointer to the negotiated IMFMediaType, kept for Resume().
+    bool m_suspended = false;       // True between Suspend() and Resume().
     unsigned m_deviceIndex = 0;     // Index of currently open capture device.
     CaptureFormat m_captureFormat;  // Current capture image format.
+    FrameOrientation m_orientation; // How converted frames are rotated and mirrored.
+    PrivacyMask m_privacyMask;      // Pixels of converted frames to hide.
+    bool m_frameDropped = false;    // True if the device dropped the last frame.
+    FrameTimestamp m_timestamp;     // Timestamps of the last frame grabbed.
 };
 
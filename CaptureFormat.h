@@ -0,0 +1,108 @@
+//--------------------------------------------------------------------
+// CaptureFormat.h
+// Types that describe the image formats produced by a capture
+// device.
+//
+// (C) Copyright 2019,2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <guiddef.h>
+
+//---------------------------------------------------------------
+// Possible values for the pixel type member of CaptureFormat.
+//---------------------------------------------------------------
+enum CapturePixelType
+{
+    CPT_INVALID = 0,
+    CPT_RGB24   = 1,
+    CPT_RGB32   = 2,
+    CPT_YUY2    = 3,
+    CPT_NV12    = 4
+};
+
+//---------------------------------------------------------------
+// Structure that describes a video image format.
+//---------------------------------------------------------------
+struct CaptureFormat
+{
+    CaptureFormat() = default;
+
+    // Index of this capture format.
+    // This is used to select this format in a device with multiple formats.
+    unsigned m_index = 0;
+
+    // Size of the captured image in pixels.
+    unsigned m_width = 0;
+    unsigned m_height = 0;
+
+    // Width of each scanline in bytes.
+    // Note that only counts one color plane in multi-plane images!
+    unsigned m_stride = 0;
+
+    // Size of each sample frame buffer in bytes.
+    // May be zero, in which case we have to calculate the size.
+    unsigned m_frameSize = 0;
+
+    // Indicates the kind of pixel encoding.
+    CapturePixelType m_pixelType = CPT_INVALID;
+
+    // The GUID of this video format.
+    GUID m_vidFormatGuid = {0};
+};
+
+//---------------------------------------------------------------
+// How converted frames are turned to match the way the camera is
+// mounted.  The frame is rotated first, then mirrored.
+//---------------------------------------------------------------
+struct FrameOrientation
+{
+    unsigned m_rotation = 0;        // Clockwise rotation in degrees:  0, 90, 180, or 270.
+    bool m_flipHorizontal = false;  // Mirror left to right.
+    bool m_flipVertical = false;    // Mirror top to bottom.
+
+    // Returns true if the frame's rows become columns.
+    bool IsTransposed() const { return m_rotation == 90 || m_rotation == 270; }
+};
+
+//---------------------------------------------------------------
+// Per-channel tone curves applied to each pixel as frames are
+// converted, indexed by blue, green, then red.
+//---------------------------------------------------------------
+struct ColorCurves
+{
+    uint8_t m_curves[3][256];
+};
@@ -0,0 +1,152 @@
+//--------------------------------------------------------------------
+// CaptureScheduler.cpp
+// A C++ module that dispatches tasks to a WorkerPool when their
+// deadlines come due.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "CaptureScheduler.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+//---------------------------------------------------------------
+CaptureScheduler::CaptureScheduler(WorkerPool &pool)
+    : m_pool(pool)
+{
+    m_thread = std::thread(&CaptureScheduler::DispatchThread, this);
+}
+
+//---------------------------------------------------------------
+CaptureScheduler::~CaptureScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+}
+
+//---------------------------------------------------------------
+// Orders the heap so the earliest deadline is on top.
+//---------------------------------------------------------------
+bool CaptureScheduler::IsLater(const Entry &a, const Entry &b)
+{
+    if (a.m_deadline != b.m_deadline)
+        return a.m_deadline > b.m_deadline;
+    return a.m_sequence > b.m_sequence;
+}
+
+//---------------------------------------------------------------
+// Submits 'task' to the pool under 'key' once 'deadline' has
+// passed.
+//---------------------------------------------------------------
+void CaptureScheduler::Schedule(Clock::time_point deadline, unsigned key, std::function<void()> task)
+{
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_dispatchAll)
+            deadline = Clock::time_point::min();
+
+        unsigned long long sequence = m_nextSequence++;
+        m_heap.push_back(Entry{deadline, sequence, key, std::move(task)});
+        std::push_heap(m_heap.begin(), m_heap.end(), IsLater);
+
+        // The dispatcher only needs waking if the new task is now
+        // the earliest one.
+        wake = (m_heap.front().m_sequence == sequence);
+    }
+    if (wake)
+        m_wake.notify_one();
+}
+
+//---------------------------------------------------------------
+// Makes every pending task, and every task scheduled from now
+// on, due immediately.
+//---------------------------------------------------------------
+void CaptureScheduler::DispatchAllNow()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_dispatchAll = true;
+    }
+    m_wake.notify_one();
+}
+
+//---------------------------------------------------------------
+// Returns the number of tasks waiting for their deadline.
+//---------------------------------------------------------------
+size_t CaptureScheduler::GetPendingCount()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_heap.size();
+}
+
+//---------------------------------------------------------------
+// The dispatcher thread.  Sleeps until the earliest deadline,
+// then hands every task that has come due to the pool.
+//---------------------------------------------------------------
+void CaptureScheduler::DispatchThread()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (!m_stopping)
+    {
+        if (m_heap.empty())
+        {
+            m_wake.wait(lock);
+            continue;
+        }
+
+        if (!m_dispatchAll && Clock::now() < m_heap.front().m_deadline)
+        {
+            // Wake up again for the deadline, or for an earlier
+            // task being scheduled.
+            m_wake.wait_until(lock, m_heap.front().m_deadline);
+            continue;
+        }
+
+        std::pop_heap(m_heap.begin(), m_heap.end(), IsLater);
+        Entry entry = std::move(m_heap.back());
+        m_heap.pop_back();
+
+        // Submit outside the lock, so a busy pool doesn't hold up
+        // Schedule() calls.
+        lock.unlock();
+        m_pool.Submit(entry.m_key, std::move(entry.m_task));
+        lock.lock();
+    }
+}
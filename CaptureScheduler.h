@@ -0,0 +1,121 @@
+//--------------------------------------------------------------------
+// CaptureScheduler.h
+// A C++ module that dispatches tasks to a WorkerPool when their
+// deadlines come due.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Declare a CaptureScheduler on top of a
+//   WorkerPool, then call Schedule() with a deadline, a key, and
+//   a task.  When the deadline comes due, the task is submitted to
+//   the pool under the given key.  A task usually schedules its
+//   own next run.
+//
+// * Pending tasks are kept in a min-heap ordered by deadline, so
+//   scheduling costs O(log n) however many sources there are, and
+//   a single dispatcher thread sleeps until the earliest deadline.
+//   Tasks with the same deadline are dispatched in the order they
+//   were scheduled.
+//
+// * Deadlines are on the monotonic steady_clock, so changes to the
+//   wall clock don't shift them.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool;
+
+//---------------------------------------------------------------
+// A C++ class that runs tasks on a WorkerPool at scheduled times.
+//---------------------------------------------------------------
+class CaptureScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit CaptureScheduler(WorkerPool &pool);
+
+    // Stops the dispatcher thread.  Tasks that haven't come due
+    // are discarded.
+    ~CaptureScheduler();
+
+    CaptureScheduler(const CaptureScheduler &) = delete;
+    CaptureScheduler &operator=(const CaptureScheduler &) = delete;
+
+    // Submits 'task' to the pool under 'key' once 'deadline' has
+    // passed.  May be called from any thread, including from a
+    // running task.
+    void Schedule(Clock::time_point deadline, unsigned key, std::function<void()> task);
+
+    // Makes every pending task, and every task scheduled from now
+    // on, due immediately.  Used to wind down early.
+    void DispatchAllNow();
+
+    // Returns the number of tasks waiting for their deadline.
+    size_t GetPendingCount();
+
+private:
+    // A task waiting for its deadline.
+    struct Entry
+    {
+        Clock::time_point m_deadline;   // When the task comes due.
+        unsigned long long m_sequence;  // Breaks ties between equal deadlines.
+        unsigned m_key;                 // Key to submit the task to the pool under.
+        std::function<void()> m_task;   // The task.
+    };
+
+    // Orders the heap so the earliest deadline is on top.
+    static bool IsLater(const Entry &a, const Entry &b);
+
+    void DispatchThread();
+
+    WorkerPool &m_pool;                     // Where due tasks are run.
+    std::mutex m_lock;                      // Protects all of the members below.
+    std::condition_variable m_wake;         // Signaled when the earliest deadline may have changed.
+    std::vector<Entry> m_heap;              // Pending tasks, as a min-heap by deadline.
+    unsigned long long m_nextSequence = 0;  // Sequence number for the next scheduled task.
+    bool m_dispatchAll = false;             // True once DispatchAllNow() has been called.
+    bool m_stopping = false;                // True once the destructor has been called.
+    std::thread m_thread;                   // The dispatcher thread.
+};
+
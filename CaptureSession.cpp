@@ -0,0 +1,1887 @@
+//--------------------------------------------------------------------
+// CaptureSession.cpp
+// A C++ module that runs a time lapse capture session on one or more
+// camera devices at once.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "CaptureSession.h"
+#include "AutoColor.h"
+#include "CameraFrameGrabber.h"
+#include "CaptureScheduler.h"
+#include "ColorLut.h"
+#include "ControlServer.h"
+#include "FlatField.h"
+#include "FrameComposite.h"
+#include "FrameQuality.h"
+#include "FrameRing.h"
+#include "FrameShare.h"
+#include "ImagePyramid.h"
+#include "PreviewServer.h"
+#include "Stabilizer.h"
+#include "TemporalFilter.h"
+#include "TextOverlay.h"
+#include "WorkerPool.h"
+
+#include <io.h>
+#include <stdio.h>
+#include <windows.h>
+#include <objbase.h>
+#include <chrono>
+#include <thread>
+
+#pragma comment(lib, "ole32.lib")
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+using Ms = std::chrono::duration<double, std::milli>;
+
+//---------------------------------------------------------------
+// Returns the number of microseconds between two time points.
+//---------------------------------------------------------------
+long long MicrosBetween(Clock::time_point t0, Clock::time_point t1)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+}
+
+//---------------------------------------------------------------
+// Formats a wall-clock time as local time with strftime() and
+// appends the milliseconds.  The default format can be used in
+// file names, e.g. "20261017-134501.250".
+//---------------------------------------------------------------
+void FormatWallTime(std::chrono::system_clock::time_point wallTime, char *buffer, size_t bufferSize,
+    const char *format = "%Y%m%d-%H%M%S")
+{
+    time_t seconds = std::chrono::system_clock::to_time_t(wallTime);
+    long long millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+        wallTime.time_since_epoch()).count() % 1000;
+
+    struct tm local = {0};
+    localtime_s(&local, &seconds);
+    size_t len = strftime(buffer, bufferSize, format, &local);
+    sprintf_s(buffer + len, bufferSize - len, ".%03lld", millis);
+}
+
+//---------------------------------------------------------------
+// Flushes a file all the way to the disk, then closes it, so an
+// index file is complete even if the machine goes down next.
+//---------------------------------------------------------------
+void CloseFlushed(
+    FILE *&fp   // in/out:  File to close; set to nullptr.
+    )
+{
+    if (fp == nullptr)
+        return;
+
+    fflush(fp);
+    _commit(_fileno(fp));
+    fclose(fp);
+    fp = nullptr;
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// One captured frame as it moves from the grab thread through
+// the conversion and writer pools.
+//---------------------------------------------------------------
+struct CaptureSession::Frame
+{
+    unsigned m_number = 0;              // Frame number within the session.
+    std::vector<unsigned char> m_raw;   // Frame in the device's native format.
+    std::vector<unsigned char> m_bgra;  // Frame converted to 32-bit BGRA.
+    ImagePyramid m_pyramid;             // Halved copies of m_bgra, shared by the renditions.
+    FrameTimestamp m_timestamp;         // When the frame was captured and dequeued.
+    Clock::time_point m_convertTime;    // When the frame finished converting.
+    Clock::time_point m_writeTime;      // When the frame's last rendition was written.
+    std::atomic<unsigned> m_renditionsLeft{0};  // Renditions not yet written.
+    std::atomic<bool> m_writeFailed{false};     // Set if any rendition failed to write.
+};
+
+//---------------------------------------------------------------
+// The state and statistics of one camera in the session.
+//---------------------------------------------------------------
+struct CaptureSession::Camera
+{
+    unsigned m_id = 0;                  // Position of the camera in the session; used as the pool key.
+    unsigned m_deviceIndex = 0;         // Which capture device to grab frames from (0-based).
+    unsigned m_formatIndex = 0;         // Which of the device's formats to use.
+    CameraFrameGrabber m_cam;           // The capture device.
+    FrameStacker m_stacker;             // Stacks bursts of frames, if enabled.
+    FrameComposite m_lighten;           // Lighten-blend composite, if enabled.
+    FrameComposite m_average;           // Average-blend composite, if enabled.
+    std::vector<unsigned char> m_scratch;   // Raw frame buffer for warm-up, stacking, and streaming.
+    FrameRing m_ring;                   // Most recent frames, in sync mode.
+    std::chrono::seconds m_interval{1};     // Time between frames.
+    Clock::time_point m_openTime;       // When the device was opened.
+    Clock::time_point m_startTime;      // When frame 0 was due, or would have been at the current interval.
+    bool m_opened = false;              // True if the device was opened successfully.
+    bool m_stopped = false;             // True once StopCamera() has run.
+    unsigned m_pyramidLevels = 1;       // Pyramid levels the renditions need.
+    std::vector<Resampler> m_resamplers;    // Scaling filter of each rendition, built on opening.
+    FlatField m_flat;                   // Evens out vignetting, if enabled.
+    TemporalFilter m_denoise;           // Smooths frames over time, if enabled.
+    AutoColor m_autoColor;              // Levels and white balance curves, if enabled.
+    std::vector<uint32_t> m_colorSamples;   // Pixels sampled for m_autoColor.
+    std::vector<uint32_t> m_colorSamplePixels;  // Where each sample lands in the converted frame.
+    Remapper m_remap;                   // Corrects lens distortion and perspective, if enabled.
+    std::vector<unsigned char> m_remapSource;   // Converted frame before correction.
+    Stabilizer m_stabilizer;            // Removes camera shake, if enabled.
+    std::vector<unsigned char> m_stabilizeSource;   // Corrected frame before stabilizing.
+    TextOverlay m_stamp;                // Burns the timestamp into frames, if enabled.
+    FrameShareWriter m_share;           // Publishes frames to other processes, if enabled.
+    bool m_stampReady = false;          // True if m_stamp was created successfully.
+
+    // Statistics, updated by the grab thread and the pools.
+    std::atomic<unsigned> m_framesGrabbed{0};
+    std::atomic<unsigned> m_grabFailures{0};
+    std::atomic<unsigned> m_framesConverted{0};
+    std::atomic<unsigned> m_convertFailures{0};
+    std::atomic<unsigned> m_framesWritten{0};   // Frames with every rendition written.
+    std::atomic<unsigned> m_filesWritten{0};
+    std::atomic<unsigned> m_writeFailures{0};   // Rendition files that failed to write.
+    std::atomic<unsigned> m_framesDiscarded{0}; // Frames dropped when the drain timed out.
+    std::atomic<long long> m_convertMicros{0};
+    std::atomic<long long> m_writeMicros{0};
+    std::atomic<unsigned> m_intervalSeconds{1}; // Copy of m_interval for the control thread.
+    long long m_lateMicros = 0;         // Total time grabs started after their deadlines.
+    long long m_maxLateMicros = 0;      // Longest time a grab started after its deadline.
+    double m_firstFrameMs = -1.0;       // Time from Open() to the first good frame.
+
+    // Per-frame latency statistics, updated by the writer pool
+    // under m_metadataLock, as each frame's last rendition is
+    // written.
+    std::mutex m_metadataLock;
+    FILE *m_metadata = nullptr;         // Per-frame timestamps and latencies, one CSV line per frame.
+    long long m_dequeueLatencyMicros = 0;   // Total time from capture to dequeue.
+    long long m_convertLatencyMicros = 0;   // Total time from dequeue to converted.
+    long long m_writeLatencyMicros = 0;     // Total time from converted to written.
+    long long m_maxLatencyMicros = 0;       // Longest time from capture to written.
+    unsigned m_capturesTimed = 0;           // Frames whose device reported a capture time.
+    unsigned m_metadataSegment = 0;         // Segment m_metadata belongs to.
+
+    // Control requests, set by the control thread and applied by
+    // ControlTask() on the grab pool.
+    std::atomic<bool> m_pauseRequested{false};
+    std::atomic<bool> m_captureRequested{false};
+    std::atomic<unsigned> m_intervalRequested{0};   // New interval in seconds (0 = no change).
+
+    // Scheduling state, used only by the camera's own tasks on the
+    // grab pool.
+    unsigned m_nextFrame = 0;           // Next frame to capture.
+    unsigned m_generation = 0;          // Bumped to cancel the pending resume or grab task.
+    bool m_paused = false;              // True while no frame is scheduled because of a pause.
+
+    ~Camera()
+    {
+        if (m_metadata != nullptr)
+            fclose(m_metadata);
+    }
+};
+
+//---------------------------------------------------------------
+CaptureSession::CaptureSession(const CaptureSettings &settings)
+    : m_settings(settings)
+{
+    m_stoppedEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+    // Without any renditions, write full-size .BMP files.
+    if (m_settings.m_renditions.empty())
+        m_settings.m_renditions.push_back(RenditionSpec());
+}
+
+//---------------------------------------------------------------
+CaptureSession::~CaptureSession()
+{
+    // Commands schedule tasks, so the control server has to stop
+    // before the scheduler.
+    m_control.reset();
+
+    Abort();
+    {
+        std::unique_lock<std::mutex> lock(m_doneLock);
+        m_done.wait(lock, [this]() { return m_running == 0; });
+    }
+
+    // Conversion feeds the writers, so it has to drain first.
+    if (m_convertPool)
+        m_convertPool->WaitIdle();
+    if (m_writePool)
+        m_writePool->WaitIdle();
+
+    // The scheduler has to stop before the grab pool it feeds.
+    m_scheduler.reset();
+    m_grabPool.reset();
+
+    if (m_setsFile != nullptr)
+        fclose(m_setsFile);
+    if (m_stoppedEvent != nullptr)
+        CloseHandle(m_stoppedEvent);
+
+    if (m_mtaCookie != nullptr)
+        CoDecrementMTAUsage(static_cast<CO_MTA_USAGE_COOKIE>(m_mtaCookie));
+
+    // Every thread that logs has stopped.
+    Logger::Get().Stop();
+}
+
+//---------------------------------------------------------------
+// Starts capturing from every camera in the background.
+// Returns false if the settings name no cameras.
+//---------------------------------------------------------------
+bool CaptureSession::Start()
+{
+    if (m_settings.m_deviceIndices.empty())
+        return false;
+
+    // Everything after this logs through the logger's thread.
+    {
+        std::string errText;
+        if (!Logger::Get().Start(m_settings.m_logLevel, m_settings.m_logPath, errText))
+        {
+            printf("Failed opening the log file!\n");
+            printf("  Error Text:  %s\n", errText.c_str());
+            return false;
+        }
+    }
+
+    // Load the color grading table once for every camera.
+    if (!m_settings.m_lutPath.empty())
+    {
+        std::string errText;
+        m_lut.reset(new ColorLut);
+        if (!m_lut->Load(m_settings.m_lutPath.c_str(), errText))
+        {
+            Logger::Get().Log(LL_ERROR, "Failed loading the color lookup table!\n  Error Text:  %s", errText);
+            return false;
+        }
+        if (m_lut->Is3D())
+        {
+            Logger::Get().Log(LL_INFO, "Loaded %ux%ux%u color lookup table%s.",
+                m_lut->GetSize(), m_lut->GetSize(), m_lut->GetSize(),
+                m_lut->IsSeparable() ? " (separable; using per-channel curves)" : "");
+        }
+        else
+        {
+            Logger::Get().Log(LL_INFO, "Loaded %u-entry 1D color lookup table.", m_lut->GetSize());
+        }
+    }
+
+    // Find the rendition to preview.
+    if (m_settings.m_previewPort != 0)
+    {
+        m_previewRendition = 0;
+        if (!m_settings.m_previewRendition.empty())
+        {
+            m_previewRendition = static_cast<unsigned>(m_settings.m_renditions.size());
+            for (unsigned r = 0; r < m_settings.m_renditions.size(); r++)
+            {
+                if (_stricmp(m_settings.m_renditions[r].m_name.c_str(), m_settings.m_previewRendition.c_str()) == 0)
+                    m_previewRendition = r;
+            }
+            if (m_previewRendition == m_settings.m_renditions.size())
+            {
+                Logger::Get().Log(LL_ERROR, "No rendition is named \"%s\" to preview!",
+                    m_settings.m_previewRendition.c_str());
+                return false;
+            }
+        }
+    }
+
+    // The pool threads use Media Foundation without initializing
+    // COM themselves, so keep the process's multithreaded apartment
+    // alive for them.
+    CO_MTA_USAGE_COOKIE cookie = nullptr;
+    if (SUCCEEDED(CoIncrementMTAUsage(&cookie)))
+        m_mtaCookie = cookie;
+
+    const unsigned numCameras = static_cast<unsigned>(m_settings.m_deviceIndices.size());
+    const unsigned numCpus = __max(1u, std::thread::hardware_concurrency());
+
+    // Grab tasks mostly wait on their devices, so the grab pool can
+    // have more threads than there are CPUs, but it needs no more
+    // than one per camera.
+    // In sync mode every camera streams continuously and keeps a
+    // thread busy, and the sync task needs one more.
+    unsigned grabThreads = m_settings.m_grabThreads;
+    if (grabThreads == 0)
+        grabThreads = __min(numCameras, __max(8u, numCpus * 2));
+    if (m_settings.m_syncMode)
+        grabThreads = __max(grabThreads, numCameras + 1);
+    unsigned convertThreads = m_settings.m_convertThreads;
+    if (convertThreads == 0)
+        convertThreads = numCpus;
+
+    // Helpers share out the work of the stages that split a single
+    // frame:  remapping, grading, and scaling.
+    unsigned helperThreads = __max(m_settings.m_scaleThreads, __max(m_settings.m_remapThreads, m_settings.m_lutThreads));
+    if (helperThreads > 1)
+        m_helperPool.reset(new WorkerPool(__min(numCpus, (helperThreads - 1) * numCameras)));
+
+    m_convertPool.reset(new WorkerPool(convertThreads));
+    m_writePool.reset(new WorkerPool(m_settings.m_writeThreads));
+    m_grabPool.reset(new WorkerPool(grabThreads));
+    m_scheduler.reset(new CaptureScheduler(*m_grabPool));
+
+    if (m_settings.m_previewPort != 0)
+    {
+        std::string errText;
+        m_preview.reset(new PreviewServer);
+        if (!m_preview->Start(m_settings.m_previewPort, numCameras,
+                m_settings.m_renditions[m_previewRendition].m_quality, errText))
+        {
+            Logger::Get().Log(LL_ERROR, "Failed starting the preview server!\n  Error Text:  %s", errText);
+            m_preview.reset();
+            return false;
+        }
+        Logger::Get().Log(LL_INFO, "Serving live preview at http://localhost:%u/", m_settings.m_previewPort);
+    }
+
+    for (const auto &spec : m_settings.m_renditions)
+    {
+        if (!spec.m_directory.empty())
+            CreateDirectoryA(spec.m_directory.c_str(), nullptr);
+    }
+
+    for (unsigned i = 0; i < numCameras; i++)
+    {
+        std::unique_ptr<Camera> camera(new Camera);
+        camera->m_id = i;
+        camera->m_deviceIndex = m_settings.m_deviceIndices[i];
+        camera->m_formatIndex = m_settings.GetFormatIndex(i);
+        camera->m_interval = std::chrono::seconds(m_settings.GetSecondsBetweenFrames(i));
+        camera->m_intervalSeconds = m_settings.GetSecondsBetweenFrames(i);
+        camera->m_ring.Reset(m_settings.m_syncRingFrames);
+        m_cameras.push_back(std::move(camera));
+    }
+
+    // The devices are opened in parallel on the grab pool.
+    m_running = numCameras;
+    m_opensPending = numCameras;
+    const auto now = Clock::now();
+    m_epoch = now;
+    for (auto &camera : m_cameras)
+    {
+        Camera *pCamera = camera.get();
+        m_scheduler->Schedule(now, pCamera->m_id, [this, pCamera]() { OpenTask(*pCamera); });
+    }
+
+    // The control server starts last, so every camera's control
+    // tasks are scheduled after its open task.
+    if (!m_settings.m_controlPath.empty())
+    {
+        std::string errText;
+        m_control.reset(new ControlServer);
+        if (!m_control->Start(m_settings.m_controlPath.c_str(),
+                [this](const std::string &command, std::string &reply, std::string &errText)
+                { return HandleCommand(command, reply, errText); }, errText))
+        {
+            Logger::Get().Log(LL_ERROR, "Failed starting the control server!\n  Error Text:  %s", errText);
+            m_control.reset();
+            Abort();
+            return false;
+        }
+        Logger::Get().Log(LL_INFO, "Accepting control commands on \"%s\"", m_settings.m_controlPath.c_str());
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------
+// Asks every camera to stop before its next frame.  Pending
+// tasks are run right away, so cameras waiting for a distant
+// deadline stop promptly.  Paused cameras have no task pending,
+// so each camera also gets a control task to notice the abort.
+//---------------------------------------------------------------
+void CaptureSession::Abort()
+{
+    m_abort = true;
+    if (m_scheduler)
+    {
+        const auto now = Clock::now();
+        for (auto &camera : m_cameras)
+        {
+            Camera *pCamera = camera.get();
+            m_scheduler->Schedule(now, pCamera->m_id, [this, pCamera]() { ControlTask(*pCamera); });
+        }
+        m_scheduler->DispatchAllNow();
+    }
+}
+
+//---------------------------------------------------------------
+// Opens a camera's device, lets its exposure settle, and sets up
+// its composites.  Returns true if successful.
+//---------------------------------------------------------------
+bool CaptureSession::OpenCamera(Camera &camera)
+{
+    Logger::Get().Log(LL_INFO, "Opening capture device %u in capture format %u.",
+        camera.m_deviceIndex + 1, camera.m_formatIndex);
+
+    // Rotate and mirror frames, and hide their privacy regions, as
+    // they are converted.  The mask is compiled by Open().
+    std::vector<PrivacyRegion> regions;
+    for (const PrivacyRegion &region : m_settings.m_privacyRegions)
+    {
+        if (region.m_deviceIndex < 0 || static_cast<unsigned>(region.m_deviceIndex) == camera.m_deviceIndex)
+            regions.push_back(region);
+    }
+    camera.m_cam.SetOrientation(m_settings.GetOrientation(camera.m_id));
+    camera.m_cam.SetPrivacyMask(regions, m_settings.m_maskColor, m_settings.m_maskPixelateSize);
+
+    if (!camera.m_cam.Open(camera.m_deviceIndex, camera.m_formatIndex))
+    {
+        Logger::Get().Log(LL_ERROR, "Failed opening capture device %u!", camera.m_deviceIndex + 1);
+        return false;
+    }
+
+    Logger::Get().Log(LL_INFO, "Capture device %u opened.", camera.m_deviceIndex + 1);
+
+    // Let the device's exposure settle before capturing.
+    if (m_settings.m_warmUpFrames > 0)
+    {
+        unsigned discarded = WarmUpCamera(camera);
+        Logger::Get().Log(LL_INFO, "Camera %u:  Discarded %u warm-up frame(s).",
+            camera.m_deviceIndex + 1, discarded);
+    }
+
+    // Build the geometric correction table once, now that the
+    // frame size is known.
+    CameraFrameGrabber &cam = camera.m_cam;
+    const LensModel *lens = nullptr;
+    for (const LensModel &model : m_settings.m_lensModels)
+    {
+        if (model.m_deviceIndex < 0 ? lens == nullptr :
+            static_cast<unsigned>(model.m_deviceIndex) == camera.m_deviceIndex)
+            lens = &model;
+    }
+    const Homography *homography = nullptr;
+    for (const Homography &transform : m_settings.m_homographies)
+    {
+        if (transform.m_deviceIndex < 0 ? homography == nullptr :
+            static_cast<unsigned>(transform.m_deviceIndex) == camera.m_deviceIndex)
+            homography = &transform;
+    }
+    if ((lens != nullptr || homography != nullptr) && camera.m_remap.IsEmpty())
+    {
+        std::string errText;
+        if (!camera.m_remap.Init(cam.GetWidth(), cam.GetHeight(), cam.GetStride(),
+                lens, homography, m_settings.m_remapFilter, errText))
+        {
+            Logger::Get().Log(LL_ERROR, "Camera %u:  Failed building the geometric correction!\n  Error Text:  %s",
+                camera.m_deviceIndex + 1, errText);
+            return false;
+        }
+    }
+
+    // Load the flat-field calibration for this camera.
+    if (!m_settings.m_flatFieldPath.empty() && camera.m_flat.IsEmpty())
+    {
+        std::string errText;
+        std::string path = GetCameraPath(camera, m_settings.m_flatFieldPath);
+        if (!camera.m_flat.Load(path.c_str(), cam.GetWidth(), cam.GetHeight(), m_settings.m_flatFieldGrid, errText))
+        {
+            Logger::Get().Log(LL_ERROR, "Camera %u:  Failed loading the flat-field image!\n  Error Text:  %s",
+                camera.m_deviceIndex + 1, errText);
+            return false;
+        }
+    }
+
+    // Set up the temporal noise filter, in the device's native
+    // format or on the converted frames.
+    if (m_settings.m_denoiseStrength > 1 && !camera.m_denoise.IsEnabled())
+    {
+        bool ok = m_settings.m_denoiseNative ?
+            camera.m_denoise.Init(cam.GetRawFrameSize(), 1, m_settings.m_denoiseStrength, m_settings.m_denoiseThreshold) :
+            camera.m_denoise.Init(static_cast<size_t>(cam.GetStride()) * cam.GetHeight(), 4,
+                m_settings.m_denoiseStrength, m_settings.m_denoiseThreshold);
+        if (!ok)
+            Logger::Get().Log(LL_WARNING, "Camera %u:  Temporal noise filter disabled; bad settings!",
+                camera.m_deviceIndex + 1);
+    }
+
+    // Set up auto-levels and white balance.
+    if ((m_settings.m_autoLevels || m_settings.m_autoWhiteBalance) && !camera.m_autoColor.IsEnabled())
+    {
+        if (!camera.m_autoColor.Init(m_settings.m_autoLevels, m_settings.m_autoWhiteBalance,
+                m_settings.m_autoColorSmoothing))
+        {
+            Logger::Get().Log(LL_WARNING, "Camera %u:  Auto color disabled; bad settings!",
+                camera.m_deviceIndex + 1);
+        }
+    }
+
+    // Set up stabilization.
+    if (m_settings.m_stabilizeMargin > 0 && !camera.m_stabilizer.IsEnabled())
+    {
+        std::string errText;
+        if (!camera.m_stabilizer.Init(cam.GetWidth(), cam.GetHeight(), m_settings.m_stabilizeMargin,
+                m_settings.m_stabilizeSmoothing, errText))
+        {
+            Logger::Get().Log(LL_WARNING, "Camera %u:  Stabilization disabled!\n  Error Text:  %s",
+                camera.m_deviceIndex + 1, errText);
+        }
+    }
+
+    // Set up the shared-memory frame ring.
+    if (!m_settings.m_shareName.empty() && !camera.m_share.IsOpen())
+    {
+        std::string errText;
+        std::string name = GetCameraPath(camera, m_settings.m_shareName);
+        if (camera.m_share.Create(name.c_str(), m_settings.m_shareSlots,
+                static_cast<size_t>(cam.GetStride()) * cam.GetHeight(), errText))
+        {
+            Logger::Get().Log(LL_INFO, "Camera %u:  Publishing frames to shared memory \"%s\".",
+                camera.m_deviceIndex + 1, name.c_str());
+        }
+        else
+        {
+            Logger::Get().Log(LL_WARNING, "Camera %u:  Frame sharing disabled!\n  Error Text:  %s",
+                camera.m_deviceIndex + 1, errText);
+        }
+    }
+
+    // Set up the session composites, if requested.
+    if (!m_settings.m_lightenPath.empty())
+        camera.m_lighten.Begin(cam.GetWidth(), cam.GetHeight(), CM_LIGHTEN);
+    if (!m_settings.m_averagePath.empty())
+        camera.m_average.Begin(cam.GetWidth(), cam.GetHeight(), CM_AVERAGE);
+
+    // Work out how deep a pyramid the renditions can use, and
+    // precompute their scaling filters.
+    camera.m_pyramidLevels = 1;
+    camera.m_resamplers.resize(m_settings.m_renditions.size());
+    for (size_t r = 0; r < m_settings.m_renditions.size(); r++)
+    {
+        const RenditionSpec &spec = m_settings.m_renditions[r];
+        camera.m_pyramidLevels = __max(camera.m_pyramidLevels,
+            GetRenditionPyramidLevels(spec, cam.GetWidth(), cam.GetHeight()));
+        PrepareRendition(spec, cam.GetWidth(), cam.GetHeight(), camera.m_resamplers[r]);
+    }
+
+    // Rasterize the timestamp font once, scaled to the frame.
+    if (m_settings.m_stamp && !camera.m_stampReady)
+    {
+        unsigned textHeight = m_settings.m_stampHeight;
+        if (textHeight == 0)
+            textHeight = __max(12u, cam.GetHeight() / 30);
+        std::string errText;
+        camera.m_stampReady = camera.m_stamp.Create(textHeight, errText);
+        if (!camera.m_stampReady)
+        {
+            Logger::Get().Log(LL_WARNING,
+                "Camera %u:  Timestamps disabled; failed creating the font!\n  Error Text:  %s",
+                camera.m_deviceIndex + 1, errText);
+        }
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------
+// Discards frames from a newly opened or resumed device until
+// its automatic exposure settles, i.e. until two consecutive
+// non-blank frames have about the same brightness, or until
+// m_warmUpFrames frames have been discarded.  Returns the
+// number of frames discarded.
+//---------------------------------------------------------------
+unsigned CaptureSession::WarmUpCamera(Camera &camera)
+{
+    CameraFrameGrabber &cam = camera.m_cam;
+    FrameStats prev, cur;
+    bool havePrev = false;
+    unsigned discarded = 0;
+    while (discarded < m_settings.m_warmUpFrames && !m_abort)
+    {
+        // The raw frame is good enough to judge the brightness, so
+        // warm-up frames never need converting.
+        std::string errText;
+        if (cam.GrabRawFrame(camera.m_scratch, errText) &&
+            SampleRawFrameStats(camera.m_scratch.data(), camera.m_scratch.size(), cam.GetCaptureFormat(), cur) &&
+            !IsFrameBlank(cur))
+        {
+            if (havePrev && IsExposureSettled(prev, cur))
+                break;
+            prev = cur;
+            havePrev = true;
+        }
+        else
+        {
+            havePrev = false;
+        }
+
+        ++discarded;
+    }
+
+    return discarded;
+}
+
+//---------------------------------------------------------------
+// Restarts a suspended capture device ahead of the next frame,
+// waits for its exposure to settle again, and reports how long
+// that took.  Falls back to reopening the device if the fast
+// resume fails.  Returns true if successful.
+//---------------------------------------------------------------
+bool CaptureSession::ResumeCamera(Camera &camera)
+{
+    CameraFrameGrabber &cam = camera.m_cam;
+
+    auto t0 = Clock::now();
+    if (!cam.Resume())
+    {
+        Logger::Get().Log(LL_WARNING, "Camera %u:  Fast resume failed; reopening capture device.",
+            camera.m_deviceIndex + 1);
+        if (!cam.Open(camera.m_deviceIndex, camera.m_formatIndex))
+        {
+            Logger::Get().Log(LL_ERROR, "Camera %u:  Failed reopening capture device!", camera.m_deviceIndex + 1);
+            return false;
+        }
+    }
+
+    auto t1 = Clock::now();
+    unsigned discarded = WarmUpCamera(camera);
+    auto t2 = Clock::now();
+
+    Logger::Get().Log(LL_INFO, "Camera %u:  Resumed in %.0f ms (stream %.0f ms, warm-up %u frame(s) %.0f ms).",
+        camera.m_deviceIndex + 1, Ms(t2 - t0).count(), Ms(t1 - t0).count(), discarded, Ms(t2 - t1).count());
+    return true;
+}
+
+//---------------------------------------------------------------
+// Captures a burst of m_stackCount consecutive frames and stacks
+// them into one lower-noise frame.  The frames are stacked in the
+// device's native pixel format, so only the stacked result needs
+// converting.  The frame takes the timestamps of the first frame
+// in the burst.  Returns true if successful.
+//---------------------------------------------------------------
+bool CaptureSession::GrabStackedFrame(Camera &camera, Frame &frame, std::string &errText)
+{
+    CameraFrameGrabber &cam = camera.m_cam;
+    FrameStacker &stacker = camera.m_stacker;
+
+    size_t rawSize = cam.GetRawFrameSize();
+    if (!stacker.Begin(rawSize, m_settings.m_stackCount, m_settings.m_stackMode))
+    {
+        errText = "Invalid stacking parameters.";
+        return false;
+    }
+
+    // Time the grabbing and the stacking separately, so the cost
+    // of each extra frame in the burst can be reported.
+    Clock::duration grabTime(0), stackTime(0);
+    for (unsigned i = 0; i < m_settings.m_stackCount; i++)
+    {
+        auto t0 = Clock::now();
+        if (!cam.GrabRawFrame(camera.m_scratch, errText))
+        {
+            Logger::Get().Log(LL_WARNING, "Camera %u:  Skipping frame %u of stack:  %s",
+                camera.m_deviceIndex + 1, i + 1, errText.c_str());
+            continue;
+        }
+
+        auto t1 = Clock::now();
+        if (stacker.GetFrameCount() == 0)
+            frame.m_timestamp = cam.GetFrameTimestamp();
+        stacker.AddFrame(camera.m_scratch.data(), camera.m_scratch.size());
+        grabTime += t1 - t0;
+        stackTime += Clock::now() - t1;
+    }
+
+    if (stacker.GetFrameCount() < 1)
+    {
+        errText = "No frames captured for stack.";
+        return false;
+    }
+
+    auto t0 = Clock::now();
+    frame.m_raw.resize(rawSize);
+    if (!stacker.Finish(frame.m_raw.data(), frame.m_raw.size()))
+    {
+        errText = "Stacking failed.";
+        return false;
+    }
+    stackTime += Clock::now() - t0;
+
+    unsigned count = stacker.GetFrameCount();
+    Logger::Get().Log(LL_INFO, "Camera %u:  Stacked %u frames:  grab %.1f ms/frame, stack %.2f ms/frame.",
+        camera.m_deviceIndex + 1, count, Ms(grabTime).count() / count, Ms(stackTime).count() / count);
+    return true;
+}
+
+//---------------------------------------------------------------
+// Captures a frame (or a stack of frames) into 'frame', retrying
+// up to m_grabRetries times if the device drops the frame or
+// delivers a black or uniform frame.  Returns false if no usable
+// frame could be captured.
+//---------------------------------------------------------------
+bool CaptureSession::GrabGoodFrame(Camera &camera, Frame &frame, std::string &errText)
+{
+    CameraFrameGrabber &cam = camera.m_cam;
+    std::vector<unsigned char> &raw = frame.m_raw;
+    for (unsigned attempt = 0; attempt <= m_settings.m_grabRetries; attempt++)
+    {
+        bool grabbed = false;
+        if (m_settings.m_stackCount > 1)
+        {
+            grabbed = GrabStackedFrame(camera, frame, errText);
+        }
+        else
+        {
+            grabbed = cam.GrabRawFrame(raw, errText);
+            frame.m_timestamp = cam.GetFrameTimestamp();
+        }
+        if (!grabbed)
+        {
+            // Dropped frames are worth retrying, other errors aren't.
+            if (m_settings.m_stackCount > 1 || cam.WasFrameDropped())
+                continue;
+            return false;
+        }
+
+        FrameStats stats;
+        if (SampleRawFrameStats(raw.data(), raw.size(), cam.GetCaptureFormat(), stats) &&
+            IsFrameBlank(stats))
+        {
+            errText = "Frame is black or uniform.";
+            continue;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+//---------------------------------------------------------------
+// Runs on the grab pool.  Opens a camera's device, then schedules
+// its first frame.
+//---------------------------------------------------------------
+void CaptureSession::OpenTask(Camera &camera)
+{
+    camera.m_openTime = Clock::now();
+    if (m_abort || !OpenCamera(camera))
+    {
+        StopCamera(camera);
+        if (--m_opensPending == 0 && m_settings.m_syncMode)
+            StartSync();
+        return;
+    }
+
+    // In sync mode, the camera streams until the last set is taken,
+    // and the sets are scheduled once every camera is streaming.
+    if (m_settings.m_syncMode)
+    {
+        camera.m_opened = true;
+        StreamTask(camera);
+        if (--m_opensPending == 0)
+            StartSync();
+        return;
+    }
+
+    // Frames are scheduled at fixed offsets from the start of the
+    // session, so the time spent capturing doesn't add up as drift.
+    camera.m_opened = true;
+    camera.m_startTime = Clock::now();
+    ScheduleFrame(camera, 0);
+}
+
+//---------------------------------------------------------------
+// Schedules the task that captures frame 'iframe'.  If the device
+// was stopped to save power, a resume task is scheduled early
+// enough that the device has warmed up when the frame is due.
+// Stops the camera once every frame has been captured, and
+// schedules nothing while it is paused.
+//---------------------------------------------------------------
+void CaptureSession::ScheduleFrame(Camera &camera, unsigned iframe)
+{
+    if (iframe >= m_settings.m_numFramesToGrab || m_abort)
+    {
+        StopCamera(camera);
+        return;
+    }
+
+    camera.m_nextFrame = iframe;
+    if (camera.m_pauseRequested)
+    {
+        if (!camera.m_paused)
+            PauseCamera(camera);
+        return;
+    }
+
+    // The tasks are tagged with the camera's generation, so a
+    // control task can cancel them by bumping it.
+    const auto deadline = camera.m_startTime + camera.m_interval * iframe;
+    const unsigned generation = camera.m_generation;
+    Camera *pCamera = &camera;
+    if (camera.m_cam.IsSuspended())
+    {
+        const std::chrono::seconds resumeLead(m_settings.m_resumeLeadSeconds);
+        m_scheduler->Schedule(deadline - resumeLead, camera.m_id,
+            [this, pCamera, iframe, generation]() { ResumeTask(*pCamera, iframe, generation); });
+    }
+    else
+    {
+        m_scheduler->Schedule(deadline, camera.m_id,
+            [this, pCamera, iframe, generation]() { GrabTask(*pCamera, iframe, generation); });
+    }
+}
+
+//---------------------------------------------------------------
+// Runs on the grab pool.  Restarts a suspended device ahead of
+// frame 'iframe', then schedules the frame.  Does nothing if a
+// control task has cancelled it.
+//---------------------------------------------------------------
+void CaptureSession::ResumeTask(Camera &camera, unsigned iframe, unsigned generation)
+{
+    if (generation != camera.m_generation)
+        return;
+
+    if (m_abort || !ResumeCamera(camera))
+    {
+        StopCamera(camera);
+        return;
+    }
+
+    ScheduleFrame(camera, iframe);
+}
+
+//---------------------------------------------------------------
+// Runs on the grab pool.  Grabs frame 'iframe', hands it to the
+// conversion pool, and schedules the next frame.  Does nothing if
+// a control task has cancelled it.
+//---------------------------------------------------------------
+void CaptureSession::GrabTask(Camera &camera, unsigned iframe, unsigned generation)
+{
+    if (generation != camera.m_generation)
+        return;
+
+    if (m_abort)
+    {
+        StopCamera(camera);
+        return;
+    }
+
+    CameraFrameGrabber &cam = camera.m_cam;
+    const unsigned label = camera.m_deviceIndex + 1;
+
+    // Track how late the grab starts, to show whether the grab pool
+    // is keeping up with the cameras.
+    const auto deadline = camera.m_startTime + camera.m_interval * iframe;
+    long long lateMicros = __max(0LL, MicrosBetween(deadline, Clock::now()));
+    camera.m_lateMicros += lateMicros;
+    camera.m_maxLateMicros = __max(camera.m_maxLateMicros, lateMicros);
+
+    std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+    frame->m_number = iframe;
+
+    std::string errText;
+    if (GrabGoodFrame(camera, *frame, errText))
+    {
+        ++camera.m_framesGrabbed;
+        if (camera.m_firstFrameMs < 0.0)
+        {
+            camera.m_firstFrameMs = Ms(Clock::now() - camera.m_openTime).count();
+            Logger::Get().Log(LL_INFO, "Camera %u:  Time to first good frame:  %.0f ms",
+                label, camera.m_firstFrameMs);
+        }
+
+        m_convertPool->Submit(camera.m_id, [this, &camera, frame]() { ConvertFrame(camera, frame); });
+    }
+    else
+    {
+        ++camera.m_grabFailures;
+        Logger::Get().Log(LL_ERROR, "Camera %u:  Failed capturing frame!\n  Error Text:  %s", label, errText);
+    }
+
+    // Stop the device's stream if the next frame is far enough
+    // away that restarting it is worth the trouble.
+    const std::chrono::seconds resumeLead(m_settings.m_resumeLeadSeconds);
+    if (m_settings.m_powerSave && iframe + 1 < m_settings.m_numFramesToGrab &&
+        deadline + camera.m_interval - Clock::now() > resumeLead * 2)
+    {
+        if (cam.Suspend())
+            Logger::Get().Log(LL_INFO, "Camera %u:  Capture device suspended until next frame.", label);
+    }
+
+    ScheduleFrame(camera, iframe + 1);
+}
+
+//---------------------------------------------------------------
+// Closes a camera's device once it has finished capturing, and
+// lets Finish() know.
+//---------------------------------------------------------------
+void CaptureSession::StopCamera(Camera &camera)
+{
+    camera.m_stopped = true;
+    if (camera.m_opened)
+    {
+        Logger::Get().Log(LL_INFO, "Closing capture device %u.", camera.m_deviceIndex + 1);
+        camera.m_cam.Close();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_doneLock);
+        if (--m_running == 0 && m_stoppedEvent != nullptr)
+            SetEvent(m_stoppedEvent);
+    }
+    m_done.notify_all();
+}
+
+//---------------------------------------------------------------
+// Runs on the grab pool, between the camera's other tasks.
+// Applies the control requests the control thread has left on
+// the camera, rescheduling its next frame to suit.  Also stops a
+// paused camera once the session is aborted.
+//---------------------------------------------------------------
+void CaptureSession::ControlTask(Camera &camera)
+{
+    if (camera.m_stopped || !camera.m_opened || m_settings.m_syncMode)
+        return;
+    if (m_abort)
+    {
+        // A camera that isn't paused has a task pending that will
+        // stop it.
+        if (camera.m_paused)
+            StopCamera(camera);
+        return;
+    }
+
+    const unsigned label = camera.m_deviceIndex + 1;
+    const auto now = Clock::now();
+    bool reschedule = false;
+
+    // Frames already taken keep their times; the next one is due
+    // the new interval after the last one (or now, if that has
+    // passed), and the rest follow at the new interval.
+    const unsigned seconds = camera.m_intervalRequested.exchange(0);
+    if (seconds != 0 && std::chrono::seconds(seconds) != camera.m_interval)
+    {
+        const std::chrono::seconds interval(seconds);
+        auto next = camera.m_startTime;
+        if (camera.m_nextFrame > 0)
+            next = __max(now, camera.m_startTime + camera.m_interval * (camera.m_nextFrame - 1) + interval);
+        camera.m_interval = interval;
+        camera.m_intervalSeconds = seconds;
+        camera.m_startTime = next - interval * camera.m_nextFrame;
+        reschedule = true;
+        Logger::Get().Log(LL_INFO, "Camera %u:  Interval changed to %u seconds.", label, seconds);
+    }
+
+    const bool pause = camera.m_pauseRequested;
+    if (camera.m_captureRequested.exchange(false))
+    {
+        // Take the next frame now, and space the rest from it.  A
+        // paused camera takes just the one frame and stays paused,
+        // since ScheduleFrame() pauses it again.
+        ++camera.m_generation;
+        camera.m_paused = false;
+        camera.m_startTime = now - camera.m_interval * camera.m_nextFrame;
+        Logger::Get().Log(LL_INFO, "Camera %u:  Capturing frame %u now.", label, camera.m_nextFrame);
+        if (camera.m_cam.IsSuspended() && !ResumeCamera(camera))
+        {
+            StopCamera(camera);
+            return;
+        }
+        GrabTask(camera, camera.m_nextFrame, camera.m_generation);
+        return;
+    }
+
+    if (pause && !camera.m_paused)
+    {
+        // Cancel the pending frame.  ScheduleFrame() won't schedule
+        // another until the camera is resumed.
+        ++camera.m_generation;
+        PauseCamera(camera);
+        return;
+    }
+    if (!pause && camera.m_paused)
+    {
+        // Resume with the next frame due now.
+        camera.m_paused = false;
+        camera.m_startTime = now - camera.m_interval * camera.m_nextFrame;
+        reschedule = true;
+        Logger::Get().Log(LL_INFO, "Camera %u:  Resumed at frame %u.", label, camera.m_nextFrame);
+    }
+
+    if (reschedule && !camera.m_paused)
+    {
+        ++camera.m_generation;
+        ScheduleFrame(camera, camera.m_nextFrame);
+    }
+}
+
+//---------------------------------------------------------------
+// Marks a camera paused, with no frame scheduled, and stops its
+// device's stream if saving power.
+//---------------------------------------------------------------
+void CaptureSession::PauseCamera(Camera &camera)
+{
+    const unsigned label = camera.m_deviceIndex + 1;
+    camera.m_paused = true;
+    Logger::Get().Log(LL_INFO, "Camera %u:  Paused before frame %u.", label, camera.m_nextFrame);
+    if (m_settings.m_powerSave && !camera.m_cam.IsSuspended() && camera.m_cam.Suspend())
+        Logger::Get().Log(LL_INFO, "Camera %u:  Capture device suspended until resumed.", label);
+}
+
+//---------------------------------------------------------------
+// Runs on the control server's thread.  Carries out one control
+// command.  Changes to a camera are only left on the camera as
+// atomic requests, with a control task scheduled right away to
+// apply them, so the command never waits on the camera.  Returns
+// false if the command isn't understood.
+//---------------------------------------------------------------
+bool CaptureSession::HandleCommand(const std::string &command, std::string &reply, std::string &errText)
+{
+    char verb[16] = {0};
+    char arg1[32] = {0};
+    char arg2[32] = {0};
+    int numArgs = sscanf_s(command.c_str(), "%15s %31s %31s", verb, static_cast<unsigned>(_countof(verb)),
+        arg1, static_cast<unsigned>(_countof(arg1)), arg2, static_cast<unsigned>(_countof(arg2))) - 1;
+
+    if (_stricmp(verb, "help") == 0)
+    {
+        reply = "capture [camera]       Take the next frame now.\n"
+            "interval x [camera]    Set the seconds between frames.\n"
+            "pause [camera]         Stop taking frames.\n"
+            "resume [camera]        Start taking frames again, the next one now.\n"
+            "rotate                 Start a new segment of the metadata files.\n"
+            "stats                  List the statistics so far.\n"
+            "quit                   Close the connection.\n";
+        return true;
+    }
+    if (_stricmp(verb, "stats") == 0)
+    {
+        reply = GetStats();
+        return true;
+    }
+    if (_stricmp(verb, "rotate") == 0)
+    {
+        // Each camera starts its new metadata file with the next
+        // frame it records.
+        unsigned segment = ++m_segment;
+        char text[64] = {0};
+        sprintf_s(text, _countof(text), "segment=%u", segment + 1);
+        reply = text;
+        Logger::Get().Log(LL_INFO, "Starting metadata segment %u.", segment + 1);
+        return true;
+    }
+
+    bool pause = _stricmp(verb, "pause") == 0;
+    bool resume = _stricmp(verb, "resume") == 0;
+    bool capture = _stricmp(verb, "capture") == 0;
+    bool interval = _stricmp(verb, "interval") == 0;
+    if (!pause && !resume && !capture && !interval)
+    {
+        errText = "Unknown command \"" + std::string(verb) + "\"; try \"help\".";
+        return false;
+    }
+    if (m_settings.m_syncMode)
+    {
+        errText = "Not supported in sync mode.";
+        return false;
+    }
+
+    // "interval" takes the seconds first.  Cameras are named by
+    // the 1-based device number shown in the output; without one,
+    // the command applies to every camera.
+    unsigned seconds = 0;
+    const char *cameraArg = arg1;
+    int cameraArgs = numArgs;
+    if (interval)
+    {
+        seconds = static_cast<unsigned>(atoi(arg1));
+        if (numArgs < 1 || seconds < 1)
+        {
+            errText = "Bad interval.";
+            return false;
+        }
+        cameraArg = arg2;
+        cameraArgs = numArgs - 1;
+    }
+    unsigned label = 0;
+    if (cameraArgs > 0)
+    {
+        label = static_cast<unsigned>(atoi(cameraArg));
+        bool found = false;
+        for (const auto &camera : m_cameras)
+            found = found || camera->m_deviceIndex + 1 == label;
+        if (!found)
+        {
+            errText = "No such camera.";
+            return false;
+        }
+    }
+
+    const auto now = Clock::now();
+    for (auto &camera : m_cameras)
+    {
+        if (label != 0 && camera->m_deviceIndex + 1 != label)
+            continue;
+
+        if (pause || resume)
+            camera->m_pauseRequested = pause;
+        if (capture)
+            camera->m_captureRequested = true;
+        if (interval)
+            camera->m_intervalRequested = seconds;
+
+        Camera *pCamera = camera.get();
+        m_scheduler->Schedule(now, pCamera->m_id, [this, pCamera]() { ControlTask(*pCamera); });
+    }
+    return true;
+}
+
+//---------------------------------------------------------------
+// Runs on the control server's thread.  Returns the statistics so
+// far, one line per camera, as "name=value" pairs.
+//---------------------------------------------------------------
+std::string CaptureSession::GetStats() const
+{
+    std::string stats;
+    char line[512] = {0};
+    sprintf_s(line, _countof(line), "session cameras=%zu running=%u segment=%u elapsed_s=%.1f\n",
+        m_cameras.size(), m_running.load(), m_segment.load() + 1,
+        std::chrono::duration<double>(Clock::now() - m_epoch).count());
+    stats += line;
+
+    for (const auto &pCamera : m_cameras)
+    {
+        const Camera &camera = *pCamera;
+        const unsigned converted = camera.m_framesConverted;
+        const unsigned files = camera.m_filesWritten + camera.m_writeFailures;
+        sprintf_s(line, _countof(line),
+            "camera=%u paused=%d interval_s=%u grabbed=%u grab_failures=%u converted=%u "
+            "convert_failures=%u written=%u files=%u write_failures=%u avg_convert_ms=%.2f avg_file_ms=%.2f\n",
+            camera.m_deviceIndex + 1, camera.m_pauseRequested ? 1 : 0, camera.m_intervalSeconds.load(),
+            camera.m_framesGrabbed.load(), camera.m_grabFailures.load(), converted,
+            camera.m_convertFailures.load(), camera.m_framesWritten.load(), camera.m_filesWritten.load(),
+            camera.m_writeFailures.load(), converted > 0 ? camera.m_convertMicros / 1000.0 / converted : 0.0,
+            files > 0 ? camera.m_writeMicros / 1000.0 / files : 0.0);
+        stats += line;
+    }
+
+    if (m_preview)
+    {
+        sprintf_s(line, _countof(line), "preview encoded=%u sent=%u dropped=%u\n",
+            m_preview->GetFramesEncoded(), m_preview->GetFramesSent(), m_preview->GetFramesDropped());
+        stats += line;
+    }
+    return stats;
+}
+
+//---------------------------------------------------------------
+// Runs on the grab pool in sync mode.  Grabs the camera's next
+// frame into its ring, then schedules itself again right away.
+//---------------------------------------------------------------
+void CaptureSession::StreamTask(Camera &camera)
+{
+    if (m_abort || m_syncDone)
+    {
+        StopCamera(camera);
+        return;
+    }
+
+    CameraFrameGrabber &cam = camera.m_cam;
+    std::string errText;
+    auto next = Clock::now();
+    if (cam.GrabRawFrame(camera.m_scratch, errText))
+    {
+        // Black or uniform frames never reach the ring, so a set
+        // can't pick one; the next grab is the retry.
+        FrameStats stats;
+        if (!SampleRawFrameStats(camera.m_scratch.data(), camera.m_scratch.size(), cam.GetCaptureFormat(), stats) ||
+            !IsFrameBlank(stats))
+        {
+            ++camera.m_framesGrabbed;
+            if (camera.m_firstFrameMs < 0.0)
+                camera.m_firstFrameMs = Ms(Clock::now() - camera.m_openTime).count();
+            camera.m_ring.Push(camera.m_scratch, cam.GetFrameTimestamp());
+        }
+    }
+    else if (!cam.WasFrameDropped())
+    {
+        // Back off a little rather than spinning on a failing device.
+        ++camera.m_grabFailures;
+        Logger::Get().Log(LL_ERROR, "Camera %u:  Failed capturing frame:  %s",
+            camera.m_deviceIndex + 1, errText.c_str());
+        next += std::chrono::milliseconds(100);
+    }
+
+    Camera *pCamera = &camera;
+    m_scheduler->Schedule(next, camera.m_id, [this, pCamera]() { StreamTask(*pCamera); });
+}
+
+//---------------------------------------------------------------
+// Schedules the first set, once every camera has either opened
+// and started streaming or failed to open.
+//---------------------------------------------------------------
+void CaptureSession::StartSync()
+{
+    unsigned opened = 0;
+    for (auto &camera : m_cameras)
+        opened += camera->m_opened ? 1 : 0;
+    if (opened == 0)
+        return;
+
+    m_syncStart = Clock::now();
+    const unsigned syncKey = static_cast<unsigned>(m_cameras.size());
+    m_scheduler->Schedule(m_syncStart + std::chrono::milliseconds(m_settings.m_syncLagMs), syncKey,
+        [this]() { SyncTask(0); });
+}
+
+//---------------------------------------------------------------
+// Runs on the grab pool in sync mode.  Picks the frame from each
+// camera captured closest to the set's reference time, hands the
+// set to the conversion pool, and schedules the next set.  The
+// task runs m_syncLagMs after the reference time, so frames
+// captured just after it have had time to arrive.
+//---------------------------------------------------------------
+void CaptureSession::SyncTask(unsigned iset)
+{
+    if (m_abort)
+    {
+        m_syncDone = true;
+        return;
+    }
+
+    // Every camera shares the first camera's interval in sync mode.
+    const auto interval = m_cameras[0]->m_interval;
+    const auto reference = m_syncStart + interval * iset;
+
+    std::vector<std::shared_ptr<Frame>> frames(m_cameras.size());
+    bool first = true;
+    Clock::time_point earliest, latest;
+    for (size_t i = 0; i < m_cameras.size(); i++)
+    {
+        Camera &camera = *m_cameras[i];
+        if (!camera.m_opened)
+            continue;
+
+        std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+        frame->m_number = iset;
+        if (!camera.m_ring.GetClosest(reference, frame->m_raw, frame->m_timestamp))
+            continue;
+
+        const Clock::time_point captureTime = frame->m_timestamp.m_captureTime;
+        earliest = first ? captureTime : __min(earliest, captureTime);
+        latest = first ? captureTime : __max(latest, captureTime);
+        first = false;
+        frames[i] = frame;
+    }
+
+    // The skew is the spread of the set's capture times.
+    unsigned taken = 0;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        if (!frames[i])
+            continue;
+        Camera *pCamera = m_cameras[i].get();
+        std::shared_ptr<Frame> frame = frames[i];
+        m_convertPool->Submit(pCamera->m_id, [this, pCamera, frame]() { ConvertFrame(*pCamera, frame); });
+        ++taken;
+    }
+
+    long long skew = first ? 0 : MicrosBetween(earliest, latest);
+    ++m_setsTaken;
+    if (taken < m_cameras.size())
+        ++m_setsIncomplete;
+    m_skewMicros += skew;
+    m_maxSkewMicros = __max(m_maxSkewMicros, skew);
+    Logger::Get().Log(LL_INFO, "Set %u:  %u of %zu camera(s), skew %.1f ms.",
+        iset, taken, m_cameras.size(), skew / 1000.0);
+    WriteSetMetadata(iset, reference, frames, skew);
+
+    if (iset + 1 >= m_settings.m_numFramesToGrab)
+    {
+        m_syncDone = true;
+        return;
+    }
+
+    const unsigned syncKey = static_cast<unsigned>(m_cameras.size());
+    m_scheduler->Schedule(reference + interval + std::chrono::milliseconds(m_settings.m_syncLagMs), syncKey,
+        [this, iset]() { SyncTask(iset + 1); });
+}
+
+//---------------------------------------------------------------
+// Logs a set's reference time, each camera's offset from it, and
+// the set's skew to "sets.csv".
+//---------------------------------------------------------------
+void CaptureSession::WriteSetMetadata(unsigned iset, Clock::time_point reference,
+    const std::vector<std::shared_ptr<Frame>> &frames, long long skewMicros)
+{
+    if (m_setsFile == nullptr)
+    {
+        if (fopen_s(&m_setsFile, "sets.csv", "w") != 0 || m_setsFile == nullptr)
+            return;
+
+        fprintf(m_setsFile, "set,reference_ms");
+        for (auto &camera : m_cameras)
+            fprintf(m_setsFile, ",cam%u_offset_ms", camera->m_deviceIndex + 1);
+        fprintf(m_setsFile, ",skew_ms\n");
+    }
+
+    fprintf(m_setsFile, "%u,%.3f", iset, MicrosBetween(m_epoch, reference) / 1000.0);
+    for (auto &frame : frames)
+    {
+        if (frame)
+            fprintf(m_setsFile, ",%.3f", MicrosBetween(reference, frame->m_timestamp.m_captureTime) / 1000.0);
+        else
+            fprintf(m_setsFile, ",");
+    }
+    fprintf(m_setsFile, ",%.3f\n", skewMicros / 1000.0);
+}
+
+//---------------------------------------------------------------
+// Runs on the conversion pool.  Converts a frame to BGRA, blends
+// it into the composites, and hands it to the writer pool.
+//---------------------------------------------------------------
+void CaptureSession::ConvertFrame(Camera &camera, std::shared_ptr<Frame> frame)
+{
+    if (m_discard)
+    {
+        ++camera.m_framesDiscarded;
+        return;
+    }
+
+    CameraFrameGrabber &cam = camera.m_cam;
+    auto t0 = Clock::now();
+
+    std::string errText;
+
+    // Smooth the native frame over time before converting it.
+    size_t rawSize = cam.GetRawFrameSize();
+    if (m_settings.m_denoiseNative && camera.m_denoise.IsEnabled() && frame->m_raw.size() >= rawSize)
+        camera.m_denoise.Apply(frame->m_raw.data(), rawSize);
+
+    // Work out this frame's levels and white balance from a sample
+    // of its pixels, to be applied as it is converted.  A flat-field
+    // changes the levels, so with one the samples are corrected
+    // first and the curves are applied by the flat-field pass.
+    const ColorCurves *curves = nullptr;
+    if (camera.m_autoColor.IsEnabled() &&
+        cam.SampleRawColors(frame->m_raw.data(), frame->m_raw.size(), camera.m_colorSamples,
+            &camera.m_colorSamplePixels))
+    {
+        if (!camera.m_flat.IsEmpty())
+        {
+            const unsigned width = cam.GetWidth();
+            for (size_t i = 0; i < camera.m_colorSamples.size(); i++)
+            {
+                uint32_t pixel = camera.m_colorSamplePixels[i];
+                camera.m_colorSamples[i] = camera.m_flat.CorrectPixel(pixel % width, pixel / width,
+                    camera.m_colorSamples[i]);
+            }
+        }
+        curves = &camera.m_autoColor.Update(camera.m_colorSamples);
+    }
+    const ColorCurves *convertCurves = camera.m_flat.IsEmpty() ? curves : nullptr;
+
+    // With a geometric correction, convert into the camera's
+    // scratch frame and warp from there.
+    frame->m_bgra.resize(static_cast<size_t>(cam.GetStride()) * cam.GetHeight());
+    std::vector<unsigned char> &converted = camera.m_remap.IsEmpty() ? frame->m_bgra : camera.m_remapSource;
+    converted.resize(frame->m_bgra.size());
+    if (!cam.ConvertRawFrame(frame->m_raw.data(), frame->m_raw.size(),
+            converted.data(), converted.size(), errText, convertCurves))
+    {
+        ++camera.m_convertFailures;
+        Logger::Get().Log(LL_ERROR, "Camera %u:  Failed converting frame %u!\n  Error Text:  %s",
+            camera.m_deviceIndex + 1, frame->m_number, errText);
+        return;
+    }
+
+    // The raw frame isn't needed any more.
+    std::vector<unsigned char>().swap(frame->m_raw);
+
+    if (!camera.m_flat.IsEmpty())
+        camera.m_flat.Apply(converted.data(), cam.GetStride(), curves);
+    if (!m_settings.m_denoiseNative && camera.m_denoise.IsEnabled())
+        camera.m_denoise.Apply(converted.data(), converted.size());
+    if (!camera.m_remap.IsEmpty())
+        camera.m_remap.Apply(converted.data(), frame->m_bgra.data(), m_settings.m_remapThreads,
+            m_helperPool.get());
+
+    // Steady the frame, from a copy of the corrected frame.
+    if (camera.m_stabilizer.IsEnabled())
+    {
+        frame->m_bgra.swap(camera.m_stabilizeSource);
+        frame->m_bgra.resize(camera.m_stabilizeSource.size());
+        camera.m_stabilizer.Apply(camera.m_stabilizeSource.data(), frame->m_bgra.data(), cam.GetStride());
+    }
+
+    // Grade the frame before the composites and renditions see it.
+    if (m_lut)
+        m_lut->Apply(frame->m_bgra.data(), cam.GetWidth(), cam.GetHeight(), cam.GetStride(),
+            m_settings.m_lutThreads, m_helperPool.get());
+
+    // Blend the frame into the session composites, and
+    // periodically save a snapshot of them in the background.
+    // Tasks for one camera never run concurrently, so this is
+    // safe without a lock.
+    bool snapshotDue = ((frame->m_number + 1) % m_settings.m_snapshotInterval) == 0;
+    if (!m_settings.m_lightenPath.empty())
+    {
+        camera.m_lighten.AddFrame(frame->m_bgra.data(), frame->m_bgra.size());
+        if (snapshotDue)
+            camera.m_lighten.WriteSnapshotAsync(GetCameraPath(camera, m_settings.m_lightenPath).c_str());
+    }
+    if (!m_settings.m_averagePath.empty())
+    {
+        camera.m_average.AddFrame(frame->m_bgra.data(), frame->m_bgra.size());
+        if (snapshotDue)
+            camera.m_average.WriteSnapshotAsync(GetCameraPath(camera, m_settings.m_averagePath).c_str());
+    }
+
+    // Stamp the frame (after the composites, which would only smear
+    // the text).  The box is in the bottom rows, which conversion
+    // and the composites have just touched, so it is still in cache.
+    if (camera.m_stampReady)
+        StampFrame(camera, *frame);
+
+    if (camera.m_share.IsOpen())
+        ShareFrame(camera, *frame);
+
+    // Build the downscale pyramid once for all of the renditions.
+    frame->m_pyramid.Build(frame->m_bgra.data(), cam.GetWidth(), cam.GetHeight(), cam.GetStride(),
+        camera.m_pyramidLevels);
+
+    frame->m_convertTime = Clock::now();
+    ++camera.m_framesConverted;
+    camera.m_convertMicros += MicrosBetween(t0, frame->m_convertTime);
+
+    // Encode the renditions in parallel.  Each rendition of each
+    // camera has its own pool key, so its files stay in order.
+    const unsigned numRenditions = static_cast<unsigned>(m_settings.m_renditions.size());
+    frame->m_renditionsLeft = numRenditions;
+    for (unsigned r = 0; r < numRenditions; r++)
+    {
+        unsigned key = r * static_cast<unsigned>(m_cameras.size()) + camera.m_id;
+        m_writePool->Submit(key, [this, &camera, frame, r]() { WriteRendition(camera, frame, r); });
+    }
+}
+
+//---------------------------------------------------------------
+// Runs on the conversion pool.  Burns the label, the wall clock
+// time the frame was dequeued, and the frame number into the
+// bottom left corner of a converted frame.
+//---------------------------------------------------------------
+void CaptureSession::StampFrame(Camera &camera, Frame &frame)
+{
+    const CameraFrameGrabber &cam = camera.m_cam;
+    char timeText[32] = {0};
+    FormatWallTime(frame.m_timestamp.m_wallTime, timeText, _countof(timeText), "%Y-%m-%d %H:%M:%S");
+
+    char text[256] = {0};
+    const char *label = m_settings.m_stampLabel.c_str();
+    if (m_settings.m_stampLabel.empty() && m_cameras.size() > 1)
+        sprintf_s(text, _countof(text), "Cam %u  %s  #%04u", camera.m_deviceIndex + 1, timeText, frame.m_number);
+    else
+        sprintf_s(text, _countof(text), "%s%s%s  #%04u", label, *label ? "  " : "", timeText, frame.m_number);
+
+    TextOverlay &stamp = camera.m_stamp;
+    unsigned margin = stamp.GetBoxHeight() / 2;
+    unsigned y = (cam.GetHeight() > stamp.GetBoxHeight() + margin) ? cam.GetHeight() - stamp.GetBoxHeight() - margin : 0;
+    stamp.Draw(text, frame.m_bgra.data(), cam.GetWidth(), cam.GetHeight(), cam.GetStride(), margin, y);
+}
+
+//---------------------------------------------------------------
+// Runs on the conversion pool.  Publishes a finished frame to the
+// camera's shared-memory ring, for other local processes.
+//---------------------------------------------------------------
+void CaptureSession::ShareFrame(Camera &camera, const Frame &frame)
+{
+    const CameraFrameGrabber &cam = camera.m_cam;
+    const CaptureFormat &native = cam.GetCaptureFormat();
+    const FrameTimestamp &timestamp = frame.m_timestamp;
+
+    FrameShareInfo info;
+    info.m_deviceIndex = camera.m_deviceIndex;
+    info.m_frameNumber = frame.m_number;
+    info.m_width = cam.GetWidth();
+    info.m_height = cam.GetHeight();
+    info.m_stride = cam.GetStride();
+    info.m_nativeWidth = native.m_width;
+    info.m_nativeHeight = native.m_height;
+    info.m_nativePixelType = native.m_pixelType;
+    info.m_haveCaptureTime = timestamp.m_haveCaptureTime ? 1 : 0;
+    info.m_sampleTime = timestamp.m_sampleTime;
+    info.m_captureMicros = MicrosBetween(m_epoch, timestamp.m_captureTime);
+    info.m_wallTimeMicros = std::chrono::duration_cast<std::chrono::microseconds>(
+        timestamp.m_wallTime.time_since_epoch()).count();
+
+    std::string errText;
+    if (!camera.m_share.Publish(info, frame.m_bgra.data(), errText))
+    {
+        Logger::Get().Log(LL_ERROR, "Camera %u:  Failed sharing frame %u!\n  Error Text:  %s",
+            camera.m_deviceIndex + 1, frame.m_number, errText);
+    }
+}
+
+//---------------------------------------------------------------
+// Runs on the writer pool.  Renders one rendition of a converted
+// frame and writes it to a file.  Whichever rendition finishes
+// last records the frame's timestamps and latencies.
+//---------------------------------------------------------------
+void CaptureSession::WriteRendition(Camera &camera, std::shared_ptr<Frame> frame, unsigned rendition)
+{
+    if (m_discard)
+    {
+        if (--frame->m_renditionsLeft == 0)
+            ++camera.m_framesDiscarded;
+        return;
+    }
+
+    const RenditionSpec &spec = m_settings.m_renditions[rendition];
+    auto t0 = Clock::now();
+
+    std::string path = GetRenditionPath(camera, *frame, spec);
+    Logger::Get().Log(LL_INFO, "Writing frame to \"%s\"", path.c_str());
+
+    std::string errText;
+    RenditionImage image;
+    bool rendered = RenderRendition(frame->m_pyramid, spec, camera.m_resamplers[rendition], image,
+        m_settings.m_scaleThreads, m_helperPool.get());
+
+    // Hand the preview server a reference to the rendered pixels,
+    // which keeps either their storage or the frame alive.  The
+    // storage moves into the preview, so 'preview' has to outlive
+    // the write below; the encoder may drop its reference first.
+    std::shared_ptr<PreviewImage> preview;
+    if (rendered && m_preview && rendition == m_previewRendition && m_preview->IsWatched(camera.m_id))
+    {
+        preview = std::make_shared<PreviewImage>();
+        preview->m_pixels = image.m_pixels;
+        preview->m_width = image.m_width;
+        preview->m_height = image.m_height;
+        preview->m_stride = image.m_stride;
+        if (image.m_storage.empty())
+            preview->m_owner = frame;
+        else
+            preview->m_owner = std::make_shared<std::vector<unsigned char>>(std::move(image.m_storage));
+        m_preview->Publish(camera.m_id, preview);
+    }
+
+    if (!rendered)
+    {
+        errText = "Rendition is empty.";
+    }
+    else if (WriteImageFile(path.c_str(), spec.m_format, image.m_width, image.m_height, image.m_stride,
+            image.m_pixels, spec.m_quality, m_settings.m_flushWrites, errText))
+    {
+        ++camera.m_filesWritten;
+    }
+
+    if (!errText.empty())
+    {
+        ++camera.m_writeFailures;
+        frame->m_writeFailed = true;
+        Logger::Get().Log(LL_ERROR, "Failed writing captured image to \"%s\"!\n  Error Text:  %s",
+            path.c_str(), errText);
+    }
+
+    auto t1 = Clock::now();
+    camera.m_writeMicros += MicrosBetween(t0, t1);
+
+    if (--frame->m_renditionsLeft == 0 && !frame->m_writeFailed)
+    {
+        frame->m_writeTime = t1;
+        RecordFrame(camera, *frame);
+    }
+}
+
+//---------------------------------------------------------------
+// Records a frame's timestamps and latencies in the camera's
+// statistics and metadata file, once all of its renditions have
+// been written.
+//---------------------------------------------------------------
+void CaptureSession::RecordFrame(Camera &camera, const Frame &frame)
+{
+    const FrameTimestamp &timestamp = frame.m_timestamp;
+    std::lock_guard<std::mutex> lock(camera.m_metadataLock);
+    ++camera.m_framesWritten;
+
+    // Break the frame's latency down by stage.
+    long long dequeueLatency = MicrosBetween(timestamp.m_captureTime, timestamp.m_dequeueTime);
+    long long convertLatency = MicrosBetween(timestamp.m_dequeueTime, frame.m_convertTime);
+    long long writeLatency = MicrosBetween(frame.m_convertTime, frame.m_writeTime);
+    long long totalLatency = dequeueLatency + convertLatency + writeLatency;
+    if (timestamp.m_haveCaptureTime)
+        ++camera.m_capturesTimed;
+    camera.m_dequeueLatencyMicros += dequeueLatency;
+    camera.m_convertLatencyMicros += convertLatency;
+    camera.m_writeLatencyMicros += writeLatency;
+    camera.m_maxLatencyMicros = __max(camera.m_maxLatencyMicros, totalLatency);
+
+    // Record the frame's metadata.  Capture times are given on the
+    // monotonic clock relative to the start of the session, which
+    // is shared by every camera, so frames can be lined up across
+    // cameras.  The file column names the first rendition.  After
+    // a "rotate" command, each segment gets its own numbered file.
+    const unsigned segment = m_segment;
+    if (camera.m_metadata != nullptr && camera.m_metadataSegment != segment)
+        CloseFlushed(camera.m_metadata);
+    if (camera.m_metadata == nullptr)
+    {
+        camera.m_metadataSegment = segment;
+        std::string metaPath = GetCameraPrefix(camera) + "frames.csv";
+        if (segment > 0)
+            metaPath = GetCameraPrefix(camera) + "frames_" + std::to_string(segment + 1) + ".csv";
+        if (fopen_s(&camera.m_metadata, metaPath.c_str(), "w") == 0 && camera.m_metadata != nullptr)
+        {
+            fprintf(camera.m_metadata, "frame,file,wall_time,sample_time_100ns,capture_ms,device_capture_time,"
+                "capture_to_dequeue_ms,dequeue_to_convert_ms,convert_to_write_ms,total_ms\n");
+        }
+    }
+    if (camera.m_metadata != nullptr)
+    {
+        char wallTime[32] = {0};
+        FormatWallTime(timestamp.m_wallTime, wallTime, _countof(wallTime));
+        fprintf(camera.m_metadata, "%u,%s,%s,%lld,%.3f,%d,%.3f,%.3f,%.3f,%.3f\n",
+            frame.m_number, GetRenditionPath(camera, frame, m_settings.m_renditions[0]).c_str(),
+            wallTime, timestamp.m_sampleTime,
+            MicrosBetween(m_epoch, timestamp.m_captureTime) / 1000.0, timestamp.m_haveCaptureTime ? 1 : 0,
+            dequeueLatency / 1000.0, convertLatency / 1000.0, writeLatency / 1000.0, totalLatency / 1000.0);
+    }
+}
+
+//---------------------------------------------------------------
+// Returns the path of one rendition of a frame, named after the
+// frame number, the wall-clock time the frame was dequeued, and
+// the rendition's name, e.g. "thumbs\frame0012_20261017-134501.250_thumb.jpg".
+//---------------------------------------------------------------
+std::string CaptureSession::GetRenditionPath(const Camera &camera, const Frame &frame,
+    const RenditionSpec &spec) const
+{
+    char wallTime[32] = {0};
+    FormatWallTime(frame.m_timestamp.m_wallTime, wallTime, _countof(wallTime));
+
+    char filename[MAX_PATH] = {0};
+    sprintf_s(filename, _countof(filename), "frame%04u_%s%s%s.%s", frame.m_number, wallTime,
+        spec.m_name.empty() ? "" : "_", spec.m_name.c_str(), GetImageFileExtension(spec.m_format));
+
+    std::string path;
+    if (!spec.m_directory.empty())
+    {
+        path = spec.m_directory;
+        if (path.back() != '\\' && path.back() != '/')
+            path += '\\';
+    }
+    return path + GetCameraPrefix(camera) + filename;
+}
+
+//---------------------------------------------------------------
+// Returns the prefix for a camera's per-frame output files:
+// "camN_" with more than one camera, or nothing otherwise.
+//---------------------------------------------------------------
+std::string CaptureSession::GetCameraPrefix(const Camera &camera) const
+{
+    if (m_cameras.size() < 2)
+        return std::string();
+    return "cam" + std::to_string(camera.m_deviceIndex + 1) + "_";
+}
+
+//---------------------------------------------------------------
+// Returns the path of a per-camera output file.  With more than
+// one camera, "_camN" is inserted before the file extension.
+//---------------------------------------------------------------
+std::string CaptureSession::GetCameraPath(const Camera &camera, const std::string &path) const
+{
+    if (m_cameras.size() < 2)
+        return path;
+
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("\\/");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = path.size();
+
+    return path.substr(0, dot) + "_cam" + std::to_string(camera.m_deviceIndex + 1) + path.substr(dot);
+}
+
+//---------------------------------------------------------------
+// Writes a camera's final composites and prints its statistics.
+//---------------------------------------------------------------
+void CaptureSession::FinishCamera(Camera &camera)
+{
+    const unsigned label = camera.m_deviceIndex + 1;
+    if (!camera.m_opened)
+        return;
+
+    // Let the frame ring's readers know no more frames are coming.
+    camera.m_share.Close();
+
+    // Write the final composites.
+    if (!m_settings.m_lightenPath.empty() && camera.m_lighten.GetFrameCount() > 0)
+    {
+        std::string path = GetCameraPath(camera, m_settings.m_lightenPath);
+        Logger::Get().Log(LL_INFO, "Writing lighten composite of %u frames to \"%s\"",
+            camera.m_lighten.GetFrameCount(), path.c_str());
+        if (!camera.m_lighten.WriteSnapshot(path.c_str()))
+            Logger::Get().Log(LL_ERROR, "Failed writing lighten composite!");
+    }
+    if (!m_settings.m_averagePath.empty() && camera.m_average.GetFrameCount() > 0)
+    {
+        std::string path = GetCameraPath(camera, m_settings.m_averagePath);
+        Logger::Get().Log(LL_INFO, "Writing average composite of %u frames to \"%s\"",
+            camera.m_average.GetFrameCount(), path.c_str());
+        if (!camera.m_average.WriteSnapshot(path.c_str()))
+            Logger::Get().Log(LL_ERROR, "Failed writing average composite!");
+    }
+
+    unsigned written = camera.m_framesWritten;
+    unsigned converted = camera.m_framesConverted;
+    unsigned files = camera.m_filesWritten + camera.m_writeFailures;
+    Logger::Get().Flush();
+    printf("Camera %u statistics:\n", label);
+    printf("  Frames grabbed:           %u\n", camera.m_framesGrabbed.load());
+    printf("  Frames failed:            %u\n", camera.m_grabFailures.load());
+    printf("  Conversion failures:      %u\n", camera.m_convertFailures.load());
+    printf("  Frames written:           %u\n", written);
+    printf("  Files written:            %u\n", camera.m_filesWritten.load());
+    printf("  Write failures:           %u\n", camera.m_writeFailures.load());
+    if (camera.m_framesDiscarded > 0)
+        printf("  Frames discarded:         %u\n", camera.m_framesDiscarded.load());
+    if (camera.m_firstFrameMs >= 0.0)
+        printf("  Time to first frame:      %.0f ms\n", camera.m_firstFrameMs);
+    if (converted > 0)
+        printf("  Average convert time:     %.2f ms\n", camera.m_convertMicros / 1000.0 / converted);
+    if (files > 0)
+        printf("  Average time per file:    %.2f ms\n", camera.m_writeMicros / 1000.0 / files);
+    unsigned attempted = camera.m_framesGrabbed + camera.m_grabFailures;
+    if (attempted > 0)
+    {
+        printf("  Average grab lateness:    %.2f ms\n", camera.m_lateMicros / 1000.0 / attempted);
+        printf("  Worst grab lateness:      %.2f ms\n", camera.m_maxLateMicros / 1000.0);
+    }
+    if (written > 0)
+    {
+        if (camera.m_capturesTimed == written)
+            printf("  Capture to dequeue:       %.2f ms\n", camera.m_dequeueLatencyMicros / 1000.0 / written);
+        else
+            printf("  Capture to dequeue:       (not reported by device)\n");
+        printf("  Dequeue to converted:     %.2f ms\n", camera.m_convertLatencyMicros / 1000.0 / written);
+        printf("  Converted to written:     %.2f ms%s\n", camera.m_writeLatencyMicros / 1000.0 / written,
+            m_settings.m_flushWrites ? " (flushed to disk)" : "");
+        printf("  Worst total latency:      %.2f ms\n", camera.m_maxLatencyMicros / 1000.0);
+    }
+
+    CloseFlushed(camera.m_metadata);
+}
+
+//---------------------------------------------------------------
+// Waits for the cameras to stop, finishes converting and writing
+// their frames, and writes the final composites.  Returns true
+// if every camera was opened successfully.
+//---------------------------------------------------------------
+bool CaptureSession::Finish()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_doneLock);
+        m_done.wait(lock, [this]() { return m_running == 0; });
+    }
+
+    // Commands have nothing left to act on.
+    if (m_control)
+    {
+        m_control->Stop();
+        Logger::Get().Flush();
+        printf("Control statistics:\n");
+        printf("  Commands handled:         %u\n", m_control->GetCommandsHandled());
+        m_control.reset();
+    }
+
+    // After an abort, the frames already grabbed get m_drainSeconds
+    // to finish converting and writing; whatever is still queued
+    // after that is dropped.  Conversion feeds the writers, so it
+    // has to drain first.
+    const auto drainStart = Clock::now();
+    if (m_abort && m_settings.m_drainSeconds > 0 && m_convertPool && m_writePool)
+    {
+        const auto drainEnd = drainStart + std::chrono::seconds(m_settings.m_drainSeconds);
+        if (!m_convertPool->WaitIdle(std::chrono::duration_cast<std::chrono::milliseconds>(drainEnd - Clock::now())) ||
+            !m_writePool->WaitIdle(std::chrono::duration_cast<std::chrono::milliseconds>(drainEnd - Clock::now())))
+        {
+            Logger::Get().Log(LL_WARNING, "Queued frames not finished after %u seconds; discarding the rest.",
+                m_settings.m_drainSeconds);
+            m_discard = true;
+        }
+    }
+    if (m_convertPool)
+        m_convertPool->WaitIdle();
+    if (m_writePool)
+        m_writePool->WaitIdle();
+    if (m_abort)
+        Logger::Get().Log(LL_INFO, "Queued frames finished in %.0f ms.", Ms(Clock::now() - drainStart).count());
+
+    bool ok = true;
+    for (auto &camera : m_cameras)
+    {
+        FinishCamera(*camera);
+        ok = ok && camera->m_opened;
+    }
+
+    if (m_preview)
+    {
+        m_preview->Stop();
+        Logger::Get().Flush();
+        printf("Preview statistics:\n");
+        printf("  Frames encoded:           %u\n", m_preview->GetFramesEncoded());
+        printf("  Frames sent:              %u\n", m_preview->GetFramesSent());
+        printf("  Frames dropped:           %u\n", m_preview->GetFramesDropped());
+        m_preview.reset();
+    }
+
+    if (m_settings.m_syncMode && m_setsTaken > 0)
+    {
+        printf("Sync statistics:\n");
+        printf("  Sets taken:               %u\n", m_setsTaken);
+        printf("  Incomplete sets:          %u\n", m_setsIncomplete);
+        printf("  Average skew:             %.2f ms\n", m_skewMicros / 1000.0 / m_setsTaken);
+        printf("  Worst skew:               %.2f ms\n", m_maxSkewMicros / 1000.0);
+    }
+
+    CloseFlushed(m_setsFile);
+
+    Logger &logger = Logger::Get();
+    logger.Flush();
+    if (logger.GetRecordsDropped() > 0 || logger.GetRecordsSuppressed() > 0)
+    {
+        printf("Log statistics:\n");
+        printf("  Messages dropped:         %u\n", logger.GetRecordsDropped());
+        printf("  Repeats suppressed:       %u\n", logger.GetRecordsSuppressed());
+    }
+
+    return ok;
+}
@@ -0,0 +1,361 @@
+//--------------------------------------------------------------------
+// CaptureSession.h
+// A C++ module that runs a time lapse capture session on one or more
+// camera devices at once.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Fill in a CaptureSettings structure, call
+//   Start() to begin capturing in the background, poll IsRunning()
+//   (calling Abort() to stop early), then call Finish().
+//
+// * No thread sleeps per camera.  A CaptureScheduler keeps every
+//   camera's next deadline in one min-heap and hands each camera's
+//   open, resume, and grab tasks to a shared grab pool when they
+//   come due, so hundreds of cameras on independent intervals cost
+//   only a few threads.  Each task schedules the camera's next one.
+//
+// * Frames are grabbed in the device's native format.  Color
+//   conversion and file writing are handed to two more worker
+//   pools, which take turns between cameras and keep each camera's
+//   frames in order.
+//
+// * ConvertFrame() runs each frame through these stages, in this
+//   order, skipping any whose settings are off:
+//     1. The TemporalFilter (m_denoiseStrength), on the native
+//        frame if m_denoiseNative is set.
+//     2. AutoColor sampling (m_autoLevels, m_autoWhiteBalance):  a
+//        sparse sample of the native frame.
+//     3. Conversion to BGRA, which orients the frame and hides the
+//        privacy regions (so they are given in uncorrected frame
+//        pixels).  Without a flat-field, the conversion kernels
+//        also apply the AutoColor curves, at no extra pass.
+//     4. The FlatField (m_flatFieldPath; one image per camera,
+//        named as for the composites), since vignetting belongs to
+//        the uncorrected frame.  With AutoColor too, the samples
+//        are corrected the same way before the curves are worked
+//        out, and the flat-field pass applies the curves to each
+//        row right after its gains.
+//     5. The TemporalFilter, on the BGRA frame if m_denoiseNative
+//        isn't set.
+//     6. The Remapper for a lens model or homography, built when
+//        the camera opens.
+//     7. The Stabilizer (m_stabilizeMargin), which measures each
+//        frame's shake and shifts it out.
+//     8. The ColorLut (m_lutPath), so the composites and every
+//        rendition share the grade.
+//     9. The lighten and average composites.
+//    10. The timestamp (m_stamp), after the composites, which
+//        would only smear it.
+//    11. The shared-memory ring, then the renditions' pyramid.
+//
+// * Each frame is converted once, then fanned out to every
+//   rendition (scale, crop, file format, destination) in
+//   m_renditions.  The renditions share one downscale pyramid and
+//   are encoded in parallel on the writer pool.
+//
+// * With m_previewPort set, one rendition of each camera's frames
+//   is also handed to a PreviewServer as it is rendered, as a
+//   reference to the rendered pixels (or the frame itself) rather
+//   than a copy, but only while someone is watching.  Stream N of
+//   the server is the Nth camera.
+//
+// * With m_shareName set, each finished frame (after the stamp) is
+//   also copied into a FrameShareWriter ring of that name (one per
+//   camera, named as for the composites), where other local
+//   processes can read it in place with FrameShareReader, with no
+//   disk I/O.
+//
+// * With m_controlPath set, a ControlServer accepts commands on a
+//   local socket at that path while the session runs:  "capture"
+//   takes a camera's next frame now, "interval" changes a camera's
+//   interval, "pause" and "resume" hold and restart its frames,
+//   "rotate" starts a new segment of the metadata files, and
+//   "stats" lists the statistics so far.  The control thread only
+//   sets atomic requests on the cameras and schedules a control
+//   task for each; the task applies them on the grab pool between
+//   the camera's grabs, so nothing waits on the control thread and
+//   the scheduling state is only ever touched by the camera's own
+//   tasks.  The control commands don't apply in sync mode.
+//
+// * Abort() stops the cameras promptly, however long their
+//   intervals:  tasks waiting for a deadline run right away and see
+//   the abort.  Finish() then lets the frames already grabbed finish
+//   converting and writing, for up to m_drainSeconds, and flushes
+//   the metadata files through to the disk before closing them.
+//
+// * Progress, warnings, and errors go through the Logger, which
+//   the session starts and stops, so the grab, conversion, and
+//   writer threads never wait on the console.  Identical warnings
+//   and errors (a camera failing every frame, say) are rate
+//   limited.  The statistics are printed directly, once the log is
+//   flushed.
+//
+// * Output files and statistics are kept separate per camera.
+//   With more than one camera, file names get a "camN_" prefix
+//   (or "_camN" suffix for composites), where N is the 1-based
+//   device index.
+//
+// * In sync mode, every camera streams continuously into a short
+//   FrameRing of timestamped frames.  At each scheduled time, the
+//   frame from each camera captured closest to that time is picked
+//   and the picks are written as one set, sharing a frame number.
+//   The skew of each set (the spread of its capture times) is
+//   reported and logged to "sets.csv".
+//
+// * With m_stamp set, each frame gets its label, capture time,
+//   and frame number burned into its bottom left corner by a
+//   TextOverlay, right after conversion.  The time is the wall
+//   clock time the frame was dequeued, as in its file name.
+//
+// * Frame files are named after the frame number, the wall clock
+//   time the frame was dequeued, and the rendition's name.  Each
+//   camera also gets a "frames.csv" file with every frame's
+//   device, monotonic, and wall clock timestamps, and its latency
+//   from capture to dequeue to conversion to written files.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include "CameraFrameGrabber.h"
+#include "FrameStacker.h"
+#include "Logger.h"
+#include "Remapper.h"
+#include "Rendition.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class CaptureScheduler;
+class ColorLut;
+class ControlServer;
+class PreviewServer;
+class WorkerPool;
+
+//---------------------------------------------------------------
+// Settings for a capture session.
+//---------------------------------------------------------------
+struct CaptureSettings
+{
+    std::vector<unsigned> m_deviceIndices;  // Which capture devices to grab frames from (0-based).
+    std::vector<unsigned> m_formatIndices;  // Which format to use on each device; one entry applies to all.
+    std::vector<unsigned> m_secondsBetweenFrames;   // Interval of each camera; one entry applies to all.
+    std::vector<FrameOrientation> m_orientations;   // Rotation and mirroring of each camera; one entry applies to all.
+    unsigned m_numFramesToGrab = 10;
+    unsigned m_stackCount = 1;        // How many consecutive frames to stack into each saved frame.
+    StackMode m_stackMode = SM_MEAN;  // How the stacked frames get combined.
+    std::string m_lightenPath;        // Where to write the lighten-blend composite, if any.
+    std::string m_averagePath;        // Where to write the average-blend composite, if any.
+    unsigned m_snapshotInterval = 10; // How many frames between composite snapshots.
+    unsigned m_warmUpFrames = 30;     // Most frames to discard while the device's exposure settles.
+    unsigned m_grabRetries = 3;       // How many times to retry a dropped or blank frame.
+    bool m_powerSave = false;         // Stop the device's stream during long waits between frames.
+    unsigned m_resumeLeadSeconds = 5; // How long before a frame is due to restart a stopped stream.
+    unsigned m_grabThreads = 0;       // Threads in the shared grab pool (0 = one per camera, up to a limit).
+    unsigned m_convertThreads = 0;    // Threads in the shared conversion pool (0 = one per CPU).
+    unsigned m_writeThreads = 2;      // Threads in the shared file writing pool.
+    unsigned m_scaleThreads = 1;      // Threads that share the scaling of each rendition.
+    bool m_flushWrites = false;       // Wait for each frame's file to reach the disk.
+    std::vector<RenditionSpec> m_renditions;    // Output versions of each frame; none means full-size .BMP.
+    bool m_syncMode = false;          // Stream all cameras and capture timestamp-matched sets.
+    unsigned m_syncRingFrames = 8;    // How many recent frames each camera keeps in sync mode.
+    unsigned m_syncLagMs = 150;       // How long after each set's time to wait for its frames.
+    std::string m_flatFieldPath;      // .BMP image of an evenly lit target, to correct vignetting with.
+    unsigned m_flatFieldGrid = 0;     // Spacing of the flat-field gain grid (0 = a gain per pixel).
+    unsigned m_denoiseStrength = 0;   // Frames static areas are smoothed over (0 = no temporal filter).
+    unsigned m_denoiseThreshold = 6;  // Largest change the temporal filter treats as noise.
+    bool m_denoiseNative = true;      // Filter in the device's native format rather than on BGRA.
+    bool m_autoLevels = false;        // Stretch each frame's levels to the full range.
+    bool m_autoWhiteBalance = false;  // Gray-world white balance each frame.
+    double m_autoColorSmoothing = 0.8;    // How slowly the levels and white balance follow the scene.
+    std::vector<LensModel> m_lensModels;        // Lens distortion to correct; a device's own model wins.
+    std::vector<Homography> m_homographies;     // Perspective to correct; a device's own transform wins.
+    RemapFilter m_remapFilter = RMF_BILINEAR;   // How corrected frames are sampled.
+    unsigned m_remapThreads = 1;      // Threads that share the correction of each frame.
+    unsigned m_stabilizeMargin = 0;   // Percent cropped from each side to steady the frames (0 = off).
+    double m_stabilizeSmoothing = 0.9;    // How slowly the stabilized view follows the camera.
+    std::string m_lutPath;            // .cube file to color grade frames with, if any.
+    unsigned m_lutThreads = 1;        // Threads that share the grading of each frame.
+    std::vector<PrivacyRegion> m_privacyRegions;    // Regions of the frames that must never be saved.
+    uint32_t m_maskColor = 0;         // Color of the privacy regions (0x00RRGGBB).
+    unsigned m_maskPixelateSize = 0;  // Pixelate the privacy regions in blocks this size instead (0 = solid).
+    bool m_stamp = false;             // Burn the time each frame was grabbed into it.
+    std::string m_stampLabel;         // Text shown before the time; if empty, the camera number (with several cameras).
+    unsigned m_stampHeight = 0;       // Height of the stamp's text in pixels (0 = 1/30 of the frame).
+    unsigned m_previewPort = 0;       // Localhost port to serve live MJPEG previews on (0 = none).
+    std::string m_previewRendition;   // Name of the rendition to preview; empty for the first one.
+    std::string m_shareName;          // Name of the shared-memory frame ring to publish to, if any.
+    unsigned m_shareSlots = 4;        // Frames the shared-memory ring holds.
+    std::string m_controlPath;        // Local socket to accept control commands on, if any.
+    unsigned m_drainSeconds = 30;     // Longest Finish() waits for queued frames after Abort() (0 = no limit).
+    LogLevel m_logLevel = LL_INFO;    // Least severe messages shown on the console.
+    std::string m_logPath;            // JSON lines file to log every message to, if any.
+
+    // Returns the format index to use for the given camera.
+    unsigned GetFormatIndex(size_t camera) const
+    {
+        if (m_formatIndices.empty())
+            return 0;
+        return m_formatIndices[__min(camera, m_formatIndices.size() - 1)];
+    }
+
+    // Returns the number of seconds between frames for the given
+    // camera.
+    unsigned GetSecondsBetweenFrames(size_t camera) const
+    {
+        if (m_secondsBetweenFrames.empty())
+            return 1;
+        return m_secondsBetweenFrames[__min(camera, m_secondsBetweenFrames.size() - 1)];
+    }
+
+    // Returns how the given camera's frames are rotated and
+    // mirrored.
+    FrameOrientation GetOrientation(size_t camera) const
+    {
+        if (m_orientations.empty())
+            return FrameOrientation();
+        return m_orientations[__min(camera, m_orientations.size() - 1)];
+    }
+};
+
+//---------------------------------------------------------------
+// A C++ class that captures time lapse frames from a set of
+// cameras.
+//---------------------------------------------------------------
+class CaptureSession
+{
+public:
+    explicit CaptureSession(const CaptureSettings &settings);
+    ~CaptureSession();
+
+    CaptureSession(const CaptureSession &) = delete;
+    CaptureSession &operator=(const CaptureSession &) = delete;
+
+    // Starts the logger, then starts capturing from every camera
+    // in the background.  Returns false if the settings name no
+    // cameras, the log file, or the color lookup table can't be
+    // loaded, or the preview or control server can't be started.
+    bool Start();
+
+    // Returns true while any camera is still capturing.
+    bool IsRunning() const { return m_running > 0; }
+
+    // Returns a manual-reset event (a HANDLE) that is set once
+    // every camera has stopped capturing, for waiting on along
+    // with other events.
+    void *GetStoppedEvent() const { return m_stoppedEvent; }
+
+    // Asks every camera to stop before its next frame.
+    void Abort();
+
+    // Waits for the cameras to stop, finishes converting and
+    // writing their frames (for at most m_drainSeconds after an
+    // abort), writes the final composites, flushes the metadata
+    // files to disk, and prints each camera's statistics.  Returns
+    // true if every camera was opened successfully.
+    bool Finish();
+
+private:
+    struct Camera;
+    struct Frame;
+
+    void OpenTask(Camera &camera);
+    void ResumeTask(Camera &camera, unsigned iframe, unsigned generation);
+    void GrabTask(Camera &camera, unsigned iframe, unsigned generation);
+    void ScheduleFrame(Camera &camera, unsigned iframe);
+    void ControlTask(Camera &camera);
+    void PauseCamera(Camera &camera);
+    bool HandleCommand(const std::string &command, std::string &reply, std::string &errText);
+    std::string GetStats() const;
+    void StopCamera(Camera &camera);
+    void StreamTask(Camera &camera);
+    void StartSync();
+    void SyncTask(unsigned iset);
+    void WriteSetMetadata(unsigned iset, std::chrono::steady_clock::time_point reference,
+        const std::vector<std::shared_ptr<Frame>> &frames, long long skewMicros);
+    bool OpenCamera(Camera &camera);
+    unsigned WarmUpCamera(Camera &camera);
+    bool ResumeCamera(Camera &camera);
+    bool GrabStackedFrame(Camera &camera, Frame &frame, std::string &errText);
+    bool GrabGoodFrame(Camera &camera, Frame &frame, std::string &errText);
+    void ConvertFrame(Camera &camera, std::shared_ptr<Frame> frame);
+    void WriteRendition(Camera &camera, std::shared_ptr<Frame> frame, unsigned rendition);
+    void StampFrame(Camera &camera, Frame &frame);
+    void ShareFrame(Camera &camera, const Frame &frame);
+    void RecordFrame(Camera &camera, const Frame &frame);
+    std::string GetRenditionPath(const Camera &camera, const Frame &frame, const RenditionSpec &spec) const;
+    void FinishCamera(Camera &camera);
+    std::string GetCameraPath(const Camera &camera, const std::string &path) const;
+    std::string GetCameraPrefix(const Camera &camera) const;
+
+    CaptureSettings m_settings;                     // Settings for the session.
+    std::vector<std::unique_ptr<Camera>> m_cameras; // State of each camera.
+    std::unique_ptr<ColorLut> m_lut;                // Color grading table, shared by the cameras.
+    std::unique_ptr<PreviewServer> m_preview;       // Serves live previews, if enabled.
+    unsigned m_previewRendition = 0;                // Which rendition is previewed.
+    std::unique_ptr<ControlServer> m_control;       // Accepts control commands, if enabled.
+    std::atomic<unsigned> m_segment{0};             // Metadata segment, advanced by "rotate".
+    std::unique_ptr<WorkerPool> m_helperPool;       // Threads that help split one frame's work, if any.
+    std::unique_ptr<WorkerPool> m_convertPool;      // Shared color conversion threads.
+    std::unique_ptr<WorkerPool> m_writePool;        // Shared file writing threads.
+    std::unique_ptr<WorkerPool> m_grabPool;         // Shared threads that open devices and grab frames.
+    std::unique_ptr<CaptureScheduler> m_scheduler;  // Dispatches grab tasks when they come due.
+    void *m_mtaCookie = nullptr;                    // Keeps COM's multithreaded apartment alive for the pools.
+    std::chrono::steady_clock::time_point m_epoch;  // When the session started; capture times are relative to it.
+    std::atomic<bool> m_abort{false};               // Set to stop capturing early.
+    std::atomic<unsigned> m_running{0};             // Number of cameras still capturing.
+    void *m_stoppedEvent = nullptr;                 // Set when m_running reaches 0 (a HANDLE).
+    std::atomic<bool> m_discard{false};             // Set to drop queued frames once the drain times out.
+    std::mutex m_doneLock;                          // Protects waiting on m_done.
+    std::condition_variable m_done;                 // Signaled when a camera stops capturing.
+
+    // Sync mode state, used only by the sync task and Finish().
+    std::atomic<unsigned> m_opensPending{0};        // Cameras that haven't finished opening.
+    std::atomic<bool> m_syncDone{false};            // Set when the last set has been taken.
+    std::chrono::steady_clock::time_point m_syncStart;  // Reference time of the first set.
+    FILE *m_setsFile = nullptr;                     // Per-set skew log.
+    unsigned m_setsTaken = 0;                       // Number of sets taken.
+    unsigned m_setsIncomplete = 0;                  // Sets missing a frame from some camera.
+    long long m_skewMicros = 0;                     // Total skew of all sets.
+    long long m_maxSkewMicros = 0;                  // Largest skew of any set.
+};
@@ -0,0 +1,371 @@
+//--------------------------------------------------------------------
+// ColorLut.cpp
+// A C++ module that color grades 32-bit BGRA images with a 3D lookup
+// table loaded from a .cube file.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "ColorLut.h"
+#include "WorkerPool.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+
+namespace
+{
+
+// Table entries are stored in steps of 1/64 of an 8-bit level.
+const int TABLE_BITS = 6;
+
+// Largest table side (or 1D length) accepted.
+const unsigned MAX_SIZE = 256;
+
+// How far (in output range 0 to 1) a 3D table may stray from its
+// baked curves and still count as separable.
+const double SEPARABLE_TOLERANCE = 1.0 / 1024.0;
+
+// The channels (0 = B, 1 = G, 2 = R) in order of decreasing
+// fraction, indexed by (R >= G) << 2 | (G >= B) << 1 | (R >= B).
+// Entries 1 and 6 can't happen.
+const unsigned char TETRAHEDRON_ORDER[8][3] =
+{
+    {0, 1, 2}, {2, 1, 0}, {1, 0, 2}, {1, 2, 0},
+    {0, 2, 1}, {2, 0, 1}, {2, 1, 0}, {2, 1, 0}
+};
+
+//---------------------------------------------------------------
+// Returns 'line' without leading white space, and with any
+// trailing white space removed in place.
+//---------------------------------------------------------------
+char *Trim(char *line)
+{
+    while (*line == ' ' || *line == '\t')
+        line++;
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' ||
+                       line[len - 1] == ' ' || line[len - 1] == '\t'))
+        line[--len] = '\0';
+    return line;
+}
+
+//---------------------------------------------------------------
+// Returns the fixed point table value of an output level (0 to 1).
+//---------------------------------------------------------------
+int16_t ToTableValue(double value)
+{
+    value = __max(0.0, __min(value, 1.0));
+    return static_cast<int16_t>(floor(value * (255 << TABLE_BITS) + 0.5));
+}
+
+//---------------------------------------------------------------
+// Returns a 32-bit lane holding a pair of 16-bit weights, as
+// _mm_madd_epi16 expects them.
+//---------------------------------------------------------------
+inline __m128i WeightPair(int w0, int w1)
+{
+    return _mm_set1_epi32((w1 << 16) | (w0 & 0xffff));
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Loads a .cube file.  Returns false if the file can't be read or
+// isn't a valid table.
+//---------------------------------------------------------------
+bool ColorLut::Load(const char *path, std::string &errText)
+{
+    m_size = 0;
+    m_is3D = false;
+    m_separable = false;
+    m_table.clear();
+
+    FILE *fp = nullptr;
+    if (fopen_s(&fp, path, "r") != 0 || fp == nullptr)
+    {
+        errText = std::string("Failed opening \"") + path + "\".";
+        return false;
+    }
+
+    // Read the keywords and the table's R G B triplets.
+    unsigned size3d = 0, size1d = 0;
+    double domainMin[3] = {0.0, 0.0, 0.0};
+    double domainMax[3] = {1.0, 1.0, 1.0};
+    std::vector<double> values;
+    char buffer[512];
+    bool valid = true;
+    while (valid && fgets(buffer, sizeof(buffer), fp) != nullptr)
+    {
+        char *line = Trim(buffer);
+        double r = 0.0, g = 0.0, b = 0.0;
+        if (*line == '\0' || *line == '#' || strncmp(line, "TITLE", 5) == 0)
+            continue;
+        if (strncmp(line, "LUT_3D_SIZE", 11) == 0)
+            valid = sscanf_s(line + 11, "%u", &size3d) == 1;
+        else if (strncmp(line, "LUT_1D_SIZE", 11) == 0)
+            valid = sscanf_s(line + 11, "%u", &size1d) == 1;
+        else if (strncmp(line, "DOMAIN_MIN", 10) == 0)
+            valid = sscanf_s(line + 10, "%lf %lf %lf", &domainMin[2], &domainMin[1], &domainMin[0]) == 3;
+        else if (strncmp(line, "DOMAIN_MAX", 10) == 0)
+            valid = sscanf_s(line + 10, "%lf %lf %lf", &domainMax[2], &domainMax[1], &domainMax[0]) == 3;
+        else if (strncmp(line, "LUT_1D_INPUT_RANGE", 18) == 0 || strncmp(line, "LUT_3D_INPUT_RANGE", 18) == 0)
+        {
+            valid = sscanf_s(line + 18, "%lf %lf", &domainMin[0], &domainMax[0]) == 2;
+            domainMin[1] = domainMin[2] = domainMin[0];
+            domainMax[1] = domainMax[2] = domainMax[0];
+        }
+        else if (sscanf_s(line, "%lf %lf %lf", &r, &g, &b) == 3)
+        {
+            values.push_back(r);
+            values.push_back(g);
+            values.push_back(b);
+        }
+        else
+            valid = false;
+    }
+    fclose(fp);
+
+    unsigned size = (size3d != 0) ? size3d : size1d;
+    size_t entries = (size3d != 0) ? static_cast<size_t>(size) * size * size : size;
+    if (!valid || (size3d != 0) == (size1d != 0) || size < 2 || size > MAX_SIZE)
+    {
+        errText = std::string("\"") + path + "\" is not a valid .cube file.";
+        return false;
+    }
+    if (values.size() != entries * 3)
+    {
+        errText = std::string("\"") + path + "\" has the wrong number of table entries.";
+        return false;
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        if (domainMax[c] <= domainMin[c])
+        {
+            errText = std::string("\"") + path + "\" has an empty domain.";
+            return false;
+        }
+    }
+    m_size = size;
+    m_is3D = (size3d != 0);
+
+    // Find each input level's cell and its position in the cell,
+    // per channel.  The last cell is used for the top of the range,
+    // so the cell's far corner always exists.
+    const unsigned strides[3] = {size * size, size, 1};    // B, G, R
+    for (int c = 0; c < 3; c++)
+    {
+        for (unsigned v = 0; v < 256; v++)
+        {
+            double t = (v / 255.0 - domainMin[c]) / (domainMax[c] - domainMin[c]);
+            t = __max(0.0, __min(t, 1.0)) * (size - 1);
+            unsigned cell = __min(static_cast<unsigned>(t), size - 2);
+            m_fractions[c][v] = static_cast<int>(floor((t - cell) * 256.0 + 0.5));
+            m_offsets[c][v] = cell * strides[c] * 4;
+        }
+    }
+
+    // Bake the output curve of each channel along its own axis.
+    // (values holds R, G, B per entry; channel c of BGRA is value
+    // 2 - c.)
+    for (int c = 0; c < 3; c++)
+    {
+        size_t axisStride = (size3d != 0) ? strides[c] : 1;
+        for (unsigned v = 0; v < 256; v++)
+        {
+            size_t cell = m_offsets[c][v] / 4 / strides[c];
+            double f = m_fractions[c][v] / 256.0;
+            double lo = values[(cell * axisStride) * 3 + (2 - c)];
+            double hi = values[((cell + 1) * axisStride) * 3 + (2 - c)];
+            double out = lo + (hi - lo) * f;
+            m_curves[c][v] = static_cast<unsigned char>(floor(__max(0.0, __min(out, 1.0)) * 255.0 + 0.5));
+        }
+    }
+
+    if (size1d != 0)
+    {
+        m_separable = true;
+        return true;
+    }
+
+    // A 3D table is separable if each output channel matches its
+    // curve everywhere, whatever the other two inputs are.
+    m_separable = true;
+    for (unsigned b = 0; b < size && m_separable; b++)
+    {
+        for (unsigned g = 0; g < size && m_separable; g++)
+        {
+            for (unsigned r = 0; r < size && m_separable; r++)
+            {
+                const double *entry = &values[((static_cast<size_t>(b) * size + g) * size + r) * 3];
+                m_separable =
+                    fabs(entry[0] - values[static_cast<size_t>(r) * 3 + 0]) <= SEPARABLE_TOLERANCE &&
+                    fabs(entry[1] - values[static_cast<size_t>(g) * size * 3 + 1]) <= SEPARABLE_TOLERANCE &&
+                    fabs(entry[2] - values[static_cast<size_t>(b) * size * size * 3 + 2]) <= SEPARABLE_TOLERANCE;
+            }
+        }
+    }
+    if (m_separable)
+        return true;
+
+    m_table.resize(entries * 4);
+    for (size_t i = 0; i < entries; i++)
+    {
+        m_table[i * 4 + 0] = ToTableValue(values[i * 3 + 2]);
+        m_table[i * 4 + 1] = ToTableValue(values[i * 3 + 1]);
+        m_table[i * 4 + 2] = ToTableValue(values[i * 3 + 0]);
+        m_table[i * 4 + 3] = 0;
+    }
+    return true;
+}
+
+//---------------------------------------------------------------
+// Grades an image in place, splitting it into bands that are
+// graded in parallel on the calling thread and the helper pool's
+// threads.
+//---------------------------------------------------------------
+void ColorLut::Apply(unsigned char *pixels, unsigned width, unsigned height, unsigned stride,
+    unsigned numThreads, WorkerPool *helpers) const
+{
+    if (m_size == 0 || height == 0)
+        return;
+
+    if (helpers == nullptr || numThreads < 2)
+    {
+        ApplyBand(pixels, width, 0, height, stride);
+        return;
+    }
+
+    numThreads = __min(numThreads, height);
+    unsigned rowsPerBand = (height + numThreads - 1) / numThreads;
+    unsigned numBands = (height + rowsPerBand - 1) / rowsPerBand;
+    helpers->RunParallel(numBands, [=](unsigned band)
+    {
+        unsigned first = band * rowsPerBand;
+        ApplyBand(pixels, width, first, __min(first + rowsPerBand, height), stride);
+    });
+}
+
+//---------------------------------------------------------------
+// Grades one band of rows.
+//---------------------------------------------------------------
+void ColorLut::ApplyBand(
+    unsigned char *pixels,  // in/out:  BGRA pixels of the whole image.
+    unsigned width,         // in:  Pixels per row.
+    unsigned firstRow,      // in:  First row of the band.
+    unsigned endRow,        // in:  Row after the band.
+    unsigned stride         // in:  Bytes per row.
+    ) const
+{
+    if (m_separable)
+    {
+        for (unsigned y = firstRow; y < endRow; y++)
+        {
+            unsigned char *p = pixels + static_cast<size_t>(stride) * y;
+            for (unsigned x = 0; x < width; x++, p += 4)
+            {
+                p[0] = m_curves[0][p[0]];
+                p[1] = m_curves[1][p[1]];
+                p[2] = m_curves[2][p[2]];
+            }
+        }
+        return;
+    }
+
+    // Steps between neighbouring table entries along each axis.
+    const unsigned stepB = m_size * m_size * 4;
+    const unsigned stepG = m_size * 4;
+    const unsigned stepR = 4;
+    const unsigned steps[3] = {stepB, stepG, stepR};
+    const int16_t *table = m_table.data();
+    const __m128i round = _mm_set1_epi32(1 << (TABLE_BITS + 8 - 1));
+
+    for (unsigned y = firstRow; y < endRow; y++)
+    {
+        uint32_t *p = reinterpret_cast<uint32_t *>(pixels + static_cast<size_t>(stride) * y);
+        uint32_t lastIn = 0, lastOut = 0;
+        bool haveLast = false;
+        for (unsigned x = 0; x < width; x++)
+        {
+            uint32_t in = p[x];
+            if (haveLast && (in & 0xffffff) == lastIn)
+            {
+                p[x] = (in & 0xff000000) | lastOut;
+                continue;
+            }
+
+            unsigned b = in & 0xff;
+            unsigned g = (in >> 8) & 0xff;
+            unsigned r = (in >> 16) & 0xff;
+            int fb = m_fractions[0][b];
+            int fg = m_fractions[1][g];
+            int fr = m_fractions[2][r];
+            const int16_t *c0 = table + m_offsets[0][b] + m_offsets[1][g] + m_offsets[2][r];
+
+            // Pick the tetrahedron holding the point by ordering its
+            // fractions:  walk from the cell's near corner along the
+            // axes of the largest, middle, and smallest fraction.
+            // A table lookup keeps the unpredictable order branch-free.
+            const int fractions[3] = {fb, fg, fr};
+            const unsigned char *order = TETRAHEDRON_ORDER[((fr >= fg) << 2) | ((fg >= fb) << 1) | (fr >= fb)];
+            int f1 = fractions[order[0]];
+            int f2 = fractions[order[1]];
+            int f3 = fractions[order[2]];
+            unsigned step1 = steps[order[0]];
+            unsigned step2 = steps[order[1]];
+            const int16_t *c1 = c0 + step1;
+            const int16_t *c2 = c1 + step2;
+            const int16_t *c3 = c0 + stepB + stepG + stepR;
+
+            // out = c0 (256 - f1) + c1 (f1 - f2) + c2 (f2 - f3) + c3 f3,
+            // all four channels at once.
+            __m128i v01 = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(c0)),
+                _mm_loadl_epi64(reinterpret_cast<const __m128i *>(c1)));
+            __m128i v23 = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(c2)),
+                _mm_loadl_epi64(reinterpret_cast<const __m128i *>(c3)));
+            __m128i sum = _mm_add_epi32(_mm_madd_epi16(v01, WeightPair(256 - f1, f1 - f2)),
+                _mm_madd_epi16(v23, WeightPair(f2 - f3, f3)));
+            sum = _mm_srai_epi32(_mm_add_epi32(sum, round), TABLE_BITS + 8);
+            sum = _mm_packs_epi32(sum, sum);
+            uint32_t out = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum))) & 0xffffff;
+
+            p[x] = (in & 0xff000000) | out;
+            lastIn = in & 0xffffff;
+            lastOut = out;
+            haveLast = true;
+        }
+    }
+}
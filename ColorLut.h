@@ -0,0 +1,109 @@
+//--------------------------------------------------------------------
+// ColorLut.h
+// A C++ module that color grades 32-bit BGRA images with a 3D lookup
+// table loaded from a .cube file.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Load() with the path of a .cube file (the
+//   Adobe/Resolve format, 3D or 1D), then call Apply() on as many
+//   frames as desired.  A loaded ColorLut is read-only, so one
+//   object may be shared by several threads.
+//
+// * 3D tables (typically 17, 33, or 65 entries per side) are
+//   stored as 16-bit fixed point and applied with tetrahedral
+//   interpolation:  each pixel blends the four corners of the
+//   tetrahedron of its lattice cell that contains it, with SSE2
+//   multiply-adds.  Runs of identical pixels reuse the previous
+//   result.
+//
+// * When every output channel of a 3D table depends only on the
+//   same input channel (as with pure curves and gamma changes),
+//   Load() bakes the table into three 256-entry curves and Apply()
+//   does three lookups per pixel instead.  1D tables always take
+//   this path.
+//
+// * Passing numThreads > 1 and a WorkerPool splits the image into
+//   horizontal bands that the calling thread and the pool's threads
+//   grade in parallel.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class WorkerPool;
+
+//---------------------------------------------------------------
+// A C++ class that holds a color lookup table and applies it to
+// BGRA images.
+//---------------------------------------------------------------
+class ColorLut
+{
+public:
+    // Loads a .cube file.  Returns false if the file can't be read
+    // or isn't a valid table.
+    bool Load(const char *path, std::string &errText);
+
+    // Returns true if the file held a 3D table, false for 1D.
+    bool Is3D() const { return m_is3D; }
+
+    // Returns true if the table was baked into per-channel curves.
+    bool IsSeparable() const { return m_separable; }
+
+    // Returns the number of entries per side of a 3D table, or the
+    // number of entries of a 1D table.
+    unsigned GetSize() const { return m_size; }
+
+    // Grades an image in place.  The alpha channel is kept.
+    void Apply(unsigned char *pixels, unsigned width, unsigned height, unsigned stride,
+        unsigned numThreads = 1, WorkerPool *helpers = nullptr) const;
+
+private:
+    void ApplyBand(unsigned char *pixels, unsigned width, unsigned firstRow, unsigned endRow,
+        unsigned stride) const;
+
+    unsigned m_size = 0;                // Entries per side (3D) or entries (1D).
+    bool m_is3D = false;                // True if the file held a 3D table.
+    bool m_separable = false;           // True to use m_curves instead of m_table.
+    unsigned char m_curves[3][256];     // Baked output of each channel (B, G, R) for each input value.
+    std::vector<int16_t> m_table;       // 3D table:  B, G, R, 0 per entry, red fastest, in 1/64 steps.
+    unsigned m_offsets[3][256];         // Table offset (in int16 units) of each input value's cell, per channel.
+    int m_fractions[3][256];            // Position of each input value within its cell, 0 to 256.
+};
+
@@ -0,0 +1,371 @@
+//--------------------------------------------------------------------
+// ControlServer.cpp
+// A C++ module that accepts text commands for a running program on
+// a local (Unix domain) socket.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "ControlServer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <winsock2.h>
+#include <afunix.h>
+#include <windows.h>
+
+// Link to Winsock.
+#pragma comment(lib, "ws2_32.lib")
+
+namespace
+{
+
+// Most reply text held for a client that isn't reading it.  Its
+// further commands wait until the replies drain.
+const size_t MAX_REPLY_BACKLOG = 64 * 1024;
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// The state of one connected client.
+//---------------------------------------------------------------
+struct ControlServer::Client
+{
+    SOCKET m_socket = INVALID_SOCKET;   // Connection to the client.
+    std::string m_input;                // Received text not yet handled.
+    std::string m_output;               // Replies not yet sent.
+    bool m_closeWhenSent = false;       // Disconnect once m_output has been sent.
+    bool m_readHeld = false;            // True if input was left unread while m_output was backed up.
+    bool m_closed = false;              // True once the connection has been closed.
+};
+
+//---------------------------------------------------------------
+ControlServer::ControlServer()
+{
+}
+
+//---------------------------------------------------------------
+ControlServer::~ControlServer()
+{
+    Stop();
+}
+
+//---------------------------------------------------------------
+// Starts listening on a socket at the given path.  Returns false
+// if the socket can't be created.
+//---------------------------------------------------------------
+bool ControlServer::Start(const char *path, Handler handler, std::string &errText)
+{
+    errText.clear();
+    Stop();
+    sockaddr_un addr = {0};
+    if (path == nullptr || *path == '\0' || strlen(path) >= sizeof(addr.sun_path) || !handler)
+    {
+        errText = "Bad parameter.";
+        return false;
+    }
+
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        errText = "WSAStartup failed.";
+        return false;
+    }
+    m_winsockStarted = true;
+
+    SOCKET listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == INVALID_SOCKET)
+    {
+        errText = "Failed creating socket (Unix domain sockets need Windows 10 version 1803 or later).";
+        Stop();
+        return false;
+    }
+    m_listener = listener;
+
+    // A socket file left behind by an earlier run would make
+    // bind() fail.
+    DeleteFileA(path);
+    addr.sun_family = AF_UNIX;
+    strcpy_s(addr.sun_path, sizeof(addr.sun_path), path);
+    if (bind(listener, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == SOCKET_ERROR)
+    {
+        errText = "Failed binding socket to \"" + std::string(path) + "\".";
+        Stop();
+        return false;
+    }
+    m_path = path;
+    if (listen(listener, SOMAXCONN) == SOCKET_ERROR)
+    {
+        errText = "Failed listening on socket.";
+        Stop();
+        return false;
+    }
+
+    m_networkEvent = WSACreateEvent();
+    m_wakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if (m_networkEvent == WSA_INVALID_EVENT || m_wakeEvent == nullptr ||
+        WSAEventSelect(listener, m_networkEvent, FD_ACCEPT) == SOCKET_ERROR)
+    {
+        if (m_networkEvent == WSA_INVALID_EVENT)
+            m_networkEvent = nullptr;
+        errText = "Failed creating events.";
+        Stop();
+        return false;
+    }
+
+    m_handler = handler;
+    m_stop = false;
+    m_thread = std::thread([this]() { ServerThread(); });
+    return true;
+}
+
+//---------------------------------------------------------------
+// Disconnects every client, stops the server thread, and deletes
+// the socket file.
+//---------------------------------------------------------------
+void ControlServer::Stop()
+{
+    if (m_thread.joinable())
+    {
+        m_stop = true;
+        SetEvent(m_wakeEvent);
+        m_thread.join();
+    }
+
+    for (auto &client : m_clients)
+        CloseClient(*client);
+    m_clients.clear();
+    m_handler = nullptr;
+
+    if (m_listener != ~uintptr_t(0))
+    {
+        closesocket(static_cast<SOCKET>(m_listener));
+        m_listener = ~uintptr_t(0);
+    }
+    if (!m_path.empty())
+    {
+        DeleteFileA(m_path.c_str());
+        m_path.clear();
+    }
+    if (m_networkEvent != nullptr)
+    {
+        WSACloseEvent(m_networkEvent);
+        m_networkEvent = nullptr;
+    }
+    if (m_wakeEvent != nullptr)
+    {
+        CloseHandle(m_wakeEvent);
+        m_wakeEvent = nullptr;
+    }
+    if (m_winsockStarted)
+    {
+        WSACleanup();
+        m_winsockStarted = false;
+    }
+}
+
+//---------------------------------------------------------------
+// Runs on the server thread.  Waits for the sockets, then handles
+// whatever commands have arrived.
+//---------------------------------------------------------------
+void ControlServer::ServerThread()
+{
+    HANDLE events[2] = {m_networkEvent, m_wakeEvent};
+    while (!m_stop)
+    {
+        WaitForMultipleObjects(2, events, FALSE, INFINITE);
+        if (m_stop)
+            break;
+
+        // Reset the network event before looking at the sockets,
+        // so anything that happens from here on sets it again.
+        WSAResetEvent(m_networkEvent);
+        AcceptClients();
+        for (auto &client : m_clients)
+        {
+            ReadCommands(*client);
+            SendPending(*client);
+
+            // Only recv() re-arms FD_READ, so input held back for
+            // the backlog has to be read as soon as the backlog
+            // drains, or a client that has sent everything waits
+            // forever.
+            while (client->m_readHeld && !client->m_closed && client->m_output.size() <= MAX_REPLY_BACKLOG)
+            {
+                ReadCommands(*client);
+                SendPending(*client);
+            }
+        }
+
+        for (size_t i = 0; i < m_clients.size();)
+        {
+            if (m_clients[i]->m_closed)
+                m_clients.erase(m_clients.begin() + i);
+            else
+                i++;
+        }
+    }
+}
+
+//---------------------------------------------------------------
+// Accepts every pending connection.
+//---------------------------------------------------------------
+void ControlServer::AcceptClients()
+{
+    for (;;)
+    {
+        SOCKET s = accept(static_cast<SOCKET>(m_listener), nullptr, nullptr);
+        if (s == INVALID_SOCKET)
+            return;
+
+        if (m_clients.size() >= MaxClients ||
+            WSAEventSelect(s, m_networkEvent, FD_READ | FD_WRITE | FD_CLOSE) == SOCKET_ERROR)
+        {
+            closesocket(s);
+            continue;
+        }
+
+        std::unique_ptr<Client> client(new Client);
+        client->m_socket = s;
+        m_clients.push_back(std::move(client));
+    }
+}
+
+//---------------------------------------------------------------
+// Reads whatever the client has sent and handles each complete
+// command line in turn.
+//---------------------------------------------------------------
+void ControlServer::ReadCommands(Client &client)
+{
+    client.m_readHeld = client.m_output.size() > MAX_REPLY_BACKLOG;
+    if (client.m_readHeld)
+        return;
+
+    char buffer[1024];
+    while (!client.m_closed)
+    {
+        int received = recv(client.m_socket, buffer, sizeof(buffer), 0);
+        if (received == 0 || (received == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK))
+        {
+            // The client hung up.
+            CloseClient(client);
+            return;
+        }
+        if (received == SOCKET_ERROR)
+            break;
+
+        // Anything after "quit" is ignored.
+        if (!client.m_closeWhenSent)
+            client.m_input.append(buffer, received);
+    }
+
+    size_t start = 0;
+    while (!client.m_closeWhenSent)
+    {
+        size_t end = client.m_input.find('\n', start);
+        if (end == std::string::npos)
+            break;
+
+        // Lines may end in CR LF, and leading and trailing blanks
+        // are dropped.  Blank lines get no reply.
+        std::string command = client.m_input.substr(start, end - start);
+        start = end + 1;
+        size_t first = command.find_first_not_of(" \t\r");
+        if (first == std::string::npos)
+            continue;
+        command = command.substr(first, command.find_last_not_of(" \t\r") - first + 1);
+
+        if (_stricmp(command.c_str(), "quit") == 0)
+        {
+            client.m_output += "OK\n";
+            client.m_closeWhenSent = true;
+            break;
+        }
+
+        std::string reply, errText;
+        bool ok = m_handler(command, reply, errText);
+        ++m_commandsHandled;
+        if (!reply.empty() && reply.back() != '\n')
+            reply += '\n';
+        client.m_output += reply;
+        client.m_output += ok ? "OK\n" : "ERROR: " + errText + "\n";
+    }
+    client.m_input.erase(0, start);
+
+    if (client.m_input.size() > MaxCommandSize && !client.m_closeWhenSent)
+    {
+        client.m_output += "ERROR: Command too long.\n";
+        client.m_closeWhenSent = true;
+    }
+    if (client.m_closeWhenSent)
+        client.m_input.clear();
+}
+
+//---------------------------------------------------------------
+// Sends as much of the client's pending replies as the socket
+// will take.
+//---------------------------------------------------------------
+void ControlServer::SendPending(Client &client)
+{
+    while (!client.m_closed && !client.m_output.empty())
+    {
+        int sent = send(client.m_socket, client.m_output.data(), static_cast<int>(client.m_output.size()), 0);
+        if (sent == SOCKET_ERROR)
+        {
+            // Would block means the client isn't reading yet; the
+            // rest goes once the socket drains.
+            if (WSAGetLastError() != WSAEWOULDBLOCK)
+                CloseClient(client);
+            return;
+        }
+        client.m_output.erase(0, sent);
+    }
+
+    if (!client.m_closed && client.m_closeWhenSent && client.m_output.empty())
+        CloseClient(client);
+}
+
+//---------------------------------------------------------------
+// Closes a client's connection.
+//---------------------------------------------------------------
+void ControlServer::CloseClient(Client &client)
+{
+    if (client.m_closed)
+        return;
+
+    closesocket(client.m_socket);
+    client.m_closed = true;
+    client.m_input.clear();
+    client.m_output.clear();
+}
@@ -0,0 +1,125 @@
+//--------------------------------------------------------------------
+// ControlServer.h
+// A C++ module that accepts text commands for a running program on
+// a local (Unix domain) socket.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Start() with a socket path and a handler,
+//   and the handler is called with each command line a client
+//   sends.  Whatever the handler puts in 'reply' is sent back,
+//   followed by a line saying "OK", or "ERROR: " and the error
+//   text if the handler returns false.  A client can send any
+//   number of commands on one connection; "quit" closes it.
+//
+// * The socket is an AF_UNIX stream socket (Windows 10 version
+//   1803 and later), so only local processes can connect, and the
+//   file system's permissions on the socket's directory decide
+//   which.  Any file already at the path is deleted first, and the
+//   socket file is deleted when the server stops.
+//
+// * One thread serves every client, as in PreviewServer.  The
+//   handler runs on that thread, so it must only hand requests off
+//   (with atomics, say) rather than wait on the work they ask for.
+//   Commands are answered in the order they arrive.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+//---------------------------------------------------------------
+// A C++ class that serves a line-based command interface on a
+// local socket.
+//---------------------------------------------------------------
+class ControlServer
+{
+public:
+    // Most clients served at once.
+    static const unsigned MaxClients = 8;
+
+    // Longest command line accepted.
+    static const size_t MaxCommandSize = 1024;
+
+    // Called on the server thread with each command (without its
+    // line ending).  Returns false and sets errText if the command
+    // fails; either way, 'reply' holds any lines to send first.
+    typedef std::function<bool(const std::string &command, std::string &reply, std::string &errText)> Handler;
+
+    ControlServer();
+    ~ControlServer();
+
+    ControlServer(const ControlServer &) = delete;
+    ControlServer &operator=(const ControlServer &) = delete;
+
+    // Starts listening on a socket at the given path, handing
+    // commands to 'handler'.  Returns false if the socket can't be
+    // created.
+    bool Start(const char *path, Handler handler, std::string &errText);
+
+    // Disconnects every client, stops the server thread, and
+    // deletes the socket file.
+    void Stop();
+
+    // Statistics.
+    unsigned GetCommandsHandled() const { return m_commandsHandled; }
+
+private:
+    struct Client;
+
+    void ServerThread();
+    void AcceptClients();
+    void ReadCommands(Client &client);
+    void SendPending(Client &client);
+    void CloseClient(Client &client);
+
+    std::string m_path;                 // Path of the socket file.
+    Handler m_handler;                  // Runs the commands.
+    uintptr_t m_listener = ~uintptr_t(0);   // Listening socket (a SOCKET).
+    void *m_networkEvent = nullptr;     // Set when any socket is ready (a WSAEVENT).
+    void *m_wakeEvent = nullptr;        // Set by Stop() (a HANDLE).
+    bool m_winsockStarted = false;      // True if WSAStartup() succeeded.
+    std::thread m_thread;               // The server thread.
+    std::atomic<bool> m_stop{false};    // Set to stop the server thread.
+    std::vector<std::unique_ptr<Client>> m_clients;     // Connected clients; server thread only.
+    std::atomic<unsigned> m_commandsHandled{0};         // Commands passed to the handler.
+};
@@ -0,0 +1,181 @@
+//--------------------------------------------------------------------
+// DeviceRegistry.cpp
+// A C++ module that caches the list of capture devices, their
+// activated device objects, and their capture formats.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "DeviceRegistry.h"
+
+//---------------------------------------------------------------
+DeviceRegistry::DeviceRegistry(std::unique_ptr<DeviceSource> source)
+    : m_source(std::move(source))
+{
+    m_source->WatchForChanges([this]() { Invalidate(); });
+}
+
+//---------------------------------------------------------------
+// Enumerates the devices again if the device list is stale.
+// Cached entries of devices that are still attached are kept,
+// and entries of removed devices are dropped.  The caller must
+// hold m_lock.
+//---------------------------------------------------------------
+void DeviceRegistry::RefreshIfStale()
+{
+    if (!m_stale.exchange(false))
+        return;
+
+    std::vector<DeviceInfo> devices;
+    if (!m_source->EnumerateDevices(devices))
+    {
+        // Try again next time.
+        m_stale = true;
+        return;
+    }
+
+    std::map<std::wstring, std::shared_ptr<Entry>> entries;
+    for (const auto &device : devices)
+    {
+        auto it = m_entries.find(device.m_symbolicLink);
+        entries[device.m_symbolicLink] = (it != m_entries.end()) ?
+            it->second : std::make_shared<Entry>();
+    }
+
+    m_devices.swap(devices);
+    m_entries.swap(entries);
+}
+
+//---------------------------------------------------------------
+// Retrieves the list of capture devices.
+//---------------------------------------------------------------
+std::vector<DeviceInfo> DeviceRegistry::GetDevices()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    RefreshIfStale();
+    return m_devices;
+}
+
+//---------------------------------------------------------------
+// Retrieves the device at the given 0-based index.  Returns
+// false if the index is out of range.
+//---------------------------------------------------------------
+bool DeviceRegistry::GetDevice(unsigned deviceIndex, DeviceInfo &device)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    RefreshIfStale();
+    if (deviceIndex >= m_devices.size())
+        return false;
+
+    device = m_devices[deviceIndex];
+    return true;
+}
+
+//---------------------------------------------------------------
+// Returns the cache entry for the given device, or an empty
+// pointer if the device isn't attached.
+//---------------------------------------------------------------
+std::shared_ptr<DeviceRegistry::Entry> DeviceRegistry::FindEntry(const DeviceInfo &device)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    RefreshIfStale();
+    auto it = m_entries.find(device.m_symbolicLink);
+    if (it == m_entries.end())
+        return nullptr;
+    return it->second;
+}
+
+//---------------------------------------------------------------
+// Activates the device of the given entry if it hasn't been
+// already.  The caller must hold the entry's lock.
+//---------------------------------------------------------------
+std::shared_ptr<void> DeviceRegistry::ActivateEntry(Entry &entry, const DeviceInfo &device)
+{
+    if (!entry.m_device)
+        entry.m_device = m_source->ActivateDevice(device);
+    return entry.m_device;
+}
+
+//---------------------------------------------------------------
+// Returns the activated object for the specified device,
+// activating it first if it hasn't been already.
+//---------------------------------------------------------------
+std::shared_ptr<void> DeviceRegistry::GetActivatedDevice(const DeviceInfo &device)
+{
+    // Activation can be slow, so it is done under the entry's own
+    // lock rather than the registry lock.  That way devices can be
+    // activated in parallel.
+    std::shared_ptr<Entry> entry = FindEntry(device);
+    if (!entry)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(entry->m_lock);
+    return ActivateEntry(*entry, device);
+}
+
+//---------------------------------------------------------------
+// Retrieves the capture formats of the specified device,
+// activating it first if necessary.  Returns true if successful.
+//---------------------------------------------------------------
+bool DeviceRegistry::GetDeviceFormats(const DeviceInfo &device, std::vector<CaptureFormat> &formats)
+{
+    std::shared_ptr<Entry> entry = FindEntry(device);
+    if (!entry)
+        return false;
+
+    std::lock_guard<std::mutex> lock(entry->m_lock);
+    if (!entry->m_haveFormats)
+    {
+        std::shared_ptr<void> activated = ActivateEntry(*entry, device);
+        if (!activated || !m_source->GetDeviceFormats(activated, entry->m_formats))
+            return false;
+        entry->m_haveFormats = true;
+    }
+
+    formats = entry->m_formats;
+    return true;
+}
+
+//---------------------------------------------------------------
+// Drops the cached activated object for the specified device.
+//---------------------------------------------------------------
+void DeviceRegistry::ForgetDevice(const DeviceInfo &device)
+{
+    std::shared_ptr<Entry> entry = FindEntry(device);
+    if (!entry)
+        return;
+
+    std::lock_guard<std::mutex> lock(entry->m_lock);
+    entry->m_device.reset();
+}
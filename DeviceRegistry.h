@@ -0,0 +1,168 @@
+//--------------------------------------------------------------------
+// DeviceRegistry.h
+// A C++ module that caches the list of capture devices, their
+// activated device objects, and their capture formats.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Implement the DeviceSource interface for a
+//   capture API (or a fake one), hand it to a DeviceRegistry, then
+//   look up devices through the registry instead of the capture
+//   API.  The registry enumerates the devices once, activates each
+//   device at most once, and reads each device's format list at
+//   most once.
+//
+// * Devices are keyed by their symbolic link, which stays the same
+//   for a given device even when other devices come and go and the
+//   device indexes shift.
+//
+// * The cached information is refreshed only after the source
+//   reports that a device was added or removed (or Invalidate() is
+//   called).  Activated objects for devices that are still present
+//   survive the refresh.
+//
+// * All members are safe to call from multiple threads.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include "CaptureFormat.h"
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//---------------------------------------------------------------
+// Identifies one capture device.
+//---------------------------------------------------------------
+struct DeviceInfo
+{
+    std::wstring m_symbolicLink;    // Unique name of the device; used as the cache key.
+    std::wstring m_friendlyName;    // Human-readable name of the device.
+};
+
+//---------------------------------------------------------------
+// Interface to a capture API, as used by DeviceRegistry.  The
+// activated device is an opaque object owned by a shared_ptr,
+// whose deleter releases it in whatever way the API requires.
+//---------------------------------------------------------------
+class DeviceSource
+{
+public:
+    virtual ~DeviceSource() = default;
+
+    // Retrieves the list of currently attached capture devices.
+    // Returns true if successful.
+    virtual bool EnumerateDevices(std::vector<DeviceInfo> &devices) = 0;
+
+    // Activates the specified device.  Returns an empty pointer
+    // if the device could not be activated.
+    virtual std::shared_ptr<void> ActivateDevice(const DeviceInfo &device) = 0;
+
+    // Retrieves the capture formats supported by an activated
+    // device.  Returns true if successful.
+    virtual bool GetDeviceFormats(const std::shared_ptr<void> &device,
+        std::vector<CaptureFormat> &formats) = 0;
+
+    // Starts calling 'onChange' whenever a device is added or
+    // removed.  Sources that can't detect changes may ignore this.
+    virtual void WatchForChanges(std::function<void()> onChange) { (void)onChange; }
+};
+
+//---------------------------------------------------------------
+// A C++ class that caches capture device information obtained
+// from a DeviceSource.
+//---------------------------------------------------------------
+class DeviceRegistry
+{
+public:
+    explicit DeviceRegistry(std::unique_ptr<DeviceSource> source);
+
+    DeviceRegistry(const DeviceRegistry &) = delete;
+    DeviceRegistry &operator=(const DeviceRegistry &) = delete;
+
+    // Retrieves the list of capture devices, in the order the
+    // source enumerated them.
+    std::vector<DeviceInfo> GetDevices();
+
+    // Retrieves the device at the given 0-based index.  Returns
+    // false if the index is out of range.
+    bool GetDevice(unsigned deviceIndex, DeviceInfo &device);
+
+    // Returns the activated object for the specified device,
+    // activating it first if it hasn't been already.  Returns an
+    // empty pointer if the device could not be activated.
+    std::shared_ptr<void> GetActivatedDevice(const DeviceInfo &device);
+
+    // Retrieves the capture formats of the specified device,
+    // activating it first if necessary.  Returns true if
+    // successful.
+    bool GetDeviceFormats(const DeviceInfo &device, std::vector<CaptureFormat> &formats);
+
+    // Drops the cached activated object for the specified device,
+    // so the next GetActivatedDevice() activates it again.  Used
+    // when the cached object turns out to be unusable.
+    void ForgetDevice(const DeviceInfo &device);
+
+    // Marks the cached device list as stale, so it is enumerated
+    // again on next use.  Called automatically when the source
+    // reports a device change.
+    void Invalidate() { m_stale = true; }
+
+private:
+    // Cached information about one device.
+    struct Entry
+    {
+        std::mutex m_lock;                      // Serializes activation of this device.
+        std::shared_ptr<void> m_device;         // Activated device, if any.
+        std::vector<CaptureFormat> m_formats;   // Capture formats of the device.
+        bool m_haveFormats = false;             // True once m_formats is filled in.
+    };
+
+    void RefreshIfStale();
+    std::shared_ptr<Entry> FindEntry(const DeviceInfo &device);
+    std::shared_ptr<void> ActivateEntry(Entry &entry, const DeviceInfo &device);
+
+    std::unique_ptr<DeviceSource> m_source;     // Capture API that supplies the devices.
+    std::mutex m_lock;                          // Protects m_devices and m_entries.
+    std::atomic<bool> m_stale{true};            // True if m_devices needs enumerating.
+    std::vector<DeviceInfo> m_devices;          // Devices in enumeration order.
+    std::map<std::wstring, std::shared_ptr<Entry>> m_entries;  // Cache, by symbolic link.
+};
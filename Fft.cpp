@@ -0,0 +1,211 @@
+//--------------------------------------------------------------------
+// Fft.cpp
+// A C++ module for two dimensional radix-2 fast Fourier transforms
+// of small square images.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "Fft.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <emmintrin.h>
+
+namespace
+{
+
+const double PI = 3.14159265358979323846;
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Precomputes the twiddle factors for N x N transforms.  Returns
+// false if N isn't a power of two in range.
+//---------------------------------------------------------------
+bool Fft2d::Init(unsigned size)
+{
+    m_size = 0;
+    if (size < MinSize || size > MaxSize || (size & (size - 1)) != 0)
+        return false;
+
+    unsigned bits = 0;
+    while ((1u << bits) < size)
+        bits++;
+
+    m_bitReverse.resize(size);
+    for (unsigned i = 0; i < size; i++)
+    {
+        unsigned reversed = 0;
+        for (unsigned b = 0; b < bits; b++)
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        m_bitReverse[i] = reversed;
+    }
+
+    m_cos.resize(size / 2);
+    m_sin.resize(size / 2);
+    for (unsigned k = 0; k < size / 2; k++)
+    {
+        m_cos[k] = static_cast<float>(cos(2.0 * PI * k / size));
+        m_sin[k] = static_cast<float>(sin(2.0 * PI * k / size));
+    }
+
+    m_size = size;
+    return true;
+}
+
+//---------------------------------------------------------------
+// Transforms an image in place into its transposed spectrum.
+//---------------------------------------------------------------
+void Fft2d::Forward(float *re, float *im) const
+{
+    TransformColumns(re, im, false);
+    Transpose(re);
+    Transpose(im);
+    TransformColumns(re, im, false);
+}
+
+//---------------------------------------------------------------
+// Transforms a transposed spectrum in place back into an image,
+// scaled by 1 / N^2.
+//---------------------------------------------------------------
+void Fft2d::Inverse(float *re, float *im) const
+{
+    TransformColumns(re, im, true);
+    Transpose(re);
+    Transpose(im);
+    TransformColumns(re, im, true);
+
+    const __m128 scale = _mm_set1_ps(1.0f / (static_cast<float>(m_size) * m_size));
+    const size_t count = static_cast<size_t>(m_size) * m_size;
+    for (size_t i = 0; i < count; i += 4)
+    {
+        _mm_storeu_ps(re + i, _mm_mul_ps(_mm_loadu_ps(re + i), scale));
+        _mm_storeu_ps(im + i, _mm_mul_ps(_mm_loadu_ps(im + i), scale));
+    }
+}
+
+//---------------------------------------------------------------
+// Applies a 1D FFT down every column.
+//---------------------------------------------------------------
+void Fft2d::TransformColumns(
+    float *re,      // in/out:  Real parts, row major.
+    float *im,      // in/out:  Imaginary parts, row major.
+    bool inverse    // in:  True for the inverse transform (conjugate twiddles, no scaling).
+    ) const
+{
+    const unsigned n = m_size;
+
+    // Put the rows in bit-reversed order.
+    for (unsigned i = 0; i < n; i++)
+    {
+        unsigned j = m_bitReverse[i];
+        if (j > i)
+        {
+            std::swap_ranges(re + i * n, re + (i + 1) * n, re + j * n);
+            std::swap_ranges(im + i * n, im + (i + 1) * n, im + j * n);
+        }
+    }
+
+    // Butterflies, each on a pair of whole rows.
+    const float sign = inverse ? 1.0f : -1.0f;
+    for (unsigned half = 1; half < n; half *= 2)
+    {
+        const unsigned twiddleStep = n / (half * 2);
+        for (unsigned start = 0; start < n; start += half * 2)
+        {
+            for (unsigned k = 0; k < half; k++)
+            {
+                const __m128 wr = _mm_set1_ps(m_cos[k * twiddleStep]);
+                const __m128 wi = _mm_set1_ps(sign * m_sin[k * twiddleStep]);
+                float *ar = re + (start + k) * n;
+                float *ai = im + (start + k) * n;
+                float *br = ar + half * n;
+                float *bi = ai + half * n;
+                for (unsigned x = 0; x < n; x += 4)
+                {
+                    __m128 xr = _mm_loadu_ps(br + x);
+                    __m128 xi = _mm_loadu_ps(bi + x);
+                    __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, wr), _mm_mul_ps(xi, wi));
+                    __m128 ti = _mm_add_ps(_mm_mul_ps(xr, wi), _mm_mul_ps(xi, wr));
+                    __m128 ur = _mm_loadu_ps(ar + x);
+                    __m128 ui = _mm_loadu_ps(ai + x);
+                    _mm_storeu_ps(ar + x, _mm_add_ps(ur, tr));
+                    _mm_storeu_ps(ai + x, _mm_add_ps(ui, ti));
+                    _mm_storeu_ps(br + x, _mm_sub_ps(ur, tr));
+                    _mm_storeu_ps(bi + x, _mm_sub_ps(ui, ti));
+                }
+            }
+        }
+    }
+}
+
+//---------------------------------------------------------------
+// Transposes an N x N array in place, in 4x4 blocks.
+//---------------------------------------------------------------
+void Fft2d::Transpose(float *data) const
+{
+    const unsigned n = m_size;
+    for (unsigned by = 0; by < n; by += 4)
+    {
+        for (unsigned bx = by; bx < n; bx += 4)
+        {
+            float *a = data + by * n + bx;
+            float *b = data + bx * n + by;
+            __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + n);
+            __m128 a2 = _mm_loadu_ps(a + 2 * n), a3 = _mm_loadu_ps(a + 3 * n);
+            _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+            if (bx == by)
+            {
+                _mm_storeu_ps(a, a0);
+                _mm_storeu_ps(a + n, a1);
+                _mm_storeu_ps(a + 2 * n, a2);
+                _mm_storeu_ps(a + 3 * n, a3);
+                continue;
+            }
+            __m128 b0 = _mm_loadu_ps(b), b1 = _mm_loadu_ps(b + n);
+            __m128 b2 = _mm_loadu_ps(b + 2 * n), b3 = _mm_loadu_ps(b + 3 * n);
+            _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+            _mm_storeu_ps(a, b0);
+            _mm_storeu_ps(a + n, b1);
+            _mm_storeu_ps(a + 2 * n, b2);
+            _mm_storeu_ps(a + 3 * n, b3);
+            _mm_storeu_ps(b, a0);
+            _mm_storeu_ps(b + n, a1);
+            _mm_storeu_ps(b + 2 * n, a2);
+            _mm_storeu_ps(b + 3 * n, a3);
+        }
+    }
+}
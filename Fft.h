@@ -0,0 +1,95 @@
+//--------------------------------------------------------------------
+// Fft.h
+// A C++ module for two dimensional radix-2 fast Fourier transforms
+// of small square images.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Init() with the size (a power of two),
+//   then call Forward() and Inverse() on as many images as desired.
+//   Images are N x N complex values stored as two separate arrays of
+//   floats, real and imaginary, row major.  An Fft2d is read-only
+//   after Init(), so one object may be shared by several threads.
+//
+// * Each pass transforms every column at once:  the butterflies of
+//   an iterative radix-2 transform are applied to whole rows, four
+//   columns per SSE instruction, so the inner loops run over
+//   contiguous memory.  The image is transposed between the column
+//   pass and the row pass.
+//
+// * To save two transposes, Forward() leaves the spectrum
+//   transposed (frequency (u, v) is stored at row u, column v, with
+//   u horizontal), and Inverse() expects it that way.  Products of
+//   spectra don't care.  Inverse() scales by 1 / N^2, so a round
+//   trip returns the original image.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+
+//---------------------------------------------------------------
+// A C++ class for forward and inverse FFTs of N x N images.
+//---------------------------------------------------------------
+class Fft2d
+{
+public:
+    // Smallest and largest supported sizes.
+    static const unsigned MinSize = 8;
+    static const unsigned MaxSize = 1024;
+
+    // Precomputes the twiddle factors for N x N transforms.
+    // Returns false if N isn't a power of two in range.
+    bool Init(unsigned size);
+
+    unsigned GetSize() const { return m_size; }
+
+    // Transforms an image in place into its (transposed) spectrum.
+    void Forward(float *re, float *im) const;
+
+    // Transforms a (transposed) spectrum in place back into an
+    // image.
+    void Inverse(float *re, float *im) const;
+
+private:
+    void TransformColumns(float *re, float *im, bool inverse) const;
+    void Transpose(float *data) const;
+
+    unsigned m_size = 0;
+    std::vector<unsigned> m_bitReverse; // Row each row moves to before the butterflies.
+    std::vector<float> m_cos;           // Twiddle factors, cos(2 pi k / N) for k < N/2.
+    std::vector<float> m_sin;           // Twiddle factors, sin(2 pi k / N) for k < N/2.
+};
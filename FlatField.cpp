@@ -0,0 +1,378 @@
+//--------------------------------------------------------------------
+// FlatField.cpp
+// A C++ module that corrects vignetting and other fixed patterns of
+// uneven brightness with a flat-field gain map.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "FlatField.h"
+#include "BmpFile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <emmintrin.h>
+
+namespace
+{
+
+// Gains are fixed point with this many fraction bits.
+const int GAIN_BITS = 8;
+const unsigned GAIN_ONE = 1 << GAIN_BITS;
+
+// Largest supported grid spacing.
+const unsigned MAX_GRID_SIZE = 1024;
+
+//---------------------------------------------------------------
+// Converts a flat value to a fixed point gain.
+//---------------------------------------------------------------
+uint16_t MakeGain(
+    double mean,    // in:  Mean of the channel over the flat.
+    double value    // in:  Value of the channel at this point.
+    )
+{
+    double gain = (value > 0.0) ? mean / value : FlatField::MaxGain;
+    gain = __min(gain, static_cast<double>(FlatField::MaxGain));
+    return static_cast<uint16_t>(gain * GAIN_ONE + 0.5);
+}
+
+//---------------------------------------------------------------
+// Multiplies a row of BGRA pixels by their gains.
+//---------------------------------------------------------------
+void ApplyGains(
+    unsigned char *row,     // in/out:  Pixels to correct.
+    const uint16_t *gains,  // in:  Four gains per pixel.
+    unsigned width          // in:  Number of pixels.
+    )
+{
+    // Each sample is widened to (sample << 8) + 128 so the high
+    // half of its product with the gain is rounded.
+    const __m128i half = _mm_set1_epi8(static_cast<char>(0x80));
+    unsigned x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x * 4));
+        __m128i g0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(gains + x * 4));
+        __m128i g1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(gains + x * 4 + 8));
+        __m128i lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(half, v), g0);
+        __m128i hi = _mm_mulhi_epu16(_mm_unpackhi_epi8(half, v), g1);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(row + x * 4), _mm_packus_epi16(lo, hi));
+    }
+    for (unsigned i = x * 4; i < width * 4; i++)
+    {
+        unsigned value = (((row[i] << 8) | 0x80) * gains[i]) >> 16;
+        row[i] = static_cast<unsigned char>(__min(value, 255u));
+    }
+}
+
+//---------------------------------------------------------------
+// Runs a row of BGRA pixels through per-channel curves.
+//---------------------------------------------------------------
+void ApplyCurves(
+    unsigned char *row,         // in/out:  Pixels to adjust.
+    const ColorCurves &curves,  // in:  Curves of blue, green, and red.
+    unsigned width              // in:  Number of pixels.
+    )
+{
+    for (unsigned x = 0; x < width; x++, row += 4)
+    {
+        row[0] = curves.m_curves[0][row[0]];
+        row[1] = curves.m_curves[1][row[1]];
+        row[2] = curves.m_curves[2][row[2]];
+    }
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Builds the gain map from a BGRA flat image.  Returns false if
+// the parameters are out of range.
+//---------------------------------------------------------------
+bool FlatField::Init(const unsigned char *flat, unsigned stride, unsigned width, unsigned height,
+    unsigned gridSize, std::string &errText)
+{
+    m_gains.clear();
+
+    if (flat == nullptr || width < 1 || height < 1 || stride < width * 4)
+    {
+        errText = "Bad parameter.";
+        return false;
+    }
+    if (gridSize == 1 || gridSize > MAX_GRID_SIZE)
+    {
+        errText = "The gain grid spacing must be 0, or 2 to " + std::to_string(MAX_GRID_SIZE) + ".";
+        return false;
+    }
+
+    // The mean of each channel is the level every pixel is brought
+    // to.
+    double sums[3] = {0.0, 0.0, 0.0};
+    for (unsigned y = 0; y < height; y++)
+    {
+        const unsigned char *p = flat + static_cast<size_t>(stride) * y;
+        for (unsigned x = 0; x < width; x++, p += 4)
+        {
+            sums[0] += p[0];
+            sums[1] += p[1];
+            sums[2] += p[2];
+        }
+    }
+    double means[3];
+    for (unsigned c = 0; c < 3; c++)
+        means[c] = sums[c] / (static_cast<double>(width) * height);
+
+    m_width = width;
+    m_height = height;
+    m_gridSize = gridSize;
+    if (gridSize == 0)
+    {
+        m_gridWidth = width;
+        m_gridHeight = height;
+        m_gains.resize(static_cast<size_t>(width) * height * 4);
+        uint16_t *gains = m_gains.data();
+        for (unsigned y = 0; y < height; y++)
+        {
+            const unsigned char *p = flat + static_cast<size_t>(stride) * y;
+            for (unsigned x = 0; x < width; x++, p += 4, gains += 4)
+            {
+                for (unsigned c = 0; c < 3; c++)
+                    gains[c] = MakeGain(means[c], p[c]);
+                gains[3] = GAIN_ONE;
+            }
+        }
+        return true;
+    }
+
+    // Grid points sit every gridSize pixels, with the last ones on
+    // or past the right and bottom edges, and take the average of
+    // the box of the flat around them.
+    m_gridWidth = (width - 1 + gridSize - 1) / gridSize + 1;
+    m_gridHeight = (height - 1 + gridSize - 1) / gridSize + 1;
+    m_gains.resize(static_cast<size_t>(m_gridWidth) * m_gridHeight * 4);
+    uint16_t *gains = m_gains.data();
+    for (unsigned j = 0; j < m_gridHeight; j++)
+    {
+        unsigned cy = j * gridSize;
+        unsigned y0 = (cy > gridSize / 2) ? cy - gridSize / 2 : 0;
+        unsigned y1 = __min(cy + gridSize / 2 + 1, height);
+        for (unsigned i = 0; i < m_gridWidth; i++, gains += 4)
+        {
+            unsigned cx = i * gridSize;
+            unsigned x0 = (cx > gridSize / 2) ? cx - gridSize / 2 : 0;
+            unsigned x1 = __min(cx + gridSize / 2 + 1, width);
+            double box[3] = {0.0, 0.0, 0.0};
+            unsigned count = 0;
+            for (unsigned y = __min(y0, height - 1); y < y1; y++)
+            {
+                const unsigned char *p = flat + static_cast<size_t>(stride) * y + __min(x0, width - 1) * 4;
+                for (unsigned x = __min(x0, width - 1); x < x1; x++, p += 4)
+                {
+                    box[0] += p[0];
+                    box[1] += p[1];
+                    box[2] += p[2];
+                }
+                count += x1 - __min(x0, width - 1);
+            }
+            for (unsigned c = 0; c < 3; c++)
+                gains[c] = MakeGain(means[c], box[c] / __max(count, 1u));
+            gains[3] = GAIN_ONE;
+        }
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------
+// Reads the flat image from a .BMP file and builds the gain map.
+// Returns false if the file can't be read or is the wrong size.
+//---------------------------------------------------------------
+bool FlatField::Load(const char *path, unsigned width, unsigned height, unsigned gridSize,
+    std::string &errText)
+{
+    m_gains.clear();
+
+    unsigned flatWidth = 0, flatHeight = 0;
+    std::vector<unsigned char> flat;
+    if (!BmpRead(path, flatWidth, flatHeight, flat))
+    {
+        errText = std::string("Can't read \"") + path + "\" as a 24-bit or 32-bit .BMP file.";
+        return false;
+    }
+    if (flatWidth != width || flatHeight != height)
+    {
+        char buf[128];
+        sprintf_s(buf, sizeof(buf), "The flat is %ux%u but the frames are %ux%u.",
+            flatWidth, flatHeight, width, height);
+        errText = buf;
+        return false;
+    }
+
+    return Init(flat.data(), width * 4, width, height, gridSize, errText);
+}
+
+//---------------------------------------------------------------
+// Corrects a BGRA image of the size given to Init() in place,
+// and runs it through the curves, if any, a row at a time.
+//---------------------------------------------------------------
+void FlatField::Apply(unsigned char *pixels, unsigned stride, const ColorCurves *curves) const
+{
+    if (m_gains.empty())
+        return;
+
+    if (m_gridSize == 0)
+    {
+        for (unsigned y = 0; y < m_height; y++)
+        {
+            unsigned char *row = pixels + static_cast<size_t>(stride) * y;
+            ApplyGains(row, &m_gains[static_cast<size_t>(m_width) * 4 * y], m_width);
+            if (curves != nullptr)
+                ApplyCurves(row, *curves, m_width);
+        }
+        return;
+    }
+
+    // Expand the grid one row at a time; the row of gains stays in
+    // the L1 cache.
+    std::vector<uint16_t> rowGains(static_cast<size_t>(m_width) * 4);
+    for (unsigned y = 0; y < m_height; y++)
+    {
+        unsigned char *row = pixels + static_cast<size_t>(stride) * y;
+        ExpandGridRow(y, rowGains.data());
+        ApplyGains(row, rowGains.data(), m_width);
+        if (curves != nullptr)
+            ApplyCurves(row, *curves, m_width);
+    }
+}
+
+//---------------------------------------------------------------
+// Returns one BGRA pixel corrected as Apply() would correct it.
+//---------------------------------------------------------------
+uint32_t FlatField::CorrectPixel(unsigned x, unsigned y, uint32_t bgra) const
+{
+    if (m_gains.empty() || x >= m_width || y >= m_height)
+        return bgra;
+
+    uint16_t gains[4];
+    GetGains(x, y, gains);
+    uint32_t result = 0;
+    for (unsigned c = 0; c < 4; c++)
+    {
+        unsigned sample = (bgra >> (c * 8)) & 0xff;
+        unsigned value = (((sample << 8) | 0x80) * gains[c]) >> 16;
+        result |= __min(value, 255u) << (c * 8);
+    }
+    return result;
+}
+
+//---------------------------------------------------------------
+// Looks up, or interpolates from the grid, the gains of one pixel.
+//---------------------------------------------------------------
+void FlatField::GetGains(
+    unsigned x,         // in:  Column of the pixel.
+    unsigned y,         // in:  Row of the pixel.
+    uint16_t *gains     // out:  The pixel's four gains.
+    ) const
+{
+    if (m_gridSize == 0)
+    {
+        memcpy(gains, &m_gains[(static_cast<size_t>(m_width) * y + x) * 4], 4 * sizeof(uint16_t));
+        return;
+    }
+
+    const unsigned g = m_gridSize;
+    unsigned i = x / g, j = y / g;
+    unsigned i1 = __min(i + 1, m_gridWidth - 1);
+    unsigned j1 = __min(j + 1, m_gridHeight - 1);
+    int fx = static_cast<int>(((x % g) << GAIN_BITS) / g);
+    int fy = static_cast<int>(((y % g) << GAIN_BITS) / g);
+    const uint16_t *above = &m_gains[static_cast<size_t>(m_gridWidth) * 4 * j];
+    const uint16_t *below = &m_gains[static_cast<size_t>(m_gridWidth) * 4 * j1];
+    for (unsigned c = 0; c < 4; c++)
+    {
+        int a = above[i * 4 + c], b = below[i * 4 + c];
+        int a1 = above[i1 * 4 + c], b1 = below[i1 * 4 + c];
+        int left = a + (((b - a) * fy) >> GAIN_BITS);
+        int right = a1 + (((b1 - a1) * fy) >> GAIN_BITS);
+        gains[c] = static_cast<uint16_t>(left + (((right - left) * fx) >> GAIN_BITS));
+    }
+}
+
+//---------------------------------------------------------------
+// Upsamples the gain grid bilinearly into the gains of one row.
+//---------------------------------------------------------------
+void FlatField::ExpandGridRow(
+    unsigned y,         // in:  Row to expand.
+    uint16_t *gains     // out:  Four gains per pixel of the row.
+    ) const
+{
+    // Blend the grid rows above and below.
+    const unsigned g = m_gridSize;
+    unsigned j = y / g;
+    unsigned j1 = __min(j + 1, m_gridHeight - 1);
+    int fy = static_cast<int>(((y % g) << GAIN_BITS) / g);
+    const uint16_t *above = &m_gains[static_cast<size_t>(m_gridWidth) * 4 * j];
+    const uint16_t *below = &m_gains[static_cast<size_t>(m_gridWidth) * 4 * j1];
+    int points[4 * 2];
+
+    // Then step across each span between grid points, adding a
+    // constant 16.16 increment per pixel.
+    const __m128i round = _mm_set1_epi32(1 << 15);
+    for (unsigned i = 0; i < m_gridWidth; i++)
+    {
+        unsigned x0 = i * g;
+        if (x0 >= m_width)
+            break;
+        unsigned x1 = __min(x0 + g, m_width);
+        unsigned i1 = __min(i + 1, m_gridWidth - 1);
+        for (unsigned c = 0; c < 4; c++)
+        {
+            int a = above[i * 4 + c], b = below[i * 4 + c];
+            int a1 = above[i1 * 4 + c], b1 = below[i1 * 4 + c];
+            points[c] = a + (((b - a) * fy) >> GAIN_BITS);
+            points[4 + c] = a1 + (((b1 - a1) * fy) >> GAIN_BITS);
+        }
+
+        __m128i acc = _mm_slli_epi32(_mm_setr_epi32(points[0], points[1], points[2], points[3]), 16);
+        __m128i step = _mm_setr_epi32((points[4] - points[0]) * 65536 / static_cast<int>(g),
+            (points[5] - points[1]) * 65536 / static_cast<int>(g),
+            (points[6] - points[2]) * 65536 / static_cast<int>(g),
+            (points[7] - points[3]) * 65536 / static_cast<int>(g));
+        for (unsigned x = x0; x < x1; x++)
+        {
+            __m128i gain = _mm_srai_epi32(_mm_add_epi32(acc, round), 16);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(gains + x * 4), _mm_packs_epi32(gain, gain));
+            acc = _mm_add_epi32(acc, step);
+        }
+    }
+}
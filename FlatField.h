@@ -0,0 +1,131 @@
+//--------------------------------------------------------------------
+// FlatField.h
+// A C++ module that corrects vignetting and other fixed patterns of
+// uneven brightness with a flat-field gain map.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Capture a calibration ("flat") image of an
+//   evenly lit, featureless target, e.g. with an average= composite
+//   of a white card filling the view, out of focus.  Call Load()
+//   (or Init()) with that image, then call Apply() on each frame of
+//   the same size.  A FlatField is read-only after Init(), so one
+//   object may be shared by several threads.
+//
+// * The gains apply to frames straight out of conversion, so the
+//   flat has to be in that geometry and color:  the same
+//   orientation and privacy mask, but with no lens correction,
+//   homography, stabilization, LUT, auto-levels, or white balance.
+//   Composites are taken after all of those, so an average=
+//   composite only makes a usable flat when they are all off.
+//
+// * The gain of each channel is the channel's mean over the flat
+//   divided by its value at that point, so corrected frames keep
+//   their overall brightness while the corners catch up with the
+//   center.  Gains are 8.8 fixed point, limited to MaxGain, and are
+//   applied with SSE2 multiply-high instructions.
+//
+// * With a grid size of 0, Init() keeps a gain for every pixel (8
+//   bytes per pixel), which also corrects small blemishes such as
+//   dust.  With a grid size of N, it keeps only the gains at every
+//   Nth pixel, each averaged over an NxN box of the flat, and
+//   Apply() upsamples them bilinearly one row at a time.  That is
+//   enough for vignetting, which varies slowly, and takes a tiny
+//   fraction of the memory.
+//
+// * Apply() can also run each corrected row through per-channel
+//   color curves while the row is still in the L1 cache, so curves
+//   that have to follow the correction (such as auto-levels) cost
+//   no pass of their own.  CorrectPixel() corrects single pixels,
+//   e.g. the samples those curves are worked out from.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "CaptureFormat.h"
+
+//---------------------------------------------------------------
+// A C++ class that holds a flat-field gain map and applies it to
+// BGRA images.
+//---------------------------------------------------------------
+class FlatField
+{
+public:
+    // Largest gain applied to any pixel.
+    static const unsigned MaxGain = 8;
+
+    // Builds the gain map from a BGRA flat image.  'gridSize' is 0
+    // for a per-pixel map, or the spacing of the gain grid.  Returns
+    // false if the parameters are out of range.
+    bool Init(const unsigned char *flat, unsigned stride, unsigned width, unsigned height,
+        unsigned gridSize, std::string &errText);
+
+    // Reads the flat image from a .BMP file and builds the gain
+    // map.  Returns false if the file can't be read or isn't
+    // 'width' by 'height' pixels.
+    bool Load(const char *path, unsigned width, unsigned height, unsigned gridSize, std::string &errText);
+
+    // Returns true if Init() hasn't built a gain map.
+    bool IsEmpty() const { return m_gains.empty(); }
+
+    // Returns the size of the gain map in bytes.
+    size_t GetMapSize() const { return m_gains.size() * sizeof(uint16_t); }
+
+    // Corrects a BGRA image of the size given to Init() in place.
+    // If 'curves' is given, each corrected pixel is also run through
+    // them; the alpha channel is kept.
+    void Apply(unsigned char *pixels, unsigned stride, const ColorCurves *curves = nullptr) const;
+
+    // Returns a BGRA pixel at (x, y) as Apply() would correct it.
+    // With a gain grid, the gain is interpolated directly rather
+    // than stepped across the row, so it may differ by a level.
+    uint32_t CorrectPixel(unsigned x, unsigned y, uint32_t bgra) const;
+
+private:
+    void ExpandGridRow(unsigned y, uint16_t *gains) const;
+    void GetGains(unsigned x, unsigned y, uint16_t *gains) const;
+
+    unsigned m_width = 0;
+    unsigned m_height = 0;
+    unsigned m_gridSize = 0;            // Spacing of the gain grid; 0 for per-pixel gains.
+    unsigned m_gridWidth = 0;           // Grid points across (or pixels, with per-pixel gains).
+    unsigned m_gridHeight = 0;          // Grid points down (or rows).
+    std::vector<uint16_t> m_gains;      // B, G, R, and alpha gains of each grid point, 8.8 fixed point.
+};
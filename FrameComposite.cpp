@@ -0,0 +1,216 @@
+//--------------------------------------------------------------------
+// FrameComposite.cpp
+// A C++ module for blending every frame of a capture session into
+// a single long-exposure or star-trail image.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "FrameComposite.h"
+#include "BmpFile.h"
+#include "Logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+
+//---------------------------------------------------------------
+FrameComposite::~FrameComposite()
+{
+    WaitForSnapshot();
+}
+
+//---------------------------------------------------------------
+// Starts a new composite of 32-bit BGRA frames with the given
+// dimensions.  Returns false if the parameters are bad.
+//---------------------------------------------------------------
+bool FrameComposite::Begin(unsigned width, unsigned height, CompositeMode mode)
+{
+    if (width < 1 || height < 1)
+        return false;
+
+    WaitForSnapshot();
+
+    m_width = width;
+    m_height = height;
+    m_frameSize = static_cast<size_t>(width) * height * 4;
+    m_mode = mode;
+    m_frameCount = 0;
+
+    if (m_mode == CM_LIGHTEN)
+    {
+        m_max.assign(m_frameSize, 0);
+        m_sum.clear();
+    }
+    else
+    {
+        m_sum.assign(m_frameSize, 0);
+        m_max.clear();
+    }
+    m_snapshot.resize(m_frameSize);
+
+    return true;
+}
+
+//---------------------------------------------------------------
+// Blends a 32-bit BGRA frame into the composite.  Returns false
+// if the frame is the wrong size.
+//---------------------------------------------------------------
+bool FrameComposite::AddFrame(const void *data, size_t dataSize)
+{
+    if (data == nullptr || m_frameSize == 0 || dataSize < m_frameSize)
+        return false;
+
+    const unsigned char *in = static_cast<const unsigned char *>(data);
+    size_t i = 0;
+
+    if (m_mode == CM_LIGHTEN)
+    {
+        unsigned char *acc = m_max.data();
+        for (; i + 16 <= m_frameSize; i += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(acc + i), _mm_max_epu8(a, v));
+        }
+        for (; i < m_frameSize; ++i)
+            acc[i] = __max(acc[i], in[i]);
+    }
+    else
+    {
+        // Widen each sample to 32 bits and add it to the running sum.
+        const __m128i zero = _mm_setzero_si128();
+        uint32_t *acc = m_sum.data();
+        for (; i + 16 <= m_frameSize; i += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            __m128i lo = _mm_unpacklo_epi8(v, zero);
+            __m128i hi = _mm_unpackhi_epi8(v, zero);
+            __m128i *pacc = reinterpret_cast<__m128i *>(acc + i);
+            _mm_storeu_si128(pacc + 0, _mm_add_epi32(_mm_loadu_si128(pacc + 0), _mm_unpacklo_epi16(lo, zero)));
+            _mm_storeu_si128(pacc + 1, _mm_add_epi32(_mm_loadu_si128(pacc + 1), _mm_unpackhi_epi16(lo, zero)));
+            _mm_storeu_si128(pacc + 2, _mm_add_epi32(_mm_loadu_si128(pacc + 2), _mm_unpacklo_epi16(hi, zero)));
+            _mm_storeu_si128(pacc + 3, _mm_add_epi32(_mm_loadu_si128(pacc + 3), _mm_unpackhi_epi16(hi, zero)));
+        }
+        for (; i < m_frameSize; ++i)
+            acc[i] += in[i];
+    }
+
+    ++m_frameCount;
+    return true;
+}
+
+//---------------------------------------------------------------
+// Renders the composite so far as a 32-bit BGRA image into 'out'.
+//---------------------------------------------------------------
+void FrameComposite::Render(unsigned char *out) const
+{
+    if (m_mode == CM_LIGHTEN)
+    {
+        memcpy(out, m_max.data(), m_frameSize);
+        return;
+    }
+
+    const uint32_t *acc = m_sum.data();
+    const float scale = m_frameCount ? 1.0f / m_frameCount : 0.0f;
+    const __m128 vscale = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 16 <= m_frameSize; i += 16)
+    {
+        const __m128i *pacc = reinterpret_cast<const __m128i *>(acc + i);
+        __m128i r0 = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(pacc + 0)), vscale));
+        __m128i r1 = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(pacc + 1)), vscale));
+        __m128i r2 = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(pacc + 2)), vscale));
+        __m128i r3 = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(pacc + 3)), vscale));
+        __m128i lo = _mm_packs_epi32(r0, r1);
+        __m128i hi = _mm_packs_epi32(r2, r3);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packus_epi16(lo, hi));
+    }
+    for (; i < m_frameSize; ++i)
+        out[i] = static_cast<unsigned char>(__min(255.0f, acc[i] * scale + 0.5f));
+}
+
+//---------------------------------------------------------------
+// Writes the composite so far to a .BMP file on a background
+// thread.  Returns false without waiting if the previous
+// snapshot is still being written.
+//---------------------------------------------------------------
+bool FrameComposite::WriteSnapshotAsync(const char *path)
+{
+    if (path == nullptr || m_frameSize == 0 || m_writing)
+        return false;
+
+    // The previous writer has finished, so reap its thread.
+    if (m_writer.joinable())
+        m_writer.join();
+
+    Render(m_snapshot.data());
+
+    m_writing = true;
+    std::string snapshotPath(path);
+    m_writer = std::thread([this, snapshotPath]()
+    {
+        if (!BmpWrite(snapshotPath.c_str(), m_width, m_height, m_width * 4, 32, m_snapshot.data()))
+            Logger::Get().Log(LL_ERROR, "Failed writing composite snapshot to \"%s\"!", snapshotPath);
+        m_writing = false;
+    });
+
+    return true;
+}
+
+//---------------------------------------------------------------
+// Writes the composite so far to a .BMP file, waiting for any
+// background snapshot to finish first.  Returns true if
+// successful.
+//---------------------------------------------------------------
+bool FrameComposite::WriteSnapshot(const char *path)
+{
+    if (path == nullptr || m_frameSize == 0)
+        return false;
+
+    WaitForSnapshot();
+    Render(m_snapshot.data());
+    return BmpWrite(path, m_width, m_height, m_width * 4, 32, m_snapshot.data());
+}
+
+//---------------------------------------------------------------
+// Waits for the background snapshot, if any, to finish.
+//---------------------------------------------------------------
+void FrameComposite::WaitForSnapshot()
+{
+    if (m_writer.joinable())
+        m_writer.join();
+    m_writing = false;
+}
@@ -0,0 +1,122 @@
+//--------------------------------------------------------------------
+// FrameComposite.h
+// A C++ module for blending every frame of a capture session into
+// a single long-exposure or star-trail image.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Begin() with the frame size, call
+//   AddFrame() with each captured BGRA frame, and call
+//   WriteSnapshot() to save the composite so far.
+//
+// * The memory used is fixed by the frame size, no matter how many
+//   frames are merged:  one byte per sample for the lighten blend,
+//   and a 32-bit running sum per sample for the average blend.
+//
+// * WriteSnapshotAsync() renders the composite into a separate
+//   buffer and writes it to disk on a background thread, so the
+//   capture loop only pays for one pass over the frame.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+//---------------------------------------------------------------
+// Ways of blending the frames of a session.
+//---------------------------------------------------------------
+enum CompositeMode
+{
+    CM_LIGHTEN = 0,     // Running per-sample maximum (star trails).
+    CM_AVERAGE = 1      // Running per-sample average (long exposure).
+};
+
+//---------------------------------------------------------------
+// A C++ class for blending a stream of BGRA frames into one
+// composite image.
+//---------------------------------------------------------------
+class FrameComposite
+{
+public:
+    FrameComposite() = default;
+    ~FrameComposite();
+
+    FrameComposite(const FrameComposite &) = delete;
+    FrameComposite &operator=(const FrameComposite &) = delete;
+
+    // Starts a new composite of 32-bit BGRA frames with the given
+    // dimensions.  Returns false if the parameters are bad.
+    bool Begin(unsigned width, unsigned height, CompositeMode mode);
+
+    // Blends a 32-bit BGRA frame into the composite.  Returns
+    // false if the frame is the wrong size.
+    bool AddFrame(const void *data, size_t dataSize);
+
+    // Writes the composite so far to a .BMP file on a background
+    // thread.  Returns false without waiting if the previous
+    // snapshot is still being written.
+    bool WriteSnapshotAsync(const char *path);
+
+    // Writes the composite so far to a .BMP file, waiting for any
+    // background snapshot to finish first.  Returns true if
+    // successful.
+    bool WriteSnapshot(const char *path);
+
+    // Waits for the background snapshot, if any, to finish.
+    void WaitForSnapshot();
+
+    // Returns the number of frames blended into the composite.
+    unsigned GetFrameCount() const { return m_frameCount; }
+
+private:
+    void Render(unsigned char *out) const;
+
+    unsigned m_width = 0;                   // Width of each frame in pixels.
+    unsigned m_height = 0;                  // Height of each frame in pixels.
+    size_t m_frameSize = 0;                 // Size of each frame in bytes.
+    CompositeMode m_mode = CM_LIGHTEN;      // How the frames get blended.
+    unsigned m_frameCount = 0;              // Number of frames blended so far.
+    std::vector<unsigned char> m_max;       // Running maximum (CM_LIGHTEN).
+    std::vector<uint32_t> m_sum;            // Running sum (CM_AVERAGE).
+    std::vector<unsigned char> m_snapshot;  // Rendered image for the background writer.
+    std::thread m_writer;                   // Background snapshot writer.
+    std::atomic<bool> m_writing{false};     // True while m_writer is busy.
+};
@@ -0,0 +1,175 @@
+//--------------------------------------------------------------------
+// FrameQuality.cpp
+// A C++ module for cheaply checking whether a captured frame holds
+// a real picture.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "FrameQuality.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+namespace
+{
+
+//---------------------------------------------------------------
+// Computes the brightness statistics of any frame from a sample
+// grid of about 32x32 pixels, using 'getLuma' to read the luma of
+// the pixel at a given scanline and column.  The step is the size
+// divided by 32, rounded down, so a side gets from 32 to 63
+// samples (every pixel, if it is shorter than 32).
+//---------------------------------------------------------------
+template <typename GetLuma>
+void SampleGrid(unsigned width, unsigned height, GetLuma getLuma, FrameStats &stats)
+{
+    const unsigned gridSize = 32;
+    const unsigned stepX = __max(1u, width / gridSize);
+    const unsigned stepY = __max(1u, height / gridSize);
+
+    unsigned minLuma = 255, maxLuma = 0;
+    unsigned long long sum = 0;
+    unsigned count = 0;
+
+    // Start half a step in, so the grid is centered on the frame.
+    for (unsigned y = stepY / 2; y < height; y += stepY)
+    {
+        for (unsigned x = stepX / 2; x < width; x += stepX)
+        {
+            unsigned luma = getLuma(y, x);
+            minLuma = __min(minLuma, luma);
+            maxLuma = __max(maxLuma, luma);
+            sum += luma;
+            ++count;
+        }
+    }
+
+    stats.m_meanLuma = static_cast<float>(sum) / count;
+    stats.m_minLuma = minLuma;
+    stats.m_maxLuma = maxLuma;
+}
+
+//---------------------------------------------------------------
+// Returns the Rec. 601 luma of a BGR pixel in 8-bit fixed point.
+//---------------------------------------------------------------
+inline unsigned LumaOfBgr(const unsigned char *p)
+{
+    return (29 * p[0] + 150 * p[1] + 77 * p[2] + 128) >> 8;
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Computes the brightness statistics of a 32-bit BGRA frame by
+// sampling a grid of about 32x32 pixels.  Returns false if the
+// parameters are bad.
+//---------------------------------------------------------------
+bool SampleFrameStats(const void *data, unsigned width, unsigned height,
+    unsigned stride, FrameStats &stats)
+{
+    if (data == nullptr || width < 1 || height < 1 || stride < width * 4)
+        return false;
+
+    const unsigned char *pixels = static_cast<const unsigned char *>(data);
+    SampleGrid(width, height, [=](unsigned y, unsigned x)
+    {
+        return LumaOfBgr(pixels + static_cast<size_t>(stride) * y + x * 4);
+    }, stats);
+    return true;
+}
+
+//---------------------------------------------------------------
+// Computes the brightness statistics of a frame in the device's
+// native pixel format.  Returns false if the parameters are bad.
+//---------------------------------------------------------------
+bool SampleRawFrameStats(const void *raw, size_t rawSize,
+    const CaptureFormat &format, FrameStats &stats)
+{
+    const unsigned width = format.m_width;
+    const unsigned height = format.m_height;
+    const size_t stride = format.m_stride;
+    if (raw == nullptr || width < 1 || height < 1 || rawSize < stride * height)
+        return false;
+
+    const unsigned char *pixels = static_cast<const unsigned char *>(raw);
+    switch (format.m_pixelType)
+    {
+    case CPT_RGB24:
+        SampleGrid(width, height, [=](unsigned y, unsigned x)
+            { return LumaOfBgr(pixels + stride * y + x * 3); }, stats);
+        return true;
+
+    case CPT_RGB32:
+        SampleGrid(width, height, [=](unsigned y, unsigned x)
+            { return LumaOfBgr(pixels + stride * y + x * 4); }, stats);
+        return true;
+
+    case CPT_YUY2:
+        // Y0 U Y1 V:  every other byte is a Y sample.
+        SampleGrid(width, height, [=](unsigned y, unsigned x)
+            { return static_cast<unsigned>(pixels[stride * y + x * 2]); }, stats);
+        return true;
+
+    case CPT_NV12:
+        // The Y plane comes first.
+        SampleGrid(width, height, [=](unsigned y, unsigned x)
+            { return static_cast<unsigned>(pixels[stride * y + x]); }, stats);
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+//---------------------------------------------------------------
+// Returns true if the frame described by 'stats' is black or
+// otherwise uniform.
+//---------------------------------------------------------------
+bool IsFrameBlank(const FrameStats &stats, unsigned tolerance)
+{
+    return stats.m_maxLuma - stats.m_minLuma <= tolerance;
+}
+
+//---------------------------------------------------------------
+// Returns true if the brightness of two consecutive frames is
+// within 'percent' percent of each other.
+//---------------------------------------------------------------
+bool IsExposureSettled(const FrameStats &prev, const FrameStats &cur, float percent)
+{
+    // Allow at least one luma level of change, so very dark
+    // scenes can still count as settled.
+    float limit = __max(1.0f, prev.m_meanLuma * percent / 100.0f);
+    return fabsf(cur.m_meanLuma - prev.m_meanLuma) <= limit;
+}
@@ -0,0 +1,95 @@
+//--------------------------------------------------------------------
+// FrameQuality.h
+// A C++ module for cheaply checking whether a captured frame holds
+// a real picture.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * The checks look at a sparse grid of pixels rather than the
+//   whole frame, so they cost a few microseconds regardless of the
+//   frame size.
+//
+// * A frame is considered blank if every sampled pixel has nearly
+//   the same brightness.  That catches the all-black frames some
+//   devices deliver while starting up, without rejecting genuinely
+//   dark night frames, which still contain sensor noise.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include "CaptureFormat.h"
+
+//---------------------------------------------------------------
+// Brightness statistics of a frame, from a sparse sample grid.
+// Luma values are in the range 0 to 255.
+//---------------------------------------------------------------
+struct FrameStats
+{
+    float m_meanLuma = 0.0f;    // Average luma of the sampled pixels.
+    unsigned m_minLuma = 0;     // Darkest sampled pixel.
+    unsigned m_maxLuma = 0;     // Brightest sampled pixel.
+};
+
+//---------------------------------------------------------------
+// Computes the brightness statistics of a 32-bit BGRA frame by
+// sampling a grid of about 32x32 pixels (fewer than 64 per
+// side).  Returns false if the parameters are bad.
+//---------------------------------------------------------------
+bool SampleFrameStats(const void *data, unsigned width, unsigned height,
+    unsigned stride, FrameStats &stats);
+
+//---------------------------------------------------------------
+// Computes the brightness statistics of a frame in the device's
+// native pixel format, as retrieved by GrabRawFrame(), from the
+// same sample grid.  For YUV formats the Y samples are used
+// directly.  Returns false if the parameters are bad.
+//---------------------------------------------------------------
+bool SampleRawFrameStats(const void *raw, size_t rawSize,
+    const CaptureFormat &format, FrameStats &stats);
+
+//---------------------------------------------------------------
+// Returns true if the frame described by 'stats' is black or
+// otherwise uniform, i.e. the sampled luma values span no more
+// than 'tolerance' levels.
+//---------------------------------------------------------------
+bool IsFrameBlank(const FrameStats &stats, unsigned tolerance = 2);
+
+//---------------------------------------------------------------
+// Returns true if the brightness of two consecutive frames is
+// within 'percent' percent of each other, meaning the device's
+// automatic exposure has settled.
+//---------------------------------------------------------------
+bool IsExposureSettled(const FrameStats &prev, const FrameStats &cur, float percent = 2.0f);
@@ -0,0 +1,114 @@
+//--------------------------------------------------------------------
+// FrameRing.cpp
+// A C++ module that keeps a camera's most recent timestamped
+// frames, for matching up frames from several cameras.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "FrameRing.h"
+
+#include <stdlib.h>
+
+//---------------------------------------------------------------
+FrameRing::FrameRing(size_t capacity)
+{
+    Reset(capacity);
+}
+
+//---------------------------------------------------------------
+// Empties the ring and changes the number of frames it holds.
+//---------------------------------------------------------------
+void FrameRing::Reset(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_slots.resize(__max(capacity, size_t(1)));
+    m_next = 0;
+    m_count = 0;
+}
+
+//---------------------------------------------------------------
+// Adds a frame, replacing the oldest one if the ring is full.
+//---------------------------------------------------------------
+void FrameRing::Push(std::vector<unsigned char> &raw, const FrameTimestamp &timestamp)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    Slot &slot = m_slots[m_next];
+    slot.m_raw.swap(raw);
+    slot.m_timestamp = timestamp;
+
+    m_next = (m_next + 1) % m_slots.size();
+    if (m_count < m_slots.size())
+        ++m_count;
+}
+
+//---------------------------------------------------------------
+// Copies out the frame whose capture time is closest to
+// 'reference'.  Returns false if the ring is empty.
+//---------------------------------------------------------------
+bool FrameRing::GetClosest(std::chrono::steady_clock::time_point reference,
+    std::vector<unsigned char> &raw, FrameTimestamp &timestamp)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_count == 0)
+        return false;
+
+    const Slot *closest = nullptr;
+    std::chrono::steady_clock::duration closestDistance;
+    for (size_t i = 0; i < m_count; i++)
+    {
+        const Slot &slot = m_slots[i];
+        auto distance = slot.m_timestamp.m_captureTime - reference;
+        if (distance < distance.zero())
+            distance = -distance;
+        if (closest == nullptr || distance < closestDistance)
+        {
+            closest = &slot;
+            closestDistance = distance;
+        }
+    }
+
+    raw = closest->m_raw;
+    timestamp = closest->m_timestamp;
+    return true;
+}
+
+//---------------------------------------------------------------
+// Returns the number of frames in the ring.
+//---------------------------------------------------------------
+size_t FrameRing::GetCount()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_count;
+}
@@ -0,0 +1,99 @@
+//--------------------------------------------------------------------
+// FrameRing.h
+// A C++ module that keeps a camera's most recent timestamped
+// frames, for matching up frames from several cameras.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Declare a FrameRing with the number of frames
+//   to keep, call Push() with each frame the camera delivers, and
+//   call GetClosest() to fetch the frame captured closest to a
+//   given time.
+//
+// * The ring's slots own their frame buffers.  Push() swaps the
+//   caller's buffer with the oldest slot's, so a camera streaming
+//   into the ring reuses the same buffers instead of allocating a
+//   new one for every frame.
+//
+// * Push() and GetClosest() may be called from different threads.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include "CameraFrameGrabber.h"
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+//---------------------------------------------------------------
+// A C++ class that holds the most recent frames of one camera.
+//---------------------------------------------------------------
+class FrameRing
+{
+public:
+    explicit FrameRing(size_t capacity = 8);
+
+    // Empties the ring and changes the number of frames it holds.
+    void Reset(size_t capacity);
+
+    // Adds a frame, replacing the oldest one if the ring is full.
+    // 'raw' is swapped with the replaced slot's buffer, so on
+    // return it holds a spare buffer of undefined contents.
+    void Push(std::vector<unsigned char> &raw, const FrameTimestamp &timestamp);
+
+    // Copies out the frame whose capture time is closest to
+    // 'reference'.  Returns false if the ring is empty.
+    bool GetClosest(std::chrono::steady_clock::time_point reference,
+        std::vector<unsigned char> &raw, FrameTimestamp &timestamp);
+
+    // Returns the number of frames in the ring.
+    size_t GetCount();
+
+private:
+    // One frame in the ring.
+    struct Slot
+    {
+        std::vector<unsigned char> m_raw;   // Frame in the device's native format.
+        FrameTimestamp m_timestamp;         // When the frame was captured.
+    };
+
+    std::mutex m_lock;              // Protects all of the members below.
+    std::vector<Slot> m_slots;      // The ring's frames.
+    size_t m_next = 0;              // Slot the next frame goes into.
+    size_t m_count = 0;             // Number of slots holding frames.
+};
+
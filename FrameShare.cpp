@@ -0,0 +1,211 @@
+//--------------------------------------------------------------------
+// FrameShare.cpp
+// A C++ module that publishes captured frames into a named
+// shared-memory ring, for other local processes to read.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "FrameShare.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <windows.h>
+
+namespace
+{
+
+//---------------------------------------------------------------
+// Rounds a size up to a multiple of FrameShareAlign.
+//---------------------------------------------------------------
+uint64_t AlignUp(uint64_t size)
+{
+    return (size + FrameShareAlign - 1) & ~static_cast<uint64_t>(FrameShareAlign - 1);
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+FrameShareWriter::~FrameShareWriter()
+{
+    Close();
+}
+
+//---------------------------------------------------------------
+// Creates a ring with the given name and number of slots.
+// Returns false if the ring can't be created or a ring of that
+// name already exists.
+//---------------------------------------------------------------
+bool FrameShareWriter::Create(const char *name, unsigned numSlots, size_t slotDataSize, std::string &errText)
+{
+    errText.clear();
+    Close();
+    if (name == nullptr || name[0] == '\0' || numSlots < 2 || numSlots > MaxSlots || slotDataSize < 1)
+    {
+        errText = "Bad parameter.";
+        return false;
+    }
+
+    const uint64_t slotStride = AlignUp(FrameShareSlotHeaderSize + slotDataSize);
+    const uint64_t totalSize = FrameShareAlign + slotStride * numSlots;
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(totalSize >> 32), static_cast<DWORD>(totalSize), name);
+    if (mapping == nullptr)
+    {
+        errText = "Failed creating the shared memory.";
+        return false;
+    }
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        // Another writer, or readers of an earlier session, still
+        // hold a ring of this name, which may be the wrong size.
+        CloseHandle(mapping);
+        errText = "A frame ring of that name is already in use.";
+        return false;
+    }
+    m_mapping = mapping;
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (view == nullptr)
+    {
+        errText = "Failed mapping the shared memory.";
+        Close();
+        return false;
+    }
+    m_header = static_cast<FrameShareHeader *>(view);
+
+    for (unsigned i = 0; i < FrameShareEvents; i++)
+    {
+        char eventName[MAX_PATH] = {0};
+        sprintf_s(eventName, _countof(eventName), "%s_ready%u", name, i);
+        m_events[i] = CreateEventA(nullptr, TRUE, FALSE, eventName);
+        if (m_events[i] == nullptr)
+        {
+            errText = "Failed creating the ring's events.";
+            Close();
+            return false;
+        }
+    }
+
+    // The pages start out zeroed, so every slot's sequence is 0
+    // (holding no frame).  Fill in the header, then publish the
+    // magic number last so readers never see a half-built header.
+    m_header->m_version = FrameShareVersion;
+    m_header->m_numSlots = numSlots;
+    m_header->m_writerProcessId = GetCurrentProcessId();
+    m_header->m_firstSlot = FrameShareAlign;
+    m_header->m_slotStride = slotStride;
+    m_header->m_slotDataSize = slotDataSize;
+    m_header->m_published = 0;
+    m_header->m_closed = 0;
+    MemoryBarrier();
+    m_header->m_magic = FrameShareMagic;
+    return true;
+}
+
+//---------------------------------------------------------------
+// Marks the ring closed, wakes the readers, and lets go of it.
+// The shared memory lasts until the last reader lets go too.
+//---------------------------------------------------------------
+void FrameShareWriter::Close()
+{
+    if (m_header != nullptr)
+    {
+        InterlockedExchange(reinterpret_cast<volatile LONG *>(&m_header->m_closed), 1);
+        for (unsigned i = 0; i < FrameShareEvents; i++)
+        {
+            if (m_events[i] != nullptr)
+                SetEvent(m_events[i]);
+        }
+        UnmapViewOfFile(m_header);
+        m_header = nullptr;
+    }
+
+    for (unsigned i = 0; i < FrameShareEvents; i++)
+    {
+        if (m_events[i] != nullptr)
+        {
+            CloseHandle(m_events[i]);
+            m_events[i] = nullptr;
+        }
+    }
+
+    if (m_mapping != nullptr)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+}
+
+//---------------------------------------------------------------
+// Copies a frame into the next slot and wakes the readers.
+// Returns false if the frame doesn't fit a slot.
+//---------------------------------------------------------------
+bool FrameShareWriter::Publish(const FrameShareInfo &info, const void *pixels, std::string &errText)
+{
+    errText.clear();
+    if (m_header == nullptr || pixels == nullptr || info.m_stride < info.m_width * 4 ||
+        static_cast<uint64_t>(info.m_stride) * info.m_height > m_header->m_slotDataSize)
+    {
+        errText = "Bad parameter.";
+        return false;
+    }
+
+    const int64_t number = m_header->m_published + 1;
+    unsigned char *base = reinterpret_cast<unsigned char *>(m_header) + m_header->m_firstSlot +
+        m_header->m_slotStride * ((number - 1) % m_header->m_numSlots);
+    FrameShareSlot *slot = reinterpret_cast<FrameShareSlot *>(base);
+
+    // Mark the slot as being written, fill it, then mark it as
+    // holding the new frame.  The interlocked writes are full
+    // barriers, so a reader that sees the same even sequence before
+    // and after reading the slot has read it intact.
+    InterlockedExchange64(reinterpret_cast<volatile LONG64 *>(&slot->m_sequence), 2 * number - 1);
+    slot->m_info = info;
+    slot->m_info.m_dataSize = info.m_stride * info.m_height;
+    memcpy(base + FrameShareSlotHeaderSize, pixels, slot->m_info.m_dataSize);
+    InterlockedExchange64(reinterpret_cast<volatile LONG64 *>(&slot->m_sequence), 2 * number);
+    InterlockedExchange64(reinterpret_cast<volatile LONG64 *>(&m_header->m_published), number);
+
+    // Set this frame's event first, so a reader waiting on every
+    // event but the previous frame's always has one set.
+    const unsigned current = static_cast<unsigned>(number % FrameShareEvents);
+    SetEvent(m_events[current]);
+    for (unsigned i = 0; i < FrameShareEvents; i++)
+    {
+        if (i != current)
+            ResetEvent(m_events[i]);
+    }
+    return true;
+}
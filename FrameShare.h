@@ -0,0 +1,175 @@
+//--------------------------------------------------------------------
+// FrameShare.h
+// A C++ module that publishes captured frames into a named
+// shared-memory ring, for other local processes to read.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call FrameShareWriter::Create() with a name,
+//   a number of slots, and the largest frame to be published, then
+//   call Publish() with each frame.  Other processes read the
+//   frames with FrameShareReader (FrameShareReader.h), which needs
+//   only this header's layout, not the writer.
+//
+// * The ring is a named, pagefile-backed file mapping:  a
+//   FrameShareHeader, then a fixed array of slots.  Each slot is a
+//   FrameShareSlot header, with the frame's geometry, its device's
+//   native format, and its timestamps, followed by the frame's
+//   BGRA pixels.  Frame N (counting from 1) goes in slot
+//   (N - 1) % m_numSlots.
+//
+// * Each slot is guarded by a seqlock:  its sequence is odd while
+//   the writer fills it and 2N once it holds frame N.  Readers use
+//   the pixels in place and then check the sequence is unchanged,
+//   so they copy nothing and never block the writer.  A reader that
+//   falls a whole ring behind just skips ahead.
+//
+// * Readers are woken through FrameShareEvents named manual-reset
+//   events, "<name>_ready0" and so on.  Publishing frame N sets
+//   event N % FrameShareEvents and resets the others, so a reader
+//   that has seen frame N waits on all of the events but that one,
+//   and every waiting reader wakes on each frame.
+//
+// * Publish() copies the frame into the ring once; from there,
+//   any number of readers share it with no further copies and no
+//   disk I/O.  One thread at a time may call Publish().
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Identifies a frame ring and its layout version.
+const uint32_t FrameShareMagic = 0x52464c54;    // "TLFR"
+const uint32_t FrameShareVersion = 1;
+
+// Number of events used to wake the readers.
+const unsigned FrameShareEvents = 4;
+
+// Alignment of the slots and of each slot's pixels.
+const size_t FrameShareAlign = 64;
+
+// Offset of each slot's pixels from the start of the slot.
+const size_t FrameShareSlotHeaderSize = 2 * FrameShareAlign;
+
+//---------------------------------------------------------------
+// Header at the start of the shared memory.
+//---------------------------------------------------------------
+struct FrameShareHeader
+{
+    volatile uint32_t m_magic;      // FrameShareMagic, once the ring is ready.
+    uint32_t m_version;             // FrameShareVersion.
+    uint32_t m_numSlots;            // Number of frame slots.
+    uint32_t m_writerProcessId;     // Process that publishes the frames.
+    uint64_t m_firstSlot;           // Offset of the first slot from the header.
+    uint64_t m_slotStride;          // Bytes from one slot to the next.
+    uint64_t m_slotDataSize;        // Most pixel bytes a slot can hold.
+    volatile int64_t m_published;   // Frames published so far.
+    volatile uint32_t m_closed;     // Nonzero once the writer has stopped.
+};
+
+//---------------------------------------------------------------
+// Describes one published frame.
+//---------------------------------------------------------------
+struct FrameShareInfo
+{
+    uint32_t m_deviceIndex = 0;     // Capture device the frame came from (0-based).
+    uint32_t m_frameNumber = 0;     // Frame number within the capture session.
+    uint32_t m_width = 0;           // Width of the BGRA frame in pixels.
+    uint32_t m_height = 0;          // Height of the BGRA frame in pixels.
+    uint32_t m_stride = 0;          // Bytes per row of the BGRA frame.
+    uint32_t m_dataSize = 0;        // Bytes of pixels (m_stride * m_height).
+    uint32_t m_nativeWidth = 0;     // Width of the device's native format.
+    uint32_t m_nativeHeight = 0;    // Height of the device's native format.
+    uint32_t m_nativePixelType = 0; // The device's CapturePixelType.
+    uint32_t m_haveCaptureTime = 0; // Nonzero if the device reported its capture time.
+    int64_t m_sampleTime = 0;       // Device's sample time, in 100 ns units.
+    int64_t m_captureMicros = 0;    // Capture time on the monotonic clock, from the session start.
+    int64_t m_wallTimeMicros = 0;   // Wall clock time the frame was dequeued, from 1970-01-01 UTC.
+};
+
+//---------------------------------------------------------------
+// Header of each slot.  The pixels follow,
+// FrameShareSlotHeaderSize bytes from the start of the slot.
+//---------------------------------------------------------------
+struct FrameShareSlot
+{
+    volatile int64_t m_sequence;    // 2N while the slot holds frame N; odd while being written.
+    FrameShareInfo m_info;          // The frame in the slot.
+};
+
+static_assert(sizeof(FrameShareHeader) <= FrameShareAlign, "FrameShareHeader must fit its alignment.");
+static_assert(sizeof(FrameShareSlot) <= FrameShareSlotHeaderSize, "FrameShareSlot must fit ahead of the pixels.");
+
+//---------------------------------------------------------------
+// A C++ class that publishes frames into a shared-memory ring.
+//---------------------------------------------------------------
+class FrameShareWriter
+{
+public:
+    FrameShareWriter() = default;
+    ~FrameShareWriter();
+
+    FrameShareWriter(const FrameShareWriter &) = delete;
+    FrameShareWriter &operator=(const FrameShareWriter &) = delete;
+
+    // Creates a ring with the given name and number of slots (2 to
+    // MaxSlots), each holding up to 'slotDataSize' bytes of pixels.
+    // Returns false if the ring can't be created or a ring of that
+    // name already exists.
+    bool Create(const char *name, unsigned numSlots, size_t slotDataSize, std::string &errText);
+
+    // Marks the ring closed, wakes the readers, and lets go of it.
+    void Close();
+
+    // Returns true if the ring has been created.
+    bool IsOpen() const { return m_header != nullptr; }
+
+    // Copies a frame into the next slot and wakes the readers.
+    // 'info' gives its geometry.  Returns false if the frame doesn't
+    // fit a slot.
+    bool Publish(const FrameShareInfo &info, const void *pixels, std::string &errText);
+
+    // Largest number of slots.
+    static const unsigned MaxSlots = 64;
+
+private:
+    void *m_mapping = nullptr;              // The file mapping (a HANDLE).
+    FrameShareHeader *m_header = nullptr;   // The mapped ring.
+    void *m_events[FrameShareEvents] = {};  // Events that wake the readers (HANDLEs).
+};
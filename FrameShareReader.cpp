@@ -0,0 +1,257 @@
+//--------------------------------------------------------------------
+// FrameShareReader.cpp
+// A C++ module for reading frames that another process publishes
+// into a shared-memory frame ring.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "FrameShareReader.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <windows.h>
+
+//---------------------------------------------------------------
+FrameShareReader::~FrameShareReader()
+{
+    Close();
+}
+
+//---------------------------------------------------------------
+// Opens the named ring.  Returns false if no ring of that name
+// is ready.
+//---------------------------------------------------------------
+bool FrameShareReader::Open(const char *name, std::string &errText)
+{
+    errText.clear();
+    Close();
+    if (name == nullptr || name[0] == '\0')
+    {
+        errText = "Bad parameter.";
+        return false;
+    }
+
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (mapping == nullptr)
+    {
+        errText = "No frame ring of that name is running.";
+        return false;
+    }
+    m_mapping = mapping;
+
+    // Map the whole ring read-only.
+    m_header = static_cast<const FrameShareHeader *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_header == nullptr)
+    {
+        errText = "Failed mapping the shared memory.";
+        Close();
+        return false;
+    }
+    if (m_header->m_magic != FrameShareMagic || m_header->m_version != FrameShareVersion)
+    {
+        errText = "The frame ring isn't ready or is a different version.";
+        Close();
+        return false;
+    }
+    MemoryBarrier();
+
+    for (unsigned i = 0; i < FrameShareEvents; i++)
+    {
+        char eventName[MAX_PATH] = {0};
+        sprintf_s(eventName, _countof(eventName), "%s_ready%u", name, i);
+        m_events[i] = OpenEventA(SYNCHRONIZE, FALSE, eventName);
+        if (m_events[i] == nullptr)
+        {
+            errText = "Failed opening the ring's events.";
+            Close();
+            return false;
+        }
+    }
+
+    // Start with the newest frame.
+    int64_t published = m_header->m_published;
+    m_lastRead = (published > 0) ? published - 1 : 0;
+    m_skipped = 0;
+    return true;
+}
+
+//---------------------------------------------------------------
+// Lets go of the ring.
+//---------------------------------------------------------------
+void FrameShareReader::Close()
+{
+    for (unsigned i = 0; i < FrameShareEvents; i++)
+    {
+        if (m_events[i] != nullptr)
+        {
+            CloseHandle(m_events[i]);
+            m_events[i] = nullptr;
+        }
+    }
+    if (m_header != nullptr)
+    {
+        UnmapViewOfFile(m_header);
+        m_header = nullptr;
+    }
+    if (m_mapping != nullptr)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+}
+
+//---------------------------------------------------------------
+// Returns true if the writer has stopped publishing.
+//---------------------------------------------------------------
+bool FrameShareReader::IsWriterClosed() const
+{
+    return m_header == nullptr || m_header->m_closed != 0;
+}
+
+//---------------------------------------------------------------
+// Waits for a frame this reader hasn't read yet.  Returns true if
+// one is ready.
+//---------------------------------------------------------------
+bool FrameShareReader::WaitForFrame(unsigned timeoutMs)
+{
+    if (m_header == nullptr)
+        return false;
+    if (m_header->m_published > m_lastRead)
+        return true;
+    if (m_header->m_closed != 0)
+        return false;
+
+    // The event of the last frame read stays set until the next
+    // frame is published, so wait on all of the others.
+    HANDLE events[FrameShareEvents];
+    DWORD numEvents = 0;
+    const unsigned current = static_cast<unsigned>(m_lastRead % FrameShareEvents);
+    for (unsigned i = 0; i < FrameShareEvents; i++)
+    {
+        if (i != current)
+            events[numEvents++] = m_events[i];
+    }
+    WaitForMultipleObjects(numEvents, events, FALSE, timeoutMs);
+    return m_header->m_published > m_lastRead;
+}
+
+//---------------------------------------------------------------
+// Returns the slot that holds (or held) the given frame.
+//---------------------------------------------------------------
+const FrameShareSlot *FrameShareReader::GetSlot(int64_t number) const
+{
+    const unsigned char *base = reinterpret_cast<const unsigned char *>(m_header) + m_header->m_firstSlot +
+        m_header->m_slotStride * ((number - 1) % m_header->m_numSlots);
+    return reinterpret_cast<const FrameShareSlot *>(base);
+}
+
+//---------------------------------------------------------------
+// Gets the next unread frame without copying it.  Returns false
+// if there is no unread frame.
+//---------------------------------------------------------------
+bool FrameShareReader::PeekFrame(FrameShareView &view)
+{
+    if (m_header == nullptr)
+        return false;
+
+    for (;;)
+    {
+        int64_t published = m_header->m_published;
+        MemoryBarrier();
+        if (published <= m_lastRead)
+            return false;
+
+        // Skip any frames that have already been overwritten.
+        int64_t number = m_lastRead + 1;
+        int64_t oldest = published - m_header->m_numSlots + 1;
+        if (number < oldest)
+        {
+            m_skipped += oldest - number;
+            number = oldest;
+        }
+        m_lastRead = number;
+
+        // Read the slot's header between two looks at its sequence.
+        const FrameShareSlot *slot = GetSlot(number);
+        int64_t sequence = slot->m_sequence;
+        MemoryBarrier();
+        view.m_info = slot->m_info;
+        MemoryBarrier();
+        if (sequence != 2 * number || slot->m_sequence != sequence ||
+            static_cast<uint64_t>(view.m_info.m_dataSize) > m_header->m_slotDataSize)
+        {
+            // The writer has moved on to this slot already.
+            ++m_skipped;
+            continue;
+        }
+
+        view.m_pixels = reinterpret_cast<const unsigned char *>(slot) + FrameShareSlotHeaderSize;
+        view.m_number = number;
+        return true;
+    }
+}
+
+//---------------------------------------------------------------
+// Returns true if the writer hasn't started reusing the frame's
+// slot.
+//---------------------------------------------------------------
+bool FrameShareReader::IsIntact(const FrameShareView &view) const
+{
+    if (m_header == nullptr || view.m_number < 1)
+        return false;
+
+    MemoryBarrier();
+    return GetSlot(view.m_number)->m_sequence == 2 * view.m_number;
+}
+
+//---------------------------------------------------------------
+// Copies the next unread frame.  Returns false if there is no
+// unread frame.
+//---------------------------------------------------------------
+bool FrameShareReader::ReadFrame(FrameShareInfo &info, std::vector<unsigned char> &pixels)
+{
+    FrameShareView view;
+    while (PeekFrame(view))
+    {
+        pixels.assign(view.m_pixels, view.m_pixels + view.m_info.m_dataSize);
+        if (IsIntact(view))
+        {
+            info = view.m_info;
+            return true;
+        }
+        ++m_skipped;
+    }
+    return false;
+}
@@ -0,0 +1,135 @@
+//--------------------------------------------------------------------
+// FrameShareReader.h
+// A C++ module for reading frames that another process publishes
+// into a shared-memory frame ring.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Open() with the ring's name, as given to
+//   the capture program (with "_camN" appended when it captures
+//   from several cameras).  Then loop:  WaitForFrame(), then
+//   PeekFrame() to use the newest unread frame in place, followed
+//   by IsIntact() to make sure the writer didn't reuse its slot in
+//   the meantime.  ReadFrame() does the same, but copies the
+//   frame out.
+//
+// * Frames are read oldest first, so a reader that keeps up sees
+//   every frame.  A reader that falls more than a ring behind skips
+//   to the oldest frame still in the ring and counts the frames it
+//   missed.
+//
+// * The reader maps the ring read-only and never writes to it, so
+//   any number of readers can share it without slowing the writer
+//   or each other.
+//
+// * This module depends only on FrameShare.h's layout and the
+//   Windows API, so other programs can build it on its own.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include "FrameShare.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//---------------------------------------------------------------
+// A frame in the ring, used in place.
+//---------------------------------------------------------------
+struct FrameShareView
+{
+    FrameShareInfo m_info;                      // Geometry and timestamps of the frame.
+    const unsigned char *m_pixels = nullptr;    // BGRA pixels, in the shared memory.
+    int64_t m_number = 0;                       // Position of the frame in the ring's sequence.
+};
+
+//---------------------------------------------------------------
+// A C++ class that reads frames from a shared-memory frame ring.
+//---------------------------------------------------------------
+class FrameShareReader
+{
+public:
+    FrameShareReader() = default;
+    ~FrameShareReader();
+
+    FrameShareReader(const FrameShareReader &) = delete;
+    FrameShareReader &operator=(const FrameShareReader &) = delete;
+
+    // Opens the named ring.  The first frame read is the newest one
+    // already published, if any.  Returns false if no ring of that
+    // name is ready.
+    bool Open(const char *name, std::string &errText);
+
+    // Lets go of the ring.
+    void Close();
+
+    // Returns true if the ring is open.
+    bool IsOpen() const { return m_header != nullptr; }
+
+    // Returns true if the writer has stopped publishing.
+    bool IsWriterClosed() const;
+
+    // Waits up to 'timeoutMs' milliseconds for a frame this reader
+    // hasn't read yet.  Returns true if one is ready.
+    bool WaitForFrame(unsigned timeoutMs);
+
+    // Gets the next unread frame without copying it.  Returns false
+    // if there is no unread frame.  Check IsIntact() once done with
+    // the pixels.
+    bool PeekFrame(FrameShareView &view);
+
+    // Returns true if the writer hasn't started reusing the frame's
+    // slot, so everything read from 'view' so far is good.
+    bool IsIntact(const FrameShareView &view) const;
+
+    // Copies the next unread frame into 'pixels'.  Returns false if
+    // there is no unread frame.
+    bool ReadFrame(FrameShareInfo &info, std::vector<unsigned char> &pixels);
+
+    // Returns the number of frames skipped because the reader fell
+    // behind.
+    int64_t GetFramesSkipped() const { return m_skipped; }
+
+private:
+    const FrameShareSlot *GetSlot(int64_t number) const;
+
+    void *m_mapping = nullptr;                  // The file mapping (a HANDLE).
+    const FrameShareHeader *m_header = nullptr; // The mapped ring.
+    void *m_events[FrameShareEvents] = {};      // Events that signal new frames (HANDLEs).
+    int64_t m_lastRead = 0;                     // Number of the last frame read.
+    int64_t m_skipped = 0;                      // Frames skipped for falling behind.
+};
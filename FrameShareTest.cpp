@@ -0,0 +1,174 @@
+//--------------------------------------------------------------------
+// FrameShareTest.cpp
+// Program that reads the frames a running capture publishes into a
+// shared-memory frame ring, as a test of the FrameShareReader
+// module and an example consumer.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "FrameShareReader.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <windows.h>
+#include <chrono>
+#include <vector>
+
+//---------------------------------------------------------------
+// Prints the program's usage.
+//---------------------------------------------------------------
+static void PrintUsage()
+{
+    printf("Usage:  FrameShareTest name [frames=x] [copy=x]\n");
+    printf("\n");
+    printf("  name      Name of the frame ring, as given to TimeLapse\n");
+    printf("            with share=.\n");
+    printf("  frames=x  Stop after x frames (default: when the capture ends).\n");
+    printf("  copy=x    Specify 1 to copy each frame out of the ring\n");
+    printf("            instead of reading it in place.\n");
+}
+
+//---------------------------------------------------------------
+// Returns the average blue, green, and red of a sparse grid of a
+// frame's pixels, as a stand-in for real analysis.
+//---------------------------------------------------------------
+static void SampleMeanColor(const FrameShareInfo &info, const unsigned char *pixels, double mean[3])
+{
+    const unsigned step = 16;
+    unsigned long long sums[3] = {0, 0, 0};
+    unsigned long long count = 0;
+    for (unsigned y = step / 2; y < info.m_height; y += step)
+    {
+        const unsigned char *row = pixels + static_cast<size_t>(y) * info.m_stride;
+        for (unsigned x = step / 2; x < info.m_width; x += step, count++)
+        {
+            sums[0] += row[x * 4];
+            sums[1] += row[x * 4 + 1];
+            sums[2] += row[x * 4 + 2];
+        }
+    }
+    for (int c = 0; c < 3; c++)
+        mean[c] = count ? static_cast<double>(sums[c]) / count : 0.0;
+}
+
+//---------------------------------------------------------------
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argv[1][0] == '-' || argv[1][0] == '/')
+    {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    const char *name = argv[1];
+    unsigned maxFrames = 0;
+    bool copy = false;
+    for (int i = 2; i < argc; i++)
+    {
+        if (_strnicmp(argv[i], "frames=", 7) == 0)
+            maxFrames = atoi(argv[i] + 7);
+        else if (_strnicmp(argv[i], "copy=", 5) == 0)
+            copy = atoi(argv[i] + 5) != 0;
+        else
+        {
+            printf("Unrecognized option \"%s\"!\n", argv[i]);
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Wait a while for the capture to start.
+    FrameShareReader reader;
+    std::string errText;
+    for (int tries = 0; !reader.Open(name, errText); tries++)
+    {
+        if (tries == 30)
+        {
+            printf("Failed opening frame ring \"%s\"!\n", name);
+            printf("  Error Text:  %s\n", errText.c_str());
+            return EXIT_FAILURE;
+        }
+        Sleep(1000);
+    }
+    printf("Reading frames from \"%s\".\n", name);
+
+    unsigned framesRead = 0;
+    unsigned framesTorn = 0;
+    std::vector<unsigned char> pixels;
+    while (maxFrames == 0 || framesRead < maxFrames)
+    {
+        if (!reader.WaitForFrame(1000))
+        {
+            if (reader.IsWriterClosed())
+                break;
+            continue;
+        }
+
+        FrameShareView view;
+        FrameShareInfo info;
+        double mean[3] = {0, 0, 0};
+        if (copy)
+        {
+            if (!reader.ReadFrame(info, pixels))
+                continue;
+            SampleMeanColor(info, pixels.data(), mean);
+        }
+        else
+        {
+            if (!reader.PeekFrame(view))
+                continue;
+            info = view.m_info;
+            SampleMeanColor(info, view.m_pixels, mean);
+            if (!reader.IsIntact(view))
+            {
+                // The writer lapped us while we were reading.
+                ++framesTorn;
+                continue;
+            }
+        }
+        ++framesRead;
+
+        // The wall clock times share an epoch across processes.
+        long long nowMicros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        printf("Camera %u frame %u:  %ux%u, mean BGR %.1f %.1f %.1f, %.1f ms since dequeue\n",
+            info.m_deviceIndex + 1, info.m_frameNumber, info.m_width, info.m_height,
+            mean[0], mean[1], mean[2], (nowMicros - info.m_wallTimeMicros) / 1000.0);
+    }
+
+    printf("Read %u frames; skipped %lld, torn %u.\n", framesRead,
+        static_cast<long long>(reader.GetFramesSkipped()), framesTorn);
+    return EXIT_SUCCESS;
+}
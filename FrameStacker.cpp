@@ -0,0 +1,350 @@
+//--------------------------------------------------------------------
+// FrameStacker.cpp
+// A C++ module for combining a burst of consecutive frames into a
+// single lower-noise frame.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "FrameStacker.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <emmintrin.h>
+
+namespace
+{
+
+//---------------------------------------------------------------
+// Loads 16 8-bit samples and widens them into four vectors of
+// four floats each.
+//---------------------------------------------------------------
+inline void LoadSamplesAsFloats(const unsigned char *in, __m128 f[4])
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    f[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+    f[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+    f[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+    f[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+}
+
+//---------------------------------------------------------------
+// Rounds four vectors of four floats each to integers and
+// stores them as 16 8-bit samples.
+//---------------------------------------------------------------
+inline void StoreFloatsAsSamples(const __m128 f[4], unsigned char *out)
+{
+    __m128i lo = _mm_packs_epi32(_mm_cvtps_epi32(f[0]), _mm_cvtps_epi32(f[1]));
+    __m128i hi = _mm_packs_epi32(_mm_cvtps_epi32(f[2]), _mm_cvtps_epi32(f[3]));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(lo, hi));
+}
+
+//---------------------------------------------------------------
+// Returns the sigma-clipped mean of 'count' samples.
+//---------------------------------------------------------------
+unsigned char SigmaClipSamples(const float *samples, unsigned count, float sigma)
+{
+    float sum = 0.0f, sumSq = 0.0f;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        sum += samples[i];
+        sumSq += samples[i] * samples[i];
+    }
+
+    float mean = sum / count;
+    float threshold = sigma * sigma * __max(0.0f, sumSq / count - mean * mean) + 0.25f;
+    float clipSum = 0.0f;
+    unsigned clipCount = 0;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        float d = samples[i] - mean;
+        if (d * d <= threshold)
+        {
+            clipSum += samples[i];
+            ++clipCount;
+        }
+    }
+
+    float result = clipCount ? clipSum / clipCount : mean;
+    return static_cast<unsigned char>(__min(255.0f, result + 0.5f));
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Starts a new burst of 'numFrames' frames, each 'frameSize'
+// bytes in size.  Returns false if the parameters are out of
+// range.
+//---------------------------------------------------------------
+bool FrameStacker::Begin(size_t frameSize, unsigned numFrames, StackMode mode, float sigma)
+{
+    m_frameCount = 0;
+
+    if (frameSize < 1 || numFrames < 1 || !(sigma > 0.0f))
+        return false;
+    if (mode == SM_MEAN && numFrames > MaxMeanFrames)
+        return false;
+    if (mode == SM_MEDIAN && numFrames > MaxMedianFrames)
+        return false;
+    if (mode == SM_SIGMA_CLIP && numFrames > MaxSigmaClipFrames)
+        return false;
+
+    m_frameSize = frameSize;
+    m_numFrames = numFrames;
+    m_mode = mode;
+    m_sigma = sigma;
+
+    if (m_mode == SM_MEAN)
+    {
+        m_accum.assign(m_frameSize, 0);
+        m_frames.clear();
+    }
+    else
+    {
+        m_accum.clear();
+        m_frames.resize(m_frameSize * m_numFrames);
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------
+// Adds a frame to the current burst.  Returns false if the
+// frame is the wrong size or the burst is already full.
+//---------------------------------------------------------------
+bool FrameStacker::AddFrame(const void *data, size_t dataSize)
+{
+    if (data == nullptr || dataSize < m_frameSize || m_frameCount >= m_numFrames)
+        return false;
+
+    const unsigned char *in = static_cast<const unsigned char *>(data);
+
+    if (m_mode != SM_MEAN)
+    {
+        // Median and sigma clipping need every sample of every
+        // frame, so just keep a copy of the frame for Finish().
+        memcpy(&m_frames[m_frameSize * m_frameCount], in, m_frameSize);
+        ++m_frameCount;
+        return true;
+    }
+
+    // Widen the samples to 16 bits and add them to the running sum.
+    const __m128i zero = _mm_setzero_si128();
+    uint16_t *accum = m_accum.data();
+    size_t i = 0;
+    for (; i + 16 <= m_frameSize; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(accum + i));
+        __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(accum + i + 8));
+        a0 = _mm_add_epi16(a0, _mm_unpacklo_epi8(v, zero));
+        a1 = _mm_add_epi16(a1, _mm_unpackhi_epi8(v, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(accum + i), a0);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(accum + i + 8), a1);
+    }
+    for (; i < m_frameSize; ++i)
+        accum[i] = static_cast<uint16_t>(accum[i] + in[i]);
+
+    ++m_frameCount;
+    return true;
+}
+
+//---------------------------------------------------------------
+// Combines the frames added so far and places the result in the
+// caller's buffer.  Returns false if no frames were added.
+//---------------------------------------------------------------
+bool FrameStacker::Finish(void *out, size_t outSize)
+{
+    if (out == nullptr || outSize < m_frameSize || m_frameCount < 1)
+        return false;
+
+    unsigned char *pout = static_cast<unsigned char *>(out);
+    if (m_mode == SM_MEAN)
+        FinishMean(pout);
+    else if (m_mode == SM_MEDIAN)
+        FinishMedian(pout);
+    else
+        FinishSigmaClip(pout);
+
+    return true;
+}
+
+//---------------------------------------------------------------
+// Divides the running sums by the frame count.
+//---------------------------------------------------------------
+void FrameStacker::FinishMean(unsigned char *out) const
+{
+    const uint16_t *accum = m_accum.data();
+    const unsigned n = m_frameCount;
+    size_t i = 0;
+
+    if (n > 1)
+    {
+        // Divide by multiplying with a 16-bit fixed-point reciprocal,
+        // which is accurate to within one count for n <= 256.
+        const __m128i recip = _mm_set1_epi16(static_cast<short>((65536 + n - 1) / n));
+        const __m128i half = _mm_set1_epi16(static_cast<short>(n / 2));
+        for (; i + 16 <= m_frameSize; i += 16)
+        {
+            __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(accum + i));
+            __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(accum + i + 8));
+            a0 = _mm_mulhi_epu16(_mm_add_epi16(a0, half), recip);
+            a1 = _mm_mulhi_epu16(_mm_add_epi16(a1, half), recip);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packus_epi16(a0, a1));
+        }
+    }
+
+    for (; i < m_frameSize; ++i)
+        out[i] = static_cast<unsigned char>(__min(255u, (accum[i] + n / 2) / n));
+}
+
+//---------------------------------------------------------------
+// Takes the per-sample median of the stored frames, sorting 16
+// samples at a time with a min/max transposition network.
+//---------------------------------------------------------------
+void FrameStacker::FinishMedian(unsigned char *out) const
+{
+    const unsigned n = m_frameCount;
+    const unsigned char *frames = m_frames.data();
+    size_t i = 0;
+
+    __m128i v[MaxMedianFrames];
+    for (; i + 16 <= m_frameSize; i += 16)
+    {
+        for (unsigned k = 0; k < n; ++k)
+            v[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(frames + m_frameSize * k + i));
+
+        for (unsigned pass = 0; pass < n; ++pass)
+        {
+            for (unsigned k = pass & 1; k + 1 < n; k += 2)
+            {
+                __m128i lo = _mm_min_epu8(v[k], v[k + 1]);
+                __m128i hi = _mm_max_epu8(v[k], v[k + 1]);
+                v[k] = lo;
+                v[k + 1] = hi;
+            }
+        }
+
+        __m128i median = (n & 1) ? v[n / 2] : _mm_avg_epu8(v[n / 2 - 1], v[n / 2]);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), median);
+    }
+
+    unsigned char samples[MaxMedianFrames];
+    for (; i < m_frameSize; ++i)
+    {
+        for (unsigned k = 0; k < n; ++k)
+            samples[k] = frames[m_frameSize * k + i];
+        std::sort(samples, samples + n);
+        out[i] = (n & 1) ? samples[n / 2] : static_cast<unsigned char>((samples[n / 2 - 1] + samples[n / 2] + 1) / 2);
+    }
+}
+
+//---------------------------------------------------------------
+// Averages the samples that lie within m_sigma standard
+// deviations of the per-sample mean, 16 samples at a time.
+//---------------------------------------------------------------
+void FrameStacker::FinishSigmaClip(unsigned char *out) const
+{
+    const unsigned n = m_frameCount;
+    const unsigned char *frames = m_frames.data();
+    const __m128 invN = _mm_set1_ps(1.0f / n);
+    const __m128 sigmaSq = _mm_set1_ps(m_sigma * m_sigma);
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 16 <= m_frameSize; i += 16)
+    {
+        // First pass:  mean and variance of each sample.
+        __m128 sum[4] = { zero, zero, zero, zero };
+        __m128 sumSq[4] = { zero, zero, zero, zero };
+        for (unsigned k = 0; k < n; ++k)
+        {
+            __m128 f[4];
+            LoadSamplesAsFloats(frames + m_frameSize * k + i, f);
+            for (int j = 0; j < 4; ++j)
+            {
+                sum[j] = _mm_add_ps(sum[j], f[j]);
+                sumSq[j] = _mm_add_ps(sumSq[j], _mm_mul_ps(f[j], f[j]));
+            }
+        }
+
+        __m128 mean[4], threshold[4];
+        for (int j = 0; j < 4; ++j)
+        {
+            mean[j] = _mm_mul_ps(sum[j], invN);
+            __m128 var = _mm_max_ps(zero, _mm_sub_ps(_mm_mul_ps(sumSq[j], invN), _mm_mul_ps(mean[j], mean[j])));
+            threshold[j] = _mm_add_ps(_mm_mul_ps(sigmaSq, var), quarter);
+        }
+
+        // Second pass:  average of the samples inside the threshold.
+        __m128 clipSum[4] = { zero, zero, zero, zero };
+        __m128 clipCount[4] = { zero, zero, zero, zero };
+        for (unsigned k = 0; k < n; ++k)
+        {
+            __m128 f[4];
+            LoadSamplesAsFloats(frames + m_frameSize * k + i, f);
+            for (int j = 0; j < 4; ++j)
+            {
+                __m128 d = _mm_sub_ps(f[j], mean[j]);
+                __m128 keep = _mm_cmple_ps(_mm_mul_ps(d, d), threshold[j]);
+                clipSum[j] = _mm_add_ps(clipSum[j], _mm_and_ps(keep, f[j]));
+                clipCount[j] = _mm_add_ps(clipCount[j], _mm_and_ps(keep, one));
+            }
+        }
+
+        __m128 result[4];
+        for (int j = 0; j < 4; ++j)
+        {
+            // Fall back to the plain mean if every sample was clipped.
+            __m128 none = _mm_cmpeq_ps(clipCount[j], zero);
+            __m128 clipped = _mm_div_ps(clipSum[j], _mm_max_ps(clipCount[j], one));
+            result[j] = _mm_or_ps(_mm_and_ps(none, mean[j]), _mm_andnot_ps(none, clipped));
+        }
+        StoreFloatsAsSamples(result, out + i);
+    }
+
+    std::vector<float> samples(n);
+    for (; i < m_frameSize; ++i)
+    {
+        for (unsigned k = 0; k < n; ++k)
+            samples[k] = frames[m_frameSize * k + i];
+        out[i] = SigmaClipSamples(samples.data(), n, m_sigma);
+    }
+}
@@ -0,0 +1,115 @@
+//--------------------------------------------------------------------
+// FrameStacker.h
+// A C++ module for combining a burst of consecutive frames into a
+// single lower-noise frame.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Begin() with the size of one frame and the
+//   number of frames in the burst, call AddFrame() once for each
+//   frame, then call Finish() to get the combined frame.
+//
+// * Frames are treated as arrays of independent 8-bit samples, so
+//   the stacker works the same on BGRA output frames and on the
+//   device's native BGR, YUY2, or NV12 frame data.  Stacking in the
+//   native format means the color conversion only runs once per
+//   burst instead of once per frame.
+//
+// * The mean mode keeps a running 16-bit-per-sample sum, which is
+//   exact for up to 256 frames.  The median and sigma-clipped modes
+//   have to keep a copy of every frame in the burst.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//---------------------------------------------------------------
+// Ways of combining the frames of a burst.
+//---------------------------------------------------------------
+enum StackMode
+{
+    SM_MEAN       = 0,  // Average of all frames.
+    SM_MEDIAN     = 1,  // Per-sample median of all frames.
+    SM_SIGMA_CLIP = 2   // Average of the samples within N standard deviations of the mean.
+};
+
+//---------------------------------------------------------------
+// A C++ class for stacking a burst of frames into one frame.
+//---------------------------------------------------------------
+class FrameStacker
+{
+public:
+    // Largest number of frames that can be stacked in each mode.
+    static const unsigned MaxMeanFrames = 256;
+    static const unsigned MaxMedianFrames = 32;
+    static const unsigned MaxSigmaClipFrames = 256;
+
+    FrameStacker() = default;
+
+    // Starts a new burst of 'numFrames' frames, each 'frameSize'
+    // bytes in size.  'sigma' is the clipping threshold in
+    // standard deviations, and is only used by SM_SIGMA_CLIP.
+    // Returns false if the parameters are out of range.
+    bool Begin(size_t frameSize, unsigned numFrames, StackMode mode, float sigma = 2.0f);
+
+    // Adds a frame to the current burst.  Returns false if the
+    // frame is the wrong size or the burst is already full.
+    bool AddFrame(const void *data, size_t dataSize);
+
+    // Combines the frames added so far and places the result,
+    // normalized back to 8 bits per sample, in the caller's
+    // buffer.  Returns false if no frames were added.
+    bool Finish(void *out, size_t outSize);
+
+    // Returns the number of frames added to the current burst.
+    unsigned GetFrameCount() const { return m_frameCount; }
+
+private:
+    void FinishMean(unsigned char *out) const;
+    void FinishMedian(unsigned char *out) const;
+    void FinishSigmaClip(unsigned char *out) const;
+
+    size_t m_frameSize = 0;             // Size of each frame in bytes.
+    unsigned m_numFrames = 0;           // Number of frames expected in this burst.
+    unsigned m_frameCount = 0;          // Number of frames added so far.
+    StackMode m_mode = SM_MEAN;         // How the frames get combined.
+    float m_sigma = 2.0f;               // Clipping threshold for SM_SIGMA_CLIP.
+    std::vector<uint16_t> m_accum;      // Running per-sample sum (SM_MEAN).
+    std::vector<unsigned char> m_frames;// Copy of each frame in the burst (SM_MEDIAN and SM_SIGMA_CLIP).
+};
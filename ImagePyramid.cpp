@@ -0,0 +1,146 @@
+//--------------------------------------------------------------------
+// ImagePyramid.cpp
+// A C++ module that builds a pyramid of successively halved
+// copies of a 32-bit BGRA image.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "ImagePyramid.h"
+
+#include <emmintrin.h>
+
+namespace
+{
+
+//---------------------------------------------------------------
+// Halves a BGRA image in both directions by averaging each 2x2
+// block of pixels.  An odd last row or column is dropped.
+//---------------------------------------------------------------
+void HalveImage(
+    const unsigned char *src,   // in:  Source pixels.
+    unsigned srcStride,         // in:  Bytes per source row.
+    unsigned char *dst,         // out: Destination pixels.
+    unsigned dstWidth,          // in:  Destination width in pixels.
+    unsigned dstHeight,         // in:  Destination height in pixels.
+    unsigned dstStride          // in:  Bytes per destination row.
+    )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    for (unsigned y = 0; y < dstHeight; y++)
+    {
+        const unsigned char *row0 = src + static_cast<size_t>(srcStride) * (y * 2);
+        const unsigned char *row1 = row0 + srcStride;
+        unsigned char *out = dst + static_cast<size_t>(dstStride) * y;
+
+        // Four output pixels at a time:  widen to 16 bits, add the
+        // two rows, then add each even pixel to the odd one after
+        // it, so every pixel is (a + b + c + d + 2) / 4 exactly as
+        // below rather than an average of rounded averages.
+        unsigned x = 0;
+        for (; x + 4 <= dstWidth; x += 4)
+        {
+            __m128i top0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 8));
+            __m128i top1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 8 + 16));
+            __m128i bottom0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 8));
+            __m128i bottom1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 8 + 16));
+
+            // Each sum holds two source pixels' columns.
+            __m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(top0, zero), _mm_unpacklo_epi8(bottom0, zero));
+            __m128i s23 = _mm_add_epi16(_mm_unpackhi_epi8(top0, zero), _mm_unpackhi_epi8(bottom0, zero));
+            __m128i s45 = _mm_add_epi16(_mm_unpacklo_epi8(top1, zero), _mm_unpacklo_epi8(bottom1, zero));
+            __m128i s67 = _mm_add_epi16(_mm_unpackhi_epi8(top1, zero), _mm_unpackhi_epi8(bottom1, zero));
+
+            __m128i out01 = _mm_add_epi16(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+            __m128i out23 = _mm_add_epi16(_mm_unpacklo_epi64(s45, s67), _mm_unpackhi_epi64(s45, s67));
+            out01 = _mm_srli_epi16(_mm_add_epi16(out01, two), 2);
+            out23 = _mm_srli_epi16(_mm_add_epi16(out23, two), 2);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x * 4), _mm_packus_epi16(out01, out23));
+        }
+
+        // Leftover pixels.
+        for (; x < dstWidth; x++)
+        {
+            for (unsigned c = 0; c < 4; c++)
+            {
+                unsigned sum = row0[x * 8 + c] + row0[x * 8 + 4 + c] +
+                               row1[x * 8 + c] + row1[x * 8 + 4 + c];
+                out[x * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Builds the pyramid from a BGRA image.
+//---------------------------------------------------------------
+void ImagePyramid::Build(const void *pixels, unsigned width, unsigned height,
+    unsigned stride, unsigned numLevels)
+{
+    m_levels.clear();
+    if (pixels == nullptr || width < 1 || height < 1 || numLevels < 1)
+        return;
+
+    Level level;
+    level.m_pixels = static_cast<const unsigned char *>(pixels);
+    level.m_width = width;
+    level.m_height = height;
+    level.m_stride = stride;
+    m_levels.push_back(level);
+
+    if (m_storage.size() < numLevels - 1)
+        m_storage.resize(numLevels - 1);
+
+    for (unsigned i = 1; i < numLevels; i++)
+    {
+        const Level &above = m_levels.back();
+        if (above.m_width < 2 || above.m_height < 2)
+            break;
+
+        Level next;
+        next.m_width = above.m_width / 2;
+        next.m_height = above.m_height / 2;
+        next.m_stride = next.m_width * 4;
+
+        std::vector<unsigned char> &storage = m_storage[i - 1];
+        storage.resize(static_cast<size_t>(next.m_stride) * next.m_height);
+        HalveImage(above.m_pixels, above.m_stride, storage.data(), next.m_width, next.m_height, next.m_stride);
+
+        next.m_pixels = storage.data();
+        m_levels.push_back(next);
+    }
+}
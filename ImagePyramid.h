@@ -0,0 +1,92 @@
+//--------------------------------------------------------------------
+// ImagePyramid.h
+// A C++ module that builds a pyramid of successively halved
+// copies of a 32-bit BGRA image.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Build() with a BGRA image and the number
+//   of levels wanted, then use GetLevel() to fetch the image at
+//   each size.  Level 0 is the image itself, which is referenced
+//   rather than copied, so it must outlive the pyramid.
+//
+// * Each level is half the width and height of the one above it,
+//   made by averaging 2x2 blocks of pixels with SSE2.  Building
+//   the whole pyramid costs about a third of a pass over the
+//   original image, and lets every smaller rendition of a frame
+//   start from a level close to its own size.
+//
+// * The levels below level 0 are copies held by the pyramid, so
+//   they live as long as it does.  Each frame needs its own
+//   pyramid while its renditions are being written.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+//---------------------------------------------------------------
+// A C++ class holding successively halved copies of an image.
+//---------------------------------------------------------------
+class ImagePyramid
+{
+public:
+    // One level of the pyramid.
+    struct Level
+    {
+        const unsigned char *m_pixels = nullptr;    // BGRA pixels.
+        unsigned m_width = 0;                       // Width in pixels.
+        unsigned m_height = 0;                      // Height in pixels.
+        unsigned m_stride = 0;                      // Bytes per row.
+    };
+
+    // Builds the pyramid from a BGRA image.  Stops early if a
+    // level would be less than one pixel wide or high.
+    void Build(const void *pixels, unsigned width, unsigned height,
+        unsigned stride, unsigned numLevels);
+
+    // Returns the number of levels, including level 0.
+    size_t GetLevelCount() const { return m_levels.size(); }
+
+    // Returns one level of the pyramid.
+    const Level &GetLevel(size_t index) const { return m_levels[index]; }
+
+private:
+    std::vector<Level> m_levels;                        // The levels, largest first.
+    std::vector<std::vector<unsigned char>> m_storage;  // Pixels of levels 1 and up.
+};
+
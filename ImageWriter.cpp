@@ -0,0 +1,325 @@
+//--------------------------------------------------------------------
+// ImageWriter.cpp
+// A C++ module for writing 32-bit BGRA images to .BMP, .JPG, or
+// .PNG files.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "ImageWriter.h"
+#include "BmpFile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <windows.h>
+#include <wincodec.h>
+#include <atlbase.h>
+#include <mutex>
+#include <vector>
+
+// Link to the Windows Imaging Component.
+#pragma comment(lib, "windowscodecs.lib")
+#pragma comment(lib, "ole32.lib")
+
+namespace
+{
+
+//---------------------------------------------------------------
+// Returns the process-wide WIC factory, creating it on first
+// use.  The factory is free-threaded, so it is shared by every
+// encoding thread.  Returns nullptr if WIC is unavailable.
+//---------------------------------------------------------------
+IWICImagingFactory *GetImagingFactory()
+{
+    static std::once_flag once;
+    static CComPtr<IWICImagingFactory> factory;
+    std::call_once(once, []()
+    {
+        CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER,
+            IID_PPV_ARGS(&factory));
+    });
+    return factory;
+}
+
+//---------------------------------------------------------------
+// Waits until a file that has already been written and closed
+// has been committed to the disk.  Returns true if successful.
+//---------------------------------------------------------------
+bool FlushFileToDisk(const char *szPath)
+{
+    HANDLE hFile = CreateFileA(szPath, GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    bool result = FlushFileBuffers(hFile) != FALSE;
+    CloseHandle(hFile);
+    return result;
+}
+
+//---------------------------------------------------------------
+// Encodes a 32-bit BGRA image to a stream with WIC, as the given
+// container format.  Returns true if successful.
+//---------------------------------------------------------------
+bool EncodeWithWic(
+    IStream *stream,            // in:  Stream to write the encoded image to.
+    const GUID &container,      // in:  WIC container format to encode as.
+    unsigned width,             // in:  Width of the image in pixels.
+    unsigned height,            // in:  Height of the image in pixels.
+    unsigned stride,            // in:  Bytes per row of the image.
+    const void *pBits,          // in:  The image's pixels.
+    unsigned quality,           // in:  JPEG quality, 1 to 100.
+    std::string &errText        // out: Description of the error, if any.
+    )
+{
+    IWICImagingFactory *factory = GetImagingFactory();
+    if (factory == nullptr)
+    {
+        errText = "Windows Imaging Component is unavailable.";
+        return false;
+    }
+
+    // Wrap the caller's pixels without copying them.  The alpha
+    // channel is ignored.
+    CComPtr<IWICBitmap> bitmap;
+    if (FAILED(factory->CreateBitmapFromMemory(width, height, GUID_WICPixelFormat32bppBGR,
+            stride, stride * height, static_cast<BYTE *>(const_cast<void *>(pBits)), &bitmap)))
+    {
+        errText = "CreateBitmapFromMemory failed.";
+        return false;
+    }
+
+    CComPtr<IWICBitmapEncoder> encoder;
+    CComPtr<IWICBitmapFrameEncode> frame;
+    CComPtr<IPropertyBag2> props;
+    if (FAILED(factory->CreateEncoder(container, nullptr, &encoder)) ||
+        FAILED(encoder->Initialize(stream, WICBitmapEncoderNoCache)) ||
+        FAILED(encoder->CreateNewFrame(&frame, &props)))
+    {
+        errText = "Failed creating image encoder.";
+        return false;
+    }
+
+    // Set the JPEG quality, which WIC gives as 0.0 to 1.0.
+    if (container == GUID_ContainerFormatJpeg && props != nullptr)
+    {
+        PROPBAG2 option = {0};
+        option.pstrName = const_cast<wchar_t *>(L"ImageQuality");
+        VARIANT value;
+        VariantInit(&value);
+        value.vt = VT_R4;
+        value.fltVal = __max(1u, __min(100u, quality)) / 100.0f;
+        props->Write(1, &option, &value);
+    }
+
+    // WriteSource() converts to whatever pixel format the encoder
+    // settles on.
+    WICPixelFormatGUID pixelFormat = GUID_WICPixelFormat24bppBGR;
+    if (FAILED(frame->Initialize(props)) ||
+        FAILED(frame->SetSize(width, height)) ||
+        FAILED(frame->SetPixelFormat(&pixelFormat)) ||
+        FAILED(frame->WriteSource(bitmap, nullptr)) ||
+        FAILED(frame->Commit()) ||
+        FAILED(encoder->Commit()))
+    {
+        errText = "Image encoding failed.";
+        return false;
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------
+// Encodes a 32-bit BGRA image to a file with WIC, as the given
+// container format.  Returns true if successful.
+//---------------------------------------------------------------
+bool EncodeFileWithWic(
+    const char *szPath,         // in:  Path of the file to write.
+    const GUID &container,      // in:  WIC container format to encode as.
+    unsigned width,             // in:  Width of the image in pixels.
+    unsigned height,            // in:  Height of the image in pixels.
+    unsigned stride,            // in:  Bytes per row of the image.
+    const void *pBits,          // in:  The image's pixels.
+    unsigned quality,           // in:  JPEG quality, 1 to 100.
+    std::string &errText        // out: Description of the error, if any.
+    )
+{
+    IWICImagingFactory *factory = GetImagingFactory();
+    if (factory == nullptr)
+    {
+        errText = "Windows Imaging Component is unavailable.";
+        return false;
+    }
+
+    // WIC wants a wide path.
+    wchar_t widePath[MAX_PATH] = {0};
+    if (MultiByteToWideChar(CP_ACP, 0, szPath, -1, widePath, MAX_PATH) == 0)
+    {
+        errText = "Bad output path.";
+        return false;
+    }
+
+    CComPtr<IWICStream> stream;
+    if (FAILED(factory->CreateStream(&stream)) ||
+        FAILED(stream->InitializeFromFilename(widePath, GENERIC_WRITE)))
+    {
+        errText = "Failed creating output file.";
+        return false;
+    }
+
+    return EncodeWithWic(stream, container, width, height, stride, pBits, quality, errText);
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Returns the usual file extension of an image file format.
+//---------------------------------------------------------------
+const char *GetImageFileExtension(ImageFileFormat format)
+{
+    switch (format)
+    {
+    case IFF_JPEG:  return "jpg";
+    case IFF_PNG:   return "png";
+    default:        return "bmp";
+    }
+}
+
+//---------------------------------------------------------------
+// Parses an image file format name or extension.  Returns false
+// if it isn't recognized.
+//---------------------------------------------------------------
+bool ParseImageFileFormat(const char *name, ImageFileFormat &format)
+{
+    if (_stricmp(name, "bmp") == 0)
+        format = IFF_BMP;
+    else if (_stricmp(name, "jpg") == 0 || _stricmp(name, "jpeg") == 0)
+        format = IFF_JPEG;
+    else if (_stricmp(name, "png") == 0)
+        format = IFF_PNG;
+    else
+        return false;
+
+    return true;
+}
+
+//---------------------------------------------------------------
+// Writes a 32-bit BGRA image from memory to a file of the given
+// format.  Returns true if successful.
+//---------------------------------------------------------------
+bool WriteImageFile(const char *szPath, ImageFileFormat format,
+    unsigned width, unsigned height, unsigned stride, const void *pBits,
+    unsigned quality, bool flush, std::string &errText)
+{
+    errText.clear();
+    if (szPath == nullptr || szPath[0] == '\0' || width < 1 || height < 1 ||
+        stride < width * 4 || pBits == nullptr)
+    {
+        errText = "Bad parameter.";
+        return false;
+    }
+
+    if (format == IFF_BMP)
+    {
+        if (!BmpWrite(szPath, width, height, stride, 32, pBits, flush))
+        {
+            errText = "BmpWrite failed.";
+            return false;
+        }
+        return true;
+    }
+
+    const GUID &container = (format == IFF_JPEG) ? GUID_ContainerFormatJpeg : GUID_ContainerFormatPng;
+    if (!EncodeFileWithWic(szPath, container, width, height, stride, pBits, quality, errText))
+    {
+        _unlink(szPath);
+        return false;
+    }
+
+    if (flush && !FlushFileToDisk(szPath))
+    {
+        errText = "Failed flushing file to disk.";
+        return false;
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------
+// Encodes a 32-bit BGRA image into memory as a .JPG or .PNG
+// file.  Returns true if successful.
+//---------------------------------------------------------------
+bool EncodeImage(ImageFileFormat format, unsigned width, unsigned height, unsigned stride,
+    const void *pBits, unsigned quality, std::vector<unsigned char> &data, std::string &errText)
+{
+    errText.clear();
+    data.clear();
+    if (format == IFF_BMP || width < 1 || height < 1 || stride < width * 4 || pBits == nullptr)
+    {
+        errText = "Bad parameter.";
+        return false;
+    }
+
+    // Encode into a growable memory stream, then copy the result
+    // out.
+    CComPtr<IStream> stream;
+    if (FAILED(CreateStreamOnHGlobal(nullptr, TRUE, &stream)))
+    {
+        errText = "Failed creating memory stream.";
+        return false;
+    }
+
+    const GUID &container = (format == IFF_JPEG) ? GUID_ContainerFormatJpeg : GUID_ContainerFormatPng;
+    if (!EncodeWithWic(stream, container, width, height, stride, pBits, quality, errText))
+        return false;
+
+    STATSTG stat = {0};
+    HGLOBAL hGlobal = nullptr;
+    if (FAILED(stream->Stat(&stat, STATFLAG_NONAME)) || FAILED(GetHGlobalFromStream(stream, &hGlobal)))
+    {
+        errText = "Failed reading memory stream.";
+        return false;
+    }
+
+    const void *encoded = GlobalLock(hGlobal);
+    if (encoded == nullptr)
+    {
+        errText = "Failed reading memory stream.";
+        return false;
+    }
+    data.assign(static_cast<const unsigned char *>(encoded),
+        static_cast<const unsigned char *>(encoded) + static_cast<size_t>(stat.cbSize.QuadPart));
+    GlobalUnlock(hGlobal);
+    return true;
+}
@@ -0,0 +1,97 @@
+//--------------------------------------------------------------------
+// ImageWriter.h
+// A C++ module for writing 32-bit BGRA images to .BMP, .JPG, or
+// .PNG files.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * .BMP files are written by BmpWrite().  .JPG and .PNG files are
+//   encoded with the Windows Imaging Component (WIC), so COM must be
+//   initialized on the calling thread, or the process must have a
+//   multithreaded apartment.
+//
+// * The alpha channel is ignored; all formats are written as
+//   24-bit color.
+//
+// * EncodeImage() encodes into memory instead of a file, for
+//   images that are sent elsewhere, such as live preview frames.
+//
+// * WriteImageFile() and EncodeImage() may be called from several
+//   threads at once.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Image file formats.
+enum ImageFileFormat
+{
+    IFF_BMP,
+    IFF_JPEG,
+    IFF_PNG
+};
+
+//---------------------------------------------------------------
+// Returns the usual file extension of an image file format,
+// without the dot, e.g. "jpg".
+//---------------------------------------------------------------
+const char *GetImageFileExtension(ImageFileFormat format);
+
+//---------------------------------------------------------------
+// Parses an image file format name or extension ("bmp", "jpg",
+// "jpeg", or "png").  Returns false if it isn't recognized.
+//---------------------------------------------------------------
+bool ParseImageFileFormat(const char *name, ImageFileFormat &format);
+
+//---------------------------------------------------------------
+// Writes a 32-bit BGRA image from memory to a file of the given
+// format.  'quality' (1 to 100) applies to JPEG only.  If 'flush'
+// is true, waits until the file has been committed to the disk
+// before returning.  Returns true if successful.
+//---------------------------------------------------------------
+bool WriteImageFile(const char *szPath, ImageFileFormat format,
+    unsigned width, unsigned height, unsigned stride, const void *pBits,
+    unsigned quality, bool flush, std::string &errText);
+
+//---------------------------------------------------------------
+// Encodes a 32-bit BGRA image into memory as a .JPG or .PNG file,
+// replacing the contents of 'data'.  'quality' (1 to 100) applies
+// to JPEG only.  Returns true if successful.
+//---------------------------------------------------------------
+bool EncodeImage(ImageFileFormat format, unsigned width, unsigned height, unsigned stride,
+    const void *pBits, unsigned quality, std::vector<unsigned char> &data, std::string &errText);
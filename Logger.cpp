@@ -0,0 +1,727 @@
+//--------------------------------------------------------------------
+// Logger.cpp
+// A C++ module that logs messages from time-critical threads without
+// making them wait on the console or the disk.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "Logger.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <windows.h>
+#include <algorithm>
+
+namespace
+{
+
+// How often the logging thread writes what has been queued.
+const unsigned FLUSH_INTERVAL_MS = 20;
+
+// Names of the levels, as written to the JSON file.
+const char *const LEVEL_NAMES[] = {"debug", "info", "warning", "error"};
+
+//---------------------------------------------------------------
+// Formats a wall-clock time as local time in ISO 8601 form with
+// milliseconds, e.g. "2026-10-17T13:45:01.250".
+//---------------------------------------------------------------
+void FormatLogTime(
+    std::chrono::system_clock::time_point time,     // in:  Time to format.
+    char *buffer,                                   // out:  Formatted time.
+    size_t bufferSize                               // in:  Size of buffer in chars.
+    )
+{
+    time_t seconds = std::chrono::system_clock::to_time_t(time);
+    long long millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+        time.time_since_epoch()).count() % 1000;
+
+    struct tm local = {0};
+    localtime_s(&local, &seconds);
+    size_t len = strftime(buffer, bufferSize, "%Y-%m-%dT%H:%M:%S", &local);
+    sprintf_s(buffer + len, bufferSize - len, ".%03lld", millis);
+}
+
+//---------------------------------------------------------------
+// Returns an argument as a signed integer, whatever its type.
+//---------------------------------------------------------------
+long long GetIntArg(
+    const LogArg &arg       // in:  Argument.
+    )
+{
+    switch (arg.m_type)
+    {
+        case LogArg::LA_INT:        return arg.m_int;
+        case LogArg::LA_UINT:       return static_cast<long long>(arg.m_uint);
+        case LogArg::LA_DOUBLE:     return static_cast<long long>(arg.m_double);
+        case LogArg::LA_POINTER:    return reinterpret_cast<intptr_t>(arg.m_pointer);
+        default:                    return 0;
+    }
+}
+
+//---------------------------------------------------------------
+// Returns an argument as a double, whatever its type.
+//---------------------------------------------------------------
+double GetDoubleArg(
+    const LogArg &arg       // in:  Argument.
+    )
+{
+    switch (arg.m_type)
+    {
+        case LogArg::LA_INT:        return static_cast<double>(arg.m_int);
+        case LogArg::LA_UINT:       return static_cast<double>(arg.m_uint);
+        case LogArg::LA_DOUBLE:     return arg.m_double;
+        default:                    return 0.0;
+    }
+}
+
+//---------------------------------------------------------------
+// Formats an argument in its type's plain form.
+//---------------------------------------------------------------
+std::string FormatPlainArg(
+    const LogRecord &record,    // in:  Record holding the argument.
+    const LogArg &arg           // in:  Argument.
+    )
+{
+    char buffer[64] = {0};
+    switch (arg.m_type)
+    {
+        case LogArg::LA_INT:        sprintf_s(buffer, _countof(buffer), "%lld", arg.m_int); break;
+        case LogArg::LA_UINT:       sprintf_s(buffer, _countof(buffer), "%llu", arg.m_uint); break;
+        case LogArg::LA_DOUBLE:     sprintf_s(buffer, _countof(buffer), "%g", arg.m_double); break;
+        case LogArg::LA_POINTER:    sprintf_s(buffer, _countof(buffer), "%p", arg.m_pointer); break;
+        case LogArg::LA_STRING:     return record.m_text + arg.m_offset;
+    }
+    return buffer;
+}
+
+//---------------------------------------------------------------
+// Formats a record's message, doing the work printf() would have
+// done when the message was logged.
+//---------------------------------------------------------------
+std::string FormatMessage(
+    const LogRecord &record     // in:  Record to format.
+    )
+{
+    std::string out;
+    unsigned argIndex = 0;
+    const char *p = record.m_format;
+    while (*p != '\0')
+    {
+        if (*p != '%')
+        {
+            const char *next = strchr(p, '%');
+            size_t n = next != nullptr ? next - p : strlen(p);
+            out.append(p, n);
+            p += n;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            out += '%';
+            p += 2;
+            continue;
+        }
+
+        // Keep the flags, width, and precision, but skip the length
+        // modifiers; the argument's own type decides the length.
+        char spec[40] = "%";
+        size_t len = 1;
+        const char *q = p + 1;
+        while (*q != '\0' && strchr("-+ #0", *q) != nullptr && len < 8)
+            spec[len++] = *q++;
+        while (*q >= '0' && *q <= '9' && len < 16)
+            spec[len++] = *q++;
+        if (*q == '.')
+        {
+            spec[len++] = *q++;
+            while (*q >= '0' && *q <= '9' && len < 24)
+                spec[len++] = *q++;
+        }
+        while (*q != '\0' && strchr("hlLjztwI3264", *q) != nullptr)
+            q++;
+        const char conversion = *q;
+        if (conversion == '\0')
+            break;
+        p = q + 1;
+
+        if (argIndex >= record.m_numArgs)
+        {
+            out += "<missing>";
+            continue;
+        }
+        const LogArg &arg = record.m_args[argIndex++];
+
+        char buffer[512] = {0};
+        switch (conversion)
+        {
+            case 'd':
+            case 'i':
+                strcpy_s(spec + len, _countof(spec) - len, "lld");
+                _snprintf_s(buffer, _countof(buffer), _TRUNCATE, spec, GetIntArg(arg));
+                break;
+
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+                spec[len++] = 'l';
+                spec[len++] = 'l';
+                spec[len++] = conversion;
+                _snprintf_s(buffer, _countof(buffer), _TRUNCATE, spec,
+                    arg.m_type == LogArg::LA_UINT ? arg.m_uint : static_cast<unsigned long long>(GetIntArg(arg)));
+                break;
+
+            case 'c':
+                spec[len++] = 'c';
+                _snprintf_s(buffer, _countof(buffer), _TRUNCATE, spec, static_cast<int>(GetIntArg(arg)));
+                break;
+
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                spec[len++] = conversion;
+                _snprintf_s(buffer, _countof(buffer), _TRUNCATE, spec, GetDoubleArg(arg));
+                break;
+
+            case 'p':
+                spec[len++] = 'p';
+                _snprintf_s(buffer, _countof(buffer), _TRUNCATE, spec,
+                    arg.m_type == LogArg::LA_POINTER ? arg.m_pointer : nullptr);
+                break;
+
+            default:
+                // Strings, and anything not understood, are written
+                // as the argument's plain form.
+                spec[len++] = 's';
+                _snprintf_s(buffer, _countof(buffer), _TRUNCATE, conversion == 's' ? spec : "%s",
+                    FormatPlainArg(record, arg).c_str());
+                break;
+        }
+        out += buffer;
+    }
+    return out;
+}
+
+//---------------------------------------------------------------
+// Appends a string to a JSON line as a quoted JSON string.
+//---------------------------------------------------------------
+void AppendJsonString(
+    std::string &json,      // in/out:  Line to append to.
+    const std::string &text // in:  Text to quote.
+    )
+{
+    json += '"';
+    for (unsigned char c : text)
+    {
+        switch (c)
+        {
+            case '"':   json += "\\\""; break;
+            case '\\':  json += "\\\\"; break;
+            case '\n':  json += "\\n"; break;
+            case '\r':  json += "\\r"; break;
+            case '\t':  json += "\\t"; break;
+            default:
+                if (c < 0x20)
+                {
+                    char escape[8] = {0};
+                    sprintf_s(escape, _countof(escape), "\\u%04x", c);
+                    json += escape;
+                }
+                else
+                {
+                    json += static_cast<char>(c);
+                }
+                break;
+        }
+    }
+    json += '"';
+}
+
+//---------------------------------------------------------------
+// Appends the fields every JSON line starts with.
+//---------------------------------------------------------------
+void AppendJsonHeader(
+    std::string &json,                              // in/out:  Line to append to.
+    std::chrono::system_clock::time_point time,     // in:  When the message was logged.
+    LogLevel level,                                 // in:  Severity.
+    uint32_t threadId,                              // in:  Thread that logged it.
+    const std::string &message                      // in:  Formatted message.
+    )
+{
+    char timeText[40] = {0};
+    FormatLogTime(time, timeText, _countof(timeText));
+    char threadText[16] = {0};
+    sprintf_s(threadText, _countof(threadText), "%u", threadId);
+
+    json += "{\"time\":\"";
+    json += timeText;
+    json += "\",\"level\":\"";
+    json += LEVEL_NAMES[level];
+    json += "\",\"thread\":";
+    json += threadText;
+    json += ",\"msg\":";
+    AppendJsonString(json, message);
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// One thread's queue of records.  Only the thread adds records,
+// and only the logging thread (or Flush()) takes them.
+//---------------------------------------------------------------
+struct Logger::Ring
+{
+    LogRecord m_records[RingSize];      // Record N is in m_records[N % RingSize].
+    std::atomic<uint32_t> m_head{0};    // Records added so far.
+    std::atomic<uint32_t> m_tail{0};    // Records taken so far.
+    uint32_t m_threadId = 0;            // The thread that owns the ring.
+};
+
+//---------------------------------------------------------------
+void LogRecord::AddInt(long long value)
+{
+    if (m_numArgs >= MaxArgs)
+        return;
+    LogArg &arg = m_args[m_numArgs++];
+    arg.m_type = LogArg::LA_INT;
+    arg.m_int = value;
+}
+
+//---------------------------------------------------------------
+void LogRecord::AddUint(unsigned long long value)
+{
+    if (m_numArgs >= MaxArgs)
+        return;
+    LogArg &arg = m_args[m_numArgs++];
+    arg.m_type = LogArg::LA_UINT;
+    arg.m_uint = value;
+}
+
+//---------------------------------------------------------------
+void LogRecord::AddArg(double value)
+{
+    if (m_numArgs >= MaxArgs)
+        return;
+    LogArg &arg = m_args[m_numArgs++];
+    arg.m_type = LogArg::LA_DOUBLE;
+    arg.m_double = value;
+}
+
+//---------------------------------------------------------------
+// Copies a string argument into the record's text, truncating it
+// if the text is nearly full.
+//---------------------------------------------------------------
+void LogRecord::AddArg(const char *value)
+{
+    if (m_numArgs >= MaxArgs)
+        return;
+    if (value == nullptr)
+        value = "(null)";
+
+    // Each string is nul-terminated, so one that doesn't fit at
+    // all still gets an empty string.
+    unsigned offset = __min(m_textSize, MaxTextSize - 1);
+    size_t n = __min(strlen(value), static_cast<size_t>(MaxTextSize - 1 - offset));
+    memcpy(m_text + offset, value, n);
+    m_text[offset + n] = '\0';
+    m_textSize = static_cast<unsigned>(__min(offset + n + 1, static_cast<size_t>(MaxTextSize)));
+
+    LogArg &arg = m_args[m_numArgs++];
+    arg.m_type = LogArg::LA_STRING;
+    arg.m_offset = offset;
+}
+
+//---------------------------------------------------------------
+void LogRecord::AddArg(const void *value)
+{
+    if (m_numArgs >= MaxArgs)
+        return;
+    LogArg &arg = m_args[m_numArgs++];
+    arg.m_type = LogArg::LA_POINTER;
+    arg.m_pointer = value;
+}
+
+//---------------------------------------------------------------
+// Returns the process's logger.
+//---------------------------------------------------------------
+Logger &Logger::Get()
+{
+    static Logger logger;
+    return logger;
+}
+
+//---------------------------------------------------------------
+Logger::Logger()
+{
+}
+
+//---------------------------------------------------------------
+Logger::~Logger()
+{
+    Stop();
+}
+
+//---------------------------------------------------------------
+// Starts the logging thread, and opens the JSON lines file if a
+// path is given.  Returns false if the file can't be created.
+//---------------------------------------------------------------
+bool Logger::Start(LogLevel consoleLevel, const std::string &jsonPath, std::string &errText)
+{
+    errText.clear();
+    Stop();
+
+    if (!jsonPath.empty() && (fopen_s(&m_json, jsonPath.c_str(), "w") != 0 || m_json == nullptr))
+    {
+        m_json = nullptr;
+        errText = "Failed creating log file \"" + jsonPath + "\".";
+        return false;
+    }
+
+    m_consoleLevel = consoleLevel;
+    m_minLevel = m_json != nullptr ? LL_DEBUG : consoleLevel;
+    m_stop = false;
+    m_running = true;
+    m_thread = std::thread([this]() { LoggerThread(); });
+    return true;
+}
+
+//---------------------------------------------------------------
+// Writes everything queued, stops the logging thread, and closes
+// the JSON file.  Messages logged from here on are written right
+// away.
+//---------------------------------------------------------------
+void Logger::Stop()
+{
+    if (m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_wakeLock);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+    }
+    m_running = false;
+
+    std::lock_guard<std::mutex> lock(m_drainLock);
+    std::string console, json;
+    WriteSuppressed(true, console, json);
+    fwrite(console.data(), 1, console.size(), stdout);
+    fflush(stdout);
+    if (m_json != nullptr)
+    {
+        fwrite(json.data(), 1, json.size(), m_json);
+        fclose(m_json);
+        m_json = nullptr;
+    }
+    m_minLevel = m_consoleLevel;
+}
+
+//---------------------------------------------------------------
+// Writes everything queued so far before returning.
+//---------------------------------------------------------------
+void Logger::Flush()
+{
+    Drain();
+}
+
+//---------------------------------------------------------------
+// Starts a record in the calling thread's ring, or in a scratch
+// record if the logger isn't running.  Returns nullptr if the
+// ring is full.
+//---------------------------------------------------------------
+LogRecord *Logger::BeginRecord(LogLevel level, const char *format)
+{
+    static thread_local LogRecord scratch;
+    LogRecord *record = &scratch;
+    if (m_running)
+    {
+        Ring *ring = GetThreadRing();
+        const uint32_t head = ring->m_head.load(std::memory_order_relaxed);
+        if (head - ring->m_tail.load(std::memory_order_acquire) >= RingSize)
+        {
+            ++m_recordsDropped;
+            return nullptr;
+        }
+        record = &ring->m_records[head % RingSize];
+        record->m_threadId = ring->m_threadId;
+    }
+    else
+    {
+        record->m_threadId = GetCurrentThreadId();
+    }
+
+    record->m_time = std::chrono::system_clock::now();
+    record->m_format = format;
+    record->m_level = level;
+    record->m_numArgs = 0;
+    record->m_textSize = 0;
+    return record;
+}
+
+//---------------------------------------------------------------
+// Hands a finished record to the logging thread, or writes it
+// right away if it is the scratch record.
+//---------------------------------------------------------------
+void Logger::CommitRecord(LogRecord *record)
+{
+    Ring *ring = m_running ? GetThreadRing() : nullptr;
+    if (ring != nullptr && record >= ring->m_records && record < ring->m_records + RingSize)
+    {
+        ring->m_head.store(ring->m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_drainLock);
+    std::string console, json;
+    WriteRecord(*record, console, json);
+    fwrite(console.data(), 1, console.size(), stdout);
+    fflush(stdout);
+    if (m_json != nullptr)
+        fwrite(json.data(), 1, json.size(), m_json);
+}
+
+//---------------------------------------------------------------
+// Returns the calling thread's ring, creating it the first time.
+//---------------------------------------------------------------
+Logger::Ring *Logger::GetThreadRing()
+{
+    static thread_local Ring *ring = nullptr;
+    if (ring == nullptr)
+    {
+        std::unique_ptr<Ring> newRing(new Ring);
+        newRing->m_threadId = GetCurrentThreadId();
+        ring = newRing.get();
+        std::lock_guard<std::mutex> lock(m_ringsLock);
+        m_rings.push_back(std::move(newRing));
+    }
+    return ring;
+}
+
+//---------------------------------------------------------------
+// Runs on the logging thread.  Writes whatever has been queued,
+// every few milliseconds, until Stop() is called.
+//---------------------------------------------------------------
+void Logger::LoggerThread()
+{
+    for (;;)
+    {
+        bool stop = false;
+        {
+            std::unique_lock<std::mutex> lock(m_wakeLock);
+            stop = m_wake.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS),
+                [this]() { return m_stop.load(); });
+        }
+        Drain();
+        if (stop)
+            break;
+    }
+}
+
+//---------------------------------------------------------------
+// Takes every queued record from every ring, and writes them in
+// the order they were logged.
+//---------------------------------------------------------------
+void Logger::Drain()
+{
+    std::lock_guard<std::mutex> lock(m_drainLock);
+
+    // Rings are never freed while the logger exists, so they can
+    // be read without holding m_ringsLock.
+    std::vector<Ring *> rings;
+    {
+        std::lock_guard<std::mutex> ringsLock(m_ringsLock);
+        for (auto &ring : m_rings)
+            rings.push_back(ring.get());
+    }
+
+    std::vector<uint32_t> heads(rings.size());
+    std::vector<const LogRecord *> records;
+    for (size_t i = 0; i < rings.size(); i++)
+    {
+        heads[i] = rings[i]->m_head.load(std::memory_order_acquire);
+        for (uint32_t n = rings[i]->m_tail.load(std::memory_order_relaxed); n != heads[i]; n++)
+            records.push_back(&rings[i]->m_records[n % RingSize]);
+    }
+    std::stable_sort(records.begin(), records.end(),
+        [](const LogRecord *a, const LogRecord *b) { return a->m_time < b->m_time; });
+
+    std::string console, json;
+    for (const LogRecord *record : records)
+        WriteRecord(*record, console, json);
+    WriteSuppressed(false, console, json);
+
+    // The records have been formatted, so their slots can be
+    // reused.
+    for (size_t i = 0; i < rings.size(); i++)
+        rings[i]->m_tail.store(heads[i], std::memory_order_release);
+
+    const unsigned dropped = m_recordsDropped - m_droppedReported;
+    if (dropped > 0)
+    {
+        char text[80] = {0};
+        sprintf_s(text, _countof(text), "(%u log message(s) lost; logging fell behind)\n", dropped);
+        console += text;
+        m_droppedReported += dropped;
+    }
+
+    if (!console.empty())
+    {
+        fwrite(console.data(), 1, console.size(), stdout);
+        fflush(stdout);
+    }
+    if (m_json != nullptr && !json.empty())
+    {
+        fwrite(json.data(), 1, json.size(), m_json);
+        fflush(m_json);
+    }
+}
+
+//---------------------------------------------------------------
+// Formats one record onto the console text and the JSON lines,
+// unless the rate limit holds it back.
+//---------------------------------------------------------------
+void Logger::WriteRecord(const LogRecord &record, std::string &console, std::string &json)
+{
+    const std::string message = FormatMessage(record);
+
+    // Identical warnings and errors are rate limited.  A message
+    // whose period is over starts a new one, after reporting how
+    // many repeats were held back.
+    if (record.m_level >= LL_WARNING)
+    {
+        const auto period = std::chrono::seconds(RateLimitSeconds);
+        auto it = m_repeats.find(message);
+        if (it != m_repeats.end() && record.m_time - it->second.m_periodStart >= period)
+        {
+            WriteSuppressed(false, console, json);
+            it = m_repeats.find(message);
+        }
+        if (it == m_repeats.end())
+        {
+            RepeatState state;
+            state.m_periodStart = record.m_time;
+            state.m_level = record.m_level;
+            it = m_repeats.insert(std::make_pair(message, state)).first;
+        }
+        if (++it->second.m_count > RateLimitBurst)
+        {
+            ++m_recordsSuppressed;
+            return;
+        }
+    }
+
+    if (record.m_level >= m_consoleLevel)
+    {
+        console += message;
+        console += '\n';
+    }
+
+    if (m_json != nullptr)
+    {
+        AppendJsonHeader(json, record.m_time, record.m_level, record.m_threadId, message);
+        json += ",\"format\":";
+        AppendJsonString(json, record.m_format);
+        json += ",\"args\":[";
+        for (unsigned i = 0; i < record.m_numArgs; i++)
+        {
+            const LogArg &arg = record.m_args[i];
+            if (i > 0)
+                json += ',';
+            if (arg.m_type == LogArg::LA_STRING || arg.m_type == LogArg::LA_POINTER)
+                AppendJsonString(json, FormatPlainArg(record, arg));
+            else if (arg.m_type == LogArg::LA_DOUBLE && !isfinite(arg.m_double))
+                json += "null";
+            else if (arg.m_type == LogArg::LA_DOUBLE)
+            {
+                char number[32] = {0};
+                sprintf_s(number, _countof(number), "%.17g", arg.m_double);
+                json += number;
+            }
+            else
+                json += FormatPlainArg(record, arg);
+        }
+        json += "]}\n";
+    }
+}
+
+//---------------------------------------------------------------
+// Ends the rate limit periods that are over (or all of them), and
+// writes how many repeats of each message were held back.
+//---------------------------------------------------------------
+void Logger::WriteSuppressed(bool all, std::string &console, std::string &json)
+{
+    const auto now = std::chrono::system_clock::now();
+    const auto period = std::chrono::seconds(RateLimitSeconds);
+    for (auto it = m_repeats.begin(); it != m_repeats.end();)
+    {
+        const RepeatState &state = it->second;
+        if (!all && now - state.m_periodStart < period)
+        {
+            ++it;
+            continue;
+        }
+
+        if (state.m_count > RateLimitBurst)
+        {
+            char text[80] = {0};
+            sprintf_s(text, _countof(text), "  (repeated %u more time(s))",
+                state.m_count - RateLimitBurst);
+            const std::string message = it->first + text;
+            if (state.m_level >= m_consoleLevel)
+            {
+                console += message;
+                console += '\n';
+            }
+            if (m_json != nullptr)
+            {
+                char count[16] = {0};
+                sprintf_s(count, _countof(count), "%u", state.m_count - RateLimitBurst);
+                AppendJsonHeader(json, now, state.m_level, GetCurrentThreadId(), message);
+                json += ",\"suppressed\":";
+                json += count;
+                json += "}\n";
+            }
+        }
+        it = m_repeats.erase(it);
+    }
+}
@@ -0,0 +1,250 @@
+//--------------------------------------------------------------------
+// Logger.h
+// A C++ module that logs messages from time-critical threads without
+// making them wait on the console or the disk.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Logger::Get().Start() once, then log with
+//   Logger::Get().Log(level, format, args...), using printf-style
+//   formats.  Call Flush() before printing to the console directly,
+//   so earlier messages come first, and Stop() at the end.  Until
+//   Start() is called (or after Stop()), messages are written
+//   synchronously instead.
+//
+// * Log() doesn't format anything.  It copies the format pointer,
+//   which must be a string literal (or otherwise outlive the
+//   logger), and the arguments, as tagged binary values, into a
+//   record in the calling thread's own ring.  String arguments are
+//   copied into the record, truncated to MaxTextSize bytes in all.
+//   Each ring has one writer (its thread) and one reader (the
+//   logging thread), so adding a record takes no lock, just two
+//   atomic index updates.  If the ring is full the record is
+//   dropped and counted, rather than waiting.
+//
+// * A background thread wakes every few milliseconds, takes the
+//   records from every ring, orders them by time, formats them, and
+//   writes them to the console in one go.  With a JSON path given,
+//   every record is also written there as one JSON object per line,
+//   with its time, level, thread, message, format, and arguments.
+//
+// * Warnings and errors repeating the exact same text are rate
+//   limited:  at most RateLimitBurst of them per RateLimitSeconds
+//   are written, and a count of the rest is written once the
+//   period is over.
+//
+// * Formats support the usual printf conversions (d, i, u, x, X,
+//   o, c, e, f, g, a, s, p) with flags, width, and precision.
+//   Length modifiers are ignored; each argument's own type decides.
+//   Integral arguments are kept as 64 bits, floating point ones as
+//   doubles.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//---------------------------------------------------------------
+// Severities of log messages.
+//---------------------------------------------------------------
+enum LogLevel
+{
+    LL_DEBUG   = 0,     // Detail only wanted while investigating.
+    LL_INFO    = 1,     // Progress of the capture.
+    LL_WARNING = 2,     // Something was skipped or disabled.
+    LL_ERROR   = 3      // Something failed.
+};
+
+//---------------------------------------------------------------
+// One argument of a log record.
+//---------------------------------------------------------------
+struct LogArg
+{
+    enum Type : uint8_t
+    {
+        LA_INT,             // m_int.
+        LA_UINT,            // m_uint.
+        LA_DOUBLE,          // m_double.
+        LA_STRING,          // m_offset into the record's text.
+        LA_POINTER          // m_pointer.
+    };
+
+    Type m_type;
+    union
+    {
+        long long m_int;
+        unsigned long long m_uint;
+        double m_double;
+        unsigned m_offset;
+        const void *m_pointer;
+    };
+};
+
+//---------------------------------------------------------------
+// One message, as queued by Log().
+//---------------------------------------------------------------
+struct LogRecord
+{
+    static const unsigned MaxArgs = 8;
+    static const unsigned MaxTextSize = 192;
+
+    std::chrono::system_clock::time_point m_time;   // When the message was logged.
+    const char *m_format = nullptr;     // printf-style format.
+    LogLevel m_level = LL_INFO;         // Severity.
+    uint32_t m_threadId = 0;            // Thread that logged the message.
+    unsigned m_numArgs = 0;             // Arguments in m_args.
+    unsigned m_textSize = 0;            // Bytes used in m_text.
+    LogArg m_args[MaxArgs];             // The arguments.
+    char m_text[MaxTextSize];           // String arguments, each nul-terminated.
+
+    // Adds arguments.  Arguments past MaxArgs are ignored.
+    void AddArg(bool value) { AddInt(value ? 1 : 0); }
+    void AddArg(int value) { AddInt(value); }
+    void AddArg(long value) { AddInt(value); }
+    void AddArg(long long value) { AddInt(value); }
+    void AddArg(unsigned value) { AddUint(value); }
+    void AddArg(unsigned long value) { AddUint(value); }
+    void AddArg(unsigned long long value) { AddUint(value); }
+    void AddArg(double value);
+    void AddArg(const char *value);
+    void AddArg(const std::string &value) { AddArg(value.c_str()); }
+    void AddArg(const void *value);
+
+private:
+    void AddInt(long long value);
+    void AddUint(unsigned long long value);
+};
+
+//---------------------------------------------------------------
+// A C++ class that queues log messages from any thread and writes
+// them on a background thread.
+//---------------------------------------------------------------
+class Logger
+{
+public:
+    // Records each thread's ring holds.
+    static const unsigned RingSize = 256;
+
+    // Most identical warnings or errors written per period.
+    static const unsigned RateLimitBurst = 5;
+    static const unsigned RateLimitSeconds = 10;
+
+    // Returns the process's logger.
+    static Logger &Get();
+
+    ~Logger();
+
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
+
+    // Starts the logging thread.  Messages below 'consoleLevel'
+    // aren't shown on the console.  With a non-empty 'jsonPath',
+    // every message is also written to that file as JSON lines.
+    // Returns false if the file can't be created.
+    bool Start(LogLevel consoleLevel, const std::string &jsonPath, std::string &errText);
+
+    // Writes everything queued, stops the logging thread, and
+    // closes the JSON file.
+    void Stop();
+
+    // Writes everything queued so far before returning.
+    void Flush();
+
+    // Queues a message.  Never waits, unless the logger isn't
+    // running, in which case the message is written right away.
+    template <typename... Args>
+    void Log(LogLevel level, const char *format, const Args &... args)
+    {
+        if (level < m_minLevel)
+            return;
+        LogRecord *record = BeginRecord(level, format);
+        if (record == nullptr)
+            return;
+        int unused[] = {0, (record->AddArg(args), 0)...};
+        (void)unused;
+        CommitRecord(record);
+    }
+
+    // Statistics.
+    unsigned GetRecordsDropped() const { return m_recordsDropped; }
+    unsigned GetRecordsSuppressed() const { return m_recordsSuppressed; }
+
+private:
+    struct Ring;
+
+    // How often one warning or error has been logged lately.
+    struct RepeatState
+    {
+        std::chrono::system_clock::time_point m_periodStart;    // When the current period started.
+        LogLevel m_level = LL_WARNING;  // Severity of the message.
+        unsigned m_count = 0;           // Times logged this period.
+    };
+
+    Logger();
+
+    LogRecord *BeginRecord(LogLevel level, const char *format);
+    void CommitRecord(LogRecord *record);
+    Ring *GetThreadRing();
+    void LoggerThread();
+    void Drain();
+    void WriteRecord(const LogRecord &record, std::string &console, std::string &json);
+    void WriteSuppressed(bool all, std::string &console, std::string &json);
+
+    std::atomic<int> m_minLevel{LL_INFO};   // Least severe level anyone writes.
+    LogLevel m_consoleLevel = LL_INFO;      // Least severe level shown on the console.
+    FILE *m_json = nullptr;                 // JSON lines file, if any.
+    std::atomic<bool> m_running{false};     // True while the logging thread runs.
+    std::atomic<bool> m_stop{false};        // Set to stop the logging thread.
+    std::thread m_thread;                   // The logging thread.
+    std::mutex m_wakeLock;                  // Protects waiting on m_wake.
+    std::condition_variable m_wake;         // Signaled by Stop().
+    std::mutex m_ringsLock;                 // Protects m_rings.
+    std::vector<std::unique_ptr<Ring>> m_rings;     // Every thread's ring; kept until exit.
+    std::mutex m_drainLock;                 // Lets one thread at a time read the rings and write.
+    std::map<std::string, RepeatState> m_repeats;   // Recent warnings and errors; m_drainLock.
+    std::atomic<unsigned> m_recordsDropped{0};      // Records lost to full rings.
+    unsigned m_droppedReported = 0;                 // Dropped records already reported; m_drainLock.
+    std::atomic<unsigned> m_recordsSuppressed{0};   // Records held back by the rate limit.
+};
@@ -0,0 +1,557 @@
+//--------------------------------------------------------------------
+// PreviewServer.cpp
+// A C++ module that serves live MJPEG previews of captured frames
+// over HTTP on the local machine.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "PreviewServer.h"
+#include "ImageWriter.h"
+#include "Logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <objbase.h>
+
+// Link to Winsock.
+#pragma comment(lib, "ws2_32.lib")
+
+namespace
+{
+
+// Boundary between the frames of a stream.
+const char BOUNDARY[] = "frame";
+
+// Longest request accepted.
+const size_t MAX_REQUEST_SIZE = 4096;
+
+// Response that starts a stream.
+const char STREAM_RESPONSE[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace; boundary=frame\r\n"
+    "Cache-Control: no-cache, no-store\r\n"
+    "Pragma: no-cache\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+//---------------------------------------------------------------
+// Returns a complete response with a short text body.
+//---------------------------------------------------------------
+std::string MakeErrorResponse(
+    const char *status,     // in:  Status code and reason, e.g. "404 Not Found".
+    const char *message     // in:  Body text.
+    )
+{
+    char response[512] = {0};
+    sprintf_s(response, _countof(response),
+        "HTTP/1.0 %s\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n%s\r\n", status, message);
+    return response;
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// The state of one stream.
+//---------------------------------------------------------------
+struct PreviewServer::Stream
+{
+    std::shared_ptr<const PreviewImage> m_pending;  // Newest image, not yet encoded; protected by m_lock.
+    std::shared_ptr<const std::vector<unsigned char>> m_jpeg;   // Newest encoded frame.
+    uint64_t m_sequence = 0;            // Number of frames encoded.
+    std::atomic<unsigned> m_watchers{0};    // Clients watching the stream.
+};
+
+//---------------------------------------------------------------
+// The state of one connected client.
+//---------------------------------------------------------------
+struct PreviewServer::Client
+{
+    SOCKET m_socket = INVALID_SOCKET;   // Connection to the client.
+    std::string m_request;              // Request received so far.
+    bool m_streaming = false;           // True once the client is watching a stream.
+    unsigned m_stream = 0;              // Stream being watched.
+    uint64_t m_sequence = 0;            // Sequence number of the last frame started.
+    std::string m_head;                 // Response header or part header being sent.
+    std::shared_ptr<const std::vector<unsigned char>> m_body;   // Frame being sent, if any.
+    size_t m_sent = 0;                  // Bytes sent of m_head, m_body, and the part trailer.
+    bool m_closeWhenSent = false;       // Disconnect once m_head has been sent.
+    bool m_closed = false;              // True once the connection has been closed.
+
+    // Returns true if nothing is left to send.
+    bool IsIdle() const
+    {
+        return m_sent == m_head.size() + (m_body ? m_body->size() + 2 : 0);
+    }
+};
+
+//---------------------------------------------------------------
+PreviewServer::PreviewServer()
+{
+}
+
+//---------------------------------------------------------------
+PreviewServer::~PreviewServer()
+{
+    Stop();
+}
+
+//---------------------------------------------------------------
+// Starts serving on the given port of the loopback interface.
+// Returns false if the port can't be opened.
+//---------------------------------------------------------------
+bool PreviewServer::Start(unsigned port, unsigned numStreams, unsigned quality, std::string &errText)
+{
+    errText.clear();
+    Stop();
+    if (port < 1 || port > 65535 || numStreams < 1)
+    {
+        errText = "Bad parameter.";
+        return false;
+    }
+
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        errText = "WSAStartup failed.";
+        return false;
+    }
+    m_winsockStarted = true;
+
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET)
+    {
+        errText = "Failed creating socket.";
+        Stop();
+        return false;
+    }
+    m_listener = listener;
+
+    sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<u_short>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == SOCKET_ERROR ||
+        listen(listener, SOMAXCONN) == SOCKET_ERROR)
+    {
+        char text[64] = {0};
+        sprintf_s(text, _countof(text), "Failed listening on port %u.", port);
+        errText = text;
+        Stop();
+        return false;
+    }
+
+    // Every socket shares one network event.  WSAEventSelect()
+    // also makes the listener non-blocking, and the sockets it
+    // accepts inherit that.
+    m_networkEvent = WSACreateEvent();
+    m_wakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if (m_networkEvent == WSA_INVALID_EVENT || m_wakeEvent == nullptr ||
+        WSAEventSelect(listener, m_networkEvent, FD_ACCEPT) == SOCKET_ERROR)
+    {
+        if (m_networkEvent == WSA_INVALID_EVENT)
+            m_networkEvent = nullptr;
+        errText = "Failed creating events.";
+        Stop();
+        return false;
+    }
+
+    m_quality = __max(1u, __min(100u, quality));
+    for (unsigned i = 0; i < numStreams; i++)
+        m_streams.push_back(std::unique_ptr<Stream>(new Stream));
+
+    m_stop = false;
+    m_thread = std::thread([this]() { ServerThread(); });
+    return true;
+}
+
+//---------------------------------------------------------------
+// Disconnects every client and stops the server thread.
+//---------------------------------------------------------------
+void PreviewServer::Stop()
+{
+    if (m_thread.joinable())
+    {
+        m_stop = true;
+        SetEvent(m_wakeEvent);
+        m_thread.join();
+    }
+
+    for (auto &client : m_clients)
+        CloseClient(*client);
+    m_clients.clear();
+    m_streams.clear();
+
+    if (m_listener != ~uintptr_t(0))
+    {
+        closesocket(static_cast<SOCKET>(m_listener));
+        m_listener = ~uintptr_t(0);
+    }
+    if (m_networkEvent != nullptr)
+    {
+        WSACloseEvent(m_networkEvent);
+        m_networkEvent = nullptr;
+    }
+    if (m_wakeEvent != nullptr)
+    {
+        CloseHandle(m_wakeEvent);
+        m_wakeEvent = nullptr;
+    }
+    if (m_winsockStarted)
+    {
+        WSACleanup();
+        m_winsockStarted = false;
+    }
+}
+
+//---------------------------------------------------------------
+// Returns true if any client is watching the given stream.
+//---------------------------------------------------------------
+bool PreviewServer::IsWatched(unsigned stream) const
+{
+    return stream < m_streams.size() && m_streams[stream]->m_watchers > 0;
+}
+
+//---------------------------------------------------------------
+// Makes 'image' the newest image of the given stream and wakes
+// the server thread to encode it.
+//---------------------------------------------------------------
+void PreviewServer::Publish(unsigned stream, std::shared_ptr<const PreviewImage> image)
+{
+    if (stream >= m_streams.size() || !image || image->m_pixels == nullptr)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_streams[stream]->m_pending)
+            ++m_framesDropped;
+        m_streams[stream]->m_pending = std::move(image);
+    }
+    SetEvent(m_wakeEvent);
+}
+
+//---------------------------------------------------------------
+// Runs on the server thread.  Waits for the sockets or a new
+// image, then does whatever work is ready.
+//---------------------------------------------------------------
+void PreviewServer::ServerThread()
+{
+    bool comInitialized = SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED));
+
+    HANDLE events[2] = {m_networkEvent, m_wakeEvent};
+    while (!m_stop)
+    {
+        WaitForMultipleObjects(2, events, FALSE, INFINITE);
+        if (m_stop)
+            break;
+
+        // Reset the network event before looking at the sockets,
+        // so anything that happens from here on sets it again.
+        // Each socket is simply tried until it would block.
+        WSAResetEvent(m_networkEvent);
+        AcceptClients();
+        for (auto &client : m_clients)
+        {
+            ReadRequest(*client);
+            SendPending(*client);
+        }
+
+        EncodePending();
+
+        for (size_t i = 0; i < m_clients.size();)
+        {
+            if (m_clients[i]->m_closed)
+                m_clients.erase(m_clients.begin() + i);
+            else
+                i++;
+        }
+    }
+
+    if (comInitialized)
+        CoUninitialize();
+}
+
+//---------------------------------------------------------------
+// Accepts every pending connection.
+//---------------------------------------------------------------
+void PreviewServer::AcceptClients()
+{
+    for (;;)
+    {
+        SOCKET s = accept(static_cast<SOCKET>(m_listener), nullptr, nullptr);
+        if (s == INVALID_SOCKET)
+            return;
+
+        if (m_clients.size() >= MaxClients ||
+            WSAEventSelect(s, m_networkEvent, FD_READ | FD_WRITE | FD_CLOSE) == SOCKET_ERROR)
+        {
+            closesocket(s);
+            continue;
+        }
+
+        // Frames are sent whole, so don't hold back their tails.
+        BOOL noDelay = TRUE;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay), sizeof(noDelay));
+
+        std::unique_ptr<Client> client(new Client);
+        client->m_socket = s;
+        m_clients.push_back(std::move(client));
+    }
+}
+
+//---------------------------------------------------------------
+// Reads whatever the client has sent.  Once the request is
+// complete, answers it:  either the stream it names, or an error.
+//---------------------------------------------------------------
+void PreviewServer::ReadRequest(Client &client)
+{
+    char buffer[1024];
+    while (!client.m_closed)
+    {
+        int received = recv(client.m_socket, buffer, sizeof(buffer), 0);
+        if (received == 0 || (received == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK))
+        {
+            // The client hung up.
+            CloseClient(client);
+            return;
+        }
+        if (received == SOCKET_ERROR)
+            break;
+
+        // Anything after the request is ignored.
+        if (!client.m_streaming && !client.m_closeWhenSent)
+            client.m_request.append(buffer, received);
+    }
+
+    if (client.m_closed || client.m_streaming || client.m_closeWhenSent)
+        return;
+
+    size_t end = client.m_request.find("\r\n\r\n");
+    if (end == std::string::npos)
+    {
+        if (client.m_request.size() > MAX_REQUEST_SIZE)
+        {
+            client.m_head = MakeErrorResponse("400 Bad Request", "Request too long.");
+            client.m_closeWhenSent = true;
+        }
+        return;
+    }
+
+    // "GET /" watches the first stream and "GET /N" watches
+    // stream N.
+    char method[8] = {0};
+    char path[256] = {0};
+    unsigned stream = 0;
+    if (sscanf_s(client.m_request.c_str(), "%7s %255s", method, static_cast<unsigned>(_countof(method)),
+            path, static_cast<unsigned>(_countof(path))) != 2 || strcmp(method, "GET") != 0)
+    {
+        client.m_head = MakeErrorResponse("405 Method Not Allowed", "Only GET is supported.");
+        client.m_closeWhenSent = true;
+        return;
+    }
+    if (strcmp(path, "/") != 0)
+    {
+        char *endPath = nullptr;
+        unsigned long n = strtoul(path + 1, &endPath, 10);
+        if (path[1] < '0' || path[1] > '9' || *endPath != '\0' || n < 1 || n > m_streams.size())
+        {
+            client.m_head = MakeErrorResponse("404 Not Found", "No such stream.");
+            client.m_closeWhenSent = true;
+            return;
+        }
+        stream = static_cast<unsigned>(n - 1);
+    }
+
+    client.m_request.clear();
+    client.m_streaming = true;
+    client.m_stream = stream;
+    client.m_head = STREAM_RESPONSE;
+    client.m_sent = 0;
+    ++m_streams[stream]->m_watchers;
+}
+
+//---------------------------------------------------------------
+// Sends as much of the client's pending data as the socket will
+// take.  When a frame is done, starts the newest one, if there is
+// a newer one.
+//---------------------------------------------------------------
+void PreviewServer::SendPending(Client &client)
+{
+    static const char trailer[] = "\r\n";
+    while (!client.m_closed)
+    {
+        if (client.IsIdle())
+        {
+            if (client.m_closeWhenSent)
+            {
+                CloseClient(client);
+                return;
+            }
+            if (client.m_body)
+                ++m_framesSent;
+            if (!client.m_streaming)
+                return;
+
+            StartNextFrame(client);
+            if (client.IsIdle())
+                return;
+        }
+
+        // Send the rest of the header, frame, and trailer in one
+        // call, straight from the shared frame.
+        WSABUF buffers[3];
+        DWORD numBuffers = 0;
+        size_t offset = client.m_sent;
+        const size_t headSize = client.m_head.size();
+        if (offset < headSize)
+        {
+            buffers[numBuffers].buf = const_cast<char *>(client.m_head.data() + offset);
+            buffers[numBuffers++].len = static_cast<ULONG>(headSize - offset);
+            offset = headSize;
+        }
+        if (client.m_body)
+        {
+            const size_t bodySize = client.m_body->size();
+            if (offset < headSize + bodySize)
+            {
+                buffers[numBuffers].buf = reinterpret_cast<char *>(const_cast<unsigned char *>(
+                    client.m_body->data() + offset - headSize));
+                buffers[numBuffers++].len = static_cast<ULONG>(headSize + bodySize - offset);
+                offset = headSize + bodySize;
+            }
+            buffers[numBuffers].buf = const_cast<char *>(trailer + offset - headSize - bodySize);
+            buffers[numBuffers++].len = static_cast<ULONG>(headSize + bodySize + 2 - offset);
+        }
+
+        DWORD sent = 0;
+        if (WSASend(client.m_socket, buffers, numBuffers, &sent, 0, nullptr, nullptr) == SOCKET_ERROR)
+        {
+            // Would block means the client is slow; it gets the
+            // newest frame once the socket drains.
+            if (WSAGetLastError() != WSAEWOULDBLOCK)
+                CloseClient(client);
+            return;
+        }
+        client.m_sent += sent;
+    }
+}
+
+//---------------------------------------------------------------
+// Starts sending the newest frame of the client's stream, if it
+// hasn't already been sent one.
+//---------------------------------------------------------------
+void PreviewServer::StartNextFrame(Client &client)
+{
+    const Stream &stream = *m_streams[client.m_stream];
+    client.m_head.clear();
+    client.m_body.reset();
+    client.m_sent = 0;
+    if (!stream.m_jpeg || stream.m_sequence == client.m_sequence)
+        return;
+
+    // Frames encoded while the client was busy are skipped.
+    if (client.m_sequence != 0)
+        m_framesDropped += static_cast<unsigned>(stream.m_sequence - client.m_sequence - 1);
+    client.m_sequence = stream.m_sequence;
+
+    char head[128] = {0};
+    sprintf_s(head, _countof(head), "--%s\r\nContent-Type: image/jpeg\r\nContent-Length: %zu\r\n\r\n",
+        BOUNDARY, stream.m_jpeg->size());
+    client.m_head = head;
+    client.m_body = stream.m_jpeg;
+}
+
+//---------------------------------------------------------------
+// Encodes the newest image of each watched stream and starts
+// sending it to the stream's idle clients.
+//---------------------------------------------------------------
+void PreviewServer::EncodePending()
+{
+    for (unsigned i = 0; i < m_streams.size(); i++)
+    {
+        Stream &stream = *m_streams[i];
+        std::shared_ptr<const PreviewImage> image;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            image.swap(stream.m_pending);
+        }
+        if (!image || stream.m_watchers == 0)
+            continue;
+
+        std::shared_ptr<std::vector<unsigned char>> jpeg = std::make_shared<std::vector<unsigned char>>();
+        std::string errText;
+        if (!EncodeImage(IFF_JPEG, image->m_width, image->m_height, image->m_stride, image->m_pixels,
+                m_quality, *jpeg, errText))
+        {
+            Logger::Get().Log(LL_ERROR, "Failed encoding preview frame!\n  Error Text:  %s", errText);
+            continue;
+        }
+
+        // Let go of the pipeline's pixels as soon as possible.
+        image.reset();
+        stream.m_jpeg = jpeg;
+        ++stream.m_sequence;
+        ++m_framesEncoded;
+
+        for (auto &client : m_clients)
+        {
+            if (client->m_streaming && client->m_stream == i && !client->m_closed && client->IsIdle())
+                SendPending(*client);
+        }
+    }
+}
+
+//---------------------------------------------------------------
+// Closes a client's connection.
+//---------------------------------------------------------------
+void PreviewServer::CloseClient(Client &client)
+{
+    if (client.m_closed)
+        return;
+
+    closesocket(client.m_socket);
+    client.m_closed = true;
+    client.m_body.reset();
+    if (client.m_streaming && client.m_stream < m_streams.size())
+    {
+        // Count the frames the client was too busy to take.
+        Stream &stream = *m_streams[client.m_stream];
+        if (client.m_sequence != 0)
+            m_framesDropped += static_cast<unsigned>(stream.m_sequence - client.m_sequence);
+        --stream.m_watchers;
+    }
+}
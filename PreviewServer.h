@@ -0,0 +1,153 @@
+//--------------------------------------------------------------------
+// PreviewServer.h
+// A C++ module that serves live MJPEG previews of captured frames
+// over HTTP on the local machine.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Start() with a port and the number of
+//   streams (one per camera), then hand each stream's newest image
+//   to Publish() as frames come through the pipeline.  Point a
+//   browser or video player at http://localhost:PORT/ for the
+//   first stream, or http://localhost:PORT/N for stream N.
+//
+// * Each stream is sent as multipart/x-mixed-replace MJPEG.  The
+//   server listens on the loopback interface only.
+//
+// * Published images are reference counted handles to pixels
+//   that the pipeline already has, not copies.  Each image is
+//   encoded to JPEG once, on the server thread, however many
+//   clients are watching, and every client shares that encoded
+//   frame.  Streams nobody is watching aren't encoded at all.
+//
+// * A client that is still sending one frame when newer ones
+//   arrive skips straight to the newest, so a slow client never
+//   builds up a backlog or holds up the others.  Likewise an image
+//   replaced before it is encoded is dropped.
+//
+// * One thread serves every client.  The sockets are non-blocking
+//   and share one network event (WSAEventSelect), which the thread
+//   waits on along with a wake event set by Publish().
+//
+// * Encoding uses ImageWriter's WIC encoder, so the server thread
+//   joins COM's multithreaded apartment.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//---------------------------------------------------------------
+// One image to preview.  m_owner keeps the pixels alive for as
+// long as the server holds the image.
+//---------------------------------------------------------------
+struct PreviewImage
+{
+    std::shared_ptr<const void> m_owner;        // Whatever owns the pixels.
+    const unsigned char *m_pixels = nullptr;    // BGRA pixels.
+    unsigned m_width = 0;                       // Width in pixels.
+    unsigned m_height = 0;                      // Height in pixels.
+    unsigned m_stride = 0;                      // Bytes per row.
+};
+
+//---------------------------------------------------------------
+// A C++ class that serves live MJPEG streams over HTTP.
+//---------------------------------------------------------------
+class PreviewServer
+{
+public:
+    // Most clients served at once.
+    static const unsigned MaxClients = 16;
+
+    PreviewServer();
+    ~PreviewServer();
+
+    PreviewServer(const PreviewServer &) = delete;
+    PreviewServer &operator=(const PreviewServer &) = delete;
+
+    // Starts serving 'numStreams' streams on the given port of the
+    // loopback interface, encoding them at the given JPEG quality
+    // (1 to 100).  Returns false if the port can't be opened.
+    bool Start(unsigned port, unsigned numStreams, unsigned quality, std::string &errText);
+
+    // Disconnects every client and stops the server thread.
+    void Stop();
+
+    // Returns true if any client is watching the given stream, so
+    // callers can skip publishing images nobody will see.
+    bool IsWatched(unsigned stream) const;
+
+    // Makes 'image' the newest image of the given stream.  Only
+    // takes a reference; the image is encoded on the server thread.
+    void Publish(unsigned stream, std::shared_ptr<const PreviewImage> image);
+
+    // Statistics.
+    unsigned GetFramesEncoded() const { return m_framesEncoded; }
+    unsigned GetFramesSent() const { return m_framesSent; }
+    unsigned GetFramesDropped() const { return m_framesDropped; }
+
+private:
+    struct Client;
+    struct Stream;
+
+    void ServerThread();
+    void AcceptClients();
+    void ReadRequest(Client &client);
+    void SendPending(Client &client);
+    void StartNextFrame(Client &client);
+    void EncodePending();
+    void CloseClient(Client &client);
+
+    unsigned m_quality = 85;            // JPEG quality of the streams.
+    uintptr_t m_listener = ~uintptr_t(0);   // Listening socket (a SOCKET).
+    void *m_networkEvent = nullptr;     // Set when any socket is ready (a WSAEVENT).
+    void *m_wakeEvent = nullptr;        // Set by Publish() and Stop() (a HANDLE).
+    bool m_winsockStarted = false;      // True if WSAStartup() succeeded.
+    std::thread m_thread;               // The server thread.
+    std::atomic<bool> m_stop{false};    // Set to stop the server thread.
+    std::mutex m_lock;                  // Protects each stream's m_pending.
+    std::vector<std::unique_ptr<Stream>> m_streams;     // State of each stream.
+    std::vector<std::unique_ptr<Client>> m_clients;     // Connected clients; server thread only.
+    std::atomic<unsigned> m_framesEncoded{0};   // Images encoded.
+    std::atomic<unsigned> m_framesSent{0};      // Frames sent in full to a client.
+    std::atomic<unsigned> m_framesDropped{0};   // Frames a watching client never got.
+};
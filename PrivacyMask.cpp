@@ -0,0 +1,240 @@
+//--------------------------------------------------------------------
+// PrivacyMask.cpp
+// A C++ module that describes the privacy mask regions of a camera
+// and compiles them into per-row spans for the conversion kernels.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "PrivacyMask.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+
+//---------------------------------------------------------------
+// Maps a point of the converted frame back onto the source frame.
+// Points are in continuous pixel coordinates, so pixel i covers
+// i to i + 1, and mirroring reflects about the frame's far edge.
+//---------------------------------------------------------------
+MaskPoint ToSource(
+    const FrameOrientation &orientation,    // in:  How the frame is converted.
+    double width,                           // in:  Source width in pixels.
+    double height,                          // in:  Source height in pixels.
+    MaskPoint p                             // in:  Point in the converted frame.
+    )
+{
+    double outWidth = orientation.IsTransposed() ? height : width;
+    double outHeight = orientation.IsTransposed() ? width : height;
+    if (orientation.m_flipHorizontal)
+        p.m_x = outWidth - p.m_x;
+    if (orientation.m_flipVertical)
+        p.m_y = outHeight - p.m_y;
+
+    MaskPoint source = p;
+    switch (orientation.m_rotation)
+    {
+    case 90:    source.m_x = p.m_y;         source.m_y = height - p.m_x;    break;
+    case 180:   source.m_x = width - p.m_x; source.m_y = height - p.m_y;    break;
+    case 270:   source.m_x = width - p.m_y; source.m_y = p.m_x;             break;
+    }
+    return source;
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Parses a privacy region.  Returns false if the text is invalid.
+//---------------------------------------------------------------
+bool ParsePrivacyRegion(const char *text, PrivacyRegion &region, std::string &errText)
+{
+    region = PrivacyRegion();
+    std::string remaining(text);
+
+    // An optional "N:" picks the device.
+    size_t colon = remaining.find(':');
+    if (colon != std::string::npos)
+    {
+        int device = atoi(remaining.substr(0, colon).c_str());
+        if (device < 1)
+        {
+            errText = "\"" + remaining.substr(0, colon) + "\" is not a valid device number.";
+            return false;
+        }
+        region.m_deviceIndex = device - 1;
+        remaining = remaining.substr(colon + 1);
+    }
+
+    // A rectangle.
+    unsigned width = 0, height = 0, x = 0, y = 0;
+    if (remaining.find('x') != std::string::npos || remaining.find('X') != std::string::npos)
+    {
+        if (sscanf_s(remaining.c_str(), "%ux%u+%u+%u", &width, &height, &x, &y) != 4 ||
+            width < 1 || height < 1)
+        {
+            errText = "\"" + remaining + "\" is not a valid rectangle (WxH+X+Y).";
+            return false;
+        }
+        MaskPoint corner;
+        corner.m_x = x;
+        corner.m_y = y;
+        region.m_vertices.push_back(corner);
+        corner.m_x = x + width;
+        region.m_vertices.push_back(corner);
+        corner.m_y = y + height;
+        region.m_vertices.push_back(corner);
+        corner.m_x = x;
+        region.m_vertices.push_back(corner);
+        return true;
+    }
+
+    // A polygon.
+    while (!remaining.empty())
+    {
+        size_t semicolon = remaining.find(';');
+        std::string entry = remaining.substr(0, semicolon);
+        remaining = (semicolon == std::string::npos) ? std::string() : remaining.substr(semicolon + 1);
+
+        MaskPoint vertex;
+        if (sscanf_s(entry.c_str(), "%lf,%lf", &vertex.m_x, &vertex.m_y) != 2)
+        {
+            errText = "\"" + entry + "\" is not a valid vertex (X,Y).";
+            return false;
+        }
+        region.m_vertices.push_back(vertex);
+    }
+    if (region.m_vertices.size() < 3)
+    {
+        errText = "A privacy polygon needs at least three vertices.";
+        return false;
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------
+// Compiles the regions into masked spans of each source row.
+//---------------------------------------------------------------
+void PrivacyMask::Compile(const FrameOrientation &orientation, unsigned width, unsigned height)
+{
+    m_rowStarts.clear();
+    m_spans.clear();
+    if (m_regions.empty() || width == 0 || height == 0)
+        return;
+
+    // Map the regions onto the source frame, where the kernels
+    // work.
+    std::vector<std::vector<MaskPoint>> polygons;
+    for (const PrivacyRegion &region : m_regions)
+    {
+        if (region.m_vertices.size() < 3)
+            continue;
+        polygons.emplace_back();
+        for (const MaskPoint &vertex : region.m_vertices)
+            polygons.back().push_back(ToSource(orientation, width, height, vertex));
+    }
+
+    // Scan-convert each row at its pixel centers, using the
+    // even-odd rule, then merge the spans of all of the regions.
+    std::vector<size_t> rowStarts(height + 1, 0);
+    std::vector<Span> spans;
+    std::vector<Span> row;
+    std::vector<double> crossings;
+    for (unsigned y = 0; y < height; y++)
+    {
+        double center = y + 0.5;
+        row.clear();
+        for (const auto &polygon : polygons)
+        {
+            crossings.clear();
+            for (size_t i = 0; i < polygon.size(); i++)
+            {
+                const MaskPoint &a = polygon[i];
+                const MaskPoint &b = polygon[(i + 1) % polygon.size()];
+                if ((a.m_y <= center) != (b.m_y <= center))
+                    crossings.push_back(a.m_x + (center - a.m_y) * (b.m_x - a.m_x) / (b.m_y - a.m_y));
+            }
+            std::sort(crossings.begin(), crossings.end());
+
+            for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+            {
+                // Mask the pixels whose centers lie between the
+                // crossings, widened to even columns.
+                double first = __max(0.0, __min(ceil(crossings[i] - 0.5), static_cast<double>(width)));
+                double end = __max(0.0, __min(ceil(crossings[i + 1] - 0.5), static_cast<double>(width)));
+                Span span;
+                span.m_start = static_cast<unsigned>(first) & ~1u;
+                span.m_end = __min((static_cast<unsigned>(end) + 1) & ~1u, width);
+                if (span.m_end > span.m_start)
+                    row.push_back(span);
+            }
+        }
+
+        std::sort(row.begin(), row.end(), [](const Span &a, const Span &b) { return a.m_start < b.m_start; });
+        for (const Span &span : row)
+        {
+            if (spans.size() > rowStarts[y] && span.m_start <= spans.back().m_end)
+                spans.back().m_end = __max(spans.back().m_end, span.m_end);
+            else
+                spans.push_back(span);
+        }
+        rowStarts[y + 1] = spans.size();
+    }
+
+    if (!spans.empty())
+    {
+        m_rowStarts.swap(rowStarts);
+        m_spans.swap(spans);
+    }
+}
+
+//---------------------------------------------------------------
+// Returns the masked spans of a source row.
+//---------------------------------------------------------------
+const PrivacyMask::Span *PrivacyMask::GetSpans(unsigned y, size_t &count) const
+{
+    if (m_spans.empty() || y + 1 >= m_rowStarts.size())
+    {
+        count = 0;
+        return nullptr;
+    }
+
+    count = m_rowStarts[y + 1] - m_rowStarts[y];
+    return m_spans.data() + m_rowStarts[y];
+}
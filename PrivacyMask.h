@@ -0,0 +1,146 @@
+//--------------------------------------------------------------------
+// PrivacyMask.h
+// A C++ module that describes the privacy mask regions of a camera
+// and compiles them into per-row spans for the conversion kernels.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Give SetRegions() the polygons and rectangles
+//   to hide, in the coordinates of the converted (oriented) frame,
+//   and SetFill() how to hide them.  Then call Compile() with the
+//   frame's orientation and source size.  CameraFrameGrabber does
+//   this in Open().
+//
+// * Compile() maps the regions back onto the source frame and
+//   scan-converts them into a sorted list of masked spans for each
+//   source row.  The conversion kernels walk these spans and never
+//   convert a masked pixel:  they fill it with a solid color, or
+//   pixelate it by repeating one converted pixel per block.  So a
+//   masked pixel never reaches the output buffer, let alone the
+//   disk, and costs less than an unmasked one.
+//
+// * A pixel is masked if its center lies inside a region.  Spans
+//   are widened to even columns, to keep the 4:2:2 and 4:2:0
+//   kernels on whole chroma pairs, so masks may grow by a pixel
+//   but never shrink.
+//
+// * Regions are written as "WxH+X+Y" for a rectangle, or as a list
+//   of three or more vertices, "X,Y;X,Y;X,Y...", for a polygon.
+//   Either may start with "N:" to apply only to device N.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include "CaptureFormat.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//---------------------------------------------------------------
+// A vertex of a privacy region, in pixels from the top left
+// corner of the converted frame.
+//---------------------------------------------------------------
+struct MaskPoint
+{
+    double m_x = 0.0;
+    double m_y = 0.0;
+};
+
+//---------------------------------------------------------------
+// A region of the frame to hide.
+//---------------------------------------------------------------
+struct PrivacyRegion
+{
+    int m_deviceIndex = -1;             // Device (0-based) the region applies to; -1 for all.
+    std::vector<MaskPoint> m_vertices;  // Polygon vertices, in order.
+};
+
+//---------------------------------------------------------------
+// Parses a privacy region, either "WxH+X+Y" or "X,Y;X,Y;X,Y...",
+// optionally prefixed with "N:" (a 1-based device number).
+// Returns false if the text is invalid.
+//---------------------------------------------------------------
+bool ParsePrivacyRegion(const char *text, PrivacyRegion &region, std::string &errText);
+
+//---------------------------------------------------------------
+// A C++ class that holds a camera's privacy regions, compiled
+// into masked spans of each source row.
+//---------------------------------------------------------------
+class PrivacyMask
+{
+public:
+    // A run of masked pixels in one source row.
+    struct Span
+    {
+        unsigned m_start;   // First masked column.
+        unsigned m_end;     // Column after the last masked one.
+    };
+
+    // Sets the regions to hide.  Takes effect at the next Compile().
+    void SetRegions(const std::vector<PrivacyRegion> &regions) { m_regions = regions; }
+
+    // Sets how masked pixels are filled:  with the given color
+    // (0x00RRGGBB), or, if pixelateSize is more than 1, with blocks
+    // of that many pixels that each repeat one converted pixel.
+    void SetFill(uint32_t color, unsigned pixelateSize)
+    {
+        m_color = color;
+        m_pixelateSize = pixelateSize;
+    }
+
+    uint32_t GetColor() const { return m_color; }
+    unsigned GetPixelateSize() const { return m_pixelateSize; }
+
+    // Compiles the regions into spans for frames of the given
+    // source size, converted with the given orientation.
+    void Compile(const FrameOrientation &orientation, unsigned width, unsigned height);
+
+    // Returns true if no pixel is masked.
+    bool IsEmpty() const { return m_spans.empty(); }
+
+    // Returns the masked spans of a source row, sorted and not
+    // overlapping, and sets 'count' to how many there are.
+    const Span *GetSpans(unsigned y, size_t &count) const;
+
+private:
+    std::vector<PrivacyRegion> m_regions;   // Regions, in converted frame coordinates.
+    uint32_t m_color = 0;                   // Fill color.
+    unsigned m_pixelateSize = 0;            // Pixelation block size; 0 or 1 for a solid fill.
+    std::vector<size_t> m_rowStarts;        // Index of each source row's first span in m_spans.
+    std::vector<Span> m_spans;              // Masked spans of every row.
+};
+
@@ -0,0 +1,431 @@
+//--------------------------------------------------------------------
+// Remapper.cpp
+// A C++ module that corrects lens distortion and perspective in
+// 32-bit BGRA images with a precomputed remap table.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "Remapper.h"
+#include "WorkerPool.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+
+namespace
+{
+
+// Bilinear fractions are fixed point with this many bits, so the
+// product of two fits comfortably in a signed 16-bit weight.
+const int FRACTION_BITS = 7;
+const int FRACTION_ONE = 1 << FRACTION_BITS;
+
+// Size of the output tiles Apply() works on.  A 64x16 tile of a
+// typical correction gathers from a few dozen source rows.
+const unsigned TILE_WIDTH = 64;
+const unsigned TILE_HEIGHT = 16;
+
+// Opaque black, for output pixels that fall outside the source.
+const uint32_t OUTSIDE_PIXEL = 0xff000000;
+
+//---------------------------------------------------------------
+// Splits an optional "N:" device prefix off the text and parses
+// the comma separated numbers that follow.  Returns false if the
+// device number or any of the numbers is invalid.
+//---------------------------------------------------------------
+bool ParseDeviceNumbers(
+    const char *text,               // in:  Text to parse.
+    int &deviceIndex,               // out:  0-based device, or -1 for all.
+    std::vector<double> &values,    // out:  The numbers.
+    std::string &errText            // out:  Error message on failure.
+    )
+{
+    deviceIndex = -1;
+    values.clear();
+    std::string remaining(text);
+
+    size_t colon = remaining.find(':');
+    if (colon != std::string::npos)
+    {
+        int device = atoi(remaining.substr(0, colon).c_str());
+        if (device < 1)
+        {
+            errText = "\"" + remaining.substr(0, colon) + "\" is not a valid device number.";
+            return false;
+        }
+        deviceIndex = device - 1;
+        remaining = remaining.substr(colon + 1);
+    }
+
+    while (!remaining.empty())
+    {
+        size_t comma = remaining.find(',');
+        std::string entry = remaining.substr(0, comma);
+        remaining = (comma == std::string::npos) ? std::string() : remaining.substr(comma + 1);
+
+        char *end = nullptr;
+        double value = strtod(entry.c_str(), &end);
+        if (entry.empty() || *end != '\0')
+        {
+            errText = "\"" + entry + "\" is not a valid number.";
+            return false;
+        }
+        values.push_back(value);
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------
+// Inverts a 3x3 matrix.  Returns false if it is singular.
+//---------------------------------------------------------------
+bool InvertMatrix3(
+    const double m[9],  // in:  Row major matrix.
+    double inv[9]       // out:  Row major inverse.
+    )
+{
+    double c0 = m[4] * m[8] - m[5] * m[7];
+    double c1 = m[5] * m[6] - m[3] * m[8];
+    double c2 = m[3] * m[7] - m[4] * m[6];
+    double det = m[0] * c0 + m[1] * c1 + m[2] * c2;
+    if (fabs(det) < 1e-12)
+        return false;
+
+    double scale = 1.0 / det;
+    inv[0] = c0 * scale;
+    inv[1] = (m[2] * m[7] - m[1] * m[8]) * scale;
+    inv[2] = (m[1] * m[5] - m[2] * m[4]) * scale;
+    inv[3] = c1 * scale;
+    inv[4] = (m[0] * m[8] - m[2] * m[6]) * scale;
+    inv[5] = (m[2] * m[3] - m[0] * m[5]) * scale;
+    inv[6] = c2 * scale;
+    inv[7] = (m[1] * m[6] - m[0] * m[7]) * scale;
+    inv[8] = (m[0] * m[4] - m[1] * m[3]) * scale;
+    return true;
+}
+
+//---------------------------------------------------------------
+// Maps a corrected pixel position to where the lens actually put
+// it in the source image.
+//---------------------------------------------------------------
+void DistortPoint(
+    const LensModel &lens,  // in:  Lens to model.
+    double &x,              // in/out:  Horizontal position, in pixels.
+    double &y               // in/out:  Vertical position, in pixels.
+    )
+{
+    double nx = (x - lens.m_cx) / lens.m_fx;
+    double ny = (y - lens.m_cy) / lens.m_fy;
+    double r2 = nx * nx + ny * ny;
+    double radial = 1.0 + r2 * (lens.m_k1 + r2 * (lens.m_k2 + r2 * lens.m_k3));
+    double dx = nx * radial + 2.0 * lens.m_p1 * nx * ny + lens.m_p2 * (r2 + 2.0 * nx * nx);
+    double dy = ny * radial + lens.m_p1 * (r2 + 2.0 * ny * ny) + 2.0 * lens.m_p2 * nx * ny;
+    x = dx * lens.m_fx + lens.m_cx;
+    y = dy * lens.m_fy + lens.m_cy;
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Parses a remap filter name ("nearest" or "bilinear").  Returns
+// false if it isn't recognized.
+//---------------------------------------------------------------
+bool ParseRemapFilter(const char *name, RemapFilter &filter)
+{
+    if (_stricmp(name, "nearest") == 0)
+        filter = RMF_NEAREST;
+    else if (_stricmp(name, "bilinear") == 0)
+        filter = RMF_BILINEAR;
+    else
+        return false;
+    return true;
+}
+
+//---------------------------------------------------------------
+// Parses a lens model.  Returns false if the text is invalid.
+//---------------------------------------------------------------
+bool ParseLensModel(const char *text, LensModel &lens, std::string &errText)
+{
+    lens = LensModel();
+    std::vector<double> values;
+    if (!ParseDeviceNumbers(text, lens.m_deviceIndex, values, errText))
+        return false;
+
+    size_t count = values.size();
+    if (count != 5 && count != 6 && count != 8 && count != 9)
+    {
+        errText = "A lens model is fx,fy,cx,cy,k1[,k2[,p1,p2[,k3]]].";
+        return false;
+    }
+    if (values[0] <= 0.0 || values[1] <= 0.0)
+    {
+        errText = "The focal lengths must be positive.";
+        return false;
+    }
+
+    lens.m_fx = values[0];
+    lens.m_fy = values[1];
+    lens.m_cx = values[2];
+    lens.m_cy = values[3];
+    lens.m_k1 = values[4];
+    if (count >= 6)
+        lens.m_k2 = values[5];
+    if (count >= 8)
+    {
+        lens.m_p1 = values[6];
+        lens.m_p2 = values[7];
+    }
+    if (count == 9)
+        lens.m_k3 = values[8];
+    return true;
+}
+
+//---------------------------------------------------------------
+// Parses a homography.  Returns false if the text is invalid.
+//---------------------------------------------------------------
+bool ParseHomography(const char *text, Homography &homography, std::string &errText)
+{
+    homography = Homography();
+    std::vector<double> values;
+    if (!ParseDeviceNumbers(text, homography.m_deviceIndex, values, errText))
+        return false;
+
+    if (values.size() != 9)
+    {
+        errText = "A homography is nine comma separated numbers.";
+        return false;
+    }
+    for (unsigned i = 0; i < 9; i++)
+        homography.m_h[i] = values[i];
+    return true;
+}
+
+//---------------------------------------------------------------
+// Builds the table for images of the given size.  Returns false
+// if the image is too small or the homography can't be inverted.
+//---------------------------------------------------------------
+bool Remapper::Init(unsigned width, unsigned height, unsigned stride, const LensModel *lens,
+    const Homography *homography, RemapFilter filter, std::string &errText)
+{
+    m_offsets.clear();
+    m_fractions.clear();
+
+    if (width < 2 || height < 2 || stride < width * 4)
+    {
+        errText = "The image is too small to remap.";
+        return false;
+    }
+    double inverse[9] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+    if (homography != nullptr && !InvertMatrix3(homography->m_h, inverse))
+    {
+        errText = "The homography can't be inverted.";
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_stride = stride;
+    m_filter = filter;
+    m_tilesAcross = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+    m_tileCount = m_tilesAcross * ((height + TILE_HEIGHT - 1) / TILE_HEIGHT);
+    m_offsets.resize(static_cast<size_t>(width) * height);
+    if (filter == RMF_BILINEAR)
+        m_fractions.resize(m_offsets.size());
+
+    for (unsigned y = 0; y < height; y++)
+    {
+        for (unsigned x = 0; x < width; x++)
+        {
+            size_t i = static_cast<size_t>(y) * width + x;
+
+            // Follow the output pixel center back through the
+            // homography and then the lens.
+            double sx = x, sy = y;
+            if (homography != nullptr)
+            {
+                double w = inverse[6] * x + inverse[7] * y + inverse[8];
+                if (w <= 0.0)
+                {
+                    m_offsets[i] = -1;
+                    continue;
+                }
+                sx = (inverse[0] * x + inverse[1] * y + inverse[2]) / w;
+                sy = (inverse[3] * x + inverse[4] * y + inverse[5]) / w;
+            }
+            if (lens != nullptr)
+                DistortPoint(*lens, sx, sy);
+
+            // Pixels more than half a pixel outside the source are
+            // outside; the rest clamp to the edge.
+            if (!(sx >= -0.5 && sx < width - 0.5 && sy >= -0.5 && sy < height - 0.5))
+            {
+                m_offsets[i] = -1;
+                continue;
+            }
+
+            if (filter == RMF_NEAREST)
+            {
+                unsigned ix = __min(static_cast<unsigned>(sx + 0.5), width - 1);
+                unsigned iy = __min(static_cast<unsigned>(sy + 0.5), height - 1);
+                m_offsets[i] = static_cast<int32_t>(iy * stride + ix * 4);
+                continue;
+            }
+
+            // Keep the 2x2 neighbourhood inside the image; a
+            // fraction of one then picks the far pixel.
+            sx = __max(0.0, __min(sx, width - 1.0));
+            sy = __max(0.0, __min(sy, height - 1.0));
+            unsigned ix = __min(static_cast<unsigned>(sx), width - 2);
+            unsigned iy = __min(static_cast<unsigned>(sy), height - 2);
+            unsigned fx = static_cast<unsigned>((sx - ix) * FRACTION_ONE + 0.5);
+            unsigned fy = static_cast<unsigned>((sy - iy) * FRACTION_ONE + 0.5);
+            m_offsets[i] = static_cast<int32_t>(iy * stride + ix * 4);
+            m_fractions[i] = static_cast<uint16_t>(fx | (fy << 8));
+        }
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------
+// Warps a BGRA image of the size given to Init() into dst.
+//---------------------------------------------------------------
+void Remapper::Apply(const unsigned char *src, unsigned char *dst, unsigned numThreads,
+    WorkerPool *helpers) const
+{
+    if (m_offsets.empty())
+        return;
+
+    std::atomic<unsigned> nextTile{0};
+    if (helpers == nullptr || numThreads < 2)
+    {
+        ApplyTiles(src, dst, nextTile);
+        return;
+    }
+
+    numThreads = __min(numThreads, m_tileCount);
+    helpers->RunParallel(numThreads, [&](unsigned) { ApplyTiles(src, dst, nextTile); });
+}
+
+//---------------------------------------------------------------
+// Warps tiles until there are none left.
+//---------------------------------------------------------------
+void Remapper::ApplyTiles(
+    const unsigned char *src,           // in:  Source image.
+    unsigned char *dst,                 // out:  Warped image.
+    std::atomic<unsigned> &nextTile     // in/out:  Next tile to take.
+    ) const
+{
+    for (;;)
+    {
+        unsigned tile = nextTile++;
+        if (tile >= m_tileCount)
+            break;
+
+        unsigned x0 = (tile % m_tilesAcross) * TILE_WIDTH;
+        unsigned y0 = (tile / m_tilesAcross) * TILE_HEIGHT;
+        ApplyTile(src, dst, x0, y0, __min(x0 + TILE_WIDTH, m_width), __min(y0 + TILE_HEIGHT, m_height));
+    }
+}
+
+//---------------------------------------------------------------
+// Warps one tile of the output.
+//---------------------------------------------------------------
+void Remapper::ApplyTile(
+    const unsigned char *src,   // in:  Source image.
+    unsigned char *dst,         // out:  Warped image.
+    unsigned x0,                // in:  Left column of the tile.
+    unsigned y0,                // in:  Top row of the tile.
+    unsigned x1,                // in:  Column after the tile.
+    unsigned y1                 // in:  Row after the tile.
+    ) const
+{
+    const size_t stride = m_stride;
+    if (m_filter == RMF_NEAREST)
+    {
+        for (unsigned y = y0; y < y1; y++)
+        {
+            const int32_t *offsets = &m_offsets[static_cast<size_t>(y) * m_width];
+            uint32_t *out = reinterpret_cast<uint32_t *>(dst + stride * y);
+            for (unsigned x = x0; x < x1; x++)
+            {
+                int32_t offset = offsets[x];
+                out[x] = (offset < 0) ? OUTSIDE_PIXEL : *reinterpret_cast<const uint32_t *>(src + offset);
+            }
+        }
+        return;
+    }
+
+    // Each pixel blends the two pixels of its top row with one
+    // multiply-add, the two of its bottom row with another, and
+    // sums them.  Channels are interleaved as (left, right) pairs
+    // to line up with the weights.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (2 * FRACTION_BITS - 1));
+    for (unsigned y = y0; y < y1; y++)
+    {
+        const int32_t *offsets = &m_offsets[static_cast<size_t>(y) * m_width];
+        const uint16_t *fractions = &m_fractions[static_cast<size_t>(y) * m_width];
+        uint32_t *out = reinterpret_cast<uint32_t *>(dst + stride * y);
+        for (unsigned x = x0; x < x1; x++)
+        {
+            int32_t offset = offsets[x];
+            if (offset < 0)
+            {
+                out[x] = OUTSIDE_PIXEL;
+                continue;
+            }
+
+            int fx = fractions[x] & 0xff;
+            int fy = fractions[x] >> 8;
+            int top = FRACTION_ONE - fy;
+            int left = FRACTION_ONE - fx;
+            __m128i topWeights = _mm_set1_epi32((left * top) | ((fx * top) << 16));
+            __m128i bottomWeights = _mm_set1_epi32((left * fy) | ((fx * fy) << 16));
+
+            const unsigned char *p = src + offset;
+            __m128i upper = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), zero);
+            __m128i lower = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p + stride)), zero);
+            upper = _mm_unpacklo_epi16(upper, _mm_srli_si128(upper, 8));
+            lower = _mm_unpacklo_epi16(lower, _mm_srli_si128(lower, 8));
+
+            __m128i sum = _mm_add_epi32(_mm_madd_epi16(upper, topWeights), _mm_madd_epi16(lower, bottomWeights));
+            sum = _mm_srli_epi32(_mm_add_epi32(sum, round), 2 * FRACTION_BITS);
+            sum = _mm_packs_epi32(sum, sum);
+            out[x] = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum)));
+        }
+    }
+}
@@ -0,0 +1,165 @@
+//--------------------------------------------------------------------
+// Remapper.h
+// A C++ module that corrects lens distortion and perspective in
+// 32-bit BGRA images with a precomputed remap table.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Init() with the image size and a lens
+//   model and/or homography, then call Apply() on as many frames as
+//   desired.  Init() does all of the floating point work; a
+//   Remapper is read-only afterwards, so one object may be shared
+//   by several threads.
+//
+// * The table holds, for each output pixel, the byte offset of the
+//   source pixel (or of the top left of its 2x2 neighbourhood) and
+//   the 7-bit horizontal and vertical fractions for the bilinear
+//   blend.  Output pixels that fall outside the source are black.
+//
+// * Apply() walks the output in small tiles rather than whole
+//   rows, so the source rows a tile gathers from stay in cache even
+//   when the correction bends them steeply.  Passing numThreads > 1
+//   and a WorkerPool hands the tiles out to the calling thread and
+//   the pool's threads.
+//
+// * Lens models use the Brown-Conrady radial (k1, k2, k3) and
+//   tangential (p1, p2) coefficients, with the focal lengths and
+//   optical center in pixels, as produced by the usual calibration
+//   tools.  The corrected image keeps the same intrinsics.
+//
+// * A homography maps corrected (undistorted) camera pixels to
+//   output pixels, row major, e.g. the matrix that takes a tilted
+//   rectangle in the scene to an upright one.  Init() inverts it.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class WorkerPool;
+
+// How output pixels are sampled from the source.
+enum RemapFilter
+{
+    RMF_NEAREST,    // Nearest source pixel.
+    RMF_BILINEAR    // Blend of the four nearest source pixels.
+};
+
+//---------------------------------------------------------------
+// Parses a remap filter name ("nearest" or "bilinear").  Returns
+// false if it isn't recognized.
+//---------------------------------------------------------------
+bool ParseRemapFilter(const char *name, RemapFilter &filter);
+
+//---------------------------------------------------------------
+// A camera's lens intrinsics and distortion coefficients.
+//---------------------------------------------------------------
+struct LensModel
+{
+    int m_deviceIndex = -1;     // Device (0-based) the model applies to; -1 for all.
+    double m_fx = 0.0;          // Focal length, in pixels.
+    double m_fy = 0.0;
+    double m_cx = 0.0;          // Optical center, in pixels.
+    double m_cy = 0.0;
+    double m_k1 = 0.0;          // Radial coefficients.
+    double m_k2 = 0.0;
+    double m_k3 = 0.0;
+    double m_p1 = 0.0;          // Tangential coefficients.
+    double m_p2 = 0.0;
+};
+
+//---------------------------------------------------------------
+// Parses a lens model, "fx,fy,cx,cy,k1[,k2[,p1,p2[,k3]]]",
+// optionally prefixed with "N:" (a 1-based device number).
+// Returns false if the text is invalid.
+//---------------------------------------------------------------
+bool ParseLensModel(const char *text, LensModel &lens, std::string &errText);
+
+//---------------------------------------------------------------
+// A 3x3 perspective transform from corrected camera pixels to
+// output pixels.
+//---------------------------------------------------------------
+struct Homography
+{
+    int m_deviceIndex = -1;     // Device (0-based) the transform applies to; -1 for all.
+    double m_h[9] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};  // Row major.
+};
+
+//---------------------------------------------------------------
+// Parses a homography, nine comma separated numbers in row major
+// order, optionally prefixed with "N:" (a 1-based device number).
+// Returns false if the text is invalid.
+//---------------------------------------------------------------
+bool ParseHomography(const char *text, Homography &homography, std::string &errText);
+
+//---------------------------------------------------------------
+// A C++ class that warps images through a precomputed table of
+// source positions.
+//---------------------------------------------------------------
+class Remapper
+{
+public:
+    // Builds the table for images of the given size.  Either lens
+    // or homography may be null.  Returns false if the image is
+    // too small or the homography can't be inverted.
+    bool Init(unsigned width, unsigned height, unsigned stride, const LensModel *lens,
+        const Homography *homography, RemapFilter filter, std::string &errText);
+
+    // Returns true if Init() hasn't built a table.
+    bool IsEmpty() const { return m_offsets.empty(); }
+
+    // Warps a BGRA image of the size given to Init() into dst.
+    // The images must not overlap.
+    void Apply(const unsigned char *src, unsigned char *dst, unsigned numThreads = 1,
+        WorkerPool *helpers = nullptr) const;
+
+private:
+    void ApplyTiles(const unsigned char *src, unsigned char *dst, std::atomic<unsigned> &nextTile) const;
+    void ApplyTile(const unsigned char *src, unsigned char *dst, unsigned x0, unsigned y0,
+        unsigned x1, unsigned y1) const;
+
+    unsigned m_width = 0;
+    unsigned m_height = 0;
+    unsigned m_stride = 0;
+    unsigned m_tilesAcross = 0;
+    unsigned m_tileCount = 0;
+    RemapFilter m_filter = RMF_BILINEAR;
+    std::vector<int32_t> m_offsets;     // Source byte offset of each output pixel; -1 if outside.
+    std::vector<uint16_t> m_fractions;  // Horizontal fraction | vertical fraction << 8.
+};
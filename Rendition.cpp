@@ -0,0 +1,301 @@
+//--------------------------------------------------------------------
+// Rendition.cpp
+// A C++ module that describes and renders the output versions
+// (renditions) of a captured frame.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "Rendition.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+
+//---------------------------------------------------------------
+// The crop rectangle and output size of a rendition, for a given
+// frame size.
+//---------------------------------------------------------------
+struct Geometry
+{
+    unsigned m_cropX = 0;
+    unsigned m_cropY = 0;
+    unsigned m_cropWidth = 0;
+    unsigned m_cropHeight = 0;
+    unsigned m_width = 0;
+    unsigned m_height = 0;
+};
+
+//---------------------------------------------------------------
+// Works out a rendition's crop rectangle (clipped to the frame)
+// and output size.  Returns false if the result is empty.
+//---------------------------------------------------------------
+bool GetGeometry(const RenditionSpec &spec, unsigned frameWidth, unsigned frameHeight, Geometry &geom)
+{
+    geom.m_cropX = 0;
+    geom.m_cropY = 0;
+    geom.m_cropWidth = frameWidth;
+    geom.m_cropHeight = frameHeight;
+    if (spec.m_cropWidth > 0 && spec.m_cropHeight > 0)
+    {
+        if (spec.m_cropX >= frameWidth || spec.m_cropY >= frameHeight)
+            return false;
+        geom.m_cropX = spec.m_cropX;
+        geom.m_cropY = spec.m_cropY;
+        geom.m_cropWidth = __min(spec.m_cropWidth, frameWidth - spec.m_cropX);
+        geom.m_cropHeight = __min(spec.m_cropHeight, frameHeight - spec.m_cropY);
+    }
+
+    // A missing output dimension follows the crop's aspect ratio.
+    geom.m_width = spec.m_width;
+    geom.m_height = spec.m_height;
+    if (geom.m_width == 0 && geom.m_height == 0)
+    {
+        geom.m_width = geom.m_cropWidth;
+        geom.m_height = geom.m_cropHeight;
+    }
+    else if (geom.m_height == 0)
+    {
+        geom.m_height = static_cast<unsigned>(
+            (static_cast<unsigned long long>(geom.m_width) * geom.m_cropHeight + geom.m_cropWidth / 2) / geom.m_cropWidth);
+    }
+    else if (geom.m_width == 0)
+    {
+        geom.m_width = static_cast<unsigned>(
+            (static_cast<unsigned long long>(geom.m_height) * geom.m_cropWidth + geom.m_cropHeight / 2) / geom.m_cropHeight);
+    }
+
+    return geom.m_width > 0 && geom.m_height > 0;
+}
+
+//---------------------------------------------------------------
+// Returns the deepest pyramid level whose copy of the crop
+// rectangle is still at least as large as the output, or at least
+// twice as large for the sharper filters.
+//---------------------------------------------------------------
+unsigned ChooseLevel(const Geometry &geom, ResampleFilter filter, unsigned maxLevels)
+{
+    unsigned factor = (filter == RF_BILINEAR) ? 1 : 2;
+    unsigned level = 0;
+    while (level + 1 < maxLevels &&
+           (geom.m_cropWidth >> (level + 1)) >= geom.m_width * factor &&
+           (geom.m_cropHeight >> (level + 1)) >= geom.m_height * factor)
+    {
+        ++level;
+    }
+    return level;
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Parses a rendition spec.  Returns false if the spec is invalid.
+//---------------------------------------------------------------
+bool ParseRenditionSpec(const char *text, RenditionSpec &spec, std::string &errText)
+{
+    spec = RenditionSpec();
+    std::string remaining(text);
+    bool first = true;
+    while (!remaining.empty())
+    {
+        size_t comma = remaining.find(',');
+        std::string entry = remaining.substr(0, comma);
+        remaining = (comma == std::string::npos) ? std::string() : remaining.substr(comma + 1);
+
+        size_t equals = entry.find('=');
+        if (equals == std::string::npos)
+        {
+            // Only the first entry may be a bare name.
+            if (!first || entry.empty())
+            {
+                errText = "\"" + entry + "\" is not a valid rendition option.";
+                return false;
+            }
+            spec.m_name = entry;
+            first = false;
+            continue;
+        }
+        first = false;
+
+        std::string key = entry.substr(0, equals);
+        std::string value = entry.substr(equals + 1);
+        if (_stricmp(key.c_str(), "width") == 0)
+        {
+            spec.m_width = atoi(value.c_str());
+        }
+        else if (_stricmp(key.c_str(), "height") == 0)
+        {
+            spec.m_height = atoi(value.c_str());
+        }
+        else if (_stricmp(key.c_str(), "crop") == 0)
+        {
+            if (sscanf_s(value.c_str(), "%ux%u+%u+%u",
+                    &spec.m_cropWidth, &spec.m_cropHeight, &spec.m_cropX, &spec.m_cropY) != 4 ||
+                spec.m_cropWidth < 1 || spec.m_cropHeight < 1)
+            {
+                errText = "\"" + value + "\" is not a valid crop rectangle (WxH+X+Y).";
+                return false;
+            }
+        }
+        else if (_stricmp(key.c_str(), "format") == 0)
+        {
+            if (!ParseImageFileFormat(value.c_str(), spec.m_format))
+            {
+                errText = "\"" + value + "\" is not a valid image format.";
+                return false;
+            }
+        }
+        else if (_stricmp(key.c_str(), "quality") == 0)
+        {
+            spec.m_quality = atoi(value.c_str());
+            if (spec.m_quality < 1 || spec.m_quality > 100)
+            {
+                errText = "\"" + value + "\" is not a valid JPEG quality.";
+                return false;
+            }
+        }
+        else if (_stricmp(key.c_str(), "filter") == 0)
+        {
+            if (!ParseResampleFilter(value.c_str(), spec.m_filter))
+            {
+                errText = "\"" + value + "\" is not a valid scaling filter.";
+                return false;
+            }
+        }
+        else if (_stricmp(key.c_str(), "dir") == 0)
+        {
+            spec.m_directory = value;
+        }
+        else
+        {
+            errText = "\"" + key + "\" is not a valid rendition option.";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------
+// Returns how many pyramid levels (including level 0) a rendition
+// can make use of, for frames of the given size.
+//---------------------------------------------------------------
+unsigned GetRenditionPyramidLevels(const RenditionSpec &spec, unsigned frameWidth, unsigned frameHeight)
+{
+    Geometry geom;
+    if (!GetGeometry(spec, frameWidth, frameHeight, geom))
+        return 1;
+    return ChooseLevel(geom, spec.m_filter, 32) + 1;
+}
+
+//---------------------------------------------------------------
+// Initializes the scaler for a rendition of frames of the given
+// size.  Leaves it empty if the rendition needs no scaling.
+//---------------------------------------------------------------
+void PrepareRendition(const RenditionSpec &spec, unsigned frameWidth, unsigned frameHeight,
+    Resampler &resampler)
+{
+    resampler = Resampler();
+    Geometry geom;
+    if (!GetGeometry(spec, frameWidth, frameHeight, geom))
+        return;
+
+    // Same level and crop as RenderRendition() will use, given a
+    // pyramid of GetRenditionPyramidLevels() levels or more.
+    unsigned levelIndex = ChooseLevel(geom, spec.m_filter, 32);
+    unsigned levelWidth = __max(1u, frameWidth >> levelIndex);
+    unsigned levelHeight = __max(1u, frameHeight >> levelIndex);
+    unsigned cropX = geom.m_cropX >> levelIndex;
+    unsigned cropY = geom.m_cropY >> levelIndex;
+    unsigned cropWidth = __max(1u, __min(geom.m_cropWidth >> levelIndex, levelWidth - cropX));
+    unsigned cropHeight = __max(1u, __min(geom.m_cropHeight >> levelIndex, levelHeight - cropY));
+    if (cropWidth != geom.m_width || cropHeight != geom.m_height)
+        resampler.Init(cropWidth, cropHeight, geom.m_width, geom.m_height, spec.m_filter);
+}
+
+//---------------------------------------------------------------
+// Renders a rendition from the pyramid of a frame.  Returns false
+// if the rendition is empty.
+//---------------------------------------------------------------
+bool RenderRendition(const ImagePyramid &pyramid, const RenditionSpec &spec, const Resampler &resampler,
+    RenditionImage &image, unsigned numThreads, WorkerPool *helpers)
+{
+    if (pyramid.GetLevelCount() < 1)
+        return false;
+
+    const ImagePyramid::Level &full = pyramid.GetLevel(0);
+    Geometry geom;
+    if (!GetGeometry(spec, full.m_width, full.m_height, geom))
+        return false;
+
+    // Find the crop rectangle in the chosen level.
+    unsigned levelIndex = ChooseLevel(geom, spec.m_filter, static_cast<unsigned>(pyramid.GetLevelCount()));
+    const ImagePyramid::Level &level = pyramid.GetLevel(levelIndex);
+    unsigned cropX = geom.m_cropX >> levelIndex;
+    unsigned cropY = geom.m_cropY >> levelIndex;
+    unsigned cropWidth = __max(1u, __min(geom.m_cropWidth >> levelIndex, level.m_width - cropX));
+    unsigned cropHeight = __max(1u, __min(geom.m_cropHeight >> levelIndex, level.m_height - cropY));
+    const unsigned char *cropPixels = level.m_pixels + static_cast<size_t>(level.m_stride) * cropY + cropX * 4;
+
+    image.m_width = geom.m_width;
+    image.m_height = geom.m_height;
+
+    // No scaling needed:  reference the level's pixels directly.
+    if (cropWidth == geom.m_width && cropHeight == geom.m_height)
+    {
+        image.m_pixels = cropPixels;
+        image.m_stride = level.m_stride;
+        return true;
+    }
+
+    // The prepared filter weights fit every frame of the size they
+    // were prepared for; anything else gets its own.
+    const Resampler *scaler = &resampler;
+    Resampler fallback;
+    if (resampler.GetSrcWidth() != cropWidth || resampler.GetSrcHeight() != cropHeight ||
+        resampler.GetDstWidth() != geom.m_width || resampler.GetDstHeight() != geom.m_height)
+    {
+        if (!fallback.Init(cropWidth, cropHeight, geom.m_width, geom.m_height, spec.m_filter))
+            return false;
+        scaler = &fallback;
+    }
+    image.m_stride = geom.m_width * 4;
+    image.m_storage.resize(static_cast<size_t>(image.m_stride) * geom.m_height);
+    scaler->ResampleBgra(cropPixels, level.m_stride, image.m_storage.data(), image.m_stride, numThreads, helpers);
+    image.m_pixels = image.m_storage.data();
+    return true;
+}
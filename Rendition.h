@@ -0,0 +1,140 @@
+//--------------------------------------------------------------------
+// Rendition.h
+// A C++ module that describes and renders the output versions
+// (renditions) of a captured frame.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * A rendition is one output version of each frame:  a crop
+//   rectangle, an output size, an image file format, and a
+//   destination directory.  A typical session might write a
+//   full-size archive, a 1280-wide preview, and a 320-wide
+//   thumbnail of every frame.
+//
+// * Renditions are rendered from a shared ImagePyramid of the
+//   frame.  A bilinear rendition starts from the smallest pyramid
+//   level that is still at least as large as its output, so a
+//   thumbnail reads only a small fraction of the pixels of the
+//   full frame.  Bicubic and Lanczos renditions start from the
+//   smallest level at least twice the output size, so the box
+//   filtered levels never decide the final look and a typical 4K
+//   to 1080p or 720p rendition is filtered straight from the full
+//   frame.  A rendition that needs no scaling references the frame
+//   (or a pyramid level) directly, without copying it.
+//
+// * PrepareRendition() builds a rendition's Resampler for frames of
+//   a given size once, so RenderRendition() needn't recompute the
+//   filter weights for every frame.
+//
+// * Rendition specs are written as a comma-separated list, e.g.
+//   "preview,width=1280,format=jpg,quality=85,dir=previews".  The
+//   optional first entry is the rendition's name, which is added
+//   to its file names.  Crops are given as "crop=WxH+X+Y", and the
+//   scaling filter as "filter=bilinear|bicubic|lanczos".
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include "ImagePyramid.h"
+#include "ImageWriter.h"
+#include "Resampler.h"
+
+#include <string>
+#include <vector>
+
+//---------------------------------------------------------------
+// Describes one output version of each frame.
+//---------------------------------------------------------------
+struct RenditionSpec
+{
+    std::string m_name;             // Added to the rendition's file names; may be empty.
+    unsigned m_width = 0;           // Output width; 0 keeps the crop width, or follows m_height.
+    unsigned m_height = 0;          // Output height; 0 keeps the crop's aspect ratio.
+    unsigned m_cropX = 0;           // Left edge of the crop rectangle.
+    unsigned m_cropY = 0;           // Top edge of the crop rectangle.
+    unsigned m_cropWidth = 0;       // Width of the crop rectangle; 0 means no crop.
+    unsigned m_cropHeight = 0;      // Height of the crop rectangle; 0 means no crop.
+    ImageFileFormat m_format = IFF_BMP; // File format to write.
+    unsigned m_quality = 90;        // JPEG quality, 1 to 100.
+    ResampleFilter m_filter = RF_LANCZOS3;  // Filter used to scale the frame.
+    std::string m_directory;        // Directory to write to; empty for the current directory.
+};
+
+//---------------------------------------------------------------
+// A rendered rendition.  m_pixels points either into m_storage or
+// into the frame the rendition was rendered from.
+//---------------------------------------------------------------
+struct RenditionImage
+{
+    const unsigned char *m_pixels = nullptr;    // BGRA pixels.
+    unsigned m_width = 0;                       // Width in pixels.
+    unsigned m_height = 0;                      // Height in pixels.
+    unsigned m_stride = 0;                      // Bytes per row.
+    std::vector<unsigned char> m_storage;       // Pixels, if the rendition had to be scaled.
+};
+
+//---------------------------------------------------------------
+// Parses a rendition spec such as
+// "thumb,width=320,format=jpg,dir=thumbs".  Returns false if the
+// spec is invalid.
+//---------------------------------------------------------------
+bool ParseRenditionSpec(const char *text, RenditionSpec &spec, std::string &errText);
+
+//---------------------------------------------------------------
+// Returns how many pyramid levels (including level 0) a rendition
+// can make use of, for frames of the given size.
+//---------------------------------------------------------------
+unsigned GetRenditionPyramidLevels(const RenditionSpec &spec, unsigned frameWidth, unsigned frameHeight);
+
+//---------------------------------------------------------------
+// Initializes 'resampler' to scale a rendition of frames of the
+// given size from the pyramid level RenderRendition() will choose.
+// Leaves it empty if the rendition needs no scaling.
+//---------------------------------------------------------------
+void PrepareRendition(const RenditionSpec &spec, unsigned frameWidth, unsigned frameHeight,
+    Resampler &resampler);
+
+//---------------------------------------------------------------
+// Renders a rendition from the pyramid of a frame, with the
+// Resampler from PrepareRendition() (one is built if the frame's
+// size doesn't match it).  Returns false if the rendition is
+// empty, e.g. its crop lies outside the frame.  numThreads is how
+// many threads may share the scaling, the caller and the rest from
+// 'helpers'.
+//---------------------------------------------------------------
+bool RenderRendition(const ImagePyramid &pyramid, const RenditionSpec &spec, const Resampler &resampler,
+    RenditionImage &image, unsigned numThreads = 1, WorkerPool *helpers = nullptr);
+
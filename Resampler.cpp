@@ -0,0 +1,479 @@
+//--------------------------------------------------------------------
+// Resampler.cpp
+// A C++ module for high quality resizing of 32-bit BGRA images and
+// 8-bit image planes with a separable filter.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "Resampler.h"
+#include "WorkerPool.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+
+namespace
+{
+
+// Filter weights are fixed point with this many fraction bits.
+const int WEIGHT_BITS = 14;
+
+// The horizontal pass keeps this many fraction bits in its 16-bit
+// output, which leaves room for the overshoot of the sharper
+// filters.
+const int ROW_BITS = 6;
+
+const double PI = 3.14159265358979323846;
+
+//---------------------------------------------------------------
+// Returns sin(pi x) / (pi x).
+//---------------------------------------------------------------
+double Sinc(double x)
+{
+    if (x == 0.0)
+        return 1.0;
+    x *= PI;
+    return sin(x) / x;
+}
+
+//---------------------------------------------------------------
+// Returns the support radius of a filter, in source pixels at
+// unit scale.
+//---------------------------------------------------------------
+double GetFilterRadius(ResampleFilter filter)
+{
+    switch (filter)
+    {
+    case RF_BILINEAR:   return 1.0;
+    case RF_BICUBIC:    return 2.0;
+    default:            return 3.0;
+    }
+}
+
+//---------------------------------------------------------------
+// Evaluates a filter kernel at the given distance from its center.
+//---------------------------------------------------------------
+double EvalFilter(ResampleFilter filter, double x)
+{
+    x = fabs(x);
+    switch (filter)
+    {
+    case RF_BILINEAR:
+        return (x < 1.0) ? 1.0 - x : 0.0;
+
+    case RF_BICUBIC:
+        // Catmull-Rom (a = -0.5).
+        if (x < 1.0)
+            return (1.5 * x - 2.5) * x * x + 1.0;
+        if (x < 2.0)
+            return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+        return 0.0;
+
+    default:
+        return (x < 3.0) ? Sinc(x) * Sinc(x / 3.0) : 0.0;
+    }
+}
+
+//---------------------------------------------------------------
+// Returns a 32-bit lane holding a pair of 16-bit weights, as
+// _mm_madd_epi16 expects them.
+//---------------------------------------------------------------
+inline __m128i WeightPair(int16_t w0, int16_t w1)
+{
+    return _mm_set1_epi32((static_cast<int>(w1) << 16) | static_cast<uint16_t>(w0));
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Parses a resampling filter name.  Returns false if it isn't
+// recognized.
+//---------------------------------------------------------------
+bool ParseResampleFilter(const char *name, ResampleFilter &filter)
+{
+    if (_stricmp(name, "bilinear") == 0)
+        filter = RF_BILINEAR;
+    else if (_stricmp(name, "bicubic") == 0)
+        filter = RF_BICUBIC;
+    else if (_stricmp(name, "lanczos") == 0 || _stricmp(name, "lanczos3") == 0)
+        filter = RF_LANCZOS3;
+    else
+        return false;
+    return true;
+}
+
+//---------------------------------------------------------------
+// Precomputes the filter weights for resizing images of the given
+// source size to the given destination size.  Returns false if
+// any size is zero.
+//---------------------------------------------------------------
+bool Resampler::Init(unsigned srcWidth, unsigned srcHeight,
+    unsigned dstWidth, unsigned dstHeight, ResampleFilter filter)
+{
+    if (srcWidth == 0 || srcHeight == 0 || dstWidth == 0 || dstHeight == 0)
+        return false;
+
+    m_srcWidth = srcWidth;
+    m_srcHeight = srcHeight;
+    m_dstWidth = dstWidth;
+    m_dstHeight = dstHeight;
+    InitAxis(m_x, srcWidth, dstWidth, filter);
+    InitAxis(m_y, srcHeight, dstHeight, filter);
+    return true;
+}
+
+//---------------------------------------------------------------
+// Precomputes the weights of one dimension of the filter.
+//---------------------------------------------------------------
+void Resampler::InitAxis(
+    Axis &axis,             // out: Weights for the dimension.
+    unsigned srcSize,       // in:  Source size in pixels.
+    unsigned dstSize,       // in:  Destination size in pixels.
+    ResampleFilter filter   // in:  Filter to apply.
+    )
+{
+    axis.m_starts.resize(dstSize);
+
+    // Same size:  a single tap copies each pixel.
+    if (srcSize == dstSize)
+    {
+        axis.m_taps = 1;
+        axis.m_weightStride = 8;
+        axis.m_weights.assign(static_cast<size_t>(dstSize) * axis.m_weightStride, 0);
+        for (unsigned i = 0; i < dstSize; i++)
+        {
+            axis.m_starts[i] = i;
+            axis.m_weights[static_cast<size_t>(i) * axis.m_weightStride] = 1 << WEIGHT_BITS;
+        }
+        return;
+    }
+
+    // When shrinking, the filter is stretched to cover every
+    // source pixel that falls under an output pixel.
+    double scale = static_cast<double>(dstSize) / srcSize;
+    double stretch = (scale < 1.0) ? 1.0 / scale : 1.0;
+    double support = GetFilterRadius(filter) * stretch;
+    unsigned taps = static_cast<unsigned>(ceil(support)) * 2 + 1;
+    taps = __min(taps, srcSize);
+    axis.m_taps = taps;
+    axis.m_weightStride = (taps + 7) & ~7u;
+    axis.m_weights.assign(static_cast<size_t>(dstSize) * axis.m_weightStride, 0);
+
+    std::vector<double> contributions(srcSize);
+    for (unsigned i = 0; i < dstSize; i++)
+    {
+        // Weigh the source pixels around the output pixel's center,
+        // folding any that fall off the edge onto the edge pixel.
+        double center = (i + 0.5) / scale - 0.5;
+        int first = static_cast<int>(ceil(center - support));
+        int last = static_cast<int>(floor(center + support));
+        int lo = __max(0, __min(first, static_cast<int>(srcSize) - 1));
+        int hi = __max(0, __min(last, static_cast<int>(srcSize) - 1));
+        for (int k = lo; k <= hi; k++)
+            contributions[k] = 0.0;
+        double total = 0.0;
+        for (int j = first; j <= last; j++)
+        {
+            double w = EvalFilter(filter, (j - center) / stretch);
+            contributions[__max(lo, __min(j, hi))] += w;
+            total += w;
+        }
+        if (total == 0.0)
+        {
+            // Nothing under the filter; use the nearest pixel.
+            lo = hi = __max(0, __min(static_cast<int>(floor(center + 0.5)), static_cast<int>(srcSize) - 1));
+            contributions[lo] = 1.0;
+            total = 1.0;
+        }
+
+        // Slide the window back from the right edge so every tap
+        // reads a real pixel.
+        unsigned start = __min(static_cast<unsigned>(lo), srcSize - taps);
+        axis.m_starts[i] = start;
+
+        // Convert to fixed point, putting any rounding error on the
+        // largest weight so the weights sum to exactly one.
+        int16_t *weights = &axis.m_weights[static_cast<size_t>(i) * axis.m_weightStride];
+        int sum = 0;
+        unsigned largest = 0;
+        for (int j = lo; j <= hi; j++)
+        {
+            int w = static_cast<int>(floor(contributions[j] / total * (1 << WEIGHT_BITS) + 0.5));
+            weights[j - start] = static_cast<int16_t>(w);
+            sum += w;
+            if (abs(w) > abs(weights[largest]))
+                largest = j - start;
+        }
+        weights[largest] = static_cast<int16_t>(weights[largest] + (1 << WEIGHT_BITS) - sum);
+    }
+}
+
+//---------------------------------------------------------------
+// Resizes a 32-bit BGRA image.
+//---------------------------------------------------------------
+void Resampler::ResampleBgra(const void *src, unsigned srcStride,
+    void *dst, unsigned dstStride, unsigned numThreads, WorkerPool *helpers) const
+{
+    Resample(static_cast<const uint8_t *>(src), srcStride,
+        static_cast<uint8_t *>(dst), dstStride, 4, numThreads, helpers);
+}
+
+//---------------------------------------------------------------
+// Resizes an 8-bit image plane.
+//---------------------------------------------------------------
+void Resampler::ResamplePlane(const void *src, unsigned srcStride,
+    void *dst, unsigned dstStride, unsigned numThreads, WorkerPool *helpers) const
+{
+    Resample(static_cast<const uint8_t *>(src), srcStride,
+        static_cast<uint8_t *>(dst), dstStride, 1, numThreads, helpers);
+}
+
+//---------------------------------------------------------------
+// Splits the output into bands and resamples them in parallel on
+// the calling thread and the helper pool's threads.
+//---------------------------------------------------------------
+void Resampler::Resample(
+    const uint8_t *src,     // in:  Source pixels.
+    unsigned srcStride,     // in:  Bytes per source row.
+    uint8_t *dst,           // out: Destination pixels.
+    unsigned dstStride,     // in:  Bytes per destination row.
+    unsigned channels,      // in:  Bytes per pixel (1 or 4).
+    unsigned numThreads,    // in:  How many bands to split the output into.
+    WorkerPool *helpers     // in:  Threads to share the bands with; may be null.
+    ) const
+{
+    if (m_dstHeight == 0)
+        return;
+
+    if (helpers == nullptr || numThreads < 2)
+    {
+        ResampleBand(src, srcStride, dst, dstStride, channels, 0, m_dstHeight);
+        return;
+    }
+
+    numThreads = __min(numThreads, m_dstHeight);
+    unsigned rowsPerBand = (m_dstHeight + numThreads - 1) / numThreads;
+    unsigned numBands = (m_dstHeight + rowsPerBand - 1) / rowsPerBand;
+    helpers->RunParallel(numBands, [=](unsigned band)
+    {
+        unsigned first = band * rowsPerBand;
+        ResampleBand(src, srcStride, dst, dstStride, channels, first, __min(first + rowsPerBand, m_dstHeight));
+    });
+}
+
+//---------------------------------------------------------------
+// Resamples one band of output rows.  Source rows are filtered
+// horizontally into a rolling cache as the vertical filter's
+// window reaches them, so each is filtered only once per band.
+//---------------------------------------------------------------
+void Resampler::ResampleBand(
+    const uint8_t *src,     // in:  Source pixels.
+    unsigned srcStride,     // in:  Bytes per source row.
+    uint8_t *dst,           // out: Destination pixels.
+    unsigned dstStride,     // in:  Bytes per destination row.
+    unsigned channels,      // in:  Bytes per pixel (1 or 4).
+    unsigned firstRow,      // in:  First output row of the band.
+    unsigned endRow         // in:  Output row after the band.
+    ) const
+{
+    // The cache holds exactly one vertical window of rows; source
+    // row s lives in slot s % m_y.m_taps.
+    unsigned rowLength = m_dstWidth * channels;
+    std::vector<int16_t> cache(static_cast<size_t>(rowLength) * m_y.m_taps);
+    std::vector<unsigned> cachedRows(m_y.m_taps, ~0u);
+    std::vector<const int16_t *> window(m_y.m_taps);
+
+    for (unsigned y = firstRow; y < endRow; y++)
+    {
+        unsigned start = m_y.m_starts[y];
+        for (unsigned k = 0; k < m_y.m_taps; k++)
+        {
+            unsigned row = start + k;
+            unsigned slot = row % m_y.m_taps;
+            int16_t *cached = &cache[static_cast<size_t>(slot) * rowLength];
+            if (cachedRows[slot] != row)
+            {
+                const uint8_t *srcRow = src + static_cast<size_t>(srcStride) * row;
+                if (channels == 4)
+                    FilterRowBgra(srcRow, cached);
+                else
+                    FilterRowPlane(srcRow, cached);
+                cachedRows[slot] = row;
+            }
+            window[k] = cached;
+        }
+
+        FilterColumns(window.data(), &m_y.m_weights[static_cast<size_t>(y) * m_y.m_weightStride],
+            dst + static_cast<size_t>(dstStride) * y, rowLength);
+    }
+}
+
+//---------------------------------------------------------------
+// Filters a row of BGRA pixels horizontally.  The four channels of
+// a pixel are filtered together, two taps per multiply-add.
+//---------------------------------------------------------------
+void Resampler::FilterRowBgra(
+    const uint8_t *src,     // in:  Source row.
+    int16_t *out            // out: m_dstWidth filtered pixels, 4 values each.
+    ) const
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (WEIGHT_BITS - ROW_BITS - 1));
+    unsigned pairs = m_x.m_taps / 2;
+
+    for (unsigned x = 0; x < m_dstWidth; x++)
+    {
+        const uint8_t *p = src + m_x.m_starts[x] * 4;
+        const int16_t *w = &m_x.m_weights[static_cast<size_t>(x) * m_x.m_weightStride];
+        __m128i sum = zero;
+        for (unsigned k = 0; k < pairs; k++, p += 8, w += 2)
+        {
+            // Interleave two pixels' channels (b0 b1 g0 g1 r0 r1 a0 a1)
+            // to line them up with their pair of weights.
+            __m128i both = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), zero);
+            __m128i paired = _mm_unpacklo_epi16(both, _mm_srli_si128(both, 8));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(paired, WeightPair(w[0], w[1])));
+        }
+        if (m_x.m_taps & 1)
+        {
+            int pixel;
+            memcpy(&pixel, p, 4);
+            __m128i one = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(pixel), zero), zero);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(one, WeightPair(w[0], 0)));
+        }
+
+        sum = _mm_srai_epi32(_mm_add_epi32(sum, round), WEIGHT_BITS - ROW_BITS);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out + x * 4), _mm_packs_epi32(sum, sum));
+    }
+}
+
+//---------------------------------------------------------------
+// Filters a row of an 8-bit plane horizontally, eight taps per
+// pair of multiply-adds.
+//---------------------------------------------------------------
+void Resampler::FilterRowPlane(
+    const uint8_t *src,     // in:  Source row.
+    int16_t *out            // out: m_dstWidth filtered values.
+    ) const
+{
+    const __m128i zero = _mm_setzero_si128();
+    const int round = 1 << (WEIGHT_BITS - ROW_BITS - 1);
+    unsigned chunks = m_x.m_weightStride / 8;
+
+    for (unsigned x = 0; x < m_dstWidth; x++)
+    {
+        unsigned start = m_x.m_starts[x];
+        const uint8_t *p = src + start;
+        const int16_t *w = &m_x.m_weights[static_cast<size_t>(x) * m_x.m_weightStride];
+        int total = 0;
+        if (start + m_x.m_weightStride <= m_srcWidth)
+        {
+            // The padding weights are zero, but the pixels they
+            // read must still lie within the row.
+            __m128i sum = zero;
+            for (unsigned k = 0; k < chunks; k++, p += 8, w += 8)
+            {
+                __m128i pixels = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), zero);
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(pixels,
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(w))));
+            }
+            sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 8));
+            sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 4));
+            total = _mm_cvtsi128_si32(sum);
+        }
+        else
+        {
+            for (unsigned k = 0; k < m_x.m_taps; k++)
+                total += p[k] * w[k];
+        }
+        out[x] = static_cast<int16_t>((total + round) >> (WEIGHT_BITS - ROW_BITS));
+    }
+}
+
+//---------------------------------------------------------------
+// Filters a window of horizontally filtered rows vertically into
+// one output row, eight values at a time.
+//---------------------------------------------------------------
+void Resampler::FilterColumns(
+    const int16_t *const *rows, // in:  m_y.m_taps rows under the filter.
+    const int16_t *weights,     // in:  Weight of each row.
+    uint8_t *dst,               // out: Output row.
+    unsigned count              // in:  Values per row.
+    ) const
+{
+    const int shift = WEIGHT_BITS + ROW_BITS;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+    unsigned taps = m_y.m_taps;
+
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i lo = round;
+        __m128i hi = round;
+        unsigned k = 0;
+        for (; k + 1 < taps; k += 2)
+        {
+            // Interleave two rows to line them up with their pair of
+            // weights.
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k] + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k + 1] + i));
+            __m128i w = WeightPair(weights[k], weights[k + 1]);
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+        }
+        if (k < taps)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k] + i));
+            __m128i w = WeightPair(weights[k], 0);
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero), w));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, zero), w));
+        }
+        lo = _mm_srai_epi32(lo, shift);
+        hi = _mm_srai_epi32(hi, shift);
+        __m128i values = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(values, values));
+    }
+
+    for (; i < count; i++)
+    {
+        int total = 1 << (shift - 1);
+        for (unsigned k = 0; k < taps; k++)
+            total += rows[k][i] * weights[k];
+        total >>= shift;
+        dst[i] = static_cast<uint8_t>(__max(0, __min(total, 255)));
+    }
+}
@@ -0,0 +1,138 @@
+//--------------------------------------------------------------------
+// Resampler.h
+// A C++ module for high quality resizing of 32-bit BGRA images and
+// 8-bit image planes with a separable filter.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Init() with the source and destination
+//   sizes and a filter, then call ResampleBgra() or ResamplePlane()
+//   as many times as desired for images of those sizes.  Init()
+//   does all of the floating point work; a Resampler is read-only
+//   afterwards, so one object may be shared by several threads.
+//
+// * The filter is applied in two passes.  Each source row is
+//   filtered horizontally into a small rolling cache of 16-bit rows
+//   (just enough rows for the vertical filter), and each output row
+//   is then filtered vertically from the cache.  Both passes use
+//   precomputed 14-bit fixed point weights and SSE2 multiply-adds.
+//
+// * Passing numThreads > 1 and a WorkerPool splits the output into
+//   horizontal bands, each with its own row cache, that the calling
+//   thread and the pool's threads resample in parallel.
+//
+// * For planar YUV images (e.g. I420), resample each plane with
+//   ResamplePlane() and a Resampler sized for that plane.  Chroma
+//   planes interleaved as in NV12 must be separated first.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class WorkerPool;
+
+// Resampling filters, from fastest to sharpest.
+enum ResampleFilter
+{
+    RF_BILINEAR,    // Triangle filter, 2 taps when enlarging.
+    RF_BICUBIC,     // Catmull-Rom cubic, 4 taps when enlarging.
+    RF_LANCZOS3     // Lanczos windowed sinc, 6 taps when enlarging.
+};
+
+//---------------------------------------------------------------
+// Parses a resampling filter name ("bilinear", "bicubic", or
+// "lanczos").  Returns false if it isn't recognized.
+//---------------------------------------------------------------
+bool ParseResampleFilter(const char *name, ResampleFilter &filter);
+
+//---------------------------------------------------------------
+// A C++ class that resizes images with a separable filter.
+//---------------------------------------------------------------
+class Resampler
+{
+public:
+    // Precomputes the filter weights for resizing images of the
+    // given source size to the given destination size.  Returns
+    // false if any size is zero.
+    bool Init(unsigned srcWidth, unsigned srcHeight,
+        unsigned dstWidth, unsigned dstHeight, ResampleFilter filter);
+
+    // Resizes a 32-bit BGRA image.
+    void ResampleBgra(const void *src, unsigned srcStride,
+        void *dst, unsigned dstStride, unsigned numThreads = 1, WorkerPool *helpers = nullptr) const;
+
+    // Resizes an 8-bit image plane.
+    void ResamplePlane(const void *src, unsigned srcStride,
+        void *dst, unsigned dstStride, unsigned numThreads = 1, WorkerPool *helpers = nullptr) const;
+
+    unsigned GetSrcWidth() const { return m_srcWidth; }
+    unsigned GetSrcHeight() const { return m_srcHeight; }
+    unsigned GetDstWidth() const { return m_dstWidth; }
+    unsigned GetDstHeight() const { return m_dstHeight; }
+
+private:
+    // The weights of one dimension of the filter.  Every output
+    // position uses the same number of taps, starting at
+    // m_starts[i]; unused taps have zero weight.
+    struct Axis
+    {
+        unsigned m_taps = 0;            // Taps per output position.
+        unsigned m_weightStride = 0;    // m_taps rounded up to a multiple of 8.
+        std::vector<unsigned> m_starts; // First source position of each output position.
+        std::vector<int16_t> m_weights; // m_weightStride weights per output position.
+    };
+
+    static void InitAxis(Axis &axis, unsigned srcSize, unsigned dstSize, ResampleFilter filter);
+    void Resample(const uint8_t *src, unsigned srcStride, uint8_t *dst, unsigned dstStride,
+        unsigned channels, unsigned numThreads, WorkerPool *helpers) const;
+    void ResampleBand(const uint8_t *src, unsigned srcStride, uint8_t *dst, unsigned dstStride,
+        unsigned channels, unsigned firstRow, unsigned endRow) const;
+    void FilterRowBgra(const uint8_t *src, int16_t *out) const;
+    void FilterRowPlane(const uint8_t *src, int16_t *out) const;
+    void FilterColumns(const int16_t *const *rows, const int16_t *weights,
+        uint8_t *dst, unsigned count) const;
+
+    unsigned m_srcWidth = 0;
+    unsigned m_srcHeight = 0;
+    unsigned m_dstWidth = 0;
+    unsigned m_dstHeight = 0;
+    Axis m_x;                           // Horizontal filter.
+    Axis m_y;                           // Vertical filter.
+};
+
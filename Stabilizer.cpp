@@ -0,0 +1,371 @@
+//--------------------------------------------------------------------
+// Stabilizer.cpp
+// A C++ module that steadies shaky frames by measuring their motion
+// with phase correlation and shifting them back.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "Stabilizer.h"
+
+#include <math.h>
+#include <string.h>
+#include <emmintrin.h>
+
+namespace
+{
+
+// Largest side of the luma thumbnail (and the FFT size).
+const unsigned THUMB_SIZE = 128;
+
+// Correlation peaks weaker than this are taken as no motion.  A
+// perfect match peaks at 1.
+const float MIN_PEAK = 0.03f;
+
+// Bilinear fractions are fixed point with this many bits.
+const int FRACTION_BITS = 7;
+const int FRACTION_ONE = 1 << FRACTION_BITS;
+
+const double PI = 3.14159265358979323846;
+
+//---------------------------------------------------------------
+// Fills a Hann window.
+//---------------------------------------------------------------
+void MakeWindow(
+    std::vector<float> &window,     // out:  Window weights.
+    unsigned length                 // in:  Length of the window.
+    )
+{
+    window.resize(length);
+    for (unsigned i = 0; i < length; i++)
+        window[i] = static_cast<float>(0.5 - 0.5 * cos(2.0 * PI * (i + 0.5) / length));
+}
+
+//---------------------------------------------------------------
+// Returns the offset of a correlation peak from its sample.  A
+// pure shift correlates to a sampled sinc, whose two largest
+// samples split the peak in proportion to their heights.
+//---------------------------------------------------------------
+double RefinePeak(
+    float before,   // in:  Neighbour on the low side.
+    float peak,     // in:  The peak sample.
+    float after     // in:  Neighbour on the high side.
+    )
+{
+    if (peak <= 0.0f)
+        return 0.0;
+    if (after > before && after > 0.0f)
+        return after / (after + peak);
+    if (before > 0.0f)
+        return -before / (before + peak);
+    return 0.0;
+}
+
+//---------------------------------------------------------------
+// Builds the source offsets and fractions of one axis of the
+// shifted, zoomed crop.
+//---------------------------------------------------------------
+void MakeAxis(
+    unsigned size,                      // in:  Pixels along the axis.
+    unsigned step,                      // in:  Bytes per source pixel along the axis.
+    double zoom,                        // in:  Scale from output to source positions.
+    double offset,                      // in:  Shift of the source positions.
+    std::vector<int32_t> &offsets,      // out:  Source byte offset of each position.
+    std::vector<uint8_t> &fractions     // out:  Bilinear fraction of each position.
+    )
+{
+    offsets.resize(size);
+    fractions.resize(size);
+    double center = (size - 1) * 0.5;
+    for (unsigned i = 0; i < size; i++)
+    {
+        double s = center + (i - center) * zoom + offset;
+        s = __max(0.0, __min(s, size - 1.0));
+        unsigned whole = __min(static_cast<unsigned>(s), size - 2);
+        offsets[i] = static_cast<int32_t>(whole * step);
+        fractions[i] = static_cast<uint8_t>((s - whole) * FRACTION_ONE + 0.5);
+    }
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Starts a new stream of frames.  Returns false if the
+// parameters are out of range.
+//---------------------------------------------------------------
+bool Stabilizer::Init(unsigned width, unsigned height, unsigned margin, double smoothing,
+    std::string &errText)
+{
+    m_width = 0;
+    if (width < 16 || height < 16)
+    {
+        errText = "The frames are too small to stabilize.";
+        return false;
+    }
+    if (margin < 1 || margin > MaxMargin)
+    {
+        errText = "The crop margin must be 1 to " + std::to_string(MaxMargin) + " percent.";
+        return false;
+    }
+    if (!(smoothing >= 0.0 && smoothing <= 0.99))
+    {
+        errText = "The smoothing must be 0 to 0.99.";
+        return false;
+    }
+
+    m_fft.Init(THUMB_SIZE);
+    m_zoom = 1.0 - 2.0 * margin / 100.0;
+    m_marginX = (width - 1) * (1.0 - m_zoom) * 0.5;
+    m_marginY = (height - 1) * (1.0 - m_zoom) * 0.5;
+    m_smoothing = smoothing;
+    m_scale = (__max(width, height) + THUMB_SIZE - 1) / THUMB_SIZE;
+    m_thumbWidth = width / m_scale;
+    m_thumbHeight = height / m_scale;
+    MakeWindow(m_windowX, m_thumbWidth);
+    MakeWindow(m_windowY, m_thumbHeight);
+
+    const size_t count = THUMB_SIZE * THUMB_SIZE;
+    m_re.assign(count, 0.0f);
+    m_im.assign(count, 0.0f);
+    m_prevRe.assign(count, 0.0f);
+    m_prevIm.assign(count, 0.0f);
+    m_crossRe.assign(count, 0.0f);
+    m_crossIm.assign(count, 0.0f);
+    m_havePrev = false;
+    m_lastConfident = false;
+    m_lastX = m_lastY = 0.0;
+    m_pathX = m_pathY = 0.0;
+    m_smoothX = m_smoothY = 0.0;
+
+    m_width = width;
+    m_height = height;
+    return true;
+}
+
+//---------------------------------------------------------------
+// Measures the frame's motion and renders it, stabilized, into
+// dst.
+//---------------------------------------------------------------
+void Stabilizer::Apply(const unsigned char *src, unsigned char *dst, unsigned stride)
+{
+    if (m_width == 0)
+        return;
+
+    MakeThumbnail(src, stride);
+    double dx = 0.0, dy = 0.0;
+    m_lastConfident = MeasureShift(dx, dy);
+    m_lastX = dx;
+    m_lastY = dy;
+    m_pathX += dx;
+    m_pathY += dy;
+
+    // Follow the path smoothly, but never further behind than the
+    // crop margin can hide.
+    m_smoothX = m_smoothing * m_smoothX + (1.0 - m_smoothing) * m_pathX;
+    m_smoothY = m_smoothing * m_smoothY + (1.0 - m_smoothing) * m_pathY;
+    m_smoothX = __max(m_pathX - m_marginX, __min(m_smoothX, m_pathX + m_marginX));
+    m_smoothY = __max(m_pathY - m_marginY, __min(m_smoothY, m_pathY + m_marginY));
+
+    Render(src, dst, stride, m_pathX - m_smoothX, m_pathY - m_smoothY);
+}
+
+//---------------------------------------------------------------
+// Returns the shift of the last frame from the previous one, and
+// whether it was measured with confidence.
+//---------------------------------------------------------------
+bool Stabilizer::GetLastMotion(double &dx, double &dy) const
+{
+    dx = m_lastX;
+    dy = m_lastY;
+    return m_lastConfident;
+}
+
+//---------------------------------------------------------------
+// Box-filters the frame into a windowed, zero-mean luma
+// thumbnail in m_re, with m_im cleared.
+//---------------------------------------------------------------
+void Stabilizer::MakeThumbnail(const unsigned char *src, unsigned stride)
+{
+    memset(m_re.data(), 0, m_re.size() * sizeof(float));
+    memset(m_im.data(), 0, m_im.size() * sizeof(float));
+
+    // Luma is approximated as (B + 2G + R) / 4; only its changes
+    // matter.
+    std::vector<unsigned> sums(m_thumbWidth);
+    double total = 0.0;
+    for (unsigned ty = 0; ty < m_thumbHeight; ty++)
+    {
+        memset(sums.data(), 0, sums.size() * sizeof(unsigned));
+        for (unsigned y = ty * m_scale; y < (ty + 1) * m_scale; y++)
+        {
+            const unsigned char *p = src + static_cast<size_t>(stride) * y;
+            for (unsigned tx = 0; tx < m_thumbWidth; tx++)
+            {
+                unsigned sum = 0;
+                for (unsigned i = 0; i < m_scale; i++, p += 4)
+                    sum += p[0] + 2 * p[1] + p[2];
+                sums[tx] += sum;
+            }
+        }
+
+        float *row = &m_re[ty * THUMB_SIZE];
+        for (unsigned tx = 0; tx < m_thumbWidth; tx++)
+        {
+            row[tx] = static_cast<float>(sums[tx]);
+            total += sums[tx];
+        }
+    }
+
+    float mean = static_cast<float>(total / (static_cast<double>(m_thumbWidth) * m_thumbHeight));
+    for (unsigned ty = 0; ty < m_thumbHeight; ty++)
+    {
+        float *row = &m_re[ty * THUMB_SIZE];
+        for (unsigned tx = 0; tx < m_thumbWidth; tx++)
+            row[tx] = (row[tx] - mean) * m_windowX[tx] * m_windowY[ty];
+    }
+}
+
+//---------------------------------------------------------------
+// Transforms the thumbnail and correlates it with the previous
+// one.  Returns false, with no shift, if there's no previous frame
+// or the match is too weak to trust.
+//---------------------------------------------------------------
+bool Stabilizer::MeasureShift(
+    double &dx,     // out:  Horizontal shift since the previous frame, in pixels.
+    double &dy      // out:  Vertical shift since the previous frame, in pixels.
+    )
+{
+    dx = dy = 0.0;
+    m_fft.Forward(m_re.data(), m_im.data());
+
+    bool havePrev = m_havePrev;
+    if (havePrev)
+    {
+        // Normalized cross-power spectrum, current times the
+        // conjugate of previous.
+        const size_t count = m_re.size();
+        const __m128 tiny = _mm_set1_ps(1e-20f);
+        for (size_t i = 0; i < count; i += 4)
+        {
+            __m128 ar = _mm_loadu_ps(&m_re[i]), ai = _mm_loadu_ps(&m_im[i]);
+            __m128 br = _mm_loadu_ps(&m_prevRe[i]), bi = _mm_loadu_ps(&m_prevIm[i]);
+            __m128 cr = _mm_add_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+            __m128 ci = _mm_sub_ps(_mm_mul_ps(ai, br), _mm_mul_ps(ar, bi));
+            __m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cr, cr), _mm_mul_ps(ci, ci)), tiny));
+            _mm_storeu_ps(&m_crossRe[i], _mm_div_ps(cr, magnitude));
+            _mm_storeu_ps(&m_crossIm[i], _mm_div_ps(ci, magnitude));
+        }
+    }
+
+    // The current spectrum is the next frame's previous one.
+    m_re.swap(m_prevRe);
+    m_im.swap(m_prevIm);
+    m_havePrev = true;
+    if (!havePrev)
+        return false;
+
+    m_fft.Inverse(m_crossRe.data(), m_crossIm.data());
+
+    // Find the correlation peak.
+    const float *corr = m_crossRe.data();
+    unsigned best = 0;
+    for (unsigned i = 1; i < THUMB_SIZE * THUMB_SIZE; i++)
+    {
+        if (corr[i] > corr[best])
+            best = i;
+    }
+    if (corr[best] < MIN_PEAK)
+        return false;
+
+    // Refine it, with the neighbours wrapping around the edges.
+    const unsigned mask = THUMB_SIZE - 1;
+    unsigned px = best % THUMB_SIZE, py = best / THUMB_SIZE;
+    double fx = RefinePeak(corr[py * THUMB_SIZE + ((px - 1) & mask)], corr[best],
+        corr[py * THUMB_SIZE + ((px + 1) & mask)]);
+    double fy = RefinePeak(corr[((py - 1) & mask) * THUMB_SIZE + px], corr[best],
+        corr[((py + 1) & mask) * THUMB_SIZE + px]);
+
+    // Shifts past half the size are negative.
+    double sx = (px < THUMB_SIZE / 2) ? px : static_cast<double>(px) - THUMB_SIZE;
+    double sy = (py < THUMB_SIZE / 2) ? py : static_cast<double>(py) - THUMB_SIZE;
+    dx = (sx + fx) * m_scale;
+    dy = (sy + fy) * m_scale;
+    return true;
+}
+
+//---------------------------------------------------------------
+// Renders the frame shifted by the given offset and cropped by
+// the margin, with bilinear sampling.
+//---------------------------------------------------------------
+void Stabilizer::Render(
+    const unsigned char *src,   // in:  Source frame.
+    unsigned char *dst,         // out:  Stabilized frame.
+    unsigned stride,            // in:  Bytes per row of both frames.
+    double offsetX,             // in:  Horizontal shift of the source positions, in pixels.
+    double offsetY              // in:  Vertical shift of the source positions, in pixels.
+    )
+{
+    MakeAxis(m_width, 4, m_zoom, offsetX, m_columnOffsets, m_columnFractions);
+    MakeAxis(m_height, stride, m_zoom, offsetY, m_rowOffsets, m_rowFractions);
+
+    // The same blend as Remapper's:  one multiply-add for the top
+    // pair of source pixels and one for the bottom pair.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (2 * FRACTION_BITS - 1));
+    for (unsigned y = 0; y < m_height; y++)
+    {
+        const unsigned char *srcRow = src + m_rowOffsets[y];
+        uint32_t *out = reinterpret_cast<uint32_t *>(dst + static_cast<size_t>(stride) * y);
+        int fy = m_rowFractions[y];
+        int top = FRACTION_ONE - fy;
+        for (unsigned x = 0; x < m_width; x++)
+        {
+            int fx = m_columnFractions[x];
+            int left = FRACTION_ONE - fx;
+            __m128i topWeights = _mm_set1_epi32((left * top) | ((fx * top) << 16));
+            __m128i bottomWeights = _mm_set1_epi32((left * fy) | ((fx * fy) << 16));
+
+            const unsigned char *p = srcRow + m_columnOffsets[x];
+            __m128i upper = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), zero);
+            __m128i lower = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p + stride)), zero);
+            upper = _mm_unpacklo_epi16(upper, _mm_srli_si128(upper, 8));
+            lower = _mm_unpacklo_epi16(lower, _mm_srli_si128(lower, 8));
+
+            __m128i sum = _mm_add_epi32(_mm_madd_epi16(upper, topWeights), _mm_madd_epi16(lower, bottomWeights));
+            sum = _mm_srli_epi32(_mm_add_epi32(sum, round), 2 * FRACTION_BITS);
+            sum = _mm_packs_epi32(sum, sum);
+            out[x] = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum)));
+        }
+    }
+}
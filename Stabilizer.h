@@ -0,0 +1,135 @@
+//--------------------------------------------------------------------
+// Stabilizer.h
+// A C++ module that steadies shaky frames by measuring their motion
+// with phase correlation and shifting them back.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Init() with the frame size, the crop
+//   margin, and the smoothing factor, then call Apply() on each
+//   frame in turn.  A Stabilizer keeps the previous frame's
+//   spectrum and the camera's motion path, so each camera needs its
+//   own, and frames must be applied in order.
+//
+// * Each frame is box-filtered down to a luma thumbnail of at most
+//   128x128 pixels, windowed, and transformed with Fft2d.  The
+//   normalized cross-power spectrum with the previous frame's
+//   transforms back to a sharp peak at their relative shift, which
+//   is refined to a fraction of a thumbnail pixel from the height
+//   of its larger neighbour.  Weak peaks (scene changes,
+//   featureless frames) count as no motion.
+//
+// * The shifts add up to the camera's motion path, which is
+//   smoothed with an exponential moving average so that slow pans
+//   are followed while shake is removed.  Each frame is then
+//   shifted by the difference, to a fraction of a pixel, and
+//   cropped by the margin (zoomed back to full size) so the shifted
+//   edges never show.  The smoothed path is never allowed to stray
+//   further from the real one than the margin.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include "Fft.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//---------------------------------------------------------------
+// A C++ class that stabilizes a stream of BGRA frames.
+//---------------------------------------------------------------
+class Stabilizer
+{
+public:
+    // Largest crop margin, in percent of the frame on each side.
+    static const unsigned MaxMargin = 20;
+
+    // Starts a new stream of frames.  'margin' is the percentage of
+    // the frame cropped from each side (1 to MaxMargin), and
+    // 'smoothing' (0 to 0.99) is how much of the smoothed path
+    // carries over from frame to frame.  Returns false if the
+    // parameters are out of range.
+    bool Init(unsigned width, unsigned height, unsigned margin, double smoothing, std::string &errText);
+
+    // Returns true if Init() has been called.
+    bool IsEnabled() const { return m_width != 0; }
+
+    // Measures the frame's motion and renders it, stabilized, into
+    // dst.  The images must not overlap.
+    void Apply(const unsigned char *src, unsigned char *dst, unsigned stride);
+
+    // Returns the shift of the last frame from the previous one, in
+    // pixels, and whether it was measured with confidence.
+    bool GetLastMotion(double &dx, double &dy) const;
+
+private:
+    void MakeThumbnail(const unsigned char *src, unsigned stride);
+    bool MeasureShift(double &dx, double &dy);
+    void Render(const unsigned char *src, unsigned char *dst, unsigned stride,
+        double offsetX, double offsetY);
+
+    unsigned m_width = 0;
+    unsigned m_height = 0;
+    double m_zoom = 1.0;                // Scale from output to source positions.
+    double m_marginX = 0.0;             // Largest shift that stays inside the frame.
+    double m_marginY = 0.0;
+    double m_smoothing = 0.0;
+    unsigned m_scale = 1;               // Frame pixels per thumbnail pixel.
+    unsigned m_thumbWidth = 0;
+    unsigned m_thumbHeight = 0;
+    Fft2d m_fft;
+    std::vector<float> m_windowX;       // Hann window across the thumbnail.
+    std::vector<float> m_windowY;       // Hann window down the thumbnail.
+    std::vector<float> m_re;            // Thumbnail, then its spectrum.
+    std::vector<float> m_im;
+    std::vector<float> m_prevRe;        // Spectrum of the previous frame.
+    std::vector<float> m_prevIm;
+    std::vector<float> m_crossRe;       // Cross-power spectrum, then correlation.
+    std::vector<float> m_crossIm;
+    bool m_havePrev = false;
+    bool m_lastConfident = false;
+    double m_lastX = 0.0;               // Last measured shift.
+    double m_lastY = 0.0;
+    double m_pathX = 0.0;               // Total motion since the first frame.
+    double m_pathY = 0.0;
+    double m_smoothX = 0.0;             // Smoothed motion path.
+    double m_smoothY = 0.0;
+    std::vector<int32_t> m_columnOffsets;   // Source byte offset of each output column.
+    std::vector<uint8_t> m_columnFractions; // Horizontal bilinear fraction of each column.
+    std::vector<int32_t> m_rowOffsets;      // Source byte offset of each output row.
+    std::vector<uint8_t> m_rowFractions;    // Vertical bilinear fraction of each row.
+};
@@ -0,0 +1,208 @@
+//--------------------------------------------------------------------
+// TemporalFilter.cpp
+// A C++ module for a recursive, motion-adaptive temporal noise
+// filter.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "TemporalFilter.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+
+namespace
+{
+
+// The filtered frame and the blend weights are fixed point with
+// this many fraction bits.  State samples (up to 255 << 7) and
+// weights (up to 128) both fit a signed 16-bit multiply-add.
+const int STATE_BITS = 7;
+const int WEIGHT_ONE = 1 << STATE_BITS;
+
+//---------------------------------------------------------------
+// Returns the largest of each group of four samples, repeated in
+// all four.
+//---------------------------------------------------------------
+inline __m128i GroupMax4(__m128i v)
+{
+    v = _mm_max_epu8(v, _mm_srli_epi32(v, 8));
+    v = _mm_max_epu8(v, _mm_srli_epi32(v, 16));
+    v = _mm_and_si128(v, _mm_set1_epi32(0xff));
+    v = _mm_or_si128(v, _mm_slli_epi32(v, 8));
+    return _mm_or_si128(v, _mm_slli_epi32(v, 16));
+}
+
+//---------------------------------------------------------------
+// Blends eight state samples with eight new samples.  Returns the
+// new state.
+//---------------------------------------------------------------
+inline __m128i Blend8(
+    __m128i state,      // in:  Previous filtered samples, fixed point.
+    __m128i cur,        // in:  New samples, fixed point.
+    __m128i weight      // in:  Weight of each new sample (of 128).
+    )
+{
+    const __m128i one = _mm_set1_epi16(WEIGHT_ONE);
+    const __m128i round = _mm_set1_epi32(WEIGHT_ONE / 2);
+    __m128i keep = _mm_sub_epi16(one, weight);
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(state, cur), _mm_unpacklo_epi16(keep, weight));
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(state, cur), _mm_unpackhi_epi16(keep, weight));
+    lo = _mm_srai_epi32(_mm_add_epi32(lo, round), STATE_BITS);
+    hi = _mm_srai_epi32(_mm_add_epi32(hi, round), STATE_BITS);
+    return _mm_packs_epi32(lo, hi);
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Starts a new stream of frames.  Returns false if the
+// parameters are out of range.
+//---------------------------------------------------------------
+bool TemporalFilter::Init(size_t frameSize, unsigned sampleGroup, unsigned strength, unsigned threshold)
+{
+    m_frameSize = 0;
+    m_primed = false;
+    m_state.clear();
+
+    if (frameSize < 1 || (sampleGroup != 1 && sampleGroup != 4) ||
+        frameSize % sampleGroup != 0 || strength < 2 || strength > MaxStrength || threshold > 255)
+        return false;
+
+    m_frameSize = frameSize;
+    m_sampleGroup = sampleGroup;
+    m_minWeight = (WEIGHT_ONE + strength / 2) / strength;
+    m_threshold = threshold;
+
+    // Ramp up to taking the new frame over as many levels again as
+    // the threshold.
+    int ramp = __max(1, m_threshold);
+    m_gain = (WEIGHT_ONE - m_minWeight + ramp - 1) / ramp;
+
+    m_state.resize(m_frameSize);
+    return true;
+}
+
+//---------------------------------------------------------------
+// Filters a frame in place.  Returns false if the frame is the
+// wrong size.
+//---------------------------------------------------------------
+bool TemporalFilter::Apply(unsigned char *data, size_t dataSize)
+{
+    if (m_frameSize == 0 || data == nullptr || dataSize != m_frameSize)
+        return false;
+
+    uint16_t *state = m_state.data();
+    if (!m_primed)
+    {
+        for (size_t i = 0; i < m_frameSize; i++)
+            state[i] = static_cast<uint16_t>(data[i] << STATE_BITS);
+        m_primed = true;
+        return true;
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(WEIGHT_ONE / 2);
+    const __m128i threshold = _mm_set1_epi16(static_cast<short>(m_threshold));
+    const __m128i gain = _mm_set1_epi16(static_cast<short>(m_gain));
+    const __m128i minWeight = _mm_set1_epi16(static_cast<short>(m_minWeight));
+    const __m128i maxWeight = _mm_set1_epi16(WEIGHT_ONE);
+
+    size_t i = 0;
+    for (; i + 16 <= m_frameSize; i += 16)
+    {
+        __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i state0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state + i));
+        __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state + i + 8));
+
+        // How far each sample (or pixel) moved from the filtered
+        // frame, in 8-bit levels.
+        __m128i prev = _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(state0, round), STATE_BITS),
+            _mm_srli_epi16(_mm_add_epi16(state1, round), STATE_BITS));
+        __m128i change = _mm_or_si128(_mm_subs_epu8(cur, prev), _mm_subs_epu8(prev, cur));
+        if (m_sampleGroup == 4)
+            change = GroupMax4(change);
+
+        // Weight of the new frame:  the minimum up to the
+        // threshold, then ramping up to all of it.
+        __m128i change0 = _mm_subs_epu16(_mm_unpacklo_epi8(change, zero), threshold);
+        __m128i change1 = _mm_subs_epu16(_mm_unpackhi_epi8(change, zero), threshold);
+        __m128i weight0 = _mm_min_epi16(_mm_adds_epi16(_mm_mullo_epi16(change0, gain), minWeight), maxWeight);
+        __m128i weight1 = _mm_min_epi16(_mm_adds_epi16(_mm_mullo_epi16(change1, gain), minWeight), maxWeight);
+
+        __m128i cur0 = _mm_slli_epi16(_mm_unpacklo_epi8(cur, zero), STATE_BITS);
+        __m128i cur1 = _mm_slli_epi16(_mm_unpackhi_epi8(cur, zero), STATE_BITS);
+        state0 = Blend8(state0, cur0, weight0);
+        state1 = Blend8(state1, cur1, weight1);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(state + i), state0);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(state + i + 8), state1);
+
+        __m128i out = _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(state0, round), STATE_BITS),
+            _mm_srli_epi16(_mm_add_epi16(state1, round), STATE_BITS));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), out);
+    }
+
+    ApplyScalar(data + i, state + i, m_frameSize - i);
+    return true;
+}
+
+//---------------------------------------------------------------
+// Filters the samples left over after the SSE2 loop, the same way.
+//---------------------------------------------------------------
+void TemporalFilter::ApplyScalar(
+    unsigned char *data,    // in/out:  Samples to filter.
+    uint16_t *state,        // in/out:  Filtered samples, fixed point.
+    size_t count            // in:  Number of samples (a multiple of the sample group).
+    ) const
+{
+    for (size_t i = 0; i < count; i += m_sampleGroup)
+    {
+        int change = 0;
+        for (unsigned j = 0; j < m_sampleGroup; j++)
+        {
+            int prev = (state[i + j] + WEIGHT_ONE / 2) >> STATE_BITS;
+            change = __max(change, abs(data[i + j] - prev));
+        }
+        int weight = __min(m_minWeight + __max(0, change - m_threshold) * m_gain, WEIGHT_ONE);
+
+        for (unsigned j = 0; j < m_sampleGroup; j++)
+        {
+            int blended = (state[i + j] * (WEIGHT_ONE - weight) + (data[i + j] << STATE_BITS) * weight +
+                WEIGHT_ONE / 2) >> STATE_BITS;
+            state[i + j] = static_cast<uint16_t>(blended);
+            data[i + j] = static_cast<unsigned char>((blended + WEIGHT_ONE / 2) >> STATE_BITS);
+        }
+    }
+}
@@ -0,0 +1,105 @@
+//--------------------------------------------------------------------
+// TemporalFilter.h
+// A C++ module for a recursive, motion-adaptive temporal noise
+// filter.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Init() with the size of one frame, then
+//   call Apply() on each frame in turn.  Each frame is replaced by a
+//   blend of itself and the previous filtered frame.
+//
+// * The blend is chosen per pixel from how far the pixel moved
+//   away from the filtered frame:  changes within the noise
+//   threshold keep only 1/strength of the new frame, so static
+//   areas are smoothed over several frames, while larger changes
+//   ramp up to taking the new frame outright, so moving objects
+//   don't smear.
+//
+// * Like FrameStacker, frames are treated as arrays of 8-bit
+//   samples, so the filter works on the device's native YUY2, NV12,
+//   or BGR frames as well as on BGRA frames.  With a sample group
+//   of 4 (BGRA), the largest change among a pixel's channels picks
+//   the blend for the whole pixel; with a group of 1, each sample
+//   picks its own.
+//
+// * The filtered frame is kept with 7 fraction bits per sample (16
+//   bits in all), so slow changes aren't lost to rounding.  That
+//   frame is the filter's only state.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//---------------------------------------------------------------
+// A C++ class that smooths a stream of frames over time.
+//---------------------------------------------------------------
+class TemporalFilter
+{
+public:
+    // Largest supported strength.
+    static const unsigned MaxStrength = 32;
+
+    // Starts a new stream of frames, each 'frameSize' bytes in
+    // size.  'sampleGroup' is 4 for BGRA frames and 1 for native
+    // frames.  'strength' (2 to MaxStrength) is how many frames
+    // static areas are averaged over, roughly, and 'threshold' is
+    // the largest change (in 8-bit levels) treated as noise.
+    // Returns false if the parameters are out of range.
+    bool Init(size_t frameSize, unsigned sampleGroup, unsigned strength, unsigned threshold);
+
+    // Filters a frame in place.  The first frame after Init() is
+    // passed through unchanged.  Returns false if the frame is the
+    // wrong size.
+    bool Apply(unsigned char *data, size_t dataSize);
+
+    // Returns true if Init() has been called.
+    bool IsEnabled() const { return m_frameSize != 0; }
+
+private:
+    void ApplyScalar(unsigned char *data, uint16_t *state, size_t count) const;
+
+    size_t m_frameSize = 0;         // Size of each frame in bytes.
+    unsigned m_sampleGroup = 1;     // Samples that share one blend.
+    int m_minWeight = 0;            // Weight of the new frame in static areas (of 128).
+    int m_threshold = 0;            // Largest change treated as noise.
+    int m_gain = 0;                 // Weight added per level of change beyond the threshold.
+    bool m_primed = false;          // True once the first frame has been seen.
+    std::vector<uint16_t> m_state;  // Filtered frame, 7 fraction bits per sample.
+};
@@ -0,0 +1,273 @@
+//--------------------------------------------------------------------
+// TextOverlay.cpp
+// A C++ module that burns text, such as a timestamp, into 32-bit
+// BGRA frames.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "TextOverlay.h"
+
+#include <string.h>
+#include <windows.h>
+#include <emmintrin.h>
+
+// Link to GDI, which rasterizes the font.
+#pragma comment(lib, "gdi32.lib")
+
+namespace
+{
+
+// The atlas holds the printable ASCII characters.
+const char FIRST_GLYPH = ' ';
+const char LAST_GLYPH = '~';
+const unsigned NUM_GLYPHS = LAST_GLYPH - FIRST_GLYPH + 1;
+
+// How much of the frame's brightness shows through the box behind
+// the text, out of 256.
+const int BACKGROUND_KEEP = 128;
+
+//---------------------------------------------------------------
+// Darkens a row of BGRA pixels and blends the text color onto it
+// by the given coverage, four pixels at a time.
+//---------------------------------------------------------------
+void BlendRow(
+    unsigned char *pixels,          // in/out:  First pixel of the row.
+    const unsigned char *coverage,  // in:  Text coverage of each pixel, 0 to 255.
+    unsigned count,                 // in:  Number of pixels.
+    uint32_t rgb                    // in:  Text color, 0x00RRGGBB.
+    )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i keep = _mm_set1_epi16(BACKGROUND_KEEP);
+    const __m128i full = _mm_set1_epi16(256);
+    const __m128i color = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(rgb & 0xffffff)), zero);
+
+    unsigned x = 0;
+    for (; x + 4 <= count; x += 4)
+    {
+        // Spread each pixel's coverage across its four channels and
+        // scale it to 0-256 so the blend can shift instead of divide.
+        int cov;
+        memcpy(&cov, coverage + x, 4);
+        __m128i a = _mm_cvtsi32_si128(cov);
+        a = _mm_unpacklo_epi8(a, a);
+        a = _mm_unpacklo_epi16(a, a);
+        __m128i aLo = _mm_unpacklo_epi8(a, zero);
+        __m128i aHi = _mm_unpackhi_epi8(a, zero);
+        aLo = _mm_add_epi16(aLo, _mm_srli_epi16(aLo, 7));
+        aHi = _mm_add_epi16(aHi, _mm_srli_epi16(aHi, 7));
+
+        // pixel = (pixel * keep * (256 - a) + color * a) / 256
+        // (each product fits in 16 unsigned bits).
+        __m128i pix = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + x * 4));
+        __m128i pLo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pix, zero), keep), 8);
+        __m128i pHi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pix, zero), keep), 8);
+        pLo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(pLo, _mm_sub_epi16(full, aLo)),
+            _mm_mullo_epi16(color, aLo)), 8);
+        pHi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(pHi, _mm_sub_epi16(full, aHi)),
+            _mm_mullo_epi16(color, aHi)), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + x * 4), _mm_packus_epi16(pLo, pHi));
+    }
+
+    for (; x < count; x++)
+    {
+        unsigned a = coverage[x] + (coverage[x] >> 7);
+        unsigned char *p = pixels + x * 4;
+        for (unsigned c = 0; c < 4; c++)
+        {
+            unsigned value = (p[c] * BACKGROUND_KEEP) >> 8;
+            p[c] = static_cast<unsigned char>((value * (256 - a) + ((rgb >> (c * 8)) & 0xff) * a) >> 8);
+        }
+    }
+}
+
+} // End anon namespace
+
+//---------------------------------------------------------------
+// Rasterizes the font with the given cell height in pixels.
+// Returns false if the font couldn't be rendered.
+//---------------------------------------------------------------
+bool GlyphAtlas::Create(unsigned cellHeight, std::string &errText)
+{
+    m_cellWidth = 0;
+    m_cellHeight = 0;
+    m_coverage.clear();
+
+    HDC dc = CreateCompatibleDC(nullptr);
+    if (dc == nullptr)
+    {
+        errText = "CreateCompatibleDC failed.";
+        return false;
+    }
+
+    bool result = false;
+    HFONT font = CreateFontA(static_cast<int>(cellHeight), 0, 0, 0, FW_BOLD, FALSE, FALSE, FALSE,
+        DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY,
+        FIXED_PITCH | FF_MODERN, "Consolas");
+    if (font == nullptr)
+    {
+        errText = "CreateFont failed.";
+    }
+    else
+    {
+        HGDIOBJ oldFont = SelectObject(dc, font);
+        TEXTMETRICA metrics = {};
+        GetTextMetricsA(dc, &metrics);
+        unsigned cellWidth = static_cast<unsigned>(metrics.tmAveCharWidth);
+        unsigned height = static_cast<unsigned>(metrics.tmHeight);
+
+        // Draw every glyph side by side into a top-down 32-bit DIB,
+        // white on black.
+        BITMAPINFO bmi = {};
+        bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+        bmi.bmiHeader.biWidth = static_cast<LONG>(cellWidth * NUM_GLYPHS);
+        bmi.bmiHeader.biHeight = -static_cast<LONG>(height);
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 32;
+        bmi.bmiHeader.biCompression = BI_RGB;
+        void *bits = nullptr;
+        HBITMAP bitmap = (cellWidth > 0 && height > 0) ?
+            CreateDIBSection(dc, &bmi, DIB_RGB_COLORS, &bits, nullptr, 0) : nullptr;
+        if (bitmap == nullptr || bits == nullptr)
+        {
+            errText = "CreateDIBSection failed.";
+        }
+        else
+        {
+            HGDIOBJ oldBitmap = SelectObject(dc, bitmap);
+            SetTextColor(dc, RGB(255, 255, 255));
+            SetBkColor(dc, RGB(0, 0, 0));
+            SetBkMode(dc, OPAQUE);
+            for (unsigned i = 0; i < NUM_GLYPHS; i++)
+            {
+                char c = static_cast<char>(FIRST_GLYPH + i);
+                TextOutA(dc, static_cast<int>(i * cellWidth), 0, &c, 1);
+            }
+            GdiFlush();
+
+            // Keep one channel of each glyph's cell as its coverage.
+            m_cellWidth = cellWidth;
+            m_cellHeight = height;
+            m_coverage.resize(static_cast<size_t>(NUM_GLYPHS) * cellWidth * height);
+            const uint32_t *pixels = static_cast<const uint32_t *>(bits);
+            unsigned char *out = m_coverage.data();
+            for (unsigned i = 0; i < NUM_GLYPHS; i++)
+            {
+                for (unsigned y = 0; y < height; y++)
+                {
+                    const uint32_t *row = pixels + static_cast<size_t>(y) * cellWidth * NUM_GLYPHS + i * cellWidth;
+                    for (unsigned x = 0; x < cellWidth; x++)
+                        *out++ = static_cast<unsigned char>((row[x] >> 8) & 0xff);
+                }
+            }
+            result = true;
+
+            SelectObject(dc, oldBitmap);
+        }
+        if (bitmap != nullptr)
+            DeleteObject(bitmap);
+
+        SelectObject(dc, oldFont);
+        DeleteObject(font);
+    }
+
+    DeleteDC(dc);
+    return result;
+}
+
+//---------------------------------------------------------------
+// Returns the coverage mask of a character.
+//---------------------------------------------------------------
+const unsigned char *GlyphAtlas::GetGlyph(char c) const
+{
+    if (c < FIRST_GLYPH || c > LAST_GLYPH)
+        c = '?';
+    return m_coverage.data() + static_cast<size_t>(c - FIRST_GLYPH) * m_cellWidth * m_cellHeight;
+}
+
+//---------------------------------------------------------------
+// Prepares to draw text with the given cell height in pixels.
+// Returns false if the font couldn't be rendered.
+//---------------------------------------------------------------
+bool TextOverlay::Create(unsigned textHeight, std::string &errText)
+{
+    m_text.clear();
+    m_mask.clear();
+    return m_atlas.Create(textHeight, errText);
+}
+
+//---------------------------------------------------------------
+// Draws a line of text with its top left corner at (x, y),
+// clipped to the frame.
+//---------------------------------------------------------------
+void TextOverlay::Draw(const std::string &text, unsigned char *pixels,
+    unsigned width, unsigned height, unsigned stride, unsigned x, unsigned y)
+{
+    const unsigned cellWidth = m_atlas.GetCellWidth();
+    const unsigned cellHeight = m_atlas.GetCellHeight();
+    if (cellWidth == 0 || text.empty())
+        return;
+
+    // Start over if the length changed; NUL never matches a
+    // character, so every cell gets drawn.
+    const unsigned maskWidth = GetBoxWidth(text.size());
+    if (text.size() != m_text.size())
+    {
+        m_text.assign(text.size(), '\0');
+        m_mask.assign(static_cast<size_t>(maskWidth) * cellHeight, 0);
+    }
+
+    // Copy in only the glyphs of characters that changed.
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == m_text[i])
+            continue;
+        const unsigned char *glyph = m_atlas.GetGlyph(text[i]);
+        unsigned char *cell = m_mask.data() + i * cellWidth;
+        for (unsigned row = 0; row < cellHeight; row++)
+            memcpy(cell + static_cast<size_t>(row) * maskWidth, glyph + row * cellWidth, cellWidth);
+        m_text[i] = text[i];
+    }
+
+    if (x >= width || y >= height)
+        return;
+    unsigned drawWidth = __min(maskWidth, width - x);
+    unsigned drawHeight = __min(cellHeight, height - y);
+    for (unsigned row = 0; row < drawHeight; row++)
+    {
+        BlendRow(pixels + static_cast<size_t>(stride) * (y + row) + x * 4,
+            m_mask.data() + static_cast<size_t>(row) * maskWidth, drawWidth, m_color);
+    }
+}
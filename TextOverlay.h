@@ -0,0 +1,120 @@
+//--------------------------------------------------------------------
+// TextOverlay.h
+// A C++ module that burns text, such as a timestamp, into 32-bit
+// BGRA frames.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Call Create() once with the desired text
+//   height, then call Draw() on each frame.
+//
+// * Create() rasterizes the printable ASCII characters of a fixed
+//   pitch font (with GDI, anti-aliased) into a GlyphAtlas of
+//   8-bit coverage masks, one fixed-size cell per character.  No
+//   font rendering happens per frame.
+//
+// * Draw() keeps a coverage mask of the whole string and copies
+//   glyphs into it only for the characters that differ from the
+//   previous call; for a running timestamp that is usually just
+//   the last few digits.  The mask is then alpha blended onto the
+//   frame with SSE2, over a darkened box so the text stays
+//   readable on bright scenes.
+//
+// * A TextOverlay remembers the last string drawn, so each thread
+//   (or camera) drawing its own text needs its own object.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//---------------------------------------------------------------
+// Pre-rasterized coverage masks of the printable ASCII
+// characters of a fixed pitch font.
+//---------------------------------------------------------------
+class GlyphAtlas
+{
+public:
+    // Rasterizes the font with the given cell height in pixels.
+    // Returns false if the font couldn't be rendered.
+    bool Create(unsigned cellHeight, std::string &errText);
+
+    unsigned GetCellWidth() const { return m_cellWidth; }
+    unsigned GetCellHeight() const { return m_cellHeight; }
+
+    // Returns the coverage mask (GetCellWidth() x GetCellHeight()
+    // bytes, 0 to 255) of a character.  Characters outside the
+    // printable ASCII range are drawn as '?'.
+    const unsigned char *GetGlyph(char c) const;
+
+private:
+    unsigned m_cellWidth = 0;
+    unsigned m_cellHeight = 0;
+    std::vector<unsigned char> m_coverage;  // Masks of ' ' through '~', one after another.
+};
+
+//---------------------------------------------------------------
+// A C++ class that burns a line of text into BGRA frames.
+//---------------------------------------------------------------
+class TextOverlay
+{
+public:
+    // Prepares to draw text with the given cell height in pixels.
+    // Returns false if the font couldn't be rendered.
+    bool Create(unsigned textHeight, std::string &errText);
+
+    // Sets the text color, as 0x00RRGGBB.  The default is white.
+    void SetColor(uint32_t rgb) { m_color = rgb; }
+
+    // Returns the size of the box Draw() covers for a string of
+    // the given length.
+    unsigned GetBoxWidth(size_t length) const { return static_cast<unsigned>(length) * m_atlas.GetCellWidth(); }
+    unsigned GetBoxHeight() const { return m_atlas.GetCellHeight(); }
+
+    // Draws a line of text with its top left corner at (x, y).
+    // The text is clipped to the frame.
+    void Draw(const std::string &text, unsigned char *pixels,
+        unsigned width, unsigned height, unsigned stride, unsigned x, unsigned y);
+
+private:
+    GlyphAtlas m_atlas;                 // Glyphs of the font.
+    uint32_t m_color = 0xffffff;        // Text color.
+    std::string m_text;                 // String currently in m_mask.
+    std::vector<unsigned char> m_mask;  // Coverage of m_text, one row of cells.
+};
+
@@ -39,18 +39,82 @@
 //--------------------------------------------------------------------
 
 #include "CameraFrameGrabber.h"
+#include "CaptureSession.h"
+#include "FrameShare.h"
+#include "Stabilizer.h"
+#include "TemporalFilter.h"
 #include <stdlib.h>
 #include <stdio.h>
-#include <conio.h>
 #include <windows.h>
+#include <chrono>
+#include <string>
 
-struct Settings
+// Set by the console control handler when Ctrl+C or Ctrl+Break is
+// pressed or the console is closing (manual-reset events).
+static HANDLE s_interruptEvent = nullptr;
+
+// Set by main() once the session has finished, so the control
+// handler can let the process end.
+static HANDLE s_exitEvent = nullptr;
+
+// Which control event set s_interruptEvent.
+static volatile LONG s_ctrlType = -1;
+
+//---------------------------------------------------------------
+// Runs on a thread of its own when a console control event
+// arrives.  The first Ctrl+C or Ctrl+Break stops the capture
+// gracefully; a second one ends the process right away.  When the
+// console is closing or the user is logging off, the process ends
+// as soon as this returns, so it holds on until main() has
+// finished (Windows allows a few seconds).
+//---------------------------------------------------------------
+static BOOL WINAPI ConsoleCtrlHandler(DWORD ctrlType)
+{
+    const bool first = InterlockedCompareExchange(&s_ctrlType, static_cast<LONG>(ctrlType), -1) == -1;
+    switch (ctrlType)
+    {
+        case CTRL_C_EVENT:
+        case CTRL_BREAK_EVENT:
+            if (!first)
+                return FALSE;
+            SetEvent(s_interruptEvent);
+            return TRUE;
+
+        case CTRL_CLOSE_EVENT:
+        case CTRL_LOGOFF_EVENT:
+        case CTRL_SHUTDOWN_EVENT:
+            SetEvent(s_interruptEvent);
+            WaitForSingleObject(s_exitEvent, INFINITE);
+            return TRUE;
+    }
+    return FALSE;
+}
+
+//---------------------------------------------------------------
+// Reads every pending console input event.  Returns true if the
+// ESC key was pressed.
+//---------------------------------------------------------------
+static bool ReadEscapeKey(HANDLE input)
 {
-    unsigned m_deviceIndex = 0;       // Which capture device to grab frames from.
-    unsigned m_formatIndex = 0;       // Which of the capture device's available formats to use.
-    unsigned m_numFramesToGrab = 10;
-    unsigned m_secondsBetweenFrames = 1;
-};
+    bool escape = false;
+    DWORD count = 0;
+    while (GetNumberOfConsoleInputEvents(input, &count) && count > 0)
+    {
+        INPUT_RECORD records[16];
+        DWORD read = 0;
+        if (!ReadConsoleInputA(input, records, _countof(records), &read) || read == 0)
+            break;
+        for (DWORD i = 0; i < read; i++)
+        {
+            if (records[i].EventType == KEY_EVENT && records[i].Event.KeyEvent.bKeyDown &&
+                records[i].Event.KeyEvent.wVirtualKeyCode == VK_ESCAPE)
+            {
+                escape = true;
+            }
+        }
+    }
+    return escape;
+}
 
 //---------------------------------------------------------------
 // Gets the list of available capture devices and prints it to
@@ -104,151 +168,74 @@ static void ShowCaptureFormatsForDevice(unsigned deviceIndex)
 }
 
 //---------------------------------------------------------------
-// Writes a 24-bit BGR or 32-bit BGRA image from memory to a
-// Microsoft .BMP file on disk.  Returns true if successful.
+// Parses a comma-separated list of positive numbers, such as
+// "1,3,5", into 'numbers'.  Returns false if any entry is not a
+// positive number.
 //---------------------------------------------------------------
-static bool BmpWrite(const char *szPath, unsigned width, unsigned height,
-    unsigned stride, unsigned bitsPerPixel, const void *pBits)
+static bool ParseNumberList(const char *str, std::vector<unsigned> &numbers)
 {
-    // Check for bogus arguments.
-    if (szPath == nullptr || szPath[0] == '\0' || width < 1 || height < 1 ||
-        stride < width * 3 || (bitsPerPixel != 24 && bitsPerPixel != 32) ||
-        pBits == nullptr)
+    numbers.clear();
+    do
     {
-        return false;
-    }
-
-    // Open the output file.
-    FILE *fp = nullptr;
-    if (fopen_s(&fp, szPath, "wb") || fp == nullptr)
-    {
-        // Failed opening output file!
-        return false;
-    }
-
-    unsigned outStride = width * bitsPerPixel / 8;
-    while (outStride % 4)
-        outStride++;
-
-    // Build BITMAPINFOHEADER to write to file.
-    BITMAPINFOHEADER stInfoHdr = {0};
-    stInfoHdr.biSize = sizeof(stInfoHdr);
-    stInfoHdr.biBitCount = bitsPerPixel;
-    stInfoHdr.biWidth = width;
-    stInfoHdr.biHeight = height;
-    stInfoHdr.biPlanes = 1;
-    stInfoHdr.biSizeImage = outStride * height;
-
-    // Build BITMAPFILEHEADER structure.
-    BITMAPFILEHEADER stFileHdr;
-    memset(&stFileHdr, 0, sizeof(stFileHdr));
-    stFileHdr.bfType = (WORD)'B' + 256 * (WORD)'M';
-    stFileHdr.bfSize = sizeof(BITMAPFILEHEADER) + stInfoHdr.biSize + stInfoHdr.biSizeImage;
-    stFileHdr.bfOffBits = sizeof(BITMAPFILEHEADER) + stInfoHdr.biSize;
-
-    // Write the BITMAPFILEHEADER to the output file.
-    if (fwrite(&stFileHdr, sizeof(stFileHdr), 1, fp) != 1)
-    {
-        // Write to output file failed!
-        fclose(fp);
-        _unlink(szPath);
-        return false;
-    }
-
-    // Write the BITMAPINFOHEADER to the output file.
-    if (fwrite(&stInfoHdr, stInfoHdr.biSize, 1, fp) != 1)
-    {
-        // Write to output file failed!
-        fclose(fp);
-        _unlink(szPath);
-        return false;
-    }
-
-    // Write the bitmap bits one scanline at a time.
-    const unsigned char *scanline = static_cast<const unsigned char *>(pBits) + stride * (height - 1);
-    for (unsigned y = 0; y < height; y++)
-    {
-        if (fwrite(scanline, outStride, 1, fp) != 1)
-        {
-            // Write to output file failed!
-            fclose(fp);
-            _unlink(szPath);
+        char *end = nullptr;
+        long value = strtol(str, &end, 10);
+        if (end == str || value < 1 || (*end != ',' && *end != '\0'))
             return false;
-        }
-
-        scanline -= stride;
-    }
+        numbers.push_back(static_cast<unsigned>(value));
+        str = (*end == ',') ? end + 1 : end;
+    } while (*str != '\0');
 
-    fclose(fp);
     return true;
 }
 
 //---------------------------------------------------------------
-// Captures a series of images from the specified capture device.
-// The captured images are written to Microsoft .BMP files, with
-// the filename template "frameXXXX.bmp", in the current working
-// directory.
-//
-// The deviceIndex and formatIndex parameters are 0-based, not
-// 1-based.
-//
-// Returns true if successful.
+// Parses a comma-separated list of clockwise rotations in degrees
+// (0, 90, 180, or 270), such as "180,90".  Returns false if any
+// entry is not a valid rotation.
 //---------------------------------------------------------------
-static bool DoTimeLapseCapture(Settings &settings)
+static bool ParseRotationList(const char *str, std::vector<unsigned> &rotations)
 {
-    printf("Opening capture device %u in capture format %u.\n",
-        settings.m_deviceIndex + 1, settings.m_formatIndex);
-    CameraFrameGrabber cam;
-    if (!cam.Open(settings.m_deviceIndex, settings.m_formatIndex))
+    rotations.clear();
+    do
     {
-        printf("Failed opening capture device!\n");
-        return false;
-    }
-
-    printf("Capture device opened.\n");
-    fflush(stdout);
+        char *end = nullptr;
+        long value = strtol(str, &end, 10);
+        if (end == str || value < 0 || value > 270 || value % 90 != 0 || (*end != ',' && *end != '\0'))
+            return false;
+        rotations.push_back(static_cast<unsigned>(value));
+        str = (*end == ',') ? end + 1 : end;
+    } while (*str != '\0');
 
-    std::vector<unsigned char> frame(cam.GetStride() * cam.GetHeight());
+    return true;
+}
 
-    for (unsigned iframe = 0; iframe < settings.m_numFramesToGrab; iframe++)
+//---------------------------------------------------------------
+// Parses a comma-separated list of mirrorings ("none", "h", "v",
+// or "hv"), such as "h,none".  Each entry is stored as a pair of
+// flags:  bit 0 for horizontal, bit 1 for vertical.  Returns false
+// if any entry is not valid.
+//---------------------------------------------------------------
+static bool ParseFlipList(const char *str, std::vector<unsigned> &flips)
+{
+    flips.clear();
+    std::string remaining(str);
+    do
     {
-        if (_kbhit() && _getch() == 27)
-        {
-            printf("ESC pressed.  Aborted by user.\n");
-            break;
-        }
-
-        std::string errText;
-        if (!cam.GrabFrame(frame.data(), frame.size(), errText))
-        {
-            printf("Failed capturing frame!\n");
-            printf("  Error Text:  %s\n", errText.c_str());
-            continue;
-        }
-
-        // Write the captured frame to a .BMP file.
-        try
-        {
-            char filename[MAX_PATH] = {0};
-            sprintf_s(filename, _countof(filename), "frame%04u.bmp", iframe);
-            printf("Writing frame to \"%s\"\n", filename);
-
-            BmpWrite(filename, cam.GetWidth(), cam.GetHeight(),
-                cam.GetStride(), 32, frame.data());
-        }
-        catch(...)
-        {
-            printf("Failed writing captured image to BMP file!\n");
+        size_t comma = remaining.find(',');
+        std::string entry = remaining.substr(0, comma);
+        remaining = (comma == std::string::npos) ? std::string() : remaining.substr(comma + 1);
+        if (_stricmp(entry.c_str(), "none") == 0)
+            flips.push_back(0);
+        else if (_stricmp(entry.c_str(), "h") == 0)
+            flips.push_back(1);
+        else if (_stricmp(entry.c_str(), "v") == 0)
+            flips.push_back(2);
+        else if (_stricmp(entry.c_str(), "hv") == 0 || _stricmp(entry.c_str(), "vh") == 0)
+            flips.push_back(3);
+        else
             return false;
-        }
-
-        Sleep(settings.m_secondsBetweenFrames * 1000);
-    }
-
-    printf("Closing capture device %u.\n", settings.m_deviceIndex + 1);
-    cam.Close();
+    } while (!remaining.empty());
 
-    printf("Capture session done.\n");
     return true;
 }
 
@@ -256,12 +243,63 @@ static bool DoTimeLapseCapture(Settings &settings)
 // Parses the program's command line arguments, placing the
 // parameter values into 'settings'.  Returns false if error.
 //---------------------------------------------------------------
-static bool ParseArguments(int argc, char **argv, Settings &settings)
+static bool ParseArguments(int argc, char **argv, CaptureSettings &settings)
 {
     const char *str_device = "device=";
     const char *str_format = "format=";
     const char *str_delay  = "delay=";
     const char *str_frames = "frames=";
+    const char *str_stack  = "stack=";
+    const char *str_stackmode = "stackmode=";
+    const char *str_lighten = "lighten=";
+    const char *str_average = "average=";
+    const char *str_snapshot = "snapshot=";
+    const char *str_warmup = "warmup=";
+    const char *str_retries = "retries=";
+    const char *str_powersave = "powersave=";
+    const char *str_lead = "lead=";
+    const char *str_grabthreads = "grabthreads=";
+    const char *str_convthreads = "convthreads=";
+    const char *str_writethreads = "writethreads=";
+    const char *str_scalethreads = "scalethreads=";
+    const char *str_flush = "flush=";
+    const char *str_sync = "sync=";
+    const char *str_output = "output=";
+    const char *str_syncring = "syncring=";
+    const char *str_synclag = "synclag=";
+    const char *str_stamp = "stamp=";
+    const char *str_stamplabel = "stamplabel=";
+    const char *str_stampsize = "stampsize=";
+    const char *str_preview = "preview=";
+    const char *str_previewrendition = "previewrendition=";
+    const char *str_share = "share=";
+    const char *str_shareslots = "shareslots=";
+    const char *str_control = "control=";
+    const char *str_drain = "drain=";
+    const char *str_log = "log=";
+    const char *str_loglevel = "loglevel=";
+    const char *str_flatfield = "flatfield=";
+    const char *str_flatgrid = "flatgrid=";
+    const char *str_denoise = "denoise=";
+    const char *str_denoisethreshold = "denoisethreshold=";
+    const char *str_denoisedomain = "denoisedomain=";
+    const char *str_autolevels = "autolevels=";
+    const char *str_autowb = "autowb=";
+    const char *str_autosmooth = "autosmooth=";
+    const char *str_lens = "lens=";
+    const char *str_homography = "homography=";
+    const char *str_remap = "remap=";
+    const char *str_remapthreads = "remapthreads=";
+    const char *str_stabilize = "stabilize=";
+    const char *str_stabsmooth = "stabsmooth=";
+    const char *str_lut = "lut=";
+    const char *str_lutthreads = "lutthreads=";
+    const char *str_mask = "mask=";
+    const char *str_maskfill = "maskfill=";
+    const char *str_rotate = "rotate=";
+    const char *str_flip = "flip=";
+    std::vector<unsigned> rotations;
+    std::vector<unsigned> flips;
 
     for (int iarg = 1; iarg < argc; iarg++)
     {
@@ -271,26 +309,23 @@ static bool ParseArguments(int argc, char **argv, Settings &settings)
 
         if (_strnicmp(arg, str_device, strlen(str_device)) == 0)
         {
-            settings.m_deviceIndex = atoi(&arg[strlen(str_device)]);
-            if (settings.m_deviceIndex < 1)
+            if (!ParseNumberList(&arg[strlen(str_device)], settings.m_deviceIndices))
             {
-                printf("\"%s\" is not a valid capture device index.\n", arg);
+                printf("\"%s\" is not a valid capture device index list.\n", arg);
                 return false;
             }
         }
         else if (_strnicmp(arg, str_format, strlen(str_format)) == 0)
         {
-            settings.m_formatIndex = atoi(&arg[strlen(str_format)]);
-            if (settings.m_formatIndex < 1)
+            if (!ParseNumberList(&arg[strlen(str_format)], settings.m_formatIndices))
             {
-                printf("\"%s\" is not a valid format index.\n", arg);
+                printf("\"%s\" is not a valid format index list.\n", arg);
                 return false;
             }
         }
         else if (_strnicmp(arg, str_delay, strlen(str_delay)) == 0)
         {
-            settings.m_secondsBetweenFrames = atoi(&arg[strlen(str_delay)]);
-            if (settings.m_secondsBetweenFrames < 1)
+            if (!ParseNumberList(&arg[strlen(str_delay)], settings.m_secondsBetweenFrames))
             {
                 printf("\"%s\" is not a valid number of seconds.\n", arg);
                 return false;
@@ -305,6 +340,433 @@ static bool ParseArguments(int argc, char **argv, Settings &settings)
                 return false;
             }
         }
+        else if (_strnicmp(arg, str_stackmode, strlen(str_stackmode)) == 0)
+        {
+            const char *mode = &arg[strlen(str_stackmode)];
+            if (_stricmp(mode, "mean") == 0)
+                settings.m_stackMode = SM_MEAN;
+            else if (_stricmp(mode, "median") == 0)
+                settings.m_stackMode = SM_MEDIAN;
+            else if (_stricmp(mode, "sigma") == 0)
+                settings.m_stackMode = SM_SIGMA_CLIP;
+            else
+            {
+                printf("\"%s\" is not a valid stacking mode.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_stack, strlen(str_stack)) == 0)
+        {
+            settings.m_stackCount = atoi(&arg[strlen(str_stack)]);
+            if (settings.m_stackCount < 1 || settings.m_stackCount > FrameStacker::MaxMeanFrames)
+            {
+                printf("\"%s\" is not a valid number of frames to stack.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_lighten, strlen(str_lighten)) == 0)
+        {
+            settings.m_lightenPath = &arg[strlen(str_lighten)];
+            if (settings.m_lightenPath.empty())
+            {
+                printf("\"%s\" is not a valid filename.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_average, strlen(str_average)) == 0)
+        {
+            settings.m_averagePath = &arg[strlen(str_average)];
+            if (settings.m_averagePath.empty())
+            {
+                printf("\"%s\" is not a valid filename.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_snapshot, strlen(str_snapshot)) == 0)
+        {
+            settings.m_snapshotInterval = atoi(&arg[strlen(str_snapshot)]);
+            if (settings.m_snapshotInterval < 1)
+            {
+                printf("\"%s\" is not a valid number of frames.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_warmup, strlen(str_warmup)) == 0)
+        {
+            int warmUpFrames = atoi(&arg[strlen(str_warmup)]);
+            if (warmUpFrames < 0)
+            {
+                printf("\"%s\" is not a valid number of frames.\n", arg);
+                return false;
+            }
+            settings.m_warmUpFrames = warmUpFrames;
+        }
+        else if (_strnicmp(arg, str_retries, strlen(str_retries)) == 0)
+        {
+            int retries = atoi(&arg[strlen(str_retries)]);
+            if (retries < 0)
+            {
+                printf("\"%s\" is not a valid number of retries.\n", arg);
+                return false;
+            }
+            settings.m_grabRetries = retries;
+        }
+        else if (_strnicmp(arg, str_powersave, strlen(str_powersave)) == 0)
+        {
+            settings.m_powerSave = atoi(&arg[strlen(str_powersave)]) != 0;
+        }
+        else if (_strnicmp(arg, str_lead, strlen(str_lead)) == 0)
+        {
+            settings.m_resumeLeadSeconds = atoi(&arg[strlen(str_lead)]);
+            if (settings.m_resumeLeadSeconds < 1)
+            {
+                printf("\"%s\" is not a valid number of seconds.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_grabthreads, strlen(str_grabthreads)) == 0)
+        {
+            int threads = atoi(&arg[strlen(str_grabthreads)]);
+            if (threads < 0)
+            {
+                printf("\"%s\" is not a valid number of threads.\n", arg);
+                return false;
+            }
+            settings.m_grabThreads = threads;
+        }
+        else if (_strnicmp(arg, str_convthreads, strlen(str_convthreads)) == 0)
+        {
+            int threads = atoi(&arg[strlen(str_convthreads)]);
+            if (threads < 0)
+            {
+                printf("\"%s\" is not a valid number of threads.\n", arg);
+                return false;
+            }
+            settings.m_convertThreads = threads;
+        }
+        else if (_strnicmp(arg, str_writethreads, strlen(str_writethreads)) == 0)
+        {
+            settings.m_writeThreads = atoi(&arg[strlen(str_writethreads)]);
+            if (settings.m_writeThreads < 1)
+            {
+                printf("\"%s\" is not a valid number of threads.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_scalethreads, strlen(str_scalethreads)) == 0)
+        {
+            settings.m_scaleThreads = atoi(&arg[strlen(str_scalethreads)]);
+            if (settings.m_scaleThreads < 1)
+            {
+                printf("\"%s\" is not a valid number of threads.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_flush, strlen(str_flush)) == 0)
+        {
+            settings.m_flushWrites = atoi(&arg[strlen(str_flush)]) != 0;
+        }
+        else if (_strnicmp(arg, str_output, strlen(str_output)) == 0)
+        {
+            RenditionSpec spec;
+            std::string errText;
+            if (!ParseRenditionSpec(&arg[strlen(str_output)], spec, errText))
+            {
+                printf("\"%s\" is not a valid output:  %s\n", arg, errText.c_str());
+                return false;
+            }
+            settings.m_renditions.push_back(spec);
+        }
+        else if (_strnicmp(arg, str_syncring, strlen(str_syncring)) == 0)
+        {
+            settings.m_syncRingFrames = atoi(&arg[strlen(str_syncring)]);
+            if (settings.m_syncRingFrames < 1)
+            {
+                printf("\"%s\" is not a valid number of frames.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_synclag, strlen(str_synclag)) == 0)
+        {
+            int lag = atoi(&arg[strlen(str_synclag)]);
+            if (lag < 0)
+            {
+                printf("\"%s\" is not a valid number of milliseconds.\n", arg);
+                return false;
+            }
+            settings.m_syncLagMs = lag;
+        }
+        else if (_strnicmp(arg, str_sync, strlen(str_sync)) == 0)
+        {
+            settings.m_syncMode = atoi(&arg[strlen(str_sync)]) != 0;
+        }
+        else if (_strnicmp(arg, str_stamp, strlen(str_stamp)) == 0)
+        {
+            settings.m_stamp = atoi(&arg[strlen(str_stamp)]) != 0;
+        }
+        else if (_strnicmp(arg, str_stamplabel, strlen(str_stamplabel)) == 0)
+        {
+            settings.m_stampLabel = &arg[strlen(str_stamplabel)];
+            settings.m_stamp = true;
+        }
+        else if (_strnicmp(arg, str_stampsize, strlen(str_stampsize)) == 0)
+        {
+            int size = atoi(&arg[strlen(str_stampsize)]);
+            if (size < 6 || size > 500)
+            {
+                printf("\"%s\" is not a valid text height.\n", arg);
+                return false;
+            }
+            settings.m_stampHeight = size;
+        }
+        else if (_strnicmp(arg, str_preview, strlen(str_preview)) == 0)
+        {
+            int port = atoi(&arg[strlen(str_preview)]);
+            if (port < 1 || port > 65535)
+            {
+                printf("\"%s\" is not a valid port.\n", arg);
+                return false;
+            }
+            settings.m_previewPort = port;
+        }
+        else if (_strnicmp(arg, str_previewrendition, strlen(str_previewrendition)) == 0)
+        {
+            settings.m_previewRendition = &arg[strlen(str_previewrendition)];
+        }
+        else if (_strnicmp(arg, str_share, strlen(str_share)) == 0)
+        {
+            settings.m_shareName = &arg[strlen(str_share)];
+        }
+        else if (_strnicmp(arg, str_shareslots, strlen(str_shareslots)) == 0)
+        {
+            int slots = atoi(&arg[strlen(str_shareslots)]);
+            if (slots < 2 || slots > static_cast<int>(FrameShareWriter::MaxSlots))
+            {
+                printf("\"%s\" is not a valid slot count (2 to %u).\n", arg, FrameShareWriter::MaxSlots);
+                return false;
+            }
+            settings.m_shareSlots = slots;
+        }
+        else if (_strnicmp(arg, str_control, strlen(str_control)) == 0)
+        {
+            settings.m_controlPath = &arg[strlen(str_control)];
+        }
+        else if (_strnicmp(arg, str_drain, strlen(str_drain)) == 0)
+        {
+            int seconds = atoi(&arg[strlen(str_drain)]);
+            if (seconds < 0)
+            {
+                printf("\"%s\" is not a valid number of seconds.\n", arg);
+                return false;
+            }
+            settings.m_drainSeconds = seconds;
+        }
+        else if (_strnicmp(arg, str_log, strlen(str_log)) == 0)
+        {
+            settings.m_logPath = &arg[strlen(str_log)];
+        }
+        else if (_strnicmp(arg, str_loglevel, strlen(str_loglevel)) == 0)
+        {
+            const char *level = &arg[strlen(str_loglevel)];
+            if (_stricmp(level, "debug") == 0)
+                settings.m_logLevel = LL_DEBUG;
+            else if (_stricmp(level, "info") == 0)
+                settings.m_logLevel = LL_INFO;
+            else if (_stricmp(level, "warning") == 0)
+                settings.m_logLevel = LL_WARNING;
+            else if (_stricmp(level, "error") == 0)
+                settings.m_logLevel = LL_ERROR;
+            else
+            {
+                printf("\"%s\" is not a valid log level.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_flatfield, strlen(str_flatfield)) == 0)
+        {
+            settings.m_flatFieldPath = &arg[strlen(str_flatfield)];
+        }
+        else if (_strnicmp(arg, str_flatgrid, strlen(str_flatgrid)) == 0)
+        {
+            settings.m_flatFieldGrid = atoi(&arg[strlen(str_flatgrid)]);
+            if (settings.m_flatFieldGrid == 1 || settings.m_flatFieldGrid > 1024)
+            {
+                printf("\"%s\" is not a valid grid spacing (0 or 2 to 1024).\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_denoise, strlen(str_denoise)) == 0)
+        {
+            settings.m_denoiseStrength = atoi(&arg[strlen(str_denoise)]);
+            if (settings.m_denoiseStrength == 1 || settings.m_denoiseStrength > TemporalFilter::MaxStrength)
+            {
+                printf("\"%s\" is not a valid denoise strength (0 or 2 to %u).\n", arg, TemporalFilter::MaxStrength);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_denoisethreshold, strlen(str_denoisethreshold)) == 0)
+        {
+            settings.m_denoiseThreshold = atoi(&arg[strlen(str_denoisethreshold)]);
+            if (settings.m_denoiseThreshold > 255)
+            {
+                printf("\"%s\" is not a valid denoise threshold.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_denoisedomain, strlen(str_denoisedomain)) == 0)
+        {
+            const char *domain = &arg[strlen(str_denoisedomain)];
+            if (_stricmp(domain, "native") == 0)
+                settings.m_denoiseNative = true;
+            else if (_stricmp(domain, "bgra") == 0)
+                settings.m_denoiseNative = false;
+            else
+            {
+                printf("\"%s\" is not a valid denoise domain.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_autolevels, strlen(str_autolevels)) == 0)
+        {
+            settings.m_autoLevels = atoi(&arg[strlen(str_autolevels)]) != 0;
+        }
+        else if (_strnicmp(arg, str_autowb, strlen(str_autowb)) == 0)
+        {
+            settings.m_autoWhiteBalance = atoi(&arg[strlen(str_autowb)]) != 0;
+        }
+        else if (_strnicmp(arg, str_autosmooth, strlen(str_autosmooth)) == 0)
+        {
+            settings.m_autoColorSmoothing = atof(&arg[strlen(str_autosmooth)]);
+            if (!(settings.m_autoColorSmoothing >= 0.0 && settings.m_autoColorSmoothing <= 0.99))
+            {
+                printf("\"%s\" is not a valid smoothing (0 to 0.99).\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_lens, strlen(str_lens)) == 0)
+        {
+            LensModel lens;
+            std::string errText;
+            if (!ParseLensModel(&arg[strlen(str_lens)], lens, errText))
+            {
+                printf("\"%s\" is not a valid lens model:  %s\n", arg, errText.c_str());
+                return false;
+            }
+            settings.m_lensModels.push_back(lens);
+        }
+        else if (_strnicmp(arg, str_homography, strlen(str_homography)) == 0)
+        {
+            Homography homography;
+            std::string errText;
+            if (!ParseHomography(&arg[strlen(str_homography)], homography, errText))
+            {
+                printf("\"%s\" is not a valid homography:  %s\n", arg, errText.c_str());
+                return false;
+            }
+            settings.m_homographies.push_back(homography);
+        }
+        else if (_strnicmp(arg, str_remap, strlen(str_remap)) == 0)
+        {
+            if (!ParseRemapFilter(&arg[strlen(str_remap)], settings.m_remapFilter))
+            {
+                printf("\"%s\" is not a valid remap filter.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_remapthreads, strlen(str_remapthreads)) == 0)
+        {
+            settings.m_remapThreads = atoi(&arg[strlen(str_remapthreads)]);
+            if (settings.m_remapThreads < 1)
+            {
+                printf("\"%s\" is not a valid number of threads.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_stabilize, strlen(str_stabilize)) == 0)
+        {
+            settings.m_stabilizeMargin = atoi(&arg[strlen(str_stabilize)]);
+            if (settings.m_stabilizeMargin > Stabilizer::MaxMargin)
+            {
+                printf("\"%s\" is not a valid crop margin (0 to %u percent).\n", arg, Stabilizer::MaxMargin);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_stabsmooth, strlen(str_stabsmooth)) == 0)
+        {
+            settings.m_stabilizeSmoothing = atof(&arg[strlen(str_stabsmooth)]);
+            if (!(settings.m_stabilizeSmoothing >= 0.0 && settings.m_stabilizeSmoothing <= 0.99))
+            {
+                printf("\"%s\" is not a valid smoothing (0 to 0.99).\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_lut, strlen(str_lut)) == 0)
+        {
+            settings.m_lutPath = &arg[strlen(str_lut)];
+        }
+        else if (_strnicmp(arg, str_lutthreads, strlen(str_lutthreads)) == 0)
+        {
+            settings.m_lutThreads = atoi(&arg[strlen(str_lutthreads)]);
+            if (settings.m_lutThreads < 1)
+            {
+                printf("\"%s\" is not a valid number of threads.\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_mask, strlen(str_mask)) == 0)
+        {
+            PrivacyRegion region;
+            std::string errText;
+            if (!ParsePrivacyRegion(&arg[strlen(str_mask)], region, errText))
+            {
+                printf("\"%s\" is not a valid privacy mask:  %s\n", arg, errText.c_str());
+                return false;
+            }
+            settings.m_privacyRegions.push_back(region);
+        }
+        else if (_strnicmp(arg, str_maskfill, strlen(str_maskfill)) == 0)
+        {
+            const char *fill = &arg[strlen(str_maskfill)];
+            char *end = nullptr;
+            if (_strnicmp(fill, "pixelate", 8) == 0)
+            {
+                settings.m_maskPixelateSize = 16;
+                if (fill[8] == ':')
+                    settings.m_maskPixelateSize = strtoul(&fill[9], &end, 10);
+                if ((fill[8] != ':' && fill[8] != '\0') || (end != nullptr && *end != '\0') ||
+                    settings.m_maskPixelateSize < 2)
+                {
+                    printf("\"%s\" is not a valid pixelation block size.\n", arg);
+                    return false;
+                }
+            }
+            else
+            {
+                settings.m_maskColor = strtoul(fill, &end, 16);
+                if (end == fill || *end != '\0' || settings.m_maskColor > 0xffffff)
+                {
+                    printf("\"%s\" is not a valid mask color (RRGGBB or pixelate[:N]).\n", arg);
+                    return false;
+                }
+                settings.m_maskPixelateSize = 0;
+            }
+        }
+        else if (_strnicmp(arg, str_rotate, strlen(str_rotate)) == 0)
+        {
+            if (!ParseRotationList(&arg[strlen(str_rotate)], rotations))
+            {
+                printf("\"%s\" is not a valid rotation list (0, 90, 180, or 270).\n", arg);
+                return false;
+            }
+        }
+        else if (_strnicmp(arg, str_flip, strlen(str_flip)) == 0)
+        {
+            if (!ParseFlipList(&arg[strlen(str_flip)], flips))
+            {
+                printf("\"%s\" is not a valid flip list (none, h, v, or hv).\n", arg);
+                return false;
+            }
+        }
         else
         {
             printf("Unrecognized argument:  \"%s\"\n", arg);
@@ -312,6 +774,27 @@ static bool ParseArguments(int argc, char **argv, Settings &settings)
         }
     }
 
+    // Combine the rotations and flips into one orientation per
+    // camera (or one for all of them).
+    if (rotations.size() > 1 && flips.size() > 1 && rotations.size() != flips.size())
+    {
+        printf("The rotate and flip lists must have the same number of entries!\n");
+        return false;
+    }
+    settings.m_orientations.resize(__max(rotations.size(), flips.size()));
+    for (size_t i = 0; i < settings.m_orientations.size(); i++)
+    {
+        FrameOrientation &orientation = settings.m_orientations[i];
+        if (!rotations.empty())
+            orientation.m_rotation = rotations[__min(i, rotations.size() - 1)];
+        if (!flips.empty())
+        {
+            unsigned flip = flips[__min(i, flips.size() - 1)];
+            orientation.m_flipHorizontal = (flip & 1) != 0;
+            orientation.m_flipVertical = (flip & 2) != 0;
+        }
+    }
+
     return true;
 }
 
@@ -320,15 +803,153 @@ static bool ParseArguments(int argc, char **argv, Settings &settings)
 //---------------------------------------------------------------
 static void PrintUsage()
 {
-    printf("Usage:  TimeLapse device=x format=x [frames=x] [delay=x]\n");
+    printf("Usage:  TimeLapse device=x format=x [frames=x] [delay=x] [stack=x]\n");
+    printf("                  [stackmode=x] [lighten=x] [average=x] [snapshot=x]\n");
+    printf("                  [warmup=x] [retries=x] [powersave=x] [lead=x]\n");
+    printf("                  [grabthreads=x] [convthreads=x] [writethreads=x]\n");
+    printf("                  [scalethreads=x] [flush=x] [sync=x] [syncring=x]\n");
+    printf("                  [synclag=x] [rotate=x] [flip=x] [stamp=x]\n");
+    printf("                  [stamplabel=x] [stampsize=x] [mask=x ...]\n");
+    printf("                  [maskfill=x] [flatfield=x] [flatgrid=x]\n");
+    printf("                  [denoise=x] [denoisethreshold=x]\n");
+    printf("                  [denoisedomain=x] [autolevels=x] [autowb=x]\n");
+    printf("                  [autosmooth=x] [lens=x ...] [homography=x ...]\n");
+    printf("                  [remap=x] [remapthreads=x] [stabilize=x]\n");
+    printf("                  [stabsmooth=x] [lut=x] [lutthreads=x]\n");
+    printf("                  [preview=x] [previewrendition=x] [share=x]\n");
+    printf("                  [shareslots=x] [control=x] [drain=x]\n");
+    printf("                  [log=x] [loglevel=x] [output=x ...]\n");
     printf("\n");
     printf("Options:\n");
-    printf("  device=x  Specify the index of the camera capture device.\n");
+    printf("  device=x  Specify the index of the camera capture device, or\n");
+    printf("            a comma-separated list (e.g. 1,3) to capture from\n");
+    printf("            several devices at once.\n");
     printf("  format=x  Specify which of the device's frame formats to\n");
-    printf("            capture with.\n");
+    printf("            capture with, or a list with one format for each\n");
+    printf("            device.\n");
     printf("  frames=x  Specify the number of frames to capture.\n");
     printf("  delay=x   Specify the number of seconds to delay between\n");
-    printf("            frames.\n");
+    printf("            frames, or a list with one delay for each device.\n");
+    printf("  rotate=x  Specify how many degrees (0, 90, 180, or 270) to\n");
+    printf("            rotate frames clockwise, or a list with one\n");
+    printf("            rotation for each device.\n");
+    printf("  flip=x    Specify none, h, v, or hv to mirror frames\n");
+    printf("            (after rotating) left to right and/or top to\n");
+    printf("            bottom, or a list with one entry for each device.\n");
+    printf("  stack=x   Specify the number of consecutive frames to stack\n");
+    printf("            into each saved frame, to reduce noise.\n");
+    printf("  stackmode=x  Specify how stacked frames are combined:  mean,\n");
+    printf("            median, or sigma (sigma-clipped mean).\n");
+    printf("  lighten=x Specify a .BMP file to receive a lighten-blend\n");
+    printf("            (star trail) composite of all frames.\n");
+    printf("  average=x Specify a .BMP file to receive an average-blend\n");
+    printf("            (long exposure) composite of all frames.\n");
+    printf("  snapshot=x  Specify the number of frames between updates\n");
+    printf("            of the composite files.\n");
+    printf("  warmup=x  Specify the most frames to discard while the\n");
+    printf("            device's exposure settles (default 30).\n");
+    printf("  retries=x Specify how many times to retry a dropped or\n");
+    printf("            black frame (default 3).\n");
+    printf("  powersave=x  Specify 1 to stop the camera's stream during\n");
+    printf("            long waits between frames.\n");
+    printf("  lead=x    Specify how many seconds before each frame a\n");
+    printf("            stopped stream is restarted (default 5).\n");
+    printf("  grabthreads=x  Specify the number of threads that grab\n");
+    printf("            frames (default 0, one per device up to a limit).\n");
+    printf("  convthreads=x  Specify the number of color conversion\n");
+    printf("            threads (default 0, one per CPU).\n");
+    printf("  writethreads=x  Specify the number of file writing\n");
+    printf("            threads (default 2).\n");
+    printf("  scalethreads=x  Specify the number of threads that share\n");
+    printf("            the scaling of each rendition (default 1).\n");
+    printf("  flush=x   Specify 1 to wait for each frame to reach the\n");
+    printf("            disk, so write latency includes the flush.\n");
+    printf("  sync=x    Specify 1 to stream all devices continuously and\n");
+    printf("            save sets of frames captured at the same moment.\n");
+    printf("  syncring=x  Specify how many recent frames each device\n");
+    printf("            keeps for matching in sync mode (default 8).\n");
+    printf("  synclag=x Specify how many milliseconds after each set's\n");
+    printf("            time to wait for late frames (default 150).\n");
+    printf("  flatfield=x  Correct vignetting with a .BMP image of an\n");
+    printf("            evenly lit white target, e.g. an average= composite\n");
+    printf("            captured with the same rotate=, flip=, and mask= but\n");
+    printf("            without flatfield=, lens=, homography=, stabilize=,\n");
+    printf("            lut=, autolevels=, or autowb=.\n");
+    printf("  flatgrid=x  Keep flat-field gains only every x pixels and\n");
+    printf("            interpolate between them (default 0, every pixel).\n");
+    printf("  denoise=x Smooth static areas over roughly x frames (2 to\n");
+    printf("            32) with a motion-adaptive temporal filter.\n");
+    printf("  denoisethreshold=x  Specify the largest change, in levels,\n");
+    printf("            that the temporal filter treats as noise (default 6).\n");
+    printf("  denoisedomain=x  Specify native (default) to filter the\n");
+    printf("            device's frames before conversion, or bgra.\n");
+    printf("  autolevels=x  Specify 1 to stretch each frame's levels to\n");
+    printf("            the full range.\n");
+    printf("  autowb=x  Specify 1 to white balance each frame so its\n");
+    printf("            average color is gray.\n");
+    printf("  autosmooth=x  Specify how slowly (0 to 0.99) the levels and\n");
+    printf("            white balance follow the scene (default 0.8).\n");
+    printf("  lens=x    Correct lens distortion, given the calibration\n");
+    printf("            fx,fy,cx,cy,k1[,k2[,p1,p2[,k3]]] in pixels of the\n");
+    printf("            rotated frame.  Start with N: to apply it only to\n");
+    printf("            device N.\n");
+    printf("  homography=x  Correct perspective with a 3x3 matrix (nine\n");
+    printf("            numbers, row major) from corrected frame pixels to\n");
+    printf("            output pixels.  Start with N: as for lens=.\n");
+    printf("  remap=x   Specify nearest or bilinear (default) sampling\n");
+    printf("            for lens and perspective correction.\n");
+    printf("  remapthreads=x  Specify the number of threads that share\n");
+    printf("            the correction of each frame (default 1).\n");
+    printf("  stabilize=x  Remove camera shake, cropping x percent (1 to\n");
+    printf("            20) from each side to hide the shifted edges.\n");
+    printf("  stabsmooth=x  Specify how slowly (0 to 0.99) the steadied\n");
+    printf("            view follows deliberate camera motion (default 0.9).\n");
+    printf("  lut=x     Specify a .cube file (3D or 1D lookup table) to\n");
+    printf("            color grade every frame with.\n");
+    printf("  lutthreads=x  Specify the number of threads that share\n");
+    printf("            the grading of each frame (default 1).\n");
+    printf("  mask=x    Add a privacy region that is never saved, in\n");
+    printf("            rotated frame pixels:  a rectangle WxH+X+Y, or a\n");
+    printf("            polygon X,Y;X,Y;X,Y...  Prefix N: to apply it to\n");
+    printf("            device N only.  May be repeated.\n");
+    printf("  maskfill=x  Specify the privacy regions' color as RRGGBB\n");
+    printf("            hex (default 000000), or pixelate[:N] to show\n");
+    printf("            them as blocks of N pixels (default 16).\n");
+    printf("  stamp=x   Specify 1 to burn the date and time each frame\n");
+    printf("            was grabbed, and its number, into the frame.\n");
+    printf("  stamplabel=x  Specify text to show before the time (and\n");
+    printf("            turn on stamp=1).\n");
+    printf("  stampsize=x  Specify the height of the stamp's text in\n");
+    printf("            pixels (default 1/30 of the frame height).\n");
+    printf("  preview=x Serve a live MJPEG preview on localhost port x,\n");
+    printf("            at http://localhost:x/ (or /N for camera N).\n");
+    printf("  previewrendition=x  Specify the name of the output to\n");
+    printf("            preview (default the first one).  A small JPEG\n");
+    printf("            output is best, e.g. output=live,width=640,format=jpg\n");
+    printf("  share=x   Publish every frame to a shared-memory ring named x\n");
+    printf("            (x_camN with several cameras), for other programs\n");
+    printf("            to read; see FrameShareTest.\n");
+    printf("  shareslots=x  Specify how many frames the ring holds\n");
+    printf("            (2 to 64, default 4).\n");
+    printf("  control=x Accept commands on a local socket at path x while\n");
+    printf("            capturing:  capture, interval, pause, resume, rotate,\n");
+    printf("            stats, and help, one per line.\n");
+    printf("  drain=x   Specify the most seconds to spend finishing the\n");
+    printf("            frames already grabbed when stopped early with ESC\n");
+    printf("            or Ctrl+C (default 30, 0 = no limit).  A second\n");
+    printf("            Ctrl+C quits at once.\n");
+    printf("  log=x     Also log every message to file x, one JSON object\n");
+    printf("            per line, whatever the log level.\n");
+    printf("  loglevel=x  Specify the least severe messages to show:\n");
+    printf("            debug, info (default), warning, or error.\n");
+    printf("  output=x  Add an output version of each frame, given as a\n");
+    printf("            comma-separated list:  an optional name, then any\n");
+    printf("            of width=, height=, crop=WxH+X+Y, format=bmp|jpg|png,\n");
+    printf("            quality=, filter=bilinear|bicubic|lanczos (default\n");
+    printf("            lanczos), and dir=.  May be repeated, e.g.\n");
+    printf("            output=preview,width=1280,format=jpg\n");
+    printf("            output=thumb,width=320,format=jpg,dir=thumbs\n");
+    printf("            Default is one full-size .BMP in the current folder.\n");
 }
 
 //---------------------------------------------------------------
@@ -340,37 +961,136 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
-    Settings settings;
+    CaptureSettings settings;
     if (!ParseArguments(argc, argv, settings))
         return EXIT_FAILURE;
 
-    if (settings.m_deviceIndex < 1)
+    if (settings.m_deviceIndices.empty())
     {
         printf("No camera device index specified!\n");
         ShowCaptureDevices();
         return EXIT_FAILURE;
     }
 
-    if (settings.m_formatIndex < 1)
+    if (settings.m_formatIndices.empty())
     {
         printf("No capture format index specified!\n");
-        ShowCaptureFormatsForDevice(settings.m_deviceIndex);
+        ShowCaptureFormatsForDevice(settings.m_deviceIndices[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (settings.m_formatIndices.size() > 1 &&
+        settings.m_formatIndices.size() != settings.m_deviceIndices.size())
+    {
+        printf("The format list must have one entry for each device!\n");
+        return EXIT_FAILURE;
+    }
+
+    if (settings.m_secondsBetweenFrames.size() > 1 &&
+        settings.m_secondsBetweenFrames.size() != settings.m_deviceIndices.size())
+    {
+        printf("The delay list must have one entry for each device!\n");
+        return EXIT_FAILURE;
+    }
+
+    if (settings.m_orientations.size() > 1 &&
+        settings.m_orientations.size() != settings.m_deviceIndices.size())
+    {
+        printf("The rotate and flip lists must have one entry for each device!\n");
         return EXIT_FAILURE;
     }
 
     printf("Settings:\n");
-    printf("  Camera capture device:    %u\n", settings.m_deviceIndex);
-    printf("  Capture format:           %u\n", settings.m_formatIndex);
+    for (size_t i = 0; i < settings.m_deviceIndices.size(); i++)
+    {
+        printf("  Camera capture device:    %u (format %u, every %u seconds)\n",
+            settings.m_deviceIndices[i], settings.GetFormatIndex(i), settings.GetSecondsBetweenFrames(i));
+    }
     printf("  Number of frames to grab: %u\n", settings.m_numFramesToGrab);
-    printf("  Seconds between frames:   %u\n", settings.m_secondsBetweenFrames);
+    printf("  Frames per stack:         %u\n", settings.m_stackCount);
+    printf("  Power save:               %s\n", settings.m_powerSave ? "on" : "off");
+
+    if (settings.m_stackMode == SM_MEDIAN && settings.m_stackCount > FrameStacker::MaxMedianFrames)
+    {
+        printf("Median stacking is limited to %u frames!\n", FrameStacker::MaxMedianFrames);
+        return EXIT_FAILURE;
+    }
+
+    if (settings.m_syncMode)
+    {
+        if (settings.m_secondsBetweenFrames.size() > 1)
+        {
+            printf("All devices share one delay in sync mode!\n");
+            return EXIT_FAILURE;
+        }
+        if (settings.m_stackCount > 1 || settings.m_powerSave)
+        {
+            printf("Stacking and power save can't be used in sync mode!\n");
+            return EXIT_FAILURE;
+        }
+    }
 
-    // Command-line uses 1-based device index, but internally
-    // we use a 0-based index.
-    --settings.m_deviceIndex;
+    // Command-line uses 1-based device indices, but internally
+    // we use 0-based indices.
+    for (auto &deviceIndex : settings.m_deviceIndices)
+        --deviceIndex;
 
-    bool ok = DoTimeLapseCapture(settings);
+    s_interruptEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    s_exitEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+
+    // Capture in the background.  Sleep until the session stops,
+    // ESC is pressed, or a console control event arrives, so even
+    // a long delay between frames is interrupted at once.  Console
+    // input is only watched if it really is a console.
+    CaptureSession session(settings);
+    if (!session.Start())
+    {
+        SetEvent(s_exitEvent);
+        return EXIT_FAILURE;
+    }
+
+    HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+    DWORD inputMode = 0;
+    const bool haveConsole = input != nullptr && input != INVALID_HANDLE_VALUE && GetConsoleMode(input, &inputMode);
+    HANDLE handles[3] = {session.GetStoppedEvent(), s_interruptEvent, input};
+    bool aborted = false;
+    auto abortTime = std::chrono::steady_clock::now();
+    while (!aborted)
+    {
+        DWORD which = WaitForMultipleObjects(haveConsole ? 3 : 2, handles, FALSE, INFINITE);
+        if (which == WAIT_OBJECT_0 || which == WAIT_FAILED)
+            break;
+
+        if (which == WAIT_OBJECT_0 + 1)
+        {
+            const LONG ctrlType = s_ctrlType;
+            printf("%s.  Stopping; finishing the frames already grabbed.\n",
+                ctrlType == CTRL_C_EVENT ? "Ctrl+C pressed" :
+                ctrlType == CTRL_BREAK_EVENT ? "Ctrl+Break pressed" : "Console closing");
+            aborted = true;
+        }
+        else if (ReadEscapeKey(input))
+        {
+            printf("ESC pressed.  Aborted by user.\n");
+            aborted = true;
+        }
+    }
+    if (aborted)
+    {
+        abortTime = std::chrono::steady_clock::now();
+        session.Abort();
+    }
+
+    bool ok = session.Finish();
+    printf("Capture session done.\n");
+    if (aborted)
+    {
+        printf("Stopped %.0f ms after being interrupted.\n",
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - abortTime).count());
+    }
 
     printf("TimeLapse done.\n");
+    SetEvent(s_exitEvent);
     return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
-
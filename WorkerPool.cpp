@@ -0,0 +1,217 @@
+//--------------------------------------------------------------------
+// WorkerPool.cpp
+// A C++ module for running tasks from several producers on a shared
+// set of worker threads.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+//---------------------------------------------------------------
+WorkerPool::WorkerPool(unsigned numThreads)
+{
+    if (numThreads < 1)
+        numThreads = 1;
+
+    for (unsigned i = 0; i < numThreads; ++i)
+        m_threads.emplace_back(&WorkerPool::WorkerThread, this);
+}
+
+//---------------------------------------------------------------
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (auto &thread : m_threads)
+        thread.join();
+}
+
+//---------------------------------------------------------------
+// Queues a task to be run on one of the pool's threads.
+//---------------------------------------------------------------
+void WorkerPool::Submit(unsigned key, std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_queues[key].m_tasks.push_back(std::move(task));
+        ++m_pending;
+    }
+    m_wake.notify_one();
+}
+
+//---------------------------------------------------------------
+// Waits until every queued task has finished.
+//---------------------------------------------------------------
+void WorkerPool::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_idle.wait(lock, [this]() { return m_pending == 0; });
+}
+
+//---------------------------------------------------------------
+// Waits until every queued task has finished, or 'timeout' has
+// passed.  Returns false if tasks are still queued or running.
+//---------------------------------------------------------------
+bool WorkerPool::WaitIdle(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    return m_idle.wait_for(lock, timeout, [this]() { return m_pending == 0; });
+}
+
+//---------------------------------------------------------------
+// Returns the number of tasks queued or running for 'key'.
+//---------------------------------------------------------------
+size_t WorkerPool::GetPendingCount(unsigned key)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = m_queues.find(key);
+    if (it == m_queues.end())
+        return 0;
+    return it->second.m_tasks.size() + (it->second.m_busy ? 1 : 0);
+}
+
+//---------------------------------------------------------------
+// Runs the parts of one job on the calling thread and the pool's
+// threads.  Parts are claimed in order by whichever thread is
+// free, so the caller never sits idle while parts are left.
+//---------------------------------------------------------------
+void WorkerPool::RunParallel(unsigned count, const std::function<void(unsigned part)> &task)
+{
+    std::atomic<unsigned> nextPart{0};
+    auto runParts = [&]()
+    {
+        for (unsigned part = nextPart++; part < count; part = nextPart++)
+            task(part);
+    };
+
+    // Helpers that start after every part is claimed just return,
+    // but they still have to finish before the locals go away.
+    const unsigned numHelpers = count > 1 ? std::min(count - 1, static_cast<unsigned>(m_threads.size())) : 0;
+    std::mutex doneLock;
+    std::condition_variable done;
+    unsigned helpersLeft = numHelpers;
+    for (unsigned i = 1; i <= numHelpers; i++)
+    {
+        Submit(i, [&]()
+        {
+            runParts();
+            std::lock_guard<std::mutex> lock(doneLock);
+            --helpersLeft;
+            done.notify_all();
+        });
+    }
+
+    runParts();
+    std::unique_lock<std::mutex> lock(doneLock);
+    done.wait(lock, [&]() { return helpersLeft == 0; });
+}
+
+//---------------------------------------------------------------
+// Finds the next runnable task, starting with the key after the
+// one served last so that keys take turns.  The caller must hold
+// m_lock.  Returns false if nothing is runnable.
+//---------------------------------------------------------------
+bool WorkerPool::TakeNextTask(unsigned &key, std::function<void()> &task)
+{
+    if (m_queues.empty())
+        return false;
+
+    auto start = m_queues.upper_bound(m_lastKey);
+    if (start == m_queues.end())
+        start = m_queues.begin();
+
+    auto it = start;
+    do
+    {
+        Queue &queue = it->second;
+        if (!queue.m_busy && !queue.m_tasks.empty())
+        {
+            key = it->first;
+            task = std::move(queue.m_tasks.front());
+            queue.m_tasks.pop_front();
+            queue.m_busy = true;
+            m_lastKey = key;
+            return true;
+        }
+
+        if (++it == m_queues.end())
+            it = m_queues.begin();
+    }
+    while (it != start);
+
+    return false;
+}
+
+//---------------------------------------------------------------
+// Runs tasks until the pool is destroyed and nothing is left to
+// run.
+//---------------------------------------------------------------
+void WorkerPool::WorkerThread()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (1)
+    {
+        unsigned key = 0;
+        std::function<void()> task;
+        if (!TakeNextTask(key, task))
+        {
+            if (m_stopping && m_pending == 0)
+                break;
+            m_wake.wait(lock);
+            continue;
+        }
+
+        lock.unlock();
+        task();
+        task = nullptr;
+        lock.lock();
+
+        // Another task with this key may be runnable now.
+        m_queues[key].m_busy = false;
+        --m_pending;
+        m_wake.notify_one();
+        m_idle.notify_all();
+    }
+
+    // Let the other threads see that we're done.
+    m_wake.notify_all();
+}
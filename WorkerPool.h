@@ -0,0 +1,120 @@
+//--------------------------------------------------------------------
+// WorkerPool.h
+// A C++ module for running tasks from several producers on a shared
+// set of worker threads.
+//
+// (C) Copyright 2022 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+// NOTES:
+//
+// * General Usage:  Declare a WorkerPool with the desired number of
+//   threads, then call Submit() with a key that identifies the
+//   producer (e.g. a camera) and the task to run.
+//
+// * Tasks with the same key run one at a time, in the order they
+//   were submitted, so a producer's tasks never race each other.
+//   Tasks with different keys run in parallel.
+//
+// * Keys are served round-robin, so a producer with a long backlog
+//   can't starve the others.
+//
+// * RunParallel() splits one job into parts that the calling thread
+//   and the pool's threads work through together, so code that
+//   parallelizes a single frame needn't start threads of its own.
+//   The caller must not be one of the same pool's threads.
+//--------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//---------------------------------------------------------------
+// A C++ class that runs keyed tasks on a pool of threads.
+//---------------------------------------------------------------
+class WorkerPool
+{
+public:
+    explicit WorkerPool(unsigned numThreads);
+
+    // Runs any tasks still queued, then stops the threads.
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // Queues a task to be run on one of the pool's threads.
+    void Submit(unsigned key, std::function<void()> task);
+
+    // Waits until every queued task has finished.
+    void WaitIdle();
+
+    // As above, but gives up after 'timeout'.  Returns false if
+    // tasks are still queued or running.
+    bool WaitIdle(std::chrono::milliseconds timeout);
+
+    // Returns the number of tasks queued or running for 'key'.
+    size_t GetPendingCount(unsigned key);
+
+    // Runs task(0) through task(count - 1) on the calling thread and
+    // up to 'count - 1' of the pool's threads, and waits for all of
+    // them to finish.
+    void RunParallel(unsigned count, const std::function<void(unsigned part)> &task);
+
+private:
+    // The tasks of one producer.
+    struct Queue
+    {
+        std::deque<std::function<void()>> m_tasks; // Tasks waiting to run.
+        bool m_busy = false;                        // True while one of the tasks is running.
+    };
+
+    void WorkerThread();
+    bool TakeNextTask(unsigned &key, std::function<void()> &task);
+
+    std::mutex m_lock;                      // Protects all of the members below.
+    std::condition_variable m_wake;         // Signaled when a task may be runnable.
+    std::condition_variable m_idle;         // Signaled when a task finishes.
+    std::map<unsigned, Queue> m_queues;     // Task queues, by key.
+    unsigned m_lastKey = 0;                 // Key of the most recently started task.
+    size_t m_pending = 0;                   // Number of tasks queued or running.
+    bool m_stopping = false;                // True once the destructor has been called.
+    std::vector<std::thread> m_threads;     // The worker threads.
+};